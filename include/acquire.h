@@ -0,0 +1,118 @@
+/*
+ * acquire.h
+ *
+ *  Created on: Dec 20, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef ACQUIRE_H_
+#define ACQUIRE_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "dma_driver.h"
+#include "cycle_counter.h"
+#include "placement.h"
+#include "blockpool.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Conversions charged to the gap count per DMA error - the faulted transfer, the re-arm is far shorter than one conversion
+#define ACQUIRE_GAP_PER_ERROR	1
+
+// Acquire Errors
+typedef enum
+{
+	ACQUIRE_ERROR_SUCCESS,
+	ACQUIRE_ERROR_NULL_PTR,
+	ACQUIRE_ERROR_BLOCK_SIZE
+} acquire_error;
+
+// Acquire Configuration (the channel must already be set up by dma_init on buffer)
+typedef struct
+{
+	DMA_Type* dma;
+	dma_channel channel;
+	volatile int16_t* buffer;		// 2 * block_size samples, ping pong halves
+	uint8_t block_size;				// Largest block, the halves are this far apart
+	uint32_t sample_rate;			// ADC rate the expected block period comes from, 0 skips the jitter numbers
+	blockpool* pool;				// Fill pool blocks instead of the halves and publish them, NULL for ping pong
+} acquire_config;
+
+#define ACQUIRE_CONFIG_DEFAULT		\
+{									\
+	.dma = NULL,					\
+	.channel = DMA_CHANNEL_0,		\
+	.buffer = NULL,					\
+	.block_size = 0,				\
+	.sample_rate = 0,				\
+	.pool = NULL					\
+}
+
+// Acquire Handle (ISR writes, main loop reads)
+typedef struct
+{
+	acquire_config config;
+	volatile bool active;							// Half the DMA is filling
+	volatile uint8_t block_size;					// Samples the next re-arm asks for (acquire_set_block_size)
+	volatile uint8_t armed[2];						// Samples each half was last armed with
+	volatile uint8_t samples[2];					// Good samples at the start of each half once it completes
+	volatile uint8_t slot[2];						// Pool block each half was armed on (pool mode)
+	volatile uint32_t blocks;						// Halves completed, clean or not
+	volatile uint32_t gap_samples;					// Conversions lost to DMA errors
+	volatile uint32_t errors[DMA_STATUS_COUNT];		// Per dma_status, DONE and BUSY included
+
+	// Timebase - sample indices count every conversion (gaps included), wall time is the extended cycle_counter
+	volatile uint64_t next_sample;					// Index the DMA's next sample gets
+	volatile uint64_t first_sample[2];				// Index of each half's first sample
+	volatile uint64_t wall_time;					// cycle_counter counts at wall_hz since acquire_init
+	volatile uint64_t block_time[2];				// wall_time when each half completed
+	uint32_t last_stamp;
+	uint32_t block_period;							// Expected cycle_counter counts per block (at block_size)
+	uint32_t sample_period;							// Expected cycle_counter counts per sample, Q8
+	uint32_t wall_hz;								// Core clock at acquire_init, wall_time stays in these units
+	uint8_t wall_scale;								// wall_hz / the core clock now (clock governor)
+
+	// Arrival jitter of clean blocks against their armed size
+	volatile int32_t jitter_last;
+	volatile int32_t jitter_min;
+	volatile int32_t jitter_max;
+
+	// acquire_irq run time, entry to return (compare ENABLE_RAM_HOT_PATH off/on)
+	volatile uint32_t irq_cycles;
+	volatile uint32_t irq_cycles_max;
+} acquire_handle;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Set up the double buffer bookkeeping, the DMA starts on half 0
+acquire_error acquire_init(acquire_handle* acquire, acquire_config* config);
+
+// DMA ISR body - classify, clear, re-arm on the other half, then account for the finished half
+void acquire_irq(acquire_handle* acquire);
+
+// Start of a half of the double buffer (the pool block it was armed on in pool mode)
+volatile int16_t* acquire_half(acquire_handle* acquire, bool half);
+
+// Samples of a half that are in memory - the half being filled from the DMA byte count, a completed half whole
+uint8_t acquire_landed(acquire_handle* acquire, bool half);
+
+// New ADC rate or core clock - works out the expected block period again and restarts the jitter min/max
+void acquire_set_rate(acquire_handle* acquire, uint32_t sample_rate);
+
+// Block length from the next re-arm on (the half filling now keeps its size), 1 to config.block_size samples
+acquire_error acquire_set_block_size(acquire_handle* acquire, uint8_t block_size);
+
+// A 64 bit timebase field (next_sample, wall_time ..) read whole from outside the ISR
+uint64_t acquire_read64(const volatile uint64_t* field);
+
+// Stop the DMA for a stretch nothing can service it (flash erase), then start the filling half over and charge
+// every conversion since it was armed to the gap count. Interrupts off from suspend to resume, shorter than a
+// cycle_counter wrap, and the rate must be known (acquire_set_rate)
+void acquire_suspend(acquire_handle* acquire);
+void acquire_resume(acquire_handle* acquire);
+
+#endif /* ACQUIRE_H_ */
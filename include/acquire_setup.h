@@ -0,0 +1,37 @@
+/*
+ * acquire_setup.h
+ *
+ *  Created on: Dec 22, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef ACQUIRE_SETUP_H_
+#define ACQUIRE_SETUP_H_
+
+/* INCLUDES */
+#include "adc_driver.h"
+#include "dma_driver.h"
+#include "pipeline.h"
+
+/* DEFINES & TYPEDEFS */
+
+// ADC and DMA setups in adc_init_config / dma_init_config field order, for {ADC_FIG_SETUP}, ADC_IMAGE(ADC_FIG_SETUP)
+// and ADC_IMAGE_ASSERT(ADC_FIG_SETUP) alike (and the DMA ones). Kept out of main.c so tools/image_check compiles the
+// same lists - they expand against the includer's buffer[] and ENABLE_OVERSAMPLE
+#define ADC_FIG_SETUP		ADC0, ADC_NO_INT, ADC_CHAN_DAD0, ADC_POWER_NORMAL_MODE, ADC_CLOCK_SEL_ADACK, ADC_CLOCK_DIV_1,	\
+							ADC_SMP_CYCLE_ADD_HS_22, ADC_BITS_16BIT_DIFF,													\
+							(ENABLE_OVERSAMPLE ? ADC_SAMP_AVG_1 : ADC_SAMP_AVG_4), ADC_MUX_A, ADC_ASYNC_CLOCK_ONLY_ADC,	\
+							ADC_COMPARE_DISABLED, 0, 0, ADC_TRIGGER_SOFTWARE, ADC_DMA_ENABLED, ADC_REFERENCE_VOLT_DEFAULT,	\
+							ADC_CONTINUOUS_CONTINUOUS, PORTE, 20, 21
+#define DMA_FIG_SETUP		DMA0, DMA_CHANNEL_0, &(ADC0->R[ADC_MUX_A]), &buffer[0], BUFF_HALF_BYTES,							\
+							true,				/* interrupt */																\
+							true,				/* peripheral_en */															\
+							true,				/* steal_cycles */															\
+							false, false,		/* auto_align, async_en */													\
+							false, DMA_SIZE_16, DMA_MOD_NONE,	/* src inc, size, mod */									\
+							true, DMA_SIZE_16, DMA_MOD_NONE,	/* dest inc, size, mod */									\
+							true,				/* auto_disable_req */														\
+							DMA_LINK_NONE, DMA_LINK_DMA_CHAN_0, DMA_LINK_DMA_CHAN_0,										\
+							false				/* start */
+
+#endif /* ACQUIRE_SETUP_H_ */
@@ -277,12 +277,104 @@ typedef struct
 		.pin_2 = 0									\
 }
 
+// Diff channels go with diff modes (a disabled channel goes with anything)
+#define ADC_CHAN_IS_DIFF(channel)			(	((channel) == ADC_CHAN_DAD0)			||	\
+												((channel) == ADC_CHAN_DAD1)			||	\
+												((channel) == ADC_CHAN_DAD2)			||	\
+												((channel) == ADC_CHAN_DAD3)			||	\
+												((channel) == ADC_CHAN_TEMP_DIFF)		||	\
+												((channel) == ADC_CHAN_BANDGAP_DIFF)	||	\
+												((channel) == ADC_CHAN_VREFSH_DIFF)		)
+#define ADC_MODE_COMPATIBLE(channel, bits)	(((channel) == ADC_CHAN_DISABLED) || (((bits) >= 0x4U) == ADC_CHAN_IS_DIFF(channel)))
+
+// Enum values with holes that a cast can land in
+#define ADC_SAMP_CYCLE_ADDER_VALID(add)		(((add) == ADC_SMP_CYCLE_ADD_0) || (((add) >= ADC_SMP_CYCLE_ADD_20) && ((add) <= ADC_SMP_CYCLE_ADD_HS_2)) ||	\
+											(((add) >= ADC_SMP_CYCLE_ADD_HS_22) && ((add) <= ADC_SMP_CYCLE_ADD_HS_4)))
+#define ADC_SAMP_AVERAGE_VALID(avg)			(((avg) == ADC_SAMP_AVG_1) || (((avg) >= ADC_SAMP_AVG_4) && ((avg) <= ADC_SAMP_AVG_32)))
+#define ADC_COMPARE_VALID(mode)				(((mode) == ADC_COMPARE_DISABLED) ||	\
+											(((mode) >= ADC_COMPARE_LESS) && ((mode) <= ADC_COMPARE_RANGE_INCLUSIVE_OUTSIDE)))
+
+// Compare values - the range modes want the limits in a set order (RM 28.4.6)
+#define ADC_COMPARE_CV1(mode, compare_1, compare_2)		(	(((mode) == ADC_COMPARE_RANGE_INCLUSIVE_INSIDE) ||					\
+															((mode) == ADC_COMPARE_RANGE_EXCLUSIVE_OUTSIDE)) ?					\
+															ADC_CV1_CV(MIN(compare_1, compare_2)) :								\
+															((mode) == ADC_COMPARE_DISABLED) ? 0 : ADC_CV1_CV(MAX(compare_1, compare_2))	)
+#define ADC_COMPARE_CV2(mode, compare_1, compare_2)		(	(((mode) == ADC_COMPARE_RANGE_EXCLUSIVE_INSIDE) ||					\
+															((mode) == ADC_COMPARE_RANGE_INCLUSIVE_OUTSIDE)) ?					\
+															ADC_CV2_CV(MIN(compare_1, compare_2)) :								\
+															(((mode) == ADC_COMPARE_RANGE_INCLUSIVE_INSIDE) ||					\
+															((mode) == ADC_COMPARE_RANGE_EXCLUSIVE_OUTSIDE)) ?					\
+															ADC_CV2_CV(MAX(compare_1, compare_2)) : 0	)
+
+// Register images for one setup, adc_init_image writes them in a single pass and calibrates
+typedef struct
+{
+	ADC_Type* adc;
+	PORT_Type* port;
+	uint32_t pin_1;
+	uint32_t pin_2;
+	uint32_t cfg1;
+	uint32_t cfg2;
+	uint32_t sc2;
+	uint32_t sc3;
+	uint32_t cv1;
+	uint32_t cv2;
+	uint32_t sc2_trigger;		// ADTRG, set after calibration (calibration needs a software trigger)
+	uint32_t sc1;				// Channel and AIEN, written last since it starts the conversions
+	bool irq;
+} adc_image;
+
+// Build an image from the adc_init_config fields in struct order, e.g. from a list macro:
+//   #define MY_ADC		ADC0, ADC_NO_INT, ADC_CHAN_DAD0, ...
+//   ADC_IMAGE_ASSERT(MY_ADC);
+//   static const adc_image my_image = ADC_IMAGE(MY_ADC);
+// With constant fields the image is folded into flash, adc_init builds one the same way from a config at run time
+#define ADC_IMAGE(...)		ADC_IMAGE_FIELDS(__VA_ARGS__)
+#define ADC_IMAGE_FIELDS(adc, interrupt, channel, low_power, clock, clock_div, sample_cycle_add, bits, avg_samps, mux,		\
+						async_state, compare_mode, compare_1, compare_2, trigger, dma_mode, ref_volt, continuous, port,		\
+						pin_1, pin_2)																						\
+{																															\
+	(adc), (port), (pin_1), (pin_2),																						\
+	ADC_CFG1_ADLPC(low_power)										|														\
+	ADC_CFG1_ADIV(clock_div)										|														\
+	ADC_CFG1_ADLSMP(ADC_SAMP_CYCLE_ADDER_ADLSMP(sample_cycle_add))	|														\
+	ADC_CFG1_MODE(ADC_BITS(bits))									|														\
+	ADC_CFG1_ADICLK(clock),																									\
+	ADC_CFG2_MUXSEL(mux)											|														\
+	ADC_CFG2_ADACKEN(async_state)									|														\
+	ADC_CFG2_ADHSC(ADC_SAMP_CYCLE_ADDER_ADHSC(sample_cycle_add))	|														\
+	ADC_CFG2_ADLSTS(ADC_SAMP_CYCLE_ADDER_ADLSTS(sample_cycle_add)),															\
+	ADC_SC2_COMP(compare_mode) | ADC_SC2_DMAEN(dma_mode) | ADC_SC2_REFSEL(ref_volt),										\
+	ADC_SC3_ADCO(continuous) | ADC_SC3_AVG(avg_samps),																		\
+	ADC_COMPARE_CV1(compare_mode, compare_1, compare_2),																	\
+	ADC_COMPARE_CV2(compare_mode, compare_1, compare_2),																	\
+	((interrupt) == ADC_INT_ON_COMPLETE) ? ADC_SC2_ADTRG(trigger) : 0,														\
+	ADC_SC1_ADCH_DIFF(channel) | ADC_SC1_AIEN(interrupt),																	\
+	((interrupt) == ADC_INT_ON_COMPLETE)																					\
+}
+
+// Build time versions of the adc_init checks that do not need a pointer (the ADC and port are not integer constants)
+#define ADC_IMAGE_ASSERT(...)	ADC_IMAGE_ASSERT_FIELDS(__VA_ARGS__)
+#define ADC_IMAGE_ASSERT_FIELDS(adc, interrupt, channel, low_power, clock, clock_div, sample_cycle_add, bits, avg_samps, mux,	\
+						async_state, compare_mode, compare_1, compare_2, trigger, dma_mode, ref_volt, continuous, port,		\
+						pin_1, pin_2)																						\
+	_Static_assert(ADC_MODE_COMPATIBLE(channel, bits), "ADC: diff channels need a diff mode and single ended a single ended one");	\
+	_Static_assert(ADC_SAMP_CYCLE_ADDER_VALID(sample_cycle_add), "ADC: not an adc_samp_cycle_adder value");					\
+	_Static_assert(ADC_SAMP_AVERAGE_VALID(avg_samps), "ADC: not an adc_samp_average value");								\
+	_Static_assert(ADC_COMPARE_VALID(compare_mode), "ADC: not an adc_compare_mode value");									\
+	_Static_assert((clock_div) <= ADC_CLOCK_DIV_8, "ADC: not an adc_clock_div value");										\
+	_Static_assert((clock) != ADC_CLOCK_SEL_ALTCLK, "ADC: ALTCLK has no known rate, adc_sample_rate_calc would return 0");	\
+	_Static_assert(((pin_1) < 32) && ((pin_2) < 32), "ADC: port pin out of range")
+
 
 /* FUNCTION DECLARATIONS */
 
 // Initialize the ADC with set parameters
 adc_error adc_init(adc_init_config* config);
 
+// Initialize the ADC from prebuilt register images (checked by ADC_IMAGE_ASSERT, only calibration can fail)
+adc_error adc_init_image(const adc_image* image);
+
 // Start an ADC Conversion - Only needed in single shot mode, init automatically starts continuous mode
 void adc_start_conversion(ADC_Type* adc, adc_mux_select mux, adc_channel channel);
 
@@ -292,4 +384,7 @@ uint16_t adc_blocking_result(ADC_Type* adc, adc_mux_select mux, adc_bits bits);
 // Calculate the actual sample rate from given configuration
 uint32_t adc_sample_rate_calc(adc_init_config* config);
 
+// Change hardware averaging on a running ADC (continuous conversion and DMA keep going)
+void adc_set_averaging(ADC_Type* adc, adc_samp_average avg_samps);
+
 #endif /* INCLUDE_ADC_DRIVER_H_ */
@@ -0,0 +1,70 @@
+/*
+ * bench.h
+ *
+ *  Created on: Dec 17, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Bench Errors
+typedef enum
+{
+	BENCH_ERROR_SUCCESS,
+	BENCH_ERROR_NULL_PTR,
+	BENCH_ERROR_BAD_CONFIG
+} bench_error;
+
+// Sample Containers (16 bit diff as DMA'd today, 16 bit single ended, 32 bit container)
+typedef enum
+{
+	BENCH_SAMPLE_INT16,
+	BENCH_SAMPLE_UINT16,
+	BENCH_SAMPLE_INT32,
+	BENCH_SAMPLE_TYPES
+} bench_sample_type;
+
+// Processing Stages (bit mask)
+#define BENCH_STAGE_PEAK		0x1U
+#define BENCH_STAGE_DBFS		0x2U
+#define BENCH_STAGE_REPORT		0x4U
+
+// Sweep Tables
+#define BENCH_BLOCK_SIZES		{8, 16, 32, 64, 128, 255}
+#define BENCH_STAGE_SETS		{BENCH_STAGE_PEAK,											\
+								BENCH_STAGE_PEAK | BENCH_STAGE_DBFS,						\
+								BENCH_STAGE_PEAK | BENCH_STAGE_DBFS | BENCH_STAGE_REPORT}
+#define BENCH_MAX_BLOCK			255
+
+// Bench Configuration
+typedef struct
+{
+	uint32_t sample_rate;			// ADC rate the latency and ISR numbers are worked out for
+	uint32_t samples_per_point;		// Samples pushed through each sweep point
+	uint8_t decay_shift;
+	void (*write)(const char* text, size_t length);	// Where the rows go, NULL for stdout
+} bench_config;
+
+#define BENCH_CONFIG_DEFAULT		\
+{									\
+	.sample_rate = 27000,			\
+	.samples_per_point = 4080,		\
+	.decay_shift = 1,				\
+	.write = NULL					\
+}
+
+
+/* FUNCTION DECLARATIONS */
+
+// Sweep block size x sample type x stages, print CSV rows (point rows, a per sample/per block fit, printf vs format.c, tones)
+bench_error bench_run(bench_config* config);
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,108 @@
+/*
+ * blockpool.h
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef BLOCKPOOL_H_
+#define BLOCKPOOL_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Reference counted block pool - the DMA fills pool blocks in place and the ISR hands each completed block to
+// every subscribed consumer, which reads it where it landed and releases it when done. A block only goes back to
+// the DMA once every consumer has released it, so a slow consumer holds blocks instead of having them refilled
+// under it. With no block free the ISR refills the one that just completed and nobody sees it (an overrun),
+// counted against each consumer that was holding blocks at the time.
+// ISR publishes, main loop peeks and releases - each side only writes its own queue index and refcounts change
+// hands with the block (the ISR sets them on a block nobody holds, consumers only count down ones they hold).
+#define BLOCKPOOL_BLOCKS		4			// Power of 2, one is always being filled
+#define BLOCKPOOL_CONSUMERS		4
+
+// Block Pool Errors
+typedef enum
+{
+	BLOCKPOOL_ERROR_SUCCESS,
+	BLOCKPOOL_ERROR_NULL_PTR,
+	BLOCKPOOL_ERROR_BLOCK_SIZE,
+	BLOCKPOOL_ERROR_CONSUMERS
+} blockpool_error;
+
+// Block Pool Configuration
+typedef struct
+{
+	volatile int16_t* buffer;		// BLOCKPOOL_BLOCKS * block_size samples, block 0 is the one dma_init arms
+	uint8_t block_size;
+} blockpool_config;
+
+#define BLOCKPOOL_CONFIG_DEFAULT	\
+{									\
+	.buffer = NULL,					\
+	.block_size = 0					\
+}
+
+// One Completed Block (written by the ISR before it is published, read only after)
+typedef struct
+{
+	volatile int16_t* samples;		// In the pool buffer, fixed
+	uint8_t count;					// Good samples (short after a DMA error)
+	uint64_t first_sample;			// acquire sample index of samples[0]
+	uint64_t time;					// acquire wall_time when it completed
+	uint32_t sequence;				// acquire block count, gaps are blocks this consumer never got
+} blockpool_block;
+
+// Consumer (queue of published block indices, oldest at tail)
+typedef struct
+{
+	const char* name;
+	volatile uint8_t queue[BLOCKPOOL_BLOCKS];
+	volatile uint8_t head;			// ISR
+	volatile uint8_t tail;			// Consumer
+	volatile uint8_t max_lag;		// Most blocks held at once
+	volatile uint32_t dropped;		// Overruns while this consumer was holding blocks
+	uint32_t released;
+} blockpool_consumer;
+
+// Block Pool Handle
+typedef struct
+{
+	blockpool_config config;
+	blockpool_block blocks[BLOCKPOOL_BLOCKS];
+	volatile uint8_t refs[BLOCKPOOL_BLOCKS];		// Consumers yet to release each published block
+	blockpool_consumer consumers[BLOCKPOOL_CONSUMERS];
+	uint8_t consumer_count;
+	uint8_t last_taken;
+	volatile uint32_t published;
+	volatile uint32_t overruns;
+} blockpool;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Carve the buffer into blocks, no consumers
+blockpool_error blockpool_init(blockpool* pool, blockpool_config* config);
+
+// Add a consumer before the DMA starts, it gets every block published from then on
+blockpool_error blockpool_subscribe(blockpool* pool, const char* name, uint8_t* consumer);
+
+// ISR - a free block to arm after the one that just completed (exclude), or exclude itself on an overrun
+uint8_t blockpool_take(blockpool* pool, uint8_t exclude);
+
+// ISR - hand a completed block to every consumer
+void blockpool_publish(blockpool* pool, uint8_t index, uint8_t count, uint64_t first_sample, uint64_t time,
+						uint32_t sequence);
+
+// Consumer - oldest block not yet released (NULL when caught up), and release it
+blockpool_block* blockpool_peek(blockpool* pool, uint8_t consumer);
+void blockpool_release(blockpool* pool, uint8_t consumer);
+
+// Blocks a consumer is holding
+uint8_t blockpool_lag(blockpool* pool, uint8_t consumer);
+
+#endif /* BLOCKPOOL_H_ */
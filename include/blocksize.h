@@ -0,0 +1,82 @@
+/*
+ * blocksize.h
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef BLOCKSIZE_H_
+#define BLOCKSIZE_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "acquire.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Adaptive block length - runs at the smallest power of 2 block that fills inside the latency target, doubles
+// when the main loop falls behind (report stalls) and halves back once it has kept up for a while.
+// The new length goes in at the next DMA re-arm, the sample index stays continuous and the peak decay runs on
+// the sample index (PEAK_DECAY_SAMPLES), so the meter reads the same at any size. Tones resolve less on short
+// blocks, and HISTOGRAM_PER_SAMPLE 0 bins block maxes of whatever size was running.
+
+// Block Size Errors
+typedef enum
+{
+	BLOCKSIZE_ERROR_SUCCESS,
+	BLOCKSIZE_ERROR_NULL_PTR,
+	BLOCKSIZE_ERROR_SIZE
+} blocksize_error;
+
+// Block Size Configuration
+typedef struct
+{
+	acquire_handle* acquire;
+	uint32_t* processed_blocks;		// Main loop count, blocks behind acquire->blocks are missed
+	uint32_t latency_us;			// Longest block fill time wanted while the main loop keeps up
+	uint8_t min_size;				// Power of 2, the largest is the acquire half
+	uint8_t grow_percent;			// Double when this much of the next block is in by the time one is done, or on a miss
+	uint8_t shrink_percent;			// Halve toward the latency size when under this
+	uint16_t hold_blocks;			// Blocks to stay at a size before shrinking
+	bool automatic;					// false holds the size set from the shell
+} blocksize_config;
+
+#define BLOCKSIZE_CONFIG_DEFAULT	\
+{									\
+	.acquire = NULL,				\
+	.processed_blocks = NULL,		\
+	.latency_us = 1000,				\
+	.min_size = 8,					\
+	.grow_percent = 75,				\
+	.shrink_percent = 25,			\
+	.hold_blocks = 256,				\
+	.automatic = true				\
+}
+
+// Block Size Handle
+typedef struct
+{
+	blocksize_config config;
+	uint8_t latency_size;			// Largest block that fills inside latency_us at the current rate
+	uint8_t load;					// Percent of the next block in when the last one was done
+	uint32_t missed;				// Blocks behind at the last decision
+	uint16_t hold;
+	uint32_t grows;
+	uint32_t shrinks;
+} blocksize_handle;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Start at the latency size
+blocksize_error blocksize_init(blocksize_handle* sizer, blocksize_config* config);
+
+// Account for one processed block and pick the size of the next re-arm (call when the block is done)
+void blocksize_block(blocksize_handle* sizer);
+
+// Hold a size (the shell's manual override), automatic off
+blocksize_error blocksize_set(blocksize_handle* sizer, uint8_t size);
+
+#endif /* BLOCKSIZE_H_ */
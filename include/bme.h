@@ -0,0 +1,114 @@
+/*
+ * bme.h
+ *
+ *  Created on: Dec 22, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef BME_H_
+#define BME_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* DEFINES & TYPEDEFS */
+
+// The Bit Manipulation Engine decorates the peripheral bridge (0x40000000 - 0x4007FFFF, DMA, DMAMUX, ADC, UART, ...)
+// A store or load to a decorated alias becomes one read-modify-write on the bus the CPU cannot be interrupted in,
+// so set/clear/insert on a register shared with an ISR needs no critical section.
+// GPIO (0x400FF000) and the fast GPIO port are outside the window - use PSOR/PCOR/PTOR there.
+// Every op writes the whole register back, so w1c flags that read as 1 get cleared like they would with |=.
+#define BME_PERIPH_BASE			0x40000000UL
+#define BME_PERIPH_MASK			0x0007FFFFUL
+#define BME_IN_RANGE(addr)		((((uintptr_t)(addr)) & ~(uintptr_t)BME_PERIPH_MASK) == BME_PERIPH_BASE)
+
+// Decorated addresses (op in addr[28:26], bit number and width above the 19 bit register offset)
+// Pointers go through uintptr_t so the host builds (64 bit pointers) take the same macros without a narrowing cast
+#define BME_OFFSET(addr)				((uint32_t)(((uintptr_t)(addr)) & BME_PERIPH_MASK))
+#define BME_AND_ADDR(addr)				(0x44000000UL | BME_OFFSET(addr))
+#define BME_OR_ADDR(addr)				(0x48000000UL | BME_OFFSET(addr))
+#define BME_XOR_ADDR(addr)				(0x4C000000UL | BME_OFFSET(addr))
+#define BME_BFI_ADDR(addr, bit, width)	(0x50000000UL | (((uint32_t)(bit)) << 23) | (((uint32_t)(width) - 1) << 19) | BME_OFFSET(addr))
+#define BME_UBFX_ADDR(addr, bit, width)	BME_BFI_ADDR(addr, bit, width)		// Same decoration, loads are UBFX
+#define BME_LAC1_ADDR(addr, bit)		(0x48000000UL | (((uint32_t)(bit)) << 21) | BME_OFFSET(addr))
+#define BME_LAS1_ADDR(addr, bit)		(0x4C000000UL | (((uint32_t)(bit)) << 21) | BME_OFFSET(addr))
+
+// Field limits (BFI/UBFX width is 1-16, bit + width must stay inside the register)
+#define BME_MAX_WIDTH			16
+
+
+/* FUNCTION DEFINITIONS */
+
+// Host builds (dma_sim) run the drivers against registers in RAM, where the aliases do not exist
+#if defined(__arm__)
+#define BME_REG32(alias)		(*(volatile uint32_t*)(alias))
+#define BME_REG8(alias)			(*(volatile uint8_t*)(alias))
+
+// reg |= mask
+static inline void bme_or32(volatile uint32_t* reg, uint32_t mask)
+{
+	BME_REG32(BME_OR_ADDR(reg)) = mask;
+}
+
+static inline void bme_or8(volatile uint8_t* reg, uint8_t mask)
+{
+	BME_REG8(BME_OR_ADDR(reg)) = mask;
+}
+
+// reg &= mask (pass ~bits to clear bits)
+static inline void bme_and32(volatile uint32_t* reg, uint32_t mask)
+{
+	BME_REG32(BME_AND_ADDR(reg)) = mask;
+}
+
+static inline void bme_and8(volatile uint8_t* reg, uint8_t mask)
+{
+	BME_REG8(BME_AND_ADDR(reg)) = mask;
+}
+
+// reg[bit + width - 1:bit] = value[bit + width - 1:bit] (value already shifted into place, like the CMSIS field macros)
+static inline void bme_bfi32(volatile uint32_t* reg, uint8_t bit, uint8_t width, uint32_t value)
+{
+	BME_REG32(BME_BFI_ADDR(reg, bit, width)) = value;
+}
+
+// reg[bit + width - 1:bit], shifted down
+static inline uint32_t bme_ubfx32(volatile uint32_t* reg, uint8_t bit, uint8_t width)
+{
+	return BME_REG32(BME_UBFX_ADDR(reg, bit, width));
+}
+#else
+static inline void bme_or32(volatile uint32_t* reg, uint32_t mask)
+{
+	*reg |= mask;
+}
+
+static inline void bme_or8(volatile uint8_t* reg, uint8_t mask)
+{
+	*reg |= mask;
+}
+
+static inline void bme_and32(volatile uint32_t* reg, uint32_t mask)
+{
+	*reg &= mask;
+}
+
+static inline void bme_and8(volatile uint8_t* reg, uint8_t mask)
+{
+	*reg &= mask;
+}
+
+static inline void bme_bfi32(volatile uint32_t* reg, uint8_t bit, uint8_t width, uint32_t value)
+{
+	uint32_t field = (0xFFFFFFFFUL >> (32 - width)) << bit;
+	*reg = (*reg & ~field) | (value & field);
+}
+
+static inline uint32_t bme_ubfx32(volatile uint32_t* reg, uint8_t bit, uint8_t width)
+{
+	return (*reg >> bit) & (0xFFFFFFFFUL >> (32 - width));
+}
+#endif
+
+#endif /* BME_H_ */
@@ -0,0 +1,221 @@
+/*
+ * capture.h
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+#include "adc_driver.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Capture Info - what the samples are, sent by the firmware as a TELEMETRY_TYPE_CAPTURE_INFO frame at the start
+// of the raw stream and again every 256 raw frames, and kept in the capture file header
+#define CAPTURE_INFO_VERSION		1
+#define CAPTURE_INFO_BYTES			32
+
+// Where the info came from
+typedef enum
+{
+	CAPTURE_SOURCE_NONE,			// Nothing known yet
+	CAPTURE_SOURCE_FIRMWARE,		// Info frame, the ADC fields are the running adc_init_config
+	CAPTURE_SOURCE_HOST				// Converted from a raw file, only the rate and block size are known
+} capture_source;
+
+// Capture Info (adc_init_config fields that shape the samples, the pins and register pointers are left out)
+typedef struct
+{
+	capture_source source;
+	uint32_t sample_rate;
+	uint16_t block_size;
+	uint8_t channel;
+	uint8_t bits;
+	uint8_t avg_samps;
+	uint8_t clock;
+	uint8_t clock_div;
+	uint8_t sample_cycle_add;
+	uint8_t low_power;
+	uint8_t mux;
+	uint8_t async_state;
+	uint8_t ref_volt;
+	uint8_t continuous;
+	uint8_t trigger;
+	uint8_t compare_mode;
+	uint16_t compare_1;
+	uint16_t compare_2;
+} capture_info;
+
+// Capture Errors
+typedef enum
+{
+	CAPTURE_ERROR_SUCCESS,
+	CAPTURE_ERROR_NULL_PTR,
+	CAPTURE_ERROR_IO,
+	CAPTURE_ERROR_FORMAT,			// Not a capture file, or a version this code does not read
+	CAPTURE_ERROR_RANGE
+} capture_error;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Fill an info from the running ADC setup
+void capture_info_from_adc(capture_info* info, adc_init_config* adc, uint32_t sample_rate, uint16_t block_size);
+
+// Info to/from CAPTURE_INFO_BYTES (LE, byte at a time), unpack fails on a short payload or unknown version
+uint16_t capture_info_pack(const capture_info* info, uint8_t* payload);
+bool capture_info_unpack(const uint8_t* payload, uint16_t length, capture_info* info);
+
+
+// Capture File (host only) - raw samples in aligned chunks with their block metadata, and an index
+//   header		CAPTURE_HEADER_BYTES: magic, version, the packed info, and how far complete chunks reach
+//   chunks		header (CAPTURE_CHUNK_HEADER_BYTES) then int16 LE samples, each starting on CAPTURE_ALIGN bytes
+//   index		at the end once closed, one capture_index_entry per chunk
+// A chunk holds consecutive samples (a gap in the firmware index starts a new one), its time is the host clock
+// when its first block arrived and never goes backwards, so both the sample index and the time seek by bisection
+// (the sample index one assumes a single firmware run per capture, a reset starts the index over).
+// The writer writes a whole chunk then moves the header's committed mark past it, so a reader that maps the file
+// while it is being written sees whole chunks only and picks up new ones with capture_refresh.
+#if !defined(__arm__)
+
+#define CAPTURE_MAGIC				"KL25CAP"		// 8 bytes with the terminator
+#define CAPTURE_VERSION				1
+#define CAPTURE_ALIGN				64				// Chunk and sample alignment, a cache line and any vector width
+#define CAPTURE_HEADER_BYTES		128
+#define CAPTURE_CHUNK_HEADER_BYTES	CAPTURE_ALIGN
+#define CAPTURE_CHUNK_MAGIC			0x4B4E4843U		// "CHNK"
+#define CAPTURE_INDEX_MAGIC			0x58444E49U		// "INDX"
+#define CAPTURE_CHUNK_SAMPLES		4096			// Default, a whole number of blocks
+
+// File Header (mapped in place, little endian hosts)
+typedef struct
+{
+	char magic[8];
+	uint16_t version;
+	uint16_t header_bytes;
+	uint32_t chunk_samples;
+	uint64_t committed;				// Bytes from the file start up to the end of the last complete chunk
+	uint64_t index_offset;			// 0 while the capture is open for writing
+	uint64_t chunk_count;			// Valid once closed
+	uint64_t samples;				// Valid once closed
+	uint8_t info[CAPTURE_INFO_BYTES];
+	uint8_t reserved[CAPTURE_HEADER_BYTES - 48 - CAPTURE_INFO_BYTES];
+} capture_file_header;
+
+// Chunk Header (CAPTURE_CHUNK_HEADER_BYTES, samples follow)
+typedef struct
+{
+	uint32_t magic;
+	uint32_t count;					// Samples
+	uint64_t first_sample;			// Firmware sample index of the first
+	uint64_t time_ns;				// Host clock (ns since the epoch) when the first block arrived
+	uint64_t position;				// Samples stored before this chunk
+	uint8_t reserved[CAPTURE_CHUNK_HEADER_BYTES - 32];
+} capture_chunk_header;
+
+// Index Entry (the trailing index, or the reader's own while the file is still being written)
+typedef struct
+{
+	uint64_t first_sample;
+	uint64_t time_ns;
+	uint64_t position;
+	uint64_t offset;				// File offset of the chunk header
+} capture_index_entry;
+
+// Index Header (the trailing index starts with one)
+typedef struct
+{
+	uint32_t magic;
+	uint32_t reserved;
+	uint64_t count;
+} capture_index_header;
+
+// Zero Copy View of one Chunk (into the reader's map, valid until capture_refresh remaps or capture_close)
+typedef struct
+{
+	const int16_t* samples;
+	uint32_t count;
+	uint64_t first_sample;
+	uint64_t time_ns;
+	uint64_t position;
+} capture_slice;
+
+// Writer Configuration
+typedef struct
+{
+	const char* path;
+	uint32_t chunk_samples;
+	const capture_info* info;		// NULL to fill in later with capture_set_info
+} capture_writer_config;
+
+#define CAPTURE_WRITER_CONFIG_DEFAULT		\
+{											\
+	.path = NULL,							\
+	.chunk_samples = CAPTURE_CHUNK_SAMPLES,	\
+	.info = NULL							\
+}
+
+// Writer Handle
+typedef struct
+{
+	int fd;
+	capture_file_header header;
+	int16_t* pending;				// Chunk being collected
+	uint32_t pending_count;
+	capture_chunk_header chunk;		// Its header
+	uint64_t offset;				// Where it goes
+	uint64_t samples;
+	uint64_t last_time_ns;
+	capture_index_entry* index;
+	uint64_t index_capacity;
+	uint64_t chunk_count;
+} capture_writer;
+
+// Reader Handle
+typedef struct
+{
+	int fd;
+	const uint8_t* map;
+	size_t map_bytes;
+	const capture_file_header* header;
+	capture_info info;
+	bool closed;					// Trailing index in place, nothing more will be written
+	const capture_index_entry* index;
+	capture_index_entry* scanned;	// Index built by walking the chunks while the file is live
+	uint64_t scanned_capacity;
+	uint64_t scanned_to;			// Offset of the next chunk to walk
+	uint64_t chunk_count;
+	uint64_t samples;
+} capture_reader;
+
+
+// Writer - create (truncates), add samples as they arrive, make what is collected visible, finish with the index
+capture_error capture_create(capture_writer* writer, capture_writer_config* config);
+capture_error capture_set_info(capture_writer* writer, const capture_info* info);
+capture_error capture_append(capture_writer* writer, const int16_t* samples, uint32_t count, uint64_t first_sample,
+								uint64_t time_ns);
+capture_error capture_flush(capture_writer* writer);
+capture_error capture_finish(capture_writer* writer);
+
+// Reader - map a capture (closed or still being written), pick up chunks written since, unmap
+capture_error capture_open(capture_reader* reader, const char* path);
+capture_error capture_refresh(capture_reader* reader);
+void capture_close(capture_reader* reader);
+
+// Chunk holding a firmware sample index / a stored position / the time (the last chunk starting at or before it)
+uint64_t capture_seek_sample(const capture_reader* reader, uint64_t sample);
+uint64_t capture_seek_position(const capture_reader* reader, uint64_t position);
+uint64_t capture_seek_time(const capture_reader* reader, uint64_t time_ns);
+
+// One chunk's samples where they lie in the map
+capture_error capture_chunk(const capture_reader* reader, uint64_t chunk, capture_slice* slice);
+
+#endif
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,58 @@
+/*
+ * commands.h
+ *
+ *  Created on: Dec 18, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef COMMANDS_H_
+#define COMMANDS_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "adc_driver.h"
+#include "shell.h"
+#include "acquire.h"
+#include "governor.h"
+#include "blocksize.h"
+#include "blockpool.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Report Flags (checked by main once per block)
+// Raw frames and report text share the UART, text and pretty stay off while raw is on
+#define REPORT_TEXT		0x1U
+#define REPORT_PRETTY	0x2U
+#define REPORT_RAW		0x4U
+
+// Commands Errors
+typedef enum
+{
+	COMMANDS_ERROR_SUCCESS,
+	COMMANDS_ERROR_NULL_PTR,
+	COMMANDS_ERROR_SHELL
+} commands_error;
+
+// Application state the commands can see and change
+typedef struct
+{
+	adc_init_config* adc;			// avg_samps is kept in step with the hardware
+	uint8_t* report_flags;
+	acquire_handle* acquire;		// DMA block, error and gap counts
+	uint32_t* processed_blocks;		// Blocks run through the pipeline
+	uint32_t* raw_dropped;			// Raw stream blocks dropped on a busy UART
+	governor_handle* governor;		// NULL when the clock governor is built out
+	blocksize_handle* sizer;		// NULL when adaptive block sizing is built out
+	blockpool* pool;				// NULL when the DMA runs plain ping pong halves
+	void (*write_wait)(const char* text, size_t length);	// Console writer that waits for room (bench rows)
+} commands_context;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Register the application command table with the shell
+commands_error commands_init(commands_context* context, uint8_t* rx_ring, size_t rx_ring_size);
+
+#endif /* COMMANDS_H_ */
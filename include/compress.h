@@ -0,0 +1,49 @@
+/*
+ * compress.h
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Block Coding Methods (fixed order predictor, or samples stored as is)
+typedef enum
+{
+	COMPRESS_METHOD_ORDER_0,	// e = x[n]
+	COMPRESS_METHOD_ORDER_1,	// e = x[n] - x[n-1]
+	COMPRESS_METHOD_ORDER_2,	// e = x[n] - 2x[n-1] + x[n-2]
+	COMPRESS_METHOD_VERBATIM
+} compress_method;
+
+// Block Header - byte 0 is method | (rice k << 2), byte 1 is sample count
+#define COMPRESS_HEADER_BYTES		2
+#define COMPRESS_METHOD(byte)		((compress_method)((byte) & 0x3U))
+#define COMPRESS_RICE_K(byte)		((byte) >> 2)
+#define COMPRESS_MAX_RICE_K			16
+
+// Quotients this big are sent as an escape plus the raw zigzag residual (order 2 residuals fit in 18 bits)
+#define COMPRESS_ESCAPE_QUOTIENT	16
+#define COMPRESS_ESCAPE_BITS		18
+
+// Worst case encoded size, coder falls back to verbatim rather than exceed this
+#define COMPRESS_MAX_BYTES(samples)	(COMPRESS_HEADER_BYTES + ((samples) * 2))
+
+
+/* FUNCTION DECLARATIONS */
+
+// Encode a block of samples, returns the encoded byte count (out must hold COMPRESS_MAX_BYTES)
+uint16_t compress_encode_block(volatile int16_t* buffer, uint8_t buffer_size, uint8_t* out);
+
+// Decode one encoded block, returns the sample count or -1 if the block is malformed
+int16_t compress_decode_block(uint8_t* in, uint16_t in_size, int16_t* out, uint8_t out_size);
+
+#endif /* COMPRESS_H_ */
@@ -0,0 +1,43 @@
+/*
+ * cycle_counter.h
+ *
+ *  Created on: Dec 17, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef CYCLE_COUNTER_H_
+#define CYCLE_COUNTER_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// The M0+ has no DWT cycle counter, SysTick free runs at the core clock instead (24 bit, counts down)
+// Host builds count nanoseconds so the same benchmark code runs there
+#if defined(__arm__)
+#define CYCLE_COUNTER_MASK		0x00FFFFFFUL
+#define CYCLE_COUNTER_UNIT		"cycles"
+#else
+#define CYCLE_COUNTER_MASK		0xFFFFFFFFUL
+#define CYCLE_COUNTER_UNIT		"ns"
+#endif
+
+
+/* FUNCTION DECLARATIONS */
+
+// Start the free running counter (left alone if already running, the acquire timebase is built on it)
+void cycle_counter_init(void);
+
+// Current count (counts up, wraps at CYCLE_COUNTER_MASK)
+uint32_t cycle_counter_now(void);
+
+// Counts since start, valid for spans shorter than one wrap (~350ms at 48MHz)
+uint32_t cycle_counter_elapsed(uint32_t start);
+
+// Counter ticks per second (core clock on target, 1GHz on host)
+uint32_t cycle_counter_hz(void);
+
+#endif /* CYCLE_COUNTER_H_ */
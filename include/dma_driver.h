@@ -28,6 +28,17 @@ typedef enum
 	DMA_ERROR_UNKNOWN_DMA
 } dma_error;
 
+// DMA Channel Status (errors are checked in this order, only one is reported)
+typedef enum
+{
+	DMA_STATUS_DONE,
+	DMA_STATUS_CONFIG_ERROR,		// CE - bad SAR/DAR/BCR/size combination, nothing moved
+	DMA_STATUS_SOURCE_BUS_ERROR,	// BES - the read of the failing transfer faulted
+	DMA_STATUS_DEST_BUS_ERROR,		// BED - the write of the failing transfer faulted
+	DMA_STATUS_BUSY,				// Nothing to service (transfer still running or channel idle)
+	DMA_STATUS_COUNT
+} dma_status;
+
 // DMA Channels
 typedef enum
 {
@@ -108,7 +119,7 @@ typedef struct
 {
 	DMA_Type* dma;
 	dma_channel channel;
-	volatile void* src_addr;
+	const volatile void* src_addr;
 	volatile void* dest_addr;
 	uint32_t byte_count;
 	bool interrupt;
@@ -154,11 +165,70 @@ typedef struct
 	.start = false						\
 }
 
+// Bytes per transfer for a dma_size, and the BCR limit (24 bit field, the KL25 takes 20)
+#define DMA_SIZE_BYTES(size)		(((size) == DMA_SIZE_32) ? 4U : ((size) == DMA_SIZE_16) ? 2U : 1U)
+#define DMA_BYTE_COUNT_MAX			0xFFFFFU
+
+// Register images for one channel, dma_init_image writes them in a single pass
+typedef struct
+{
+	DMA_Type* dma;
+	dma_channel channel;
+	const volatile void* src_addr;
+	volatile void* dest_addr;
+	uint32_t dsr_bcr;
+	uint32_t dcr;
+	bool irq;
+} dma_image;
+
+// Build an image from the dma_init_config fields in struct order (see ADC_IMAGE for the list macro use)
+#define DMA_IMAGE(...)		DMA_IMAGE_FIELDS(__VA_ARGS__)
+#define DMA_IMAGE_FIELDS(dma, channel, src_addr, dest_addr, byte_count, interrupt, peripheral_en, steal_cycles, auto_align,	\
+						async_en, src_inc, src_size, src_mod, dest_inc, dest_size, dest_mod, auto_disable_req, link_mode,		\
+						link_chan_1, link_chan_2, start)																		\
+{																																\
+	(dma), (channel), (src_addr), (dest_addr),																					\
+	DMA_DSR_BCR_BCR(byte_count),																								\
+	DMA_DCR_EINT(interrupt)			|																							\
+	DMA_DCR_ERQ(peripheral_en)		|																							\
+	DMA_DCR_CS(steal_cycles)		|																							\
+	DMA_DCR_AA(auto_align)			|																							\
+	DMA_DCR_EADREQ(async_en)		|																							\
+	DMA_DCR_SINC(src_inc)			|																							\
+	DMA_DCR_SSIZE(src_size)			|																							\
+	DMA_DCR_DINC(dest_inc)			|																							\
+	DMA_DCR_DSIZE(dest_size)		|																							\
+	DMA_DCR_START(start)			|																							\
+	DMA_DCR_SMOD(src_mod)			|																							\
+	DMA_DCR_DMOD(dest_mod)			|																							\
+	DMA_DCR_D_REQ(auto_disable_req)	|																							\
+	DMA_DCR_LINKCC(link_mode)		|																							\
+	DMA_DCR_LCH1(link_chan_1)		|																							\
+	DMA_DCR_LCH2(link_chan_2),																									\
+	(interrupt)																													\
+}
+
+// Build time versions of the dma_init checks (the addresses are not integer constants, dma_init_image trusts them)
+#define DMA_IMAGE_ASSERT(...)	DMA_IMAGE_ASSERT_FIELDS(__VA_ARGS__)
+#define DMA_IMAGE_ASSERT_FIELDS(dma, channel, src_addr, dest_addr, byte_count, interrupt, peripheral_en, steal_cycles,		\
+						auto_align, async_en, src_inc, src_size, src_mod, dest_inc, dest_size, dest_mod, auto_disable_req,		\
+						link_mode, link_chan_1, link_chan_2, start)															\
+	_Static_assert(((byte_count) > 0) && ((byte_count) <= DMA_BYTE_COUNT_MAX), "DMA: byte count out of the BCR range");		\
+	_Static_assert(((src_size) <= DMA_SIZE_16) && ((dest_size) <= DMA_SIZE_16), "DMA: not a dma_size value");				\
+	_Static_assert((((byte_count) % DMA_SIZE_BYTES(src_size)) == 0) && (((byte_count) % DMA_SIZE_BYTES(dest_size)) == 0),	\
+					"DMA: byte count is not a whole number of transfers (CE at the first request)");					\
+	_Static_assert(((src_mod) <= DMA_MOD_256k) && ((dest_mod) <= DMA_MOD_256k), "DMA: not a dma_mod value");				\
+	_Static_assert((channel) <= DMA_CHANNEL_3, "DMA: not a dma_channel value");												\
+	_Static_assert(!((peripheral_en) && (start)), "DMA: START and ERQ both set, the first transfer would not wait for the request")
+
 /* FUNCTION DECLARATIONS */
 
 // DMA Initialization
 dma_error dma_init(dma_init_config* config);
 
+// DMA Initialization from prebuilt register images (checked by DMA_IMAGE_ASSERT, the channel must be idle)
+void dma_init_image(const dma_image* image);
+
 // DMA Mux Initialization
 dma_error dma_mux_init(dma_mux_config* config);
 
@@ -168,4 +238,16 @@ void dma_mux_channel_enable(DMAMUX_Type* dma_mux, dma_channel channel, bool enab
 // Used to restart a DMA transfer on an already configured DMA Channel (resets peripheral_en)
 void dma_transfer_restart(DMA_Type* dma, dma_channel channel, volatile void* buffer_ptr, uint32_t byte_count);
 
+// Classify how the last transfer on a channel ended
+dma_status dma_channel_status(DMA_Type* dma, dma_channel channel);
+
+// Bytes the last transfer did not move (0 after a clean finish)
+uint32_t dma_bytes_remaining(DMA_Type* dma, dma_channel channel);
+
+// Clear DONE and every error flag on a channel (one write to DONE clears them all)
+void dma_channel_clear(DMA_Type* dma, dma_channel channel);
+
+// Stop a channel taking requests (clears ERQ), the byte count is left where it stopped
+void dma_channel_stop(DMA_Type* dma, dma_channel channel);
+
 #endif /* DMA_DRIVER_H_ */
@@ -0,0 +1,43 @@
+/*
+ * format.h
+ *
+ *  Created on: Dec 18, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef FORMAT_H_
+#define FORMAT_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Largest outputs (no terminator is written)
+#define FORMAT_U16_BYTES		5			// 65535
+#define FORMAT_DB_BYTES			7			// -655.35
+#define FORMAT_REPORT_BYTES		(4 + FORMAT_U16_BYTES + 8 + FORMAT_DB_BYTES + 1)	// ADC:n - dBFS:-d.dd\n
+#define FORMAT_TONE_BYTES		(5 + FORMAT_U16_BYTES + 8 + FORMAT_DB_BYTES + 1)	// TONE:f - dBFS:-d.dd\n
+#define FORMAT_BAR_BYTES(scale_shift)	((UINT16_MAX >> (scale_shift)) + 3)		// 0...0>\n
+
+
+/* FUNCTION DECLARATIONS */
+
+// Unsigned decimal, no leading zeros, returns bytes written
+uint8_t format_u16(char* out, uint16_t value);
+
+// Hundredths of a dB as -W.DD (value is the unsigned dbfs_output result), returns bytes written
+uint8_t format_db(char* out, uint16_t centi_db);
+
+// Report line "ADC:<peak> - dBFS:-<dB>\n", returns bytes written (out must hold FORMAT_REPORT_BYTES)
+uint8_t format_report(char* out, uint16_t peak_counts, uint16_t centi_db);
+
+// Tone line "TONE:<hz> - dBFS:-<dB>\n", returns bytes written (out must hold FORMAT_TONE_BYTES)
+uint8_t format_tone(char* out, uint16_t frequency, uint16_t centi_db);
+
+// Bar graph of sample >> scale_shift zeros then ">\n" (same text as printf("%0*d>\n")), clipped to out_size
+uint16_t format_bar(char* out, uint16_t out_size, uint16_t sample, uint8_t scale_shift);
+
+#endif /* FORMAT_H_ */
@@ -0,0 +1,61 @@
+/*
+ * goertzel.h
+ *
+ *  Created on: Dec 19, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef GOERTZEL_H_
+#define GOERTZEL_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "stdlib.h"
+#include "fsl_common.h"
+
+/* DEFINES & TYPEDEFS */
+#define GOERTZEL_MAX_TONES		8
+#define GOERTZEL_COEFF_SHIFT	14		// 2cos(w) kept in Q14
+
+// Goertzel Errors
+typedef enum
+{
+	GOERTZEL_ERROR_SUCCESS,
+	GOERTZEL_ERROR_NULL_PTR,
+	GOERTZEL_ERROR_TONE_COUNT,
+	GOERTZEL_ERROR_FREQUENCY
+} goertzel_error;
+
+// Goertzel Bank Configuration
+typedef struct
+{
+	uint32_t sample_rate;
+	uint8_t tone_count;
+	uint16_t frequencies[GOERTZEL_MAX_TONES];	// Hz, above 0 and below sample_rate / 2
+} goertzel_config;
+
+#define GOERTZEL_CONFIG_DEFAULT		\
+{									\
+	.sample_rate = 0,				\
+	.tone_count = 0,				\
+	.frequencies = {0}				\
+}
+
+// Goertzel Bank (coefficients worked out once by goertzel_init)
+typedef struct
+{
+	goertzel_config config;
+	int32_t coeff[GOERTZEL_MAX_TONES];
+} goertzel_bank;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Work out the coefficients for every tone at the configured sample rate
+goertzel_error goertzel_init(goertzel_bank* bank, goertzel_config* config);
+
+// Run every tone over one block, amplitude[i] is tone i's peak in ADC counts (same scale as peak_block_max)
+void goertzel_process_block(goertzel_bank* bank, volatile int16_t* buffer, uint8_t buffer_size, uint16_t* amplitude);
+
+#endif /* GOERTZEL_H_ */
@@ -0,0 +1,110 @@
+/*
+ * governor.h
+ *
+ *  Created on: Dec 22, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "adc_driver.h"
+#include "acquire.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Supply and typical IDD per profile (core + flash, peripheral clocks on) - rough datasheet figures, measure the board
+// The energy figures below are this model times the block period, nothing on the board measures current
+#define GOVERNOR_SUPPLY_MV		3300
+#define GOVERNOR_CURRENT_UA		{6300, 370}
+#define GOVERNOR_PROFILE_NAMES	{"run", "vlpr"}
+
+// Core clock ratio RUN / VLPR (48MHz / 4MHz), used to guess the VLPR load from the RUN load
+#define GOVERNOR_CLOCK_RATIO	12
+
+// Governor Errors
+typedef enum
+{
+	GOVERNOR_ERROR_SUCCESS,
+	GOVERNOR_ERROR_NULL_PTR,
+	GOVERNOR_ERROR_PROFILE,
+	GOVERNOR_ERROR_BUSY,
+	GOVERNOR_ERROR_UART
+} governor_error;
+
+// Clock Profiles (board/clock_config.c)
+typedef enum
+{
+	GOVERNOR_PROFILE_RUN,		// PEE, 48MHz core / 24MHz bus and flash
+	GOVERNOR_PROFILE_VLPR,		// BLPI, 4MHz core / 800kHz bus and flash
+	GOVERNOR_PROFILE_COUNT
+} governor_profile;
+
+// Governor Configuration
+typedef struct
+{
+	acquire_handle* acquire;
+	adc_init_config* adc;
+	uint32_t* processed_blocks;		// Main loop count, blocks behind acquire->blocks are missed
+	uint16_t window_blocks;			// Blocks averaged per decision
+	uint8_t down_percent;			// Step down when the VLPR load guessed from RUN is under this
+	uint8_t up_percent;				// Step up when the load is over this, or on any missed block
+	uint16_t hold_blocks;			// Blocks to stay in RUN after a step up before trying VLPR again, and the first
+									// wait after a failed step down (doubles on each failure after that)
+	bool automatic;					// false holds the profile set from the shell
+} governor_config;
+
+#define GOVERNOR_CONFIG_DEFAULT		\
+{									\
+	.acquire = NULL,				\
+	.adc = NULL,					\
+	.processed_blocks = NULL,		\
+	.window_blocks = 64,			\
+	.down_percent = 50,				\
+	.up_percent = 80,				\
+	.hold_blocks = 4096,			\
+	.automatic = true				\
+}
+
+// Governor Handle
+typedef struct
+{
+	governor_config config;
+	governor_profile profile;
+	uint32_t window_busy;						// cycle_counter counts spent processing this window
+	uint16_t window_count;
+	uint32_t window_missed;						// Missed block count when the window started
+	uint16_t hold;
+	uint16_t backoff;							// Hold after the next failed step down
+	uint8_t load;								// Last window, percent of the block period spent processing
+	uint32_t blocks[GOVERNOR_PROFILE_COUNT];	// Blocks processed in each profile
+	uint32_t switches;
+	uint32_t failed_switches;					// UART could not hold the baud, went back
+	uint32_t switch_missed;						// Blocks missed across switches (should stay 0)
+} governor_handle;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Unlock VLPR in the SMC (PMPROT is write once) and start in RUN
+governor_error governor_init(governor_handle* governor, governor_config* config);
+
+// Account for one processed block (busy = cycle_counter counts from picking the block up to done)
+void governor_block(governor_handle* governor, uint32_t busy);
+
+// Idle loop - decide at the end of a window and switch if needed (waits for the UART to drain)
+void governor_service(governor_handle* governor);
+
+// Switch now (the shell's manual override) - ADC timing, block period and UART baud follow the clock
+governor_error governor_set_profile(governor_handle* governor, governor_profile profile);
+
+// Modelled energy per block in nJ for a profile (datasheet IDD, not measured), and the average over every block
+// processed so far
+uint32_t governor_block_energy(governor_handle* governor, governor_profile profile);
+uint32_t governor_average_energy(governor_handle* governor);
+
+#endif /* GOVERNOR_H_ */
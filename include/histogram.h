@@ -0,0 +1,58 @@
+/*
+ * histogram.h
+ *
+ *  Created on: Dec 19, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Log spaced bins - the octave is the bit length of |x| (the dbfs_output LUT index), split in 4 by the next 2 bits
+#define HISTOGRAM_SUB_BITS			2
+#define HISTOGRAM_BINS_PER_OCTAVE	(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_OCTAVES			16
+#define HISTOGRAM_BINS				(HISTOGRAM_OCTAVES * HISTOGRAM_BINS_PER_OCTAVE)
+
+// Counts are halved when the total gets here, long windows keep their shape instead of wrapping
+#define HISTOGRAM_TOTAL_LIMIT		0x80000000UL
+
+// Packed histogram - total then every bin, 32 bit little endian
+#define HISTOGRAM_PACK_BYTES		(4 + (HISTOGRAM_BINS * 4))
+
+// Amplitude Histogram
+typedef struct
+{
+	uint32_t bins[HISTOGRAM_BINS];
+	uint32_t total;
+} histogram;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Empty every bin
+void histogram_reset(histogram* hist);
+
+// Bin every |x| in a block
+void histogram_add_block(histogram* hist, volatile int16_t* buffer, uint8_t buffer_size);
+
+// Bin one magnitude (a block max for a per block histogram)
+void histogram_add_value(histogram* hist, uint16_t value);
+
+// Smallest |x| that lands in a bin
+uint16_t histogram_bin_floor(uint8_t bin);
+
+// Level exceeded exceed_percent of the time (L10 is 10, L90 is 90), as the floor of the bin it falls in
+uint16_t histogram_level(histogram* hist, uint8_t exceed_percent);
+
+// Pack for a telemetry frame, returns HISTOGRAM_PACK_BYTES
+uint16_t histogram_pack(histogram* hist, uint8_t* payload);
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,50 @@
+/*
+ * kernels.h
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* DEFINES & TYPEDEFS */
+
+// Metering kernels over whole captures for the host tools - block max (peak_block_max), energy for RMS
+// (peak_block_energy) and dBFS (dbfs_output) over any length. The scalar variant calls the firmware kernels
+// themselves, the SSE2/AVX2 (x86) and NEON (aarch64) variants give the same bits and kernels_check holds them to it.
+// On target only the scalar variant is built.
+
+// Kernel Variants
+typedef enum
+{
+	KERNELS_SCALAR,
+	KERNELS_SSE2,
+	KERNELS_AVX2,
+	KERNELS_NEON,
+	KERNELS_VARIANTS
+} kernels_variant;
+
+// Kernel Table (one per variant)
+typedef struct
+{
+	const char* name;
+	uint16_t (*block_max)(const int16_t* buffer, uint32_t count);		// Largest |x|, 32768 for INT16_MIN
+	uint64_t (*energy)(const int16_t* buffer, uint32_t count);			// Sum of x^2
+	void (*dbfs)(const uint16_t* input, uint16_t* output, uint32_t count);	// dbfs_output of each
+} kernels_table;
+
+
+/* FUNCTION DECLARATIONS */
+
+// A variant's kernels, NULL if it is not built in or this CPU lacks it
+const kernels_table* kernels_get(kernels_variant variant);
+
+// Fastest variant this CPU runs
+const kernels_table* kernels_best(void);
+
+#endif /* KERNELS_H_ */
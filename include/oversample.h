@@ -0,0 +1,63 @@
+/*
+ * oversample.h
+ *
+ *  Created on: Dec 20, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef OVERSAMPLE_H_
+#define OVERSAMPLE_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Each extra bit costs 4x the raw rate, 4 extra bits (20 bit output) is a 256 sample sum
+#define OVERSAMPLE_MAX_EXTRA_BITS	4
+#define OVERSAMPLE_RATIO(extra_bits)	(1U << ((extra_bits) * 2))
+
+// Largest number of outputs one block can give (a partial sum can finish on the first sample)
+#define OVERSAMPLE_MAX_OUTPUTS(block_size, extra_bits)	(((block_size) / OVERSAMPLE_RATIO(extra_bits)) + 1)
+
+// Oversample Errors
+typedef enum
+{
+	OVERSAMPLE_ERROR_SUCCESS,
+	OVERSAMPLE_ERROR_NULL_PTR,
+	OVERSAMPLE_ERROR_EXTRA_BITS
+} oversample_error;
+
+// Oversample Configuration
+typedef struct
+{
+	uint8_t extra_bits;		// Output is 16 + extra_bits signed bits in an int32
+} oversample_config;
+
+#define OVERSAMPLE_CONFIG_DEFAULT	\
+{									\
+	.extra_bits = 2					\
+}
+
+// Oversample Handle (the running sum carries across blocks)
+typedef struct
+{
+	oversample_config config;
+	uint16_t ratio;
+	uint16_t count;
+	int32_t sum;
+	uint32_t outputs;
+} oversample_handle;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Set the decimation ratio and clear the running sum
+oversample_error oversample_init(oversample_handle* handle, oversample_config* config);
+
+// Decimate one raw block, returns how many high resolution samples went into out
+uint8_t oversample_process_block(oversample_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int32_t* out);
+
+#endif /* OVERSAMPLE_H_ */
@@ -17,17 +17,43 @@
 
 /* DEFINES & TYPEDEFS */
 
+// dBFS Interpolation Table (the host SIMD kernels build theirs from the same numbers)
+#define dBFS_LUT_COUNTS	{0,1,3,7,15,31,63,127,255,511,1023,2047,4095,8191,16383,32767}
+#define dBFS_LUT_dB	{12700,9000,8100,7300,6700,6000,5400,4800,4200,3600,3000,2400,1800,1200,600,0}
+#define dBFS_LUT_SLOPE {0,196804805,14745600,6553600,2457600,1433600,614400,307200,153600,76800,38400,19200,9600,4800,2400,1200}
+#define dBFS_LUT_ENTRIES 16
+
+// Held Peak - one per meter (the pipeline, a bench run, each segment of an offline batch), nothing is static
+typedef struct
+{
+	uint16_t held;
+	uint64_t decay_mark;		// Decay periods up to the last block's first sample (peak_hold_at)
+} peak_state;
+
 
 /* FUNCTION DECLARATIONS */
 
+// Empty the hold, decay periods count from sample 0
+void peak_state_reset(peak_state* state);
+
 // Find the Peak in a buffer, Find the decay of the last sample, return the larger
-uint16_t peak_output(volatile int16_t* buffer, uint8_t buffer_size, uint8_t decay_shift);
+uint16_t peak_output(peak_state* state, volatile int16_t* buffer, uint8_t buffer_size, uint8_t decay_shift);
 
-// Take a ADC Reading and Convert to 16 bit scale dBFS
-int16_t dbfs_output(uint16_t input);
+// Find the largest |x| in a buffer
+uint16_t peak_block_max(volatile int16_t* buffer, uint8_t buffer_size);
 
-// Print a graphic line proportional to the input
-void pretty_print(uint16_t sample, uint8_t scale_shift);
+// Sum of x^2 over a buffer, RMS is sqrt(energy / buffer_size)
+uint64_t peak_block_energy(volatile int16_t* buffer, uint8_t buffer_size);
+
+// Decay the held peak, return the larger of the decayed peak and the block max
+uint16_t peak_hold(peak_state* state, uint16_t block_max, uint8_t decay_shift);
+
+// Same, decaying once for every 2^decay_bits samples the block start moved on since the last block
+uint16_t peak_hold_at(peak_state* state, uint16_t block_max, uint64_t first_sample, uint8_t decay_bits,
+						uint8_t decay_shift);
+
+// Take a ADC Reading and Convert to 16 bit scale dBFS (anything past 32767, like |INT16_MIN|, reads as 32767)
+int16_t dbfs_output(uint16_t input);
 
 
 #endif /* PEAK_DETECT_H_ */
@@ -0,0 +1,121 @@
+/*
+ * pipeline.h
+ *
+ *  Created on: Dec 16, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "peak_detect.h"
+#include "trigger.h"
+#include "goertzel.h"
+#include "histogram.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Block Geometry (shared by the DMA setup in main.c and the host tools)
+#define BUFF_DOUBLE_SIZE	128
+#define BUFF_ITEM_BYTES		2
+#define BUFF_DOUBLE_BYTES	(BUFF_DOUBLE_SIZE*BUFF_ITEM_BYTES)
+#define BUFF_HALF_SIZE		(BUFF_DOUBLE_SIZE/2)
+#define BUFF_HALF_BYTES		(BUFF_HALF_SIZE*BUFF_ITEM_BYTES)
+
+// Processing Stages
+#define PEAK_DECAY_SHIFT	1
+#define PEAK_DECAY_BITS		6					// 2^bits samples per decay step (BUFF_HALF_SIZE), counted on the sample
+												// index so the hold falls at the same rate whatever size the blocks are
+#define PEAK_DECAY_SAMPLES	(1U << PEAK_DECAY_BITS)
+_Static_assert(PEAK_DECAY_SAMPLES == BUFF_HALF_SIZE, "PEAK_DECAY_BITS has to follow BUFF_HALF_SIZE, the decay is per half");
+#define ENABLE_TRIGGER		1
+#define TRIGGER_HISTORY_SIZE	512
+#define TRIGGER_SETUP		{									\
+								.type = TRIGGER_TYPE_LEVEL,		\
+								.edge = TRIGGER_EDGE_RISING,	\
+								.level = 16384,					\
+								.slope = 4096,					\
+								.pre_samples = 128,				\
+								.post_samples = 256,			\
+								.block_size = BUFF_HALF_SIZE,	\
+								.history = trigger_history,		\
+								.history_size = TRIGGER_HISTORY_SIZE	}
+#define ENABLE_GOERTZEL		0
+#define GOERTZEL_TONES		{1000, 3000}		// Hz, coefficients follow the ADC sample rate
+#define GOERTZEL_TONE_COUNT	2
+#define ENABLE_HISTOGRAM	1
+#define HISTOGRAM_PER_SAMPLE	1		// 1 bins every |x|, 0 bins the block max (per block dBFS)
+
+// Pipeline Errors
+typedef enum
+{
+	PIPELINE_ERROR_SUCCESS,
+	PIPELINE_ERROR_NULL_PTR,
+	PIPELINE_ERROR_TRIGGER,
+	PIPELINE_ERROR_GOERTZEL
+} pipeline_error;
+
+// Runtime Settings (changed between blocks, so always at a block boundary)
+typedef struct
+{
+	uint8_t decay_shift;		// Per PEAK_DECAY_SAMPLES
+	trigger_type trigger_type;
+	trigger_edge trigger_edge;
+	int16_t trigger_level;
+	int16_t trigger_slope;
+	uint32_t sample_rate;		// Tone coefficients are worked out again when this changes
+} pipeline_settings;
+
+// Per Block Results
+typedef struct
+{
+	uint16_t block_max;		// Largest |x| in this block
+	uint16_t peak_counts;	// Held/decayed peak
+	uint16_t dbfs;			// Held peak in hundredths of a dB below full scale
+	uint32_t trigger_count;
+	uint8_t tone_count;
+	uint16_t tone_dbfs[GOERTZEL_MAX_TONES];	// Per tone level, same units as dbfs
+	uint64_t first_sample;	// Sample index of the block's first sample (set by the caller before processing, it owns
+							// the timebase, the peak decay runs on it)
+} pipeline_output;
+
+// Packed pipeline_output size (little endian - block_max, peak_counts, dbfs, trigger_count, first_sample)
+#define PIPELINE_OUTPUT_BYTES	18
+
+
+/* FUNCTION DECLARATIONS */
+
+// Set up every enabled processing stage for the ADC sample rate
+pipeline_error pipeline_init(uint32_t sample_rate);
+
+// Run one completed DMA block through the processing chain
+void pipeline_process_block(volatile int16_t* buffer, uint8_t buffer_size, pipeline_output* output);
+
+// Same chain split for a block that is still filling - the per sample stages a chunk at a time as samples land,
+// then the per block stages (peak hold, dB, tones) once it completes. The results match pipeline_process_block.
+uint16_t pipeline_process_chunk(volatile int16_t* buffer, uint8_t count);
+void pipeline_finish_block(volatile int16_t* buffer, uint8_t buffer_size, pipeline_output* output);
+
+// Read the current runtime settings
+pipeline_error pipeline_get_settings(pipeline_settings* settings);
+
+// Change runtime settings, trigger changes re-arm the trigger with an empty history
+pipeline_error pipeline_set_settings(pipeline_settings* settings);
+
+// Trigger engine owned by the pipeline (NULL if disabled), main streams its snapshots
+trigger_handle* pipeline_trigger(void);
+
+// Tone bank owned by the pipeline (NULL if disabled), for the tone frequencies
+goertzel_bank* pipeline_tones(void);
+
+// Amplitude histogram owned by the pipeline (NULL if disabled)
+histogram* pipeline_histogram(void);
+
+// Pack a result for a telemetry frame, returns PIPELINE_OUTPUT_BYTES
+uint16_t pipeline_output_pack(pipeline_output* output, uint8_t* payload);
+
+#endif /* PIPELINE_H_ */
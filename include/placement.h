@@ -0,0 +1,45 @@
+/*
+ * placement.h
+ *
+ *  Created on: Dec 21, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef PLACEMENT_H_
+#define PLACEMENT_H_
+
+/* INCLUDES */
+#include <stdint.h>
+
+/* DEFINES & TYPEDEFS */
+
+// Run the per block hot path from SRAM instead of flash
+// Flash runs at half the core clock at 48MHz, so every fetch of a flash loop can stall the core.
+// With this on the DMA ISR, the acquire/dma_driver bookkeeping, cycle_counter_now and the peak/dBFS kernels
+// are copied to SRAM_LOWER at startup, while the DMA buffer stays with the rest of bss in SRAM_UPPER, so the
+// DMA writes and the code fetches land on different SRAM arrays. Compare the stats irq_cycles and bench point
+// rows with it off/on.
+//
+// It needs the .cproject memory map split in two (the managed DMA_Project_Debug.ld / Release.ld follow it).
+// The default map keeps the single 16K SRAM region, turning this on means replacing its SRAM line with:
+//   SRAM_UPPER	0x20000000	0x3000	first region (RAM) - data, bss, heap and stack
+//   SRAM_LOWER	0x1FFFF000	0x1000	second region (RAM2) - only the HOT_PATH code
+// and data, bss, heap and stack then have 12K instead of 16K (check the -print-memory-usage line of the link).
+// Without the split the link stops on "undefined reference to `__base_RAM2'" (PLACEMENT_LINK_CHECK, main.c) - the
+// managed script only defines that symbol for a second RAM region, and an orphan .ramfunc section would otherwise
+// be placed wherever ld likes and never copied.
+#define ENABLE_RAM_HOT_PATH		0
+
+#if ENABLE_RAM_HOT_PATH && defined(__arm__)
+#include <cr_section_macros.h>
+#define HOT_PATH			__RAMFUNC(RAM2)
+#define PLACEMENT_NAME		"ram"
+#define PLACEMENT_LINK_CHECK	extern uint32_t __base_RAM2;										\
+								void* const placement_ram2 __attribute__((used)) = &__base_RAM2
+#else
+#define HOT_PATH
+#define PLACEMENT_NAME		"flash"
+#define PLACEMENT_LINK_CHECK	extern void* const placement_ram2
+#endif
+
+#endif /* PLACEMENT_H_ */
@@ -0,0 +1,90 @@
+/*
+ * platform.h
+ *
+ *  Created on: Dec 21, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef PLATFORM_H_
+#define PLATFORM_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "fsl_flash.h"
+#include "acquire.h"
+
+/* DEFINES & TYPEDEFS */
+
+// MCM PLACR bits a profile owns (ARB is left as it is)
+#define PLATFORM_PLACR_MASK		(MCM_PLACR_DFCDA_MASK | MCM_PLACR_DFCIC_MASK | MCM_PLACR_DFCC_MASK |	\
+								MCM_PLACR_EFDS_MASK | MCM_PLACR_DFCS_MASK | MCM_PLACR_ESFC_MASK)
+
+// Flash controller profiles, index 0 is the reset state (code and data cached, instruction speculation)
+#define PLATFORM_PROFILES																	\
+{																							\
+	{"reset",		0},																		\
+	{"code_cache",	MCM_PLACR_DFCDA_MASK},													\
+	{"data_spec",	MCM_PLACR_EFDS_MASK},													\
+	{"no_spec",		MCM_PLACR_DFCS_MASK},													\
+	{"no_cache",	MCM_PLACR_DFCC_MASK},													\
+	{"stall",		MCM_PLACR_ESFC_MASK},													\
+	{"bare",		MCM_PLACR_DFCC_MASK | MCM_PLACR_DFCS_MASK}								\
+}
+#define PLATFORM_PROFILE_COUNT	7
+
+// Tuning run - synthetic kernel blocks timed per profile, and real DMA blocks watched for the ISR time
+#define PLATFORM_TUNE_BLOCKS	16
+#define PLATFORM_TUNE_SIZE		64		// BUFF_HALF_SIZE
+
+// Persisted choice, one longword record in the last flash sector (left out of PROGRAM_FLASH in the .cproject map)
+#define PLATFORM_RECORD_MAGIC	0x504C4352UL	// "PLCR"
+
+// Platform Errors
+typedef enum
+{
+	PLATFORM_ERROR_SUCCESS,
+	PLATFORM_ERROR_NULL_PTR,
+	PLATFORM_ERROR_PROFILE,
+	PLATFORM_ERROR_FLASH,
+	PLATFORM_ERROR_NO_BLOCKS
+} platform_error;
+
+// One PLACR setting
+typedef struct
+{
+	const char* name;
+	uint32_t placr;
+} platform_profile;
+
+// Tuning result per profile (cycle_counter counts)
+typedef struct
+{
+	uint32_t kernel_cycles;		// peak_block_max + dbfs_output on one block
+	uint32_t irq_cycles;		// Worst acquire_irq over PLATFORM_TUNE_BLOCKS real blocks
+} platform_result;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Apply the saved profile, or the reset profile if nothing valid is saved
+platform_error platform_init(void);
+
+// Set PLACR from a profile and clear the flash cache
+platform_error platform_apply(uint8_t profile);
+
+// Profile in use and the profile table
+uint8_t platform_current(void);
+const platform_profile* platform_profile_get(uint8_t profile);
+
+// Time the kernels and the ISR under every profile, then apply the one with the lowest total per block
+// Blocks the caller for about PLATFORM_PROFILE_COUNT * PLATFORM_TUNE_BLOCKS DMA blocks
+platform_error platform_tune(acquire_handle* acquire, platform_result* results, uint8_t* best);
+
+// Write the profile to the flash record - interrupts and the DMA are off for the erase and the conversions it
+// costs are charged to the acquire gap count, so the sample index stays continuous. A record that is already
+// there is left alone
+platform_error platform_save(acquire_handle* acquire, uint8_t profile);
+
+#endif /* PLATFORM_H_ */
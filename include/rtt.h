@@ -0,0 +1,105 @@
+/*
+ * rtt.h
+ *
+ *  Created on: Dec 23, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef RTT_H_
+#define RTT_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// RAM ring buffer console - the debug probe reads the rings through the AHB-AP while the core runs.
+// A write is a memcpy and an index store, no peripheral and no wait, so it can take every block.
+// The control block uses the SEGGER RTT layout, so J-Link, OpenOCD ("rtt setup") and pyOCD find it by scanning
+// RAM for the id. tools/rtt_read.c reads the same layout from a memory dump or from a simulated target.
+#define ENABLE_RTT				0
+
+// Channels (up is target to host, down is host to target)
+#define RTT_UP_TERMINAL_SIZE	1024
+#define RTT_UP_TELEMETRY_SIZE	2048
+#define RTT_DOWN_TERMINAL_SIZE	32
+#define RTT_ID					"SEGGER RTT"
+#define RTT_ID_BYTES			16
+
+typedef enum
+{
+	RTT_UP_TERMINAL,		// Report text and shell replies
+	RTT_UP_TELEMETRY,		// telemetry.h frames, same bytes the UART would carry
+	RTT_UP_COUNT
+} rtt_up_channel;
+
+typedef enum
+{
+	RTT_DOWN_TERMINAL,		// Shell input
+	RTT_DOWN_COUNT
+} rtt_down_channel;
+
+// What a write does when the ring is short of room (low bits of flags, the host may change them)
+typedef enum
+{
+	RTT_MODE_SKIP,			// Write all of it or none of it, records are never cut
+	RTT_MODE_TRIM,			// Write what fits
+	RTT_MODE_BLOCK			// Wait for the probe to make room, gives up (SKIP) when no probe reads
+} rtt_mode;
+
+#define RTT_MODE_MASK			0x3U
+
+// Polls in a row with no room before a BLOCK write gives up and drops the rest (tens of ms at 48MHz). The channel
+// then acts as SKIP until the probe moves its read index again, so a board with no probe does not stop
+#define RTT_BLOCK_POLLS			100000UL
+
+// Ring descriptor - addresses are 32 bit target addresses, the layout is what the probe reads
+// The writer owns write, the reader owns read, each side only ever stores its own index
+typedef struct
+{
+	uint32_t name;
+	uint32_t buffer;
+	uint32_t size;
+	volatile uint32_t write;
+	volatile uint32_t read;
+	uint32_t flags;
+} rtt_ring;
+
+// Control block - the id goes in last so a probe never picks up a half built block
+typedef struct
+{
+	char id[RTT_ID_BYTES];
+	int32_t up_count;
+	int32_t down_count;
+	rtt_ring up[RTT_UP_COUNT];
+	rtt_ring down[RTT_DOWN_COUNT];
+} rtt_control;
+
+// Ring fill from one read of each index (the other side can move its index at any time), shared with the host reader
+#define RTT_RING_USED(write, read, size)	(((write) >= (read)) ? ((write) - (read)) : ((size) - (read) + (write)))
+#define RTT_RING_FREE(write, read, size)	((size) - 1 - RTT_RING_USED(write, read, size))
+
+
+/* FUNCTION DECLARATIONS */
+
+// Build the control block and rings
+void rtt_init(void);
+
+// Queue bytes on an up channel, returns the bytes written (0 when a SKIP record did not fit)
+uint32_t rtt_write(rtt_up_channel channel, const void* data, uint32_t length);
+
+// Room left on an up channel
+uint32_t rtt_space(rtt_up_channel channel);
+
+// Take up to max bytes the host sent on a down channel
+uint32_t rtt_read(rtt_down_channel channel, void* data, uint32_t max);
+
+// Records skipped or cut on an up channel because the host was not keeping up
+uint32_t rtt_dropped(rtt_up_channel channel);
+
+// Control block address, for a probe or a simulation that is not scanning RAM
+rtt_control* rtt_control_block(void);
+
+#endif /* RTT_H_ */
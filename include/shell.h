@@ -0,0 +1,81 @@
+/*
+ * shell.h
+ *
+ *  Created on: Dec 18, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef SHELL_H_
+#define SHELL_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "uart_driver.h"
+
+/* DEFINES & TYPEDEFS */
+#define SHELL_LINE_MAX		64		// Longest command line (DbgConsole_Scanf stops at IO_MAXLINE 20)
+#define SHELL_ARGS_MAX		4
+#define SHELL_REPLY_MAX		512		// Fits a telemetry payload, replies can go out framed
+#define SHELL_RX_PER_CALL	16		// Bytes parsed per shell_service() call, bounds the time spent
+
+// Shell Errors
+typedef enum
+{
+	SHELL_ERROR_SUCCESS,
+	SHELL_ERROR_NULL_PTR,
+	SHELL_ERROR_UART
+} shell_error;
+
+// Command Handler
+typedef void (*shell_handler)(uint8_t argc, char** argv);
+
+// Command Table Entry
+typedef struct
+{
+	const char* name;
+	const char* help;
+	shell_handler handler;
+} shell_command;
+
+// Shell Configuration
+typedef struct
+{
+	const shell_command* commands;
+	uint8_t command_count;
+	uint8_t* rx_ring;
+	size_t rx_ring_size;
+} shell_config;
+
+#define SHELL_CONFIG_DEFAULT	\
+{								\
+	.commands = NULL,			\
+	.command_count = 0,			\
+	.rx_ring = NULL,			\
+	.rx_ring_size = 0			\
+}
+
+
+/* FUNCTION DECLARATIONS */
+
+// Start receiving commands (uart_init must have been called)
+shell_error shell_init(shell_config* config);
+
+// Poll from the main loop - sends any waiting reply, parses what has arrived, runs at most one command
+void shell_service(void);
+
+// Append formatted text to the reply of the running command
+void shell_reply(const char* format, ...);
+
+// Send UART replies as TELEMETRY_TYPE_TEXT frames (raw stream on, so the host framer keeps them) or as plain text
+void shell_frame_replies(bool framed);
+
+// Print the command table
+void shell_help(void);
+
+// Commands run and lines that did not match a command
+uint32_t shell_command_count(void);
+uint32_t shell_error_count(void);
+
+#endif /* SHELL_H_ */
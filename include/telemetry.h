@@ -0,0 +1,85 @@
+/*
+ * telemetry.h
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdbool.h>
+#include "stddef.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Frame layout - sync sync type seq len_lo len_hi [payload] sum_lo sum_hi
+// Checksum is Fletcher-16 over type, seq, length and payload
+#define TELEMETRY_SYNC_0			0xA5U
+#define TELEMETRY_SYNC_1			0x5AU
+#define TELEMETRY_HEADER_BYTES		6
+#define TELEMETRY_TRAILER_BYTES		2
+#define TELEMETRY_MAX_PAYLOAD		520			// Index plus the largest raw block, COMPRESS_MAX_BYTES(UINT8_MAX)
+#define TELEMETRY_FRAME_BYTES(payload)	(TELEMETRY_HEADER_BYTES + (payload) + TELEMETRY_TRAILER_BYTES)
+
+// Sample records start with the 64 bit index of their first sample (LE)
+#define TELEMETRY_INDEX_BYTES		8
+
+// Frame Types
+typedef enum
+{
+	TELEMETRY_TYPE_TEXT,
+	TELEMETRY_TYPE_RAW_BLOCK,		// Sample index then one compress_encode_block() block
+	TELEMETRY_TYPE_METER,			// One pipeline_output_pack() result (first_sample included)
+	TELEMETRY_TYPE_HISTOGRAM,		// Sample index at the snapshot then one histogram_pack() snapshot
+	TELEMETRY_TYPE_HIRES_BLOCK,		// extra_bits, index of the first oversampled sample, then int32 LE samples
+	TELEMETRY_TYPE_CAPTURE_INFO		// One capture_info_pack() result - ADC setup, sample rate and block size
+} telemetry_type;
+
+// Frame Parser State
+typedef enum
+{
+	TELEMETRY_PARSE_SYNC_0,
+	TELEMETRY_PARSE_SYNC_1,
+	TELEMETRY_PARSE_HEADER,
+	TELEMETRY_PARSE_PAYLOAD,
+	TELEMETRY_PARSE_TRAILER
+} telemetry_parse_state;
+
+// Frame Parser (host side and command side)
+typedef struct
+{
+	telemetry_parse_state state;
+	uint16_t index;
+	uint16_t length;
+	uint8_t frame[TELEMETRY_FRAME_BYTES(TELEMETRY_MAX_PAYLOAD)];
+	uint32_t bad_frames;
+} telemetry_parser;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Pointer to where the payload goes in a frame buffer, so producers can encode in place
+uint8_t* telemetry_payload(uint8_t* frame);
+
+// Write/read a 64 bit sample index (LE, byte at a time so any alignment works), put returns the byte after it
+uint8_t* telemetry_put_index(uint8_t* ptr, uint64_t index);
+uint64_t telemetry_get_index(uint8_t* ptr);
+
+// Fill in the header and checksum around an in place payload, returns the total frame bytes
+uint16_t telemetry_frame_close(uint8_t* frame, telemetry_type type, uint8_t sequence, uint16_t length);
+
+// Reset a frame parser
+void telemetry_parser_init(telemetry_parser* parser);
+
+// Push one received byte, returns true when parser->frame holds a complete, checked frame
+bool telemetry_parse_byte(telemetry_parser* parser, uint8_t byte);
+
+// Field access on a frame
+telemetry_type telemetry_frame_type(uint8_t* frame);
+uint8_t telemetry_frame_sequence(uint8_t* frame);
+uint16_t telemetry_frame_length(uint8_t* frame);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,109 @@
+/*
+ * trace.h
+ *
+ *  Created on: Dec 24, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Micro Trace Buffer profiling - the MTB writes a packet to SRAM for every taken branch, exception entry and return
+// while it is enabled. The DMA ISR and the block processing are bracketed with TRACE_REGION_START/END, "trace arm"
+// captures the branches from the next region on until the buffer is full, and tools/mtb_decode.c turns the
+// packets plus the .axf into per function instruction/cycle counts and call paths.
+// The template buffer in mtb.c is dropped when this is on, this one is sized here.
+#define ENABLE_TRACE			0
+#define TRACE_BUFFER_SIZE		2048		// Bytes, a power of 2 from 16, aligned to its size (256 packets)
+#define TRACE_PACKET_BYTES		8			// Source address | A bit, destination address | S bit
+#define TRACE_LINE_PACKETS		4
+#define TRACE_LINE_BYTES		96
+
+// Console dump, oldest packet first:
+//   MTB <buffer address> <buffer bytes> <packets> <wrapped>
+//   MTB <first packet> <source> <destination> ... (TRACE_LINE_PACKETS pairs, hex)
+//   MTB end
+#define TRACE_TAG				"MTB"
+
+// Capture State
+typedef enum
+{
+	TRACE_STATE_IDLE,
+	TRACE_STATE_ARMED,		// The next traced region turns the MTB on
+	TRACE_STATE_FULL		// AUTOSTOP hit the end of the buffer
+} trace_state;
+
+// Only looked at in the enter path, the rest of the state is in trace.c
+extern volatile bool trace_armed;
+extern uint32_t trace_end;
+
+// Traced region brackets, they nest (an ISR in a traced region leaves the MTB on for the region)
+#if ENABLE_TRACE
+#define TRACE_REGION_START()	bool trace_was_on = trace_enter()
+#define TRACE_REGION_END()		trace_exit(trace_was_on)
+#else
+#define TRACE_REGION_START()
+#define TRACE_REGION_END()
+#endif
+
+
+/* FUNCTION DECLARATIONS */
+
+// Point the MTB at the buffer, stopped
+void trace_init(void);
+
+// Start a new capture at the next traced region
+void trace_arm(void);
+
+// Stop capturing (a capture in progress is kept)
+void trace_disarm(void);
+
+// Capture state and the packets in the buffer
+trace_state trace_status(void);
+uint32_t trace_packets(void);
+
+// Buffer address and the raw POSITION register, for reading the buffer with a debugger instead
+uint32_t trace_buffer_address(void);
+uint32_t trace_position(void);
+
+// Start a console dump (disarms), then take one line per call until it returns 0
+void trace_dump_start(void);
+uint16_t trace_dump_line(char* line);
+
+// Turn the MTB on if a capture is armed and not full, returns whether it was already on
+static inline bool trace_enter(void)
+{
+	uint32_t master = MTB->MASTER;
+
+	if(trace_armed && !(master & MTB_MASTER_EN_MASK))
+	{
+		if((MTB->POSITION & MTB_POSITION_POINTER_MASK) < trace_end)
+		{
+			MTB->MASTER = master | MTB_MASTER_EN_MASK;
+		}
+		else
+		{
+			trace_armed = false;
+		}
+	}
+
+	return (master & MTB_MASTER_EN_MASK) != 0;
+}
+
+// Turn the MTB back off unless the region around this one had it on
+static inline void trace_exit(bool was_on)
+{
+	if(!was_on)
+	{
+		MTB->MASTER &= ~MTB_MASTER_EN_MASK;
+	}
+}
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,109 @@
+/*
+ * trigger.h
+ *
+ *  Created on: Dec 14, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef TRIGGER_H_
+#define TRIGGER_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "stdlib.h"
+#include "fsl_common.h"
+
+/* DEFINES & TYPEDEFS */
+
+// Trigger Errors
+typedef enum
+{
+	TRIGGER_ERROR_SUCCESS,
+	TRIGGER_ERROR_NULL_PTR,
+	TRIGGER_ERROR_HISTORY_SIZE,
+	TRIGGER_ERROR_WINDOW_SIZE
+} trigger_error;
+
+// Trigger Types
+typedef enum
+{
+	TRIGGER_TYPE_LEVEL,		// |x| reaches level
+	TRIGGER_TYPE_EDGE,		// x crosses level in the selected direction
+	TRIGGER_TYPE_SLOPE		// x[n] - x[n-1] exceeds slope in the selected direction
+} trigger_type;
+
+// Trigger Edge/Slope Direction
+typedef enum
+{
+	TRIGGER_EDGE_RISING,
+	TRIGGER_EDGE_FALLING,
+	TRIGGER_EDGE_EITHER
+} trigger_edge;
+
+// Trigger Engine State
+typedef enum
+{
+	TRIGGER_STATE_ARMED,		// Feeding history, looking for a trigger
+	TRIGGER_STATE_POST,			// Triggered, filling the post trigger window
+	TRIGGER_STATE_STREAMING		// History frozen, snapshot being streamed out
+} trigger_state;
+
+// Trigger Configuration
+typedef struct
+{
+	trigger_type type;
+	trigger_edge edge;
+	int16_t level;
+	int16_t slope;
+	uint16_t pre_samples;		// Samples kept before the trigger sample
+	uint16_t post_samples;		// Samples kept from the trigger sample on
+	uint8_t block_size;			// Largest block that will be passed in
+	int16_t* history;			// History ring storage
+	uint16_t history_size;		// Must be a power of 2
+} trigger_config;
+
+#define TRIGGER_CONFIG_DEFAULT		\
+{									\
+	.type = TRIGGER_TYPE_LEVEL,		\
+	.edge = TRIGGER_EDGE_RISING,	\
+	.level = INT16_MAX,				\
+	.slope = INT16_MAX,				\
+	.pre_samples = 0,				\
+	.post_samples = 0,				\
+	.block_size = 0,				\
+	.history = NULL,				\
+	.history_size = 0				\
+}
+
+// Trigger Handle (one per trigger engine)
+typedef struct
+{
+	trigger_config config;
+	trigger_state state;
+	uint16_t history_mask;
+	uint16_t write_index;		// Ring position the next sample goes to
+	uint16_t post_remaining;	// Samples still needed to close the post window
+	uint16_t stream_index;		// Ring position of the next sample to stream
+	uint16_t stream_remaining;	// Samples of the snapshot not yet streamed
+	int16_t last_sample;		// Carried between blocks for edge/slope
+	uint16_t fill_remaining;	// Fresh samples to write after a re-arm before the trigger is looked for
+	uint32_t trigger_count;
+} trigger_handle;
+
+
+/* FUNCTION DECLARATIONS */
+
+// Initialize a trigger engine and arm it
+trigger_error trigger_init(trigger_handle* handle, trigger_config* config);
+
+// Feed a block to the history ring, evaluate the trigger, return the block max |x| (for peak_hold)
+uint16_t trigger_process_block(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size);
+
+// Get the next contiguous piece of a frozen snapshot, returns the sample count (0 when done)
+uint16_t trigger_stream_next(trigger_handle* handle, int16_t** samples, uint16_t max_samples);
+
+// Drop the rest of the snapshot and re-arm, the trigger waits for a fresh pre trigger window
+void trigger_rearm(trigger_handle* handle);
+
+#endif /* TRIGGER_H_ */
@@ -0,0 +1,94 @@
+/*
+ * uart_driver.h
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ */
+
+#ifndef UART_DRIVER_H_
+#define UART_DRIVER_H_
+
+/* INCLUDES */
+#include "MKL25Z4.h"
+#include "stddef.h"
+#include "fsl_common.h"
+#include "fsl_clock.h"
+#include "fsl_lpsci.h"
+
+
+/* DEFINES & TYPEDEFS */
+
+// UART Errors
+typedef enum
+{
+	UART_ERROR_SUCCESS,
+	UART_ERROR_NULL_PTR,
+	UART_ERROR_UNKNOWN_UART,
+	UART_ERROR_BAUD,
+	UART_ERROR_BUSY
+} uart_error;
+
+// Console text queue - uart_write copies into it and it drains through the same transfers as uart_send, so
+// text and frames go out one after the other and never interleave
+#define UART_TX_RING_SIZE		256
+
+// UART0 clock sources (SIM_SOPT2 UART0SRC)
+#define UART_CLOCK_PLLFLL		1U		// PLL/FLL select clock, RUN
+#define UART_CLOCK_MCGIRCLK		3U		// Fast IRC, the clock that keeps going in VLPR
+
+// UART Configuration
+typedef struct
+{
+	UART0_Type* uart;
+	uint32_t baud;
+	uint32_t clock_freq;	// 0 = use the PLL/FLL select clock like the debug console
+} uart_init_config;
+
+#define UART_INIT_CONFIG_DEFAULT	\
+{									\
+	.uart = UART0,					\
+	.baud = 115200,					\
+	.clock_freq = 0					\
+}
+
+
+/* FUNCTION DECLARATIONS */
+
+// UART Initialization (LPSCI0, interrupt driven transfers)
+uart_error uart_init(uart_init_config* config);
+
+// Start sending a buffer in the background, buffer must stay put until uart_send_busy() is false
+uart_error uart_send(uint8_t* data, size_t length);
+
+// Check if a background send is still in progress (queued console text counts)
+bool uart_send_busy(void);
+
+// Nothing queued, no transfer and the last stop bit out of the shifter (TC) - safe to change the clock or baud
+// uart_send_busy goes false with the last byte still shifting out, a baud change then garbles it
+bool uart_send_done(void);
+
+// Queue console text behind whatever is going out, copied so the caller's buffer is free at once
+// Whole or not at all, UART_ERROR_BUSY (counted as a drop) when the queue is short of room, never waits
+uart_error uart_write(const char* text, size_t length);
+
+// Same, waiting for room - for long output that runs with the main loop stopped (bench), never from an ISR
+void uart_write_wait(const char* text, size_t length);
+
+// Room left in the console text queue, and writes dropped because it was short
+size_t uart_write_space(void);
+uint32_t uart_write_dropped(void);
+
+// Start interrupt driven receive into a ring buffer
+uart_error uart_receive_start(uint8_t* ring, size_t ring_size);
+
+// Copy out whatever has been received (up to max), never waits
+size_t uart_receive(uint8_t* data, size_t max);
+
+// Bytes lost because the receive ring was full
+uint32_t uart_receive_overruns(void);
+
+// Move the UART to a new clock (UART0SRC select) and keep the baud from uart_init, call once uart_send_done()
+// Does nothing if uart_init has not run
+uart_error uart_set_clock(uint8_t source, uint32_t clock_freq);
+
+#endif /* UART_DRIVER_H_ */
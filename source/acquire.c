@@ -0,0 +1,250 @@
+/*
+ * acquire.c
+ *
+ *  Created on: Dec 20, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "acquire.h"
+
+
+/* FUNCTION DEFINITIONS */
+
+// Set up the double buffer bookkeeping, the DMA starts on half 0
+acquire_error acquire_init(acquire_handle* acquire, acquire_config* config)
+{
+	acquire_error ret = ACQUIRE_ERROR_SUCCESS;
+
+	if(	(acquire == NULL)		||
+		(config == NULL)		||
+		(config->dma == NULL)	|
+		(config->buffer == NULL))
+	{
+		ret = ACQUIRE_ERROR_NULL_PTR;
+	}
+	else if((config->block_size == 0) || (config->pool && (config->pool->config.block_size < config->block_size)))
+	{
+		ret = ACQUIRE_ERROR_BLOCK_SIZE;
+	}
+	else
+	{
+		acquire->config = *config;
+		acquire->active = 0;
+		acquire->block_size = config->block_size;
+		acquire->armed[0] = config->block_size;		// dma_init arms half 0 with a whole half
+		acquire->armed[1] = 0;
+		acquire->samples[0] = 0;
+		acquire->samples[1] = 0;
+		acquire->slot[0] = 0;						// Pool block 0 is at the start of the buffer dma_init armed
+		acquire->slot[1] = 0;
+		acquire->blocks = 0;
+		acquire->gap_samples = 0;
+		for(uint8_t i = 0; i < DMA_STATUS_COUNT; i++)
+		{
+			acquire->errors[i] = 0;
+		}
+		acquire->next_sample = 0;
+		acquire->first_sample[0] = 0;
+		acquire->first_sample[1] = 0;
+		acquire->wall_time = 0;
+		acquire->wall_hz = cycle_counter_hz();
+		acquire->irq_cycles = 0;
+		acquire->irq_cycles_max = 0;
+		acquire->block_time[0] = 0;
+		acquire->block_time[1] = 0;
+		acquire_set_rate(acquire, config->sample_rate);
+
+		cycle_counter_init();
+		acquire->last_stamp = cycle_counter_now();
+	}
+
+	return ret;
+}
+
+// DMA ISR body - classify, clear, re-arm on the other half, then account for the finished half
+// With a pool the other half is whichever pool block is free, and the finished one is published to the consumers
+HOT_PATH void acquire_irq(acquire_handle* acquire)
+{
+	uint32_t stamp = cycle_counter_now();
+	DMA_Type* dma = acquire->config.dma;
+	dma_channel channel = acquire->config.channel;
+	uint8_t next_size = acquire->block_size;
+
+	dma_status status = dma_channel_status(dma, channel);
+	if(status == DMA_STATUS_BUSY)
+	{
+		// Nothing finished, leave the running transfer alone
+		acquire->errors[DMA_STATUS_BUSY]++;
+		return;
+	}
+
+	// Straight line from here to the re-arm whatever the status, so the restart latency is fixed
+	uint32_t remaining = dma_bytes_remaining(dma, channel);
+	bool finished = acquire->active;
+	dma_channel_clear(dma, channel);
+	acquire->active = !finished;
+	if(acquire->config.pool)
+	{
+		acquire->slot[!finished] = blockpool_take(acquire->config.pool, acquire->slot[finished]);
+	}
+	dma_transfer_restart(dma, channel, acquire_half(acquire, !finished), next_size * sizeof(int16_t));
+
+	// Bookkeeping after the DMA is running again
+	acquire->armed[!finished] = next_size;
+	uint32_t block_bytes = acquire->armed[finished] * sizeof(int16_t);
+	remaining = (remaining > block_bytes) ? block_bytes : remaining;
+	uint8_t samples = (block_bytes - remaining) / sizeof(int16_t);
+	acquire->samples[finished] = samples;
+	acquire->errors[status]++;
+
+	// Blocks come far faster than the counter wraps, so each delta is the true elapsed time
+	uint32_t period = (stamp - acquire->last_stamp) & CYCLE_COUNTER_MASK;
+	acquire->last_stamp = stamp;
+	acquire->wall_time += period * acquire->wall_scale;
+	acquire->block_time[finished] = acquire->wall_time;
+
+	acquire->first_sample[finished] = acquire->next_sample;
+	acquire->next_sample += samples;
+	if(status != DMA_STATUS_DONE)
+	{
+		acquire->gap_samples += ACQUIRE_GAP_PER_ERROR;
+		acquire->next_sample += ACQUIRE_GAP_PER_ERROR;
+	}
+	else if(acquire->sample_period && acquire->blocks)
+	{
+		// Short blocks and the first block have no meaningful period
+		int32_t jitter = (int32_t)(period - ((samples * acquire->sample_period) >> 8));
+		acquire->jitter_last = jitter;
+		acquire->jitter_min = (jitter < acquire->jitter_min) ? jitter : acquire->jitter_min;
+		acquire->jitter_max = (jitter > acquire->jitter_max) ? jitter : acquire->jitter_max;
+	}
+	acquire->blocks++;
+
+	// An overrun re-armed the finished block, nobody gets it
+	if(acquire->config.pool && (acquire->slot[!finished] != acquire->slot[finished]))
+	{
+		blockpool_publish(acquire->config.pool, acquire->slot[finished], samples, acquire->first_sample[finished],
+							acquire->wall_time, acquire->blocks);
+	}
+
+	uint32_t cycles = cycle_counter_elapsed(stamp);
+	acquire->irq_cycles = cycles;
+	acquire->irq_cycles_max = (cycles > acquire->irq_cycles_max) ? cycles : acquire->irq_cycles_max;
+}
+
+// Start of a half of the double buffer (the pool block it was armed on in pool mode)
+HOT_PATH volatile int16_t* acquire_half(acquire_handle* acquire, bool half)
+{
+	if(acquire->config.pool)
+	{
+		return acquire->config.pool->blocks[acquire->slot[half]].samples;
+	}
+
+	return &acquire->config.buffer[half ? acquire->config.block_size : 0];
+}
+
+// Samples of a half that are in memory - the half being filled from the DMA byte count, a completed half whole
+// BCR counts down as each sample is written, so everything before it has landed. DONE with the ISR still
+// pending reads as a full half.
+HOT_PATH uint8_t acquire_landed(acquire_handle* acquire, bool half)
+{
+	uint32_t block_bytes;
+	uint32_t blocks;
+	uint32_t remaining;
+	bool active;
+
+	// The ISR may switch halves between the reads, then the byte count is for the other half - read again
+	do
+	{
+		blocks = acquire->blocks;
+		active = acquire->active;
+		block_bytes = acquire->armed[half] * sizeof(int16_t);
+		remaining = dma_bytes_remaining(acquire->config.dma, acquire->config.channel);
+	} while(blocks != acquire->blocks);
+
+	remaining = (remaining > block_bytes) ? block_bytes : remaining;
+
+	return (active == half) ? (uint8_t)((block_bytes - remaining) / sizeof(int16_t)) : acquire->samples[half];
+}
+
+// New ADC rate or core clock - works out the expected block period again and restarts the jitter min/max
+// The block the clock changed in is stamped with a mix of the two clocks, wall_time is off by up to one block
+void acquire_set_rate(acquire_handle* acquire, uint32_t sample_rate)
+{
+	uint32_t hz = cycle_counter_hz();
+	acquire->config.sample_rate = sample_rate;
+	acquire->block_period = sample_rate ? (uint32_t)(((uint64_t)hz * acquire->block_size) / sample_rate) : 0;
+	acquire->sample_period = sample_rate ? (uint32_t)(((uint64_t)hz << 8) / sample_rate) : 0;
+	acquire->wall_scale = (uint8_t)(acquire->wall_hz / hz);
+	acquire->jitter_last = 0;
+	acquire->jitter_min = INT32_MAX;
+	acquire->jitter_max = INT32_MIN;
+}
+
+// Block length from the next re-arm on (the half filling now keeps its size), 1 to config.block_size samples
+// The ISR picks it up in a single load, the sample index and jitter follow each half's armed size
+acquire_error acquire_set_block_size(acquire_handle* acquire, uint8_t block_size)
+{
+	acquire_error ret = ACQUIRE_ERROR_SUCCESS;
+
+	if(acquire == NULL)
+	{
+		ret = ACQUIRE_ERROR_NULL_PTR;
+	}
+	else if((block_size == 0) || (block_size > acquire->config.block_size))
+	{
+		ret = ACQUIRE_ERROR_BLOCK_SIZE;
+	}
+	else
+	{
+		acquire->block_size = block_size;
+		acquire->block_period = (uint32_t)(((uint64_t)acquire->sample_period * block_size) >> 8);
+	}
+
+	return ret;
+}
+
+// A 64 bit timebase field read whole from outside the ISR
+// The M0+ loads it as two words and the DMA ISR can land between them, so read until two reads agree (a read
+// torn by the ISR differs from the whole one after it, unless the half that changed did not)
+uint64_t acquire_read64(const volatile uint64_t* field)
+{
+	uint64_t value;
+
+	do
+	{
+		value = *field;
+	} while(value != *field);
+
+	return value;
+}
+
+// Stop the DMA for a stretch nothing can service it (flash erase)
+void acquire_suspend(acquire_handle* acquire)
+{
+	dma_channel_stop(acquire->config.dma, acquire->config.channel);
+}
+
+// Start the filling half over and charge every conversion since it was armed (at last_stamp) to the gap count
+// What had landed in it is dropped with the rest, a half that finished while stopped is dropped whole and its
+// pending ISR sees BUSY. The ADC ran on with nobody reading it, the first sample back is its last conversion.
+void acquire_resume(acquire_handle* acquire)
+{
+	DMA_Type* dma = acquire->config.dma;
+	dma_channel channel = acquire->config.channel;
+	bool filling = acquire->active;
+
+	uint32_t stamp = cycle_counter_now();
+	uint32_t period = (stamp - acquire->last_stamp) & CYCLE_COUNTER_MASK;
+	uint32_t lost = acquire->sample_period ? (uint32_t)(((uint64_t)period << 8) / acquire->sample_period) : 0;
+
+	dma_channel_clear(dma, channel);
+	dma_transfer_restart(dma, channel, acquire_half(acquire, filling), acquire->armed[filling] * sizeof(int16_t));
+
+	// The stop is wall time but not a block period, the next block's jitter starts from here
+	acquire->last_stamp = stamp;
+	acquire->wall_time += period * acquire->wall_scale;
+	acquire->gap_samples += lost;
+	acquire->next_sample += lost;
+}
@@ -8,6 +8,7 @@
 
 /* HEADER */
 #include "adc_driver.h"
+#include "bme.h"
 
 
 /* STATIC FUNCTION DECLARATIONS */
@@ -39,96 +40,64 @@ adc_error adc_init(adc_init_config* config)
 	}
 	else
 	{
-		// Easy Read Address
-		ADC_Type* adc = config->adc;
-
-		// GPIO Setup
-		clock_ip_name_t kclock = ((((uint32_t)(config->port)) >> 12) & 0xFU) + 0x10380000U;
-		CLOCK_EnableClock(kclock);
-		PORT_SetPinMux(config->port, config->pin_1, kPORT_PinDisabledOrAnalog);
-		PORT_SetPinMux(config->port, config->pin_2, kPORT_PinDisabledOrAnalog);
-
-		// Enable Clock To Peripheral
-		CLOCK_EnableClock(kCLOCK_Adc0);
-
-		// CFG1
-		adc->CFG1 = ADC_CFG1_ADLPC(config->low_power)										|
-					ADC_CFG1_ADIV(config->clock_div)										|
-					ADC_CFG1_ADLSMP(ADC_SAMP_CYCLE_ADDER_ADLSMP(config->sample_cycle_add))	|
-					ADC_CFG1_MODE(ADC_BITS(config->bits))									|
-					ADC_CFG1_ADICLK(config->clock);
-
-		// CFG2
-		adc->CFG2 = ADC_CFG2_MUXSEL(config->mux)											|
-					ADC_CFG2_ADACKEN(config->async_state)									|
-					ADC_CFG2_ADHSC(ADC_SAMP_CYCLE_ADDER_ADHSC(config->sample_cycle_add))	|
-					ADC_CFG2_ADLSTS(ADC_SAMP_CYCLE_ADDER_ADLSTS(config->sample_cycle_add));
-
-		// SC2 - Note, ADTRG is set after calibration at the end
-		adc->SC2 = 	ADC_SC2_COMP(config->compare_mode)	|
-					ADC_SC2_DMAEN(config->dma_mode)		|
-					ADC_SC2_REFSEL(config->ref_volt)	;
-
-		// SC3
-		adc->SC3 =	ADC_SC3_ADCO(config->continuous)	|
-					ADC_SC3_AVG(config->avg_samps)	;
-
-		switch(config->compare_mode)
-		{
-			case ADC_COMPARE_DISABLED:
-				break;
-
-			case ADC_COMPARE_LESS:
-				adc->CV1 = ADC_CV1_CV(MAX(config->compare_1, config->compare_2));
-				break;
-
-			case ADC_COMPARE_RANGE_EXCLUSIVE_INSIDE:
-				adc->CV1 = ADC_CV1_CV(MAX(config->compare_1, config->compare_2));
-				adc->CV2 = ADC_CV2_CV(MIN(config->compare_1, config->compare_2));
-				break;
-
-			case ADC_COMPARE_GREATER:
-				adc->CV1 = ADC_CV1_CV(MAX(config->compare_1, config->compare_2));
-				break;
-
-			case ADC_COMPARE_RANGE_INCLUSIVE_INSIDE:
-				adc->CV1 = ADC_CV1_CV(MIN(config->compare_1, config->compare_2));
-				adc->CV2 = ADC_CV2_CV(MAX(config->compare_1, config->compare_2));
-				break;
-
-			case ADC_COMPARE_RANGE_EXCLUSIVE_OUTSIDE:
-				adc->CV1 = ADC_CV1_CV(MIN(config->compare_1, config->compare_2));
-				adc->CV2 = ADC_CV2_CV(MAX(config->compare_1, config->compare_2));
-				break;
-
-			case ADC_COMPARE_RANGE_INCLUSIVE_OUTSIDE:
-				adc->CV1 = ADC_CV1_CV(MAX(config->compare_1, config->compare_2));
-				adc->CV2 = ADC_CV2_CV(MIN(config->compare_1, config->compare_2));
-				break;
-		}
+		// Same images a compile time setup gets, built from the config
+		adc_image image = ADC_IMAGE(config->adc, config->interrupt, config->channel, config->low_power, config->clock,
+									config->clock_div, config->sample_cycle_add, config->bits, config->avg_samps, config->mux,
+									config->async_state, config->compare_mode, config->compare_1, config->compare_2,
+									config->trigger, config->dma_mode, config->ref_volt, config->continuous, config->port,
+									config->pin_1, config->pin_2);
+		ret = adc_init_image(&image);
+	}
 
-		// Calibrate
-		adc->SC3 |= ADC_SC3_CAL(1);
-		while(!(*(adc->SC1) & ADC_SC1_COCO_MASK));	// Wait for cal to complete
+	return ret;
+}
 
-		// Check for Failure
-		if(adc->SC3 & ADC_SC3_CALF_MASK)
-		{
-			ret = ADC_ERROR_FAILED_CAL;
-		}
-		else
+// Initialize the ADC from prebuilt register images (checked by ADC_IMAGE_ASSERT, only calibration can fail)
+adc_error adc_init_image(const adc_image* image)
+{
+	// Init Variables
+	adc_error ret = ADC_ERROR_SUCCESS;
+
+	// Easy Read Address
+	ADC_Type* adc = image->adc;
+
+	// GPIO Setup
+	clock_ip_name_t kclock = ((((uint32_t)(image->port)) >> 12) & 0xFU) + 0x10380000U;
+	CLOCK_EnableClock(kclock);
+	PORT_SetPinMux(image->port, image->pin_1, kPORT_PinDisabledOrAnalog);
+	PORT_SetPinMux(image->port, image->pin_2, kPORT_PinDisabledOrAnalog);
+
+	// Enable Clock To Peripheral
+	CLOCK_EnableClock(kCLOCK_Adc0);
+
+	// Configuration, ADTRG is left for after calibration
+	adc->CFG1 = image->cfg1;
+	adc->CFG2 = image->cfg2;
+	adc->SC2 = image->sc2;
+	adc->SC3 = image->sc3;
+	adc->CV1 = image->cv1;
+	adc->CV2 = image->cv2;
+
+	// Calibrate
+	bme_or32(&adc->SC3, ADC_SC3_CAL_MASK);
+	while(!(*(adc->SC1) & ADC_SC1_COCO_MASK));	// Wait for cal to complete
+
+	// Check for Failure
+	if(adc->SC3 & ADC_SC3_CALF_MASK)
+	{
+		ret = ADC_ERROR_FAILED_CAL;
+	}
+	else
+	{
+		// Set up Interrupt Flag, Trigger
+		if(image->irq)
 		{
-			// Set up Interrupt Flag, Trigger
-			if(config->interrupt == ADC_INT_ON_COMPLETE)
-			{
-				adc->SC2 |= ADC_SC2_ADTRG(config->trigger);
-				NVIC_EnableIRQ(ADC0_IRQn);
-			}
-
-			// SC1 set channel (also starts conversion)
-			adc->SC1[0] = 	ADC_SC1_ADCH_DIFF(config->channel) |
-							ADC_SC1_AIEN(config->interrupt);
+			bme_or32(&adc->SC2, image->sc2_trigger);
+			NVIC_EnableIRQ(ADC0_IRQn);
 		}
+
+		// SC1 set channel (also starts conversion)
+		adc->SC1[0] = image->sc1;
 	}
 
 	return ret;
@@ -137,7 +106,7 @@ adc_error adc_init(adc_init_config* config)
 // Start an ADC Conversion - Only needed in single shot mode, init automatically starts continuous mode
 void adc_start_conversion(ADC_Type* adc, adc_mux_select mux, adc_channel channel)
 {
-	adc->SC1[mux] = ((adc->SC1[mux]) & ~(ADC_SC1_ADCH_MASK | ADC_SC1_DIFF_MASK)) | channel;
+	bme_bfi32(&adc->SC1[mux], ADC_SC1_ADCH_SHIFT, 6, ADC_SC1_ADCH_DIFF(channel));		// ADCH and DIFF
 }
 
 // Get result blocking
@@ -218,6 +187,14 @@ uint32_t adc_sample_rate_calc(adc_init_config* config)
 	return sample_rate;
 }
 
+// Change hardware averaging on a running ADC (continuous conversion and DMA keep going)
+void adc_set_averaging(ADC_Type* adc, adc_samp_average avg_samps)
+{
+	// Leave CALF alone (w1c) and keep ADCO - not a BME insert, that writes a set CALF back and clears it
+	adc->SC3 = (adc->SC3 & ~(ADC_SC3_AVGS_MASK | ADC_SC3_AVGE_MASK | ADC_SC3_CALF_MASK)) |
+				ADC_SC3_AVG(avg_samps);
+}
+
 
 /* STATIC FUNCTION DEFINITIONS */
 
@@ -243,18 +220,10 @@ static bool adc_incompatible_mode(adc_channel channel, adc_bits bits)
 	// Initialize
 	bool ret = false;
 
-	if(channel != ADC_CHAN_DISABLED)	// If channel is disabled, don't bother checking mode
+	// Same test ADC_IMAGE_ASSERT makes at build time
+	if(!ADC_MODE_COMPATIBLE(channel, bits))
 	{
-		bool diff_mode = (bits >= 0x4U);	// Diff Modes, Diff Channels
-		bool diff_channel =((channel == ADC_CHAN_DAD0)			|
-							(channel == ADC_CHAN_DAD1)			|
-							(channel == ADC_CHAN_DAD2)			|
-							(channel == ADC_CHAN_DAD3)			|
-							(channel == ADC_CHAN_TEMP_DIFF)		|
-							(channel == ADC_CHAN_BANDGAP_DIFF)	|
-							(channel == ADC_CHAN_VREFSH_DIFF));
-
-		ret = !(diff_mode == diff_channel);
+		ret = true;
 	}
 
 	return ret;
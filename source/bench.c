@@ -0,0 +1,427 @@
+/*
+ * bench.c
+ *
+ *  Created on: Dec 17, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "bench.h"
+#include "cycle_counter.h"
+#include "peak_detect.h"
+#include "format.h"
+#include "goertzel.h"
+#include "placement.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+/* DEFINES AND STATIC DATA */
+#define BENCH_REPORT_BYTES		32
+#define BENCH_LINE_BYTES		128
+#define BENCH_BAR_SHIFT			8		// PRETTY_SCALE_SHIFT in main.c
+#define BENCH_BAR_BYTES			FORMAT_BAR_BYTES(BENCH_BAR_SHIFT)
+#define BENCH_FORMAT_CALLS		1024	// Keeps the slowest printf run inside one 24 bit SysTick wrap
+#define BENCH_TONE_COUNTS		{1, 2, 4, 8}
+#define BENCH_FFT_SIZE			64		// BUFF_HALF_SIZE
+#define BENCH_FFT_STAGES		6
+#define BENCH_SAMPLE_NAMES		{"int16", "uint16", "int32"}
+
+static int16_t bench_buffer_int16[BENCH_MAX_BLOCK];
+static uint16_t bench_buffer_uint16[BENCH_MAX_BLOCK];
+static int32_t bench_buffer_int32[BENCH_MAX_BLOCK];
+static char bench_report[BENCH_REPORT_BYTES];
+static char bench_bar[BENCH_BAR_BYTES];
+static char bench_line[BENCH_LINE_BYTES];
+static void (*bench_write)(const char* text, size_t length);
+static volatile uint16_t bench_sink;
+static int32_t bench_fft_re[BENCH_FFT_SIZE];
+static int32_t bench_fft_im[BENCH_FFT_SIZE];
+static int16_t bench_twiddle_cos[BENCH_FFT_SIZE / 2];
+static int16_t bench_twiddle_sin[BENCH_FFT_SIZE / 2];
+
+// Fit accumulators for one type/stage set across the block size sweep
+typedef struct
+{
+	int64_t n;
+	int64_t sum_b;
+	int64_t sum_c;
+	int64_t sum_bb;
+	int64_t sum_bc;
+} bench_fit;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void bench_fill(void);
+static uint16_t bench_max_uint16(uint16_t* buffer, uint8_t buffer_size);
+static uint16_t bench_max_int32(int32_t* buffer, uint8_t buffer_size);
+static uint32_t bench_point(bench_config* config, bench_sample_type type, uint8_t stages, uint8_t block_size);
+static void bench_format(void);
+static void bench_tones(bench_config* config);
+static void bench_fft(int16_t* input);
+static uint32_t bench_sqrt(uint32_t value);
+static void bench_print(const char* format, ...);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Sweep block size x sample type x stages, print CSV rows (point rows, a per sample/per block fit, printf vs format.c, tones)
+bench_error bench_run(bench_config* config)
+{
+	bench_error ret = BENCH_ERROR_SUCCESS;
+
+	if(config == NULL)
+	{
+		ret = BENCH_ERROR_NULL_PTR;
+	}
+	else if((config->sample_rate == 0) | (config->samples_per_point < BENCH_MAX_BLOCK))
+	{
+		ret = BENCH_ERROR_BAD_CONFIG;
+	}
+	else
+	{
+		uint8_t block_sizes[] = BENCH_BLOCK_SIZES;
+		uint8_t stage_sets[] = BENCH_STAGE_SETS;
+		const char* type_names[] = BENCH_SAMPLE_NAMES;
+		uint32_t hz = cycle_counter_hz();
+
+		bench_write = config->write;
+		cycle_counter_init();
+		bench_fill();
+
+		bench_print("config,unit=%s,counter_hz=%u,sample_rate=%u,samples_per_point=%u,hot_path=%s\n",
+				CYCLE_COUNTER_UNIT, (unsigned)hz, (unsigned)config->sample_rate, (unsigned)config->samples_per_point,
+				PLACEMENT_NAME);
+		bench_print("point,type,stages,block,per_block,per_sample_x1000,isr_count,isr_per_s,latency_us\n");
+
+		for(uint8_t type = 0; type < BENCH_SAMPLE_TYPES; type++)
+		{
+			for(uint8_t s = 0; s < sizeof(stage_sets); s++)
+			{
+				bench_fit fit = {0};
+
+				for(uint8_t b = 0; b < sizeof(block_sizes); b++)
+				{
+					uint8_t block = block_sizes[b];
+					uint32_t per_block = bench_point(config, (bench_sample_type)type, stage_sets[s], block);
+
+					// One ISR per block, latency is filling the block plus processing it
+					uint32_t isr_count = config->samples_per_point / block;
+					uint32_t isr_per_s = config->sample_rate / block;
+					uint32_t latency_us = (uint32_t)(((uint64_t)block * 1000000U) / config->sample_rate) +
+											(uint32_t)(((uint64_t)per_block * 1000000U) / hz);
+
+					bench_print("point,%s,%u,%u,%u,%u,%u,%u,%u\n", type_names[type], stage_sets[s], block,
+							(unsigned)per_block, (unsigned)((per_block * 1000U) / block),
+							(unsigned)isr_count, (unsigned)isr_per_s, (unsigned)latency_us);
+
+					fit.n++;
+					fit.sum_b += block;
+					fit.sum_c += per_block;
+					fit.sum_bb += (int64_t)block * block;
+					fit.sum_bc += (int64_t)block * per_block;
+				}
+
+				// Least squares per_block = overhead + block * per_sample
+				int64_t denominator = (fit.n * fit.sum_bb) - (fit.sum_b * fit.sum_b);
+				int64_t slope_x1000 = ((fit.n * fit.sum_bc - fit.sum_b * fit.sum_c) * 1000) / denominator;
+				int64_t overhead = ((fit.sum_c * 1000) - (slope_x1000 * fit.sum_b)) / (fit.n * 1000);
+
+				bench_print("fit,%s,%u,per_sample_x1000=%d,per_block_overhead=%d\n", type_names[type], stage_sets[s],
+						(int)slope_x1000, (int)overhead);
+			}
+		}
+
+		bench_format();
+		bench_tones(config);
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Same noisy ramp in every container so every type does the same compares
+static void bench_fill(void)
+{
+	uint32_t lfsr = 0xACE1U;
+
+	for(uint8_t i = 0; i < BENCH_MAX_BLOCK; i++)
+	{
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1U) & 0xB400U);
+		int16_t sample = (int16_t)((i * 256) + (lfsr & 0xFFU) - 32768);
+
+		bench_buffer_int16[i] = sample;
+		bench_buffer_uint16[i] = (uint16_t)(sample + 32768);
+		bench_buffer_int32[i] = sample;
+	}
+}
+
+// Single ended samples, mid scale is zero
+static uint16_t bench_max_uint16(uint16_t* buffer, uint8_t buffer_size)
+{
+	uint16_t max = 0;
+	for(uint16_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
+	{
+		uint16_t sample_abs = abs((int32_t)*ptr - 32768);
+		if(sample_abs > max)
+		{
+			max = sample_abs;
+		}
+	}
+
+	return max;
+}
+
+// 32 bit containers, no sign extension on load
+static uint16_t bench_max_int32(int32_t* buffer, uint8_t buffer_size)
+{
+	uint16_t max = 0;
+	for(int32_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
+	{
+		uint16_t sample_abs = abs(*ptr);
+		if(sample_abs > max)
+		{
+			max = sample_abs;
+		}
+	}
+
+	return max;
+}
+
+// Run samples_per_point samples through the stages in blocks, return counts per block
+static uint32_t bench_point(bench_config* config, bench_sample_type type, uint8_t stages, uint8_t block_size)
+{
+	uint32_t blocks = config->samples_per_point / block_size;
+	peak_state peak;
+	peak_state_reset(&peak);
+	uint32_t start = cycle_counter_now();
+
+	for(uint32_t b = 0; b < blocks; b++)
+	{
+		uint16_t value = 0;
+		uint16_t centi_db = 0;
+
+		switch(type)
+		{
+			case BENCH_SAMPLE_INT16:
+				value = peak_block_max(bench_buffer_int16, block_size);
+				break;
+			case BENCH_SAMPLE_UINT16:
+				value = bench_max_uint16(bench_buffer_uint16, block_size);
+				break;
+			default:
+				value = bench_max_int32(bench_buffer_int32, block_size);
+				break;
+		}
+
+		if(stages & BENCH_STAGE_PEAK)
+		{
+			value = peak_hold(&peak, value, config->decay_shift);
+		}
+		if(stages & BENCH_STAGE_DBFS)
+		{
+			centi_db = dbfs_output(value);
+			bench_sink = centi_db;
+		}
+		if(stages & BENCH_STAGE_REPORT)
+		{
+			// Same text as the main.c report (held peak and its dBFS), formatted but not sent
+			bench_sink = format_report(bench_report, value, centi_db);
+		}
+		bench_sink = value;
+	}
+
+	return cycle_counter_elapsed(start) / blocks;
+}
+
+// Report and bar text through printf against the format.c path, print bytes made per 1000 counts
+static void bench_format(void)
+{
+	const char* layouts[] = {"report", "bar"};
+	const char* paths[] = {"printf", "fast"};
+	uint32_t calls = BENCH_FORMAT_CALLS;
+
+	bench_print("format,layout,path,calls,bytes,counts,bytes_per_kcount\n");
+
+	for(uint8_t layout = 0; layout < 2; layout++)
+	{
+		for(uint8_t path = 0; path < 2; path++)
+		{
+			uint32_t bytes = 0;
+			uint32_t start = cycle_counter_now();
+
+			// Walk the full dB range so short and long numbers and bars are all in the mix
+			for(uint32_t c = 0; c < calls; c++)
+			{
+				uint16_t peak = (uint16_t)abs(bench_buffer_int16[c % BENCH_MAX_BLOCK]);
+				uint16_t centi_db = (uint16_t)dbfs_output(peak);
+				uint16_t whole = centi_db / 100;
+
+				switch((layout << 1) | path)
+				{
+					case 0:
+						bytes += sprintf(bench_report, "ADC:%d - dBFS:-%d.%02d\n", peak, whole, centi_db - (whole * 100));
+						break;
+					case 1:
+						bytes += format_report(bench_report, peak, centi_db);
+						break;
+					case 2:
+						bytes += sprintf(bench_bar, "%0*d>\n", centi_db >> BENCH_BAR_SHIFT, 0);
+						break;
+					default:
+						bytes += format_bar(bench_bar, sizeof(bench_bar), centi_db, BENCH_BAR_SHIFT);
+						break;
+				}
+			}
+
+			uint32_t counts = cycle_counter_elapsed(start);
+			bench_print("format,%s,%s,%u,%u,%u,%u\n", layouts[layout], paths[path], (unsigned)calls, (unsigned)bytes,
+					(unsigned)counts, (unsigned)(((uint64_t)bytes * 1000U) / (counts ? counts : 1)));
+		}
+	}
+}
+
+// Goertzel bank against an FFT of the block plus the same tone bins, counts per block for 1..8 tones
+static void bench_tones(bench_config* config)
+{
+	uint8_t tone_counts[] = BENCH_TONE_COUNTS;
+	uint16_t amplitude[GOERTZEL_MAX_TONES];
+	goertzel_bank bank;
+	goertzel_config tone_fig = GOERTZEL_CONFIG_DEFAULT;
+	uint32_t blocks = config->samples_per_point / BENCH_FFT_SIZE;
+
+	// Tones spread up the band
+	tone_fig.sample_rate = config->sample_rate;
+	for(uint8_t i = 0; i < GOERTZEL_MAX_TONES; i++)
+	{
+		tone_fig.frequencies[i] = (uint16_t)((config->sample_rate * (i + 1)) / ((GOERTZEL_MAX_TONES + 1) * 2));
+	}
+
+	for(uint8_t k = 0; k < (BENCH_FFT_SIZE / 2); k++)
+	{
+		float w = (2.0f * 3.14159265f * k) / BENCH_FFT_SIZE;
+		bench_twiddle_cos[k] = (int16_t)lroundf(cosf(w) * INT16_MAX);
+		bench_twiddle_sin[k] = (int16_t)lroundf(sinf(w) * INT16_MAX);
+	}
+
+	bench_print("tones,path,tone_count,block,per_block\n");
+
+	for(uint8_t t = 0; t < sizeof(tone_counts); t++)
+	{
+		tone_fig.tone_count = tone_counts[t];
+		goertzel_init(&bank, &tone_fig);
+
+		uint32_t start = cycle_counter_now();
+		for(uint32_t b = 0; b < blocks; b++)
+		{
+			goertzel_process_block(&bank, bench_buffer_int16, BENCH_FFT_SIZE, amplitude);
+			for(uint8_t i = 0; i < tone_counts[t]; i++)
+			{
+				bench_sink = dbfs_output(amplitude[i]);
+			}
+		}
+		bench_print("tones,goertzel,%u,%u,%u\n", tone_counts[t], BENCH_FFT_SIZE, (unsigned)(cycle_counter_elapsed(start) / blocks));
+
+		start = cycle_counter_now();
+		for(uint32_t b = 0; b < blocks; b++)
+		{
+			// The FFT is scaled by 1/N, a full scale sine leaves A/2 in its bin
+			bench_fft(bench_buffer_int16);
+			for(uint8_t i = 0; i < tone_counts[t]; i++)
+			{
+				uint8_t bin = (uint8_t)(((tone_fig.frequencies[i] * BENCH_FFT_SIZE) + (config->sample_rate / 2)) / config->sample_rate);
+				uint32_t power = (uint32_t)((bench_fft_re[bin] * bench_fft_re[bin]) + (bench_fft_im[bin] * bench_fft_im[bin]));
+				uint32_t peak = bench_sqrt(power) * 2U;
+				bench_sink = dbfs_output((peak > INT16_MAX) ? INT16_MAX : peak);
+			}
+		}
+		bench_print("tones,fft,%u,%u,%u\n", tone_counts[t], BENCH_FFT_SIZE, (unsigned)(cycle_counter_elapsed(start) / blocks));
+	}
+}
+
+// Radix 2 Q15 FFT of one BENCH_FFT_SIZE block, halved every stage so nothing overflows
+static void bench_fft(int16_t* input)
+{
+	for(uint8_t i = 0; i < BENCH_FFT_SIZE; i++)
+	{
+		uint8_t reversed = 0;
+		for(uint8_t bit = 0; bit < BENCH_FFT_STAGES; bit++)
+		{
+			reversed |= ((i >> bit) & 1U) << (BENCH_FFT_STAGES - 1 - bit);
+		}
+		bench_fft_re[reversed] = input[i];
+		bench_fft_im[reversed] = 0;
+	}
+
+	for(uint8_t half = 1; half < BENCH_FFT_SIZE; half <<= 1)
+	{
+		uint8_t step = BENCH_FFT_SIZE / (half * 2);
+
+		for(uint8_t base = 0; base < BENCH_FFT_SIZE; base += half * 2)
+		{
+			for(uint8_t k = 0; k < half; k++)
+			{
+				uint8_t a = base + k;
+				uint8_t b = a + half;
+				int32_t wr = bench_twiddle_cos[k * step];
+				int32_t wi = -bench_twiddle_sin[k * step];
+				int32_t tr = ((bench_fft_re[b] * wr) - (bench_fft_im[b] * wi)) >> 15;
+				int32_t ti = ((bench_fft_re[b] * wi) + (bench_fft_im[b] * wr)) >> 15;
+
+				bench_fft_re[b] = (bench_fft_re[a] - tr) >> 1;
+				bench_fft_im[b] = (bench_fft_im[a] - ti) >> 1;
+				bench_fft_re[a] = (bench_fft_re[a] + tr) >> 1;
+				bench_fft_im[a] = (bench_fft_im[a] + ti) >> 1;
+			}
+		}
+	}
+}
+
+// Integer square root, one result bit per pass
+static uint32_t bench_sqrt(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while(bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while(bit)
+	{
+		if(value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+// One CSV row to config->write, stdout without one
+static void bench_print(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(bench_line, sizeof(bench_line), format, args);
+	va_end(args);
+
+	length = MIN(MAX(length, 0), (int)sizeof(bench_line) - 1);
+	if(bench_write != NULL)
+	{
+		bench_write(bench_line, length);
+	}
+	else
+	{
+		fwrite(bench_line, 1, length, stdout);
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ * blockpool.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "blockpool.h"
+#include "placement.h"
+
+
+/* DEFINES AND STATIC DATA */
+#define BLOCKPOOL_MASK		(BLOCKPOOL_BLOCKS - 1)
+
+
+/* FUNCTION DEFINITIONS */
+
+// Carve the buffer into blocks, no consumers
+blockpool_error blockpool_init(blockpool* pool, blockpool_config* config)
+{
+	blockpool_error ret = BLOCKPOOL_ERROR_SUCCESS;
+
+	if(	(pool == NULL)				||
+		(config == NULL)			||
+		(config->buffer == NULL)	)
+	{
+		ret = BLOCKPOOL_ERROR_NULL_PTR;
+	}
+	else if(config->block_size == 0)
+	{
+		ret = BLOCKPOOL_ERROR_BLOCK_SIZE;
+	}
+	else
+	{
+		pool->config = *config;
+		for(uint8_t i = 0; i < BLOCKPOOL_BLOCKS; i++)
+		{
+			pool->blocks[i].samples = &config->buffer[i * config->block_size];
+			pool->blocks[i].count = 0;
+			pool->blocks[i].first_sample = 0;
+			pool->blocks[i].time = 0;
+			pool->blocks[i].sequence = 0;
+			pool->refs[i] = 0;
+		}
+		pool->consumer_count = 0;
+		pool->last_taken = 0;
+		pool->published = 0;
+		pool->overruns = 0;
+	}
+
+	return ret;
+}
+
+// Add a consumer before the DMA starts, it gets every block published from then on
+blockpool_error blockpool_subscribe(blockpool* pool, const char* name, uint8_t* consumer)
+{
+	blockpool_error ret = BLOCKPOOL_ERROR_SUCCESS;
+
+	if((pool == NULL) || (consumer == NULL))
+	{
+		ret = BLOCKPOOL_ERROR_NULL_PTR;
+	}
+	else if(pool->consumer_count >= BLOCKPOOL_CONSUMERS)
+	{
+		ret = BLOCKPOOL_ERROR_CONSUMERS;
+	}
+	else
+	{
+		blockpool_consumer* c = &pool->consumers[pool->consumer_count];
+		c->name = name;
+		c->head = 0;
+		c->tail = 0;
+		c->max_lag = 0;
+		c->dropped = 0;
+		c->released = 0;
+		*consumer = pool->consumer_count++;
+	}
+
+	return ret;
+}
+
+// ISR - a free block to arm after the one that just completed (exclude), or exclude itself on an overrun
+// Round robin from the last one taken, so with everyone keeping up the blocks fill in order
+HOT_PATH uint8_t blockpool_take(blockpool* pool, uint8_t exclude)
+{
+	for(uint8_t n = 1; n <= BLOCKPOOL_BLOCKS; n++)
+	{
+		uint8_t index = (pool->last_taken + n) & BLOCKPOOL_MASK;
+		if((index != exclude) && (pool->refs[index] == 0))
+		{
+			pool->last_taken = index;
+			return index;
+		}
+	}
+
+	// Every other block is held - the completed one is refilled and never published
+	pool->overruns++;
+	for(uint8_t c = 0; c < pool->consumer_count; c++)
+	{
+		blockpool_consumer* consumer = &pool->consumers[c];
+		consumer->dropped += (consumer->head != consumer->tail);
+	}
+
+	return exclude;
+}
+
+// ISR - hand a completed block to every consumer
+HOT_PATH void blockpool_publish(blockpool* pool, uint8_t index, uint8_t count, uint64_t first_sample, uint64_t time,
+								uint32_t sequence)
+{
+	blockpool_block* block = &pool->blocks[index];
+	block->count = count;
+	block->first_sample = first_sample;
+	block->time = time;
+	block->sequence = sequence;
+
+	// Set before any consumer can see it
+	pool->refs[index] = pool->consumer_count;
+
+	for(uint8_t c = 0; c < pool->consumer_count; c++)
+	{
+		blockpool_consumer* consumer = &pool->consumers[c];
+		uint8_t head = consumer->head;
+		consumer->queue[head & BLOCKPOOL_MASK] = index;
+		consumer->head = head + 1;
+
+		uint8_t lag = (uint8_t)(consumer->head - consumer->tail);
+		consumer->max_lag = (lag > consumer->max_lag) ? lag : consumer->max_lag;
+	}
+	pool->published++;
+}
+
+// Consumer - oldest block not yet released (NULL when caught up)
+HOT_PATH blockpool_block* blockpool_peek(blockpool* pool, uint8_t consumer)
+{
+	blockpool_consumer* c = &pool->consumers[consumer];
+	uint8_t tail = c->tail;
+
+	return (c->head != tail) ? &pool->blocks[c->queue[tail & BLOCKPOOL_MASK]] : NULL;
+}
+
+// Consumer - release the oldest block, the DMA can have it once the last consumer lets go
+HOT_PATH void blockpool_release(blockpool* pool, uint8_t consumer)
+{
+	blockpool_consumer* c = &pool->consumers[consumer];
+	uint8_t tail = c->tail;
+
+	if(c->head != tail)
+	{
+		pool->refs[c->queue[tail & BLOCKPOOL_MASK]]--;
+		c->tail = tail + 1;
+		c->released++;
+	}
+}
+
+// Blocks a consumer is holding
+uint8_t blockpool_lag(blockpool* pool, uint8_t consumer)
+{
+	return (uint8_t)(pool->consumers[consumer].head - pool->consumers[consumer].tail);
+}
@@ -0,0 +1,144 @@
+/*
+ * blocksize.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "blocksize.h"
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint8_t blocksize_latency_size(blocksize_handle* sizer);
+static uint32_t blocksize_missed(blocksize_handle* sizer);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Start at the latency size
+blocksize_error blocksize_init(blocksize_handle* sizer, blocksize_config* config)
+{
+	blocksize_error ret = BLOCKSIZE_ERROR_SUCCESS;
+
+	if(	(sizer == NULL)						||
+		(config == NULL)					||
+		(config->acquire == NULL)			||
+		(config->processed_blocks == NULL)	)
+	{
+		ret = BLOCKSIZE_ERROR_NULL_PTR;
+	}
+	else if((config->min_size == 0) || (config->min_size > config->acquire->config.block_size))
+	{
+		ret = BLOCKSIZE_ERROR_SIZE;
+	}
+	else
+	{
+		sizer->config = *config;
+		sizer->latency_size = blocksize_latency_size(sizer);
+		sizer->load = 0;
+		sizer->missed = blocksize_missed(sizer);
+		sizer->hold = config->hold_blocks;
+		sizer->grows = 0;
+		sizer->shrinks = 0;
+
+		acquire_set_block_size(config->acquire, sizer->latency_size);
+	}
+
+	return ret;
+}
+
+// Account for one processed block and pick the size of the next re-arm (call when the block is done)
+// How far the next half has filled by now is the lag - at 100% the main loop is a whole block behind
+void blocksize_block(blocksize_handle* sizer)
+{
+	acquire_handle* acquire = sizer->config.acquire;
+	bool filling = acquire->active;
+	uint8_t armed = acquire->armed[filling];
+	uint8_t size = acquire->block_size;
+	uint8_t max_size = acquire->config.block_size;
+	uint32_t missed = blocksize_missed(sizer);
+
+	sizer->load = armed ? (uint8_t)((acquire_landed(acquire, filling) * 100U) / armed) : 0;
+	sizer->latency_size = blocksize_latency_size(sizer);
+	bool behind = (missed > sizer->missed) || (sizer->load >= sizer->config.grow_percent);
+	sizer->missed = missed;
+
+	if(!sizer->config.automatic)
+	{
+		return;
+	}
+
+	if(behind && (size < max_size))
+	{
+		size = ((size * 2) < max_size) ? (size * 2) : max_size;
+		sizer->hold = sizer->config.hold_blocks;
+		sizer->grows++;
+	}
+	else if(behind)
+	{
+		sizer->hold = sizer->config.hold_blocks;
+	}
+	else if(sizer->hold > 0)
+	{
+		sizer->hold--;
+	}
+	else if((size > sizer->latency_size) && (sizer->load < sizer->config.shrink_percent))
+	{
+		size /= 2;
+		size = (size < sizer->latency_size) ? sizer->latency_size : size;
+		sizer->hold = sizer->config.hold_blocks;
+		sizer->shrinks++;
+	}
+	else if(size < sizer->latency_size)
+	{
+		// Latency target or rate moved
+		size = sizer->latency_size;
+	}
+
+	if(size != acquire->block_size)
+	{
+		acquire_set_block_size(acquire, size);
+	}
+}
+
+// Hold a size (the shell's manual override), automatic off
+blocksize_error blocksize_set(blocksize_handle* sizer, uint8_t size)
+{
+	blocksize_error ret = BLOCKSIZE_ERROR_SUCCESS;
+
+	if(acquire_set_block_size(sizer->config.acquire, size) != ACQUIRE_ERROR_SUCCESS)
+	{
+		ret = BLOCKSIZE_ERROR_SIZE;
+	}
+	else
+	{
+		sizer->config.automatic = false;
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Largest power of 2 block down from the acquire half that fills inside latency_us, min_size if none does
+static uint8_t blocksize_latency_size(blocksize_handle* sizer)
+{
+	uint32_t sample_rate = sizer->config.acquire->config.sample_rate;
+	uint8_t size = sizer->config.acquire->config.block_size;
+
+	while(	(size > sizer->config.min_size)																&&
+			(((uint64_t)size * 1000000U) > ((uint64_t)sizer->config.latency_us * sample_rate))	)
+	{
+		size /= 2;
+	}
+
+	return (size < sizer->config.min_size) ? sizer->config.min_size : size;
+}
+
+// Blocks the DMA finished that the main loop has not picked up
+static uint32_t blocksize_missed(blocksize_handle* sizer)
+{
+	return sizer->config.acquire->blocks - *sizer->config.processed_blocks;
+}
@@ -0,0 +1,614 @@
+/*
+ * capture.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "capture.h"
+#include <string.h>
+
+#if !defined(__arm__)
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* DEFINES AND STATIC DATA */
+#define CAPTURE_PAD(bytes)		(((bytes) + (CAPTURE_ALIGN - 1)) & ~(uint64_t)(CAPTURE_ALIGN - 1))
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint8_t* capture_put(uint8_t* ptr, uint32_t value, uint8_t bytes);
+static uint32_t capture_get(const uint8_t* ptr, uint8_t bytes);
+
+#if !defined(__arm__)
+_Static_assert(sizeof(capture_file_header) == CAPTURE_HEADER_BYTES, "capture header is not CAPTURE_HEADER_BYTES");
+_Static_assert(sizeof(capture_chunk_header) == CAPTURE_CHUNK_HEADER_BYTES, "chunk header is not its slot");
+_Static_assert((CAPTURE_HEADER_BYTES % CAPTURE_ALIGN) == 0, "the first chunk has to start aligned");
+
+static capture_error capture_write(int fd, const void* data, size_t bytes, uint64_t offset);
+static capture_error capture_map(capture_reader* reader);
+static capture_error capture_scan(capture_reader* reader);
+static uint64_t capture_bisect(const capture_reader* reader, size_t field, uint64_t value);
+#endif
+
+
+/* FUNCTION DEFINITIONS */
+
+// Fill an info from the running ADC setup
+void capture_info_from_adc(capture_info* info, adc_init_config* adc, uint32_t sample_rate, uint16_t block_size)
+{
+	memset(info, 0, sizeof(*info));
+	info->source = CAPTURE_SOURCE_FIRMWARE;
+	info->sample_rate = sample_rate;
+	info->block_size = block_size;
+	info->channel = (uint8_t)adc->channel;
+	info->bits = (uint8_t)adc->bits;
+	info->avg_samps = (uint8_t)adc->avg_samps;
+	info->clock = (uint8_t)adc->clock;
+	info->clock_div = (uint8_t)adc->clock_div;
+	info->sample_cycle_add = (uint8_t)adc->sample_cycle_add;
+	info->low_power = (uint8_t)adc->low_power;
+	info->mux = (uint8_t)adc->mux;
+	info->async_state = (uint8_t)adc->async_state;
+	info->ref_volt = (uint8_t)adc->ref_volt;
+	info->continuous = (uint8_t)adc->continuous;
+	info->trigger = (uint8_t)adc->trigger;
+	info->compare_mode = (uint8_t)adc->compare_mode;
+	info->compare_1 = adc->compare_1;
+	info->compare_2 = adc->compare_2;
+}
+
+// version source rate(4) block(2) 13 ADC bytes compare_1(2) compare_2(2), zero padded to CAPTURE_INFO_BYTES
+uint16_t capture_info_pack(const capture_info* info, uint8_t* payload)
+{
+	uint8_t* ptr = payload;
+
+	*ptr++ = CAPTURE_INFO_VERSION;
+	*ptr++ = (uint8_t)info->source;
+	ptr = capture_put(ptr, info->sample_rate, 4);
+	ptr = capture_put(ptr, info->block_size, 2);
+	*ptr++ = info->channel;
+	*ptr++ = info->bits;
+	*ptr++ = info->avg_samps;
+	*ptr++ = info->clock;
+	*ptr++ = info->clock_div;
+	*ptr++ = info->sample_cycle_add;
+	*ptr++ = info->low_power;
+	*ptr++ = info->mux;
+	*ptr++ = info->async_state;
+	*ptr++ = info->ref_volt;
+	*ptr++ = info->continuous;
+	*ptr++ = info->trigger;
+	*ptr++ = info->compare_mode;
+	ptr = capture_put(ptr, info->compare_1, 2);
+	ptr = capture_put(ptr, info->compare_2, 2);
+	while(ptr < &payload[CAPTURE_INFO_BYTES])
+	{
+		*ptr++ = 0;
+	}
+
+	return CAPTURE_INFO_BYTES;
+}
+
+bool capture_info_unpack(const uint8_t* payload, uint16_t length, capture_info* info)
+{
+	bool ret = false;
+
+	if((length >= CAPTURE_INFO_BYTES) && (payload[0] == CAPTURE_INFO_VERSION))
+	{
+		const uint8_t* ptr = &payload[1];
+		info->source = (capture_source)*ptr++;
+		info->sample_rate = capture_get(ptr, 4);
+		ptr += 4;
+		info->block_size = (uint16_t)capture_get(ptr, 2);
+		ptr += 2;
+		info->channel = *ptr++;
+		info->bits = *ptr++;
+		info->avg_samps = *ptr++;
+		info->clock = *ptr++;
+		info->clock_div = *ptr++;
+		info->sample_cycle_add = *ptr++;
+		info->low_power = *ptr++;
+		info->mux = *ptr++;
+		info->async_state = *ptr++;
+		info->ref_volt = *ptr++;
+		info->continuous = *ptr++;
+		info->trigger = *ptr++;
+		info->compare_mode = *ptr++;
+		info->compare_1 = (uint16_t)capture_get(ptr, 2);
+		info->compare_2 = (uint16_t)capture_get(&ptr[2], 2);
+		ret = true;
+	}
+
+	return ret;
+}
+
+#if !defined(__arm__)
+
+// Writer - create (truncates), header goes out straight away so a reader can open it before the first chunk
+capture_error capture_create(capture_writer* writer, capture_writer_config* config)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if(	(writer == NULL)			||
+		(config == NULL)			||
+		(config->path == NULL)		)
+	{
+		ret = CAPTURE_ERROR_NULL_PTR;
+	}
+	else if(config->chunk_samples == 0)
+	{
+		ret = CAPTURE_ERROR_RANGE;
+	}
+	else
+	{
+		memset(writer, 0, sizeof(*writer));
+		memcpy(writer->header.magic, CAPTURE_MAGIC, sizeof(writer->header.magic));
+		writer->header.version = CAPTURE_VERSION;
+		writer->header.header_bytes = CAPTURE_HEADER_BYTES;
+		writer->header.chunk_samples = config->chunk_samples;
+		writer->header.committed = CAPTURE_HEADER_BYTES;
+		if(config->info)
+		{
+			capture_info_pack(config->info, writer->header.info);
+		}
+		writer->offset = CAPTURE_HEADER_BYTES;
+		writer->pending = malloc(config->chunk_samples * sizeof(int16_t));
+
+		writer->fd = open(config->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if((writer->fd < 0) || (writer->pending == NULL))
+		{
+			ret = CAPTURE_ERROR_IO;
+		}
+		else
+		{
+			ret = capture_write(writer->fd, &writer->header, sizeof(writer->header), 0);
+		}
+	}
+
+	return ret;
+}
+
+// Rewrite the info in the header (the firmware's info frame can turn up after the first samples)
+capture_error capture_set_info(capture_writer* writer, const capture_info* info)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if((writer == NULL) || (info == NULL))
+	{
+		ret = CAPTURE_ERROR_NULL_PTR;
+	}
+	else
+	{
+		capture_info_pack(info, writer->header.info);
+		ret = capture_write(writer->fd, writer->header.info, CAPTURE_INFO_BYTES, offsetof(capture_file_header, info));
+	}
+
+	return ret;
+}
+
+// Collect samples into chunks, a jump in the firmware index starts a new chunk
+capture_error capture_append(capture_writer* writer, const int16_t* samples, uint32_t count, uint64_t first_sample,
+								uint64_t time_ns)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if(writer->pending_count && (first_sample != (writer->chunk.first_sample + writer->pending_count)))
+	{
+		ret = capture_flush(writer);
+	}
+
+	while(count && (ret == CAPTURE_ERROR_SUCCESS))
+	{
+		if(writer->pending_count == 0)
+		{
+			// Times never go backwards, so a host clock step cannot break the bisection
+			writer->chunk.first_sample = first_sample;
+			writer->chunk.time_ns = (time_ns > writer->last_time_ns) ? time_ns : writer->last_time_ns;
+			writer->chunk.position = writer->samples;
+		}
+
+		uint32_t take = writer->header.chunk_samples - writer->pending_count;
+		take = (count < take) ? count : take;
+		memcpy(&writer->pending[writer->pending_count], samples, take * sizeof(int16_t));
+		writer->pending_count += take;
+		samples += take;
+		first_sample += take;
+		count -= take;
+
+		if(writer->pending_count == writer->header.chunk_samples)
+		{
+			ret = capture_flush(writer);
+		}
+	}
+
+	return ret;
+}
+
+// Write the collected chunk, then move the committed mark past it (readers only go as far as the mark)
+capture_error capture_flush(capture_writer* writer)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if(writer->pending_count)
+	{
+		uint64_t sample_bytes = writer->pending_count * sizeof(int16_t);
+		uint64_t padded = CAPTURE_PAD(sample_bytes);
+		static const uint8_t zeros[CAPTURE_ALIGN] = {0};
+
+		writer->chunk.magic = CAPTURE_CHUNK_MAGIC;
+		writer->chunk.count = writer->pending_count;
+		ret = capture_write(writer->fd, &writer->chunk, sizeof(writer->chunk), writer->offset);
+		if(ret == CAPTURE_ERROR_SUCCESS)
+		{
+			ret = capture_write(writer->fd, writer->pending, sample_bytes, writer->offset + CAPTURE_CHUNK_HEADER_BYTES);
+		}
+		if((ret == CAPTURE_ERROR_SUCCESS) && (padded != sample_bytes))
+		{
+			ret = capture_write(writer->fd, zeros, padded - sample_bytes,
+								writer->offset + CAPTURE_CHUNK_HEADER_BYTES + sample_bytes);
+		}
+
+		if(writer->chunk_count >= writer->index_capacity)
+		{
+			writer->index_capacity = writer->index_capacity ? (writer->index_capacity * 2) : 1024;
+			writer->index = realloc(writer->index, writer->index_capacity * sizeof(capture_index_entry));
+		}
+		if(writer->index == NULL)
+		{
+			ret = CAPTURE_ERROR_IO;
+		}
+
+		if(ret == CAPTURE_ERROR_SUCCESS)
+		{
+			writer->index[writer->chunk_count++] = (capture_index_entry){writer->chunk.first_sample,
+												writer->chunk.time_ns, writer->chunk.position, writer->offset};
+			writer->offset += CAPTURE_CHUNK_HEADER_BYTES + padded;
+			writer->samples += writer->pending_count;
+			writer->last_time_ns = writer->chunk.time_ns;
+			writer->pending_count = 0;
+
+			// One aligned 8 byte store in the page cache, a mapped reader sees the old mark or the new one
+			writer->header.committed = writer->offset;
+			ret = capture_write(writer->fd, &writer->header.committed, sizeof(writer->header.committed),
+								offsetof(capture_file_header, committed));
+		}
+	}
+
+	return ret;
+}
+
+// Last chunk, the trailing index, then the header that points at it
+capture_error capture_finish(capture_writer* writer)
+{
+	capture_error ret = capture_flush(writer);
+
+	if(ret == CAPTURE_ERROR_SUCCESS)
+	{
+		capture_index_header index = {CAPTURE_INDEX_MAGIC, 0, writer->chunk_count};
+		ret = capture_write(writer->fd, &index, sizeof(index), writer->offset);
+		if(ret == CAPTURE_ERROR_SUCCESS)
+		{
+			ret = capture_write(writer->fd, writer->index, writer->chunk_count * sizeof(capture_index_entry),
+								writer->offset + sizeof(index));
+		}
+		if(ret == CAPTURE_ERROR_SUCCESS)
+		{
+			writer->header.index_offset = writer->offset;
+			writer->header.chunk_count = writer->chunk_count;
+			writer->header.samples = writer->samples;
+			ret = capture_write(writer->fd, &writer->header, sizeof(writer->header), 0);
+		}
+	}
+
+	if(writer->fd >= 0)
+	{
+		close(writer->fd);
+	}
+	writer->fd = -1;
+	free(writer->pending);
+	free(writer->index);
+	writer->pending = NULL;
+	writer->index = NULL;
+
+	return ret;
+}
+
+// Reader - a closed capture uses its trailing index in place, a live one is walked chunk by chunk
+capture_error capture_open(capture_reader* reader, const char* path)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if((reader == NULL) || (path == NULL))
+	{
+		ret = CAPTURE_ERROR_NULL_PTR;
+	}
+	else
+	{
+		memset(reader, 0, sizeof(*reader));
+		reader->fd = open(path, O_RDONLY);
+		ret = (reader->fd < 0) ? CAPTURE_ERROR_IO : capture_map(reader);
+
+		if(ret == CAPTURE_ERROR_SUCCESS)
+		{
+			const capture_file_header* header = reader->header;
+			if(	memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic))	||
+				(header->version != CAPTURE_VERSION)						||
+				(header->header_bytes != CAPTURE_HEADER_BYTES)				)
+			{
+				ret = CAPTURE_ERROR_FORMAT;
+			}
+			else
+			{
+				reader->scanned_to = CAPTURE_HEADER_BYTES;
+				ret = capture_refresh(reader);
+			}
+		}
+
+		if(ret != CAPTURE_ERROR_SUCCESS)
+		{
+			capture_close(reader);
+		}
+	}
+
+	return ret;
+}
+
+// Pick up the info and any chunks committed since the last call (remaps as the file grows, old slices go stale)
+capture_error capture_refresh(capture_reader* reader)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if(reader->closed)
+	{
+		return ret;
+	}
+
+	if(!capture_info_unpack(reader->header->info, CAPTURE_INFO_BYTES, &reader->info))
+	{
+		reader->info.source = CAPTURE_SOURCE_NONE;
+	}
+
+	uint64_t index_offset = *(volatile const uint64_t*)&reader->header->index_offset;
+	if(index_offset)
+	{
+		// Finished - map it all and switch to the trailing index
+		ret = capture_map(reader);
+		const capture_index_header* index = (const capture_index_header*)&reader->map[index_offset];
+		if(	(ret == CAPTURE_ERROR_SUCCESS)												&&
+			(	((index_offset + sizeof(*index)) > reader->map_bytes)					||
+				(index->magic != CAPTURE_INDEX_MAGIC)									||
+				((index_offset + sizeof(*index) + (index->count * sizeof(capture_index_entry))) > reader->map_bytes)))
+		{
+			ret = CAPTURE_ERROR_FORMAT;
+		}
+		if(ret == CAPTURE_ERROR_SUCCESS)
+		{
+			reader->index = (const capture_index_entry*)&index[1];
+			reader->chunk_count = index->count;
+			reader->samples = reader->header->samples;
+			reader->closed = true;
+			free(reader->scanned);
+			reader->scanned = NULL;
+		}
+	}
+	else
+	{
+		ret = capture_scan(reader);
+	}
+
+	return ret;
+}
+
+void capture_close(capture_reader* reader)
+{
+	if(reader->map)
+	{
+		munmap((void*)reader->map, reader->map_bytes);
+	}
+	if(reader->fd >= 0)
+	{
+		close(reader->fd);
+	}
+	free(reader->scanned);
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = -1;
+}
+
+// Chunk holding a firmware sample index / a stored position / the time (the last chunk starting at or before it)
+uint64_t capture_seek_sample(const capture_reader* reader, uint64_t sample)
+{
+	return capture_bisect(reader, offsetof(capture_index_entry, first_sample), sample);
+}
+
+uint64_t capture_seek_position(const capture_reader* reader, uint64_t position)
+{
+	return capture_bisect(reader, offsetof(capture_index_entry, position), position);
+}
+
+uint64_t capture_seek_time(const capture_reader* reader, uint64_t time_ns)
+{
+	return capture_bisect(reader, offsetof(capture_index_entry, time_ns), time_ns);
+}
+
+// One chunk's samples where they lie in the map
+capture_error capture_chunk(const capture_reader* reader, uint64_t chunk, capture_slice* slice)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+
+	if(chunk >= reader->chunk_count)
+	{
+		ret = CAPTURE_ERROR_RANGE;
+	}
+	else
+	{
+		const capture_index_entry* entry = &reader->index[chunk];
+		const capture_chunk_header* header = (const capture_chunk_header*)&reader->map[entry->offset];
+		slice->samples = (const int16_t*)&reader->map[entry->offset + CAPTURE_CHUNK_HEADER_BYTES];
+		slice->count = header->count;
+		slice->first_sample = entry->first_sample;
+		slice->time_ns = entry->time_ns;
+		slice->position = entry->position;
+	}
+
+	return ret;
+}
+
+#endif
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// LE field, byte at a time so any alignment works
+static uint8_t* capture_put(uint8_t* ptr, uint32_t value, uint8_t bytes)
+{
+	for(uint8_t i = 0; i < bytes; i++)
+	{
+		*ptr++ = (uint8_t)value;
+		value >>= 8;
+	}
+
+	return ptr;
+}
+
+static uint32_t capture_get(const uint8_t* ptr, uint8_t bytes)
+{
+	uint32_t value = 0;
+
+	for(uint8_t i = bytes; i > 0; i--)
+	{
+		value = (value << 8) | ptr[i - 1];
+	}
+
+	return value;
+}
+
+#if !defined(__arm__)
+
+static capture_error capture_write(int fd, const void* data, size_t bytes, uint64_t offset)
+{
+	const uint8_t* ptr = data;
+
+	while(bytes)
+	{
+		ssize_t written = pwrite(fd, ptr, bytes, (off_t)offset);
+		if(written <= 0)
+		{
+			return CAPTURE_ERROR_IO;
+		}
+		ptr += written;
+		bytes -= (size_t)written;
+		offset += (uint64_t)written;
+	}
+
+	return CAPTURE_ERROR_SUCCESS;
+}
+
+// Map the whole file as it is now (shared, so a live capture's new chunks and committed mark show through)
+static capture_error capture_map(capture_reader* reader)
+{
+	struct stat info;
+
+	if(fstat(reader->fd, &info) || (info.st_size < CAPTURE_HEADER_BYTES))
+	{
+		return (reader->map == NULL) ? CAPTURE_ERROR_FORMAT : CAPTURE_ERROR_IO;
+	}
+	if((size_t)info.st_size == reader->map_bytes)
+	{
+		return CAPTURE_ERROR_SUCCESS;
+	}
+
+	if(reader->map)
+	{
+		munmap((void*)reader->map, reader->map_bytes);
+	}
+	void* map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+	if(map == MAP_FAILED)
+	{
+		reader->map = NULL;
+		reader->map_bytes = 0;
+		return CAPTURE_ERROR_IO;
+	}
+	reader->map = map;
+	reader->map_bytes = (size_t)info.st_size;
+	reader->header = (const capture_file_header*)reader->map;
+	if(reader->closed)
+	{
+		reader->index = (const capture_index_entry*)&reader->map[reader->header->index_offset + sizeof(capture_index_header)];
+	}
+
+	return CAPTURE_ERROR_SUCCESS;
+}
+
+// Walk the chunks committed since the last walk into the reader's own index
+static capture_error capture_scan(capture_reader* reader)
+{
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+	uint64_t committed = *(volatile const uint64_t*)&reader->header->committed;
+
+	if(committed > reader->map_bytes)
+	{
+		ret = capture_map(reader);
+		committed = *(volatile const uint64_t*)&reader->header->committed;
+		committed = (committed > reader->map_bytes) ? reader->map_bytes : committed;
+	}
+
+	while((ret == CAPTURE_ERROR_SUCCESS) && ((reader->scanned_to + CAPTURE_CHUNK_HEADER_BYTES) <= committed))
+	{
+		const capture_chunk_header* chunk = (const capture_chunk_header*)&reader->map[reader->scanned_to];
+		uint64_t next = reader->scanned_to + CAPTURE_CHUNK_HEADER_BYTES + CAPTURE_PAD(chunk->count * sizeof(int16_t));
+		if((chunk->magic != CAPTURE_CHUNK_MAGIC) || (next > committed))
+		{
+			ret = CAPTURE_ERROR_FORMAT;
+			break;
+		}
+
+		if(reader->chunk_count >= reader->scanned_capacity)
+		{
+			reader->scanned_capacity = reader->scanned_capacity ? (reader->scanned_capacity * 2) : 1024;
+			reader->scanned = realloc(reader->scanned, reader->scanned_capacity * sizeof(capture_index_entry));
+			if(reader->scanned == NULL)
+			{
+				ret = CAPTURE_ERROR_IO;
+				break;
+			}
+		}
+		reader->scanned[reader->chunk_count++] = (capture_index_entry){chunk->first_sample, chunk->time_ns,
+																		chunk->position, reader->scanned_to};
+		reader->samples = chunk->position + chunk->count;
+		reader->scanned_to = next;
+	}
+	reader->index = reader->scanned;
+
+	return ret;
+}
+
+// Last entry whose field is at or below the value (0 if none is), fields only go up along the index
+static uint64_t capture_bisect(const capture_reader* reader, size_t field, uint64_t value)
+{
+	uint64_t low = 0;
+	uint64_t high = reader->chunk_count;
+
+	while((high - low) > 1)
+	{
+		uint64_t middle = low + ((high - low) / 2);
+		uint64_t key = *(const uint64_t*)((const uint8_t*)&reader->index[middle] + field);
+		if(key <= value)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+#endif
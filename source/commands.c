@@ -0,0 +1,501 @@
+/*
+ * commands.c
+ *
+ *  Created on: Dec 18, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "commands.h"
+#include "pipeline.h"
+#include "bench.h"
+#include "telemetry.h"
+#include "platform.h"
+#include "trace.h"
+#include <stdlib.h>
+
+/* DEFINES AND STATIC DATA */
+#define COMMANDS_AVERAGE_MODES		{ADC_SAMP_AVG_1, ADC_SAMP_AVG_4, ADC_SAMP_AVG_8, ADC_SAMP_AVG_16, ADC_SAMP_AVG_32}
+#define COMMANDS_TRIGGER_NAMES		{"level", "edge", "slope"}
+#define COMMANDS_EDGE_NAMES			{"rise", "fall", "both"}
+
+#define COMMANDS_LEVELS				{10, 50, 90}
+
+static commands_context context;
+static uint8_t commands_frame[TELEMETRY_FRAME_BYTES(TELEMETRY_INDEX_BYTES + HISTOGRAM_PACK_BYTES)];
+static uint8_t commands_frame_sequence = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void commands_help(uint8_t argc, char** argv);
+static void commands_get(uint8_t argc, char** argv);
+static void commands_set(uint8_t argc, char** argv);
+static void commands_bench(uint8_t argc, char** argv);
+static void commands_stats(uint8_t argc, char** argv);
+static void commands_hist(uint8_t argc, char** argv);
+static void commands_placr(uint8_t argc, char** argv);
+static void commands_gov(uint8_t argc, char** argv);
+static void commands_block(uint8_t argc, char** argv);
+static void commands_trace(uint8_t argc, char** argv);
+static bool commands_flag(uint8_t flag, char* value);
+static int8_t commands_lookup(const char* const* names, uint8_t count, char* value);
+static bool commands_number(char* value, long min, long max, long* number);
+
+static const shell_command commands_table[] =
+{
+	{"help",	"list commands",										commands_help},
+	{"get",		"show all settings",									commands_get},
+	{"set",		"set <decay|avg|text|pretty|raw|trig|edge|level|slope> <value>", commands_set},
+	{"bench",	"run the block size sweep (console, pauses processing)", commands_bench},
+	{"stats",	"dump counters",										commands_stats},
+	{"hist",	"hist [reset|frame] - L10/L50/L90, clear, or send a histogram frame", commands_hist},
+	{"placr",	"placr [profile|tune|save] - flash cache/speculation profiles", commands_placr},
+	{"gov",		"gov [auto|run|vlpr] - clock governor load, headroom and modelled energy", commands_gov},
+	{"block",	"block [auto|latency <us>|<size>] - adaptive block size, target and lag", commands_block},
+	{"trace",	"trace [arm|dump] - MTB branch capture of the ISR and block processing", commands_trace}
+};
+
+
+/* FUNCTION DEFINITIONS */
+
+// Register the application command table with the shell
+commands_error commands_init(commands_context* context_in, uint8_t* rx_ring, size_t rx_ring_size)
+{
+	commands_error ret = COMMANDS_ERROR_SUCCESS;
+
+	if(	(context_in == NULL)				||
+		(context_in->adc == NULL)			|
+		(context_in->report_flags == NULL)	|
+		(context_in->acquire == NULL)		|
+		(context_in->processed_blocks == NULL) |
+		(context_in->raw_dropped == NULL)	)
+	{
+		ret = COMMANDS_ERROR_NULL_PTR;
+	}
+	else
+	{
+		context = *context_in;
+
+		shell_config shell_fig = SHELL_CONFIG_DEFAULT;
+		shell_fig.commands = commands_table;
+		shell_fig.command_count = sizeof(commands_table) / sizeof(commands_table[0]);
+		shell_fig.rx_ring = rx_ring;
+		shell_fig.rx_ring_size = rx_ring_size;
+
+		if(shell_init(&shell_fig) != SHELL_ERROR_SUCCESS)
+		{
+			ret = COMMANDS_ERROR_SHELL;
+		}
+		shell_frame_replies(*context.report_flags & REPORT_RAW);
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+static void commands_help(uint8_t argc, char** argv)
+{
+	shell_help();
+}
+
+static void commands_get(uint8_t argc, char** argv)
+{
+	const char* const trigger_names[] = COMMANDS_TRIGGER_NAMES;
+	const char* const edge_names[] = COMMANDS_EDGE_NAMES;
+	uint8_t average_number[] = ADC_SAMP_AVERAGE_LUT;
+	pipeline_settings settings;
+	pipeline_get_settings(&settings);
+
+	shell_reply("decay %d\r\navg %d\r\nrate %d\r\n", settings.decay_shift,
+				average_number[context.adc->avg_samps], adc_sample_rate_calc(context.adc));
+	shell_reply("text %d\r\npretty %d\r\nraw %d\r\n", (*context.report_flags & REPORT_TEXT) != 0,
+				(*context.report_flags & REPORT_PRETTY) != 0, (*context.report_flags & REPORT_RAW) != 0);
+	shell_reply("trig %s\r\nedge %s\r\nlevel %d\r\nslope %d\r\n", trigger_names[settings.trigger_type],
+				edge_names[settings.trigger_edge], settings.trigger_level, settings.trigger_slope);
+}
+
+// Everything here runs from the main loop between blocks, so each change lands on a block boundary
+static void commands_set(uint8_t argc, char** argv)
+{
+	const char* const trigger_names[] = COMMANDS_TRIGGER_NAMES;
+	const char* const edge_names[] = COMMANDS_EDGE_NAMES;
+	bool ok = true;
+	pipeline_settings settings;
+	pipeline_get_settings(&settings);
+
+	if(argc != 3)
+	{
+		ok = false;
+	}
+	else if(strcmp(argv[1], "decay") == 0)
+	{
+		long value = 0;
+		ok = commands_number(argv[2], 0, 15, &value);
+		settings.decay_shift = (uint8_t)value;
+	}
+	else if(strcmp(argv[1], "avg") == 0)
+	{
+		// DMA and continuous conversion keep running, only the rate changes
+		adc_samp_average modes[] = COMMANDS_AVERAGE_MODES;
+		uint8_t average_number[] = ADC_SAMP_AVERAGE_LUT;
+		long value = strtol(argv[2], NULL, 0);
+		ok = false;
+		for(uint8_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+		{
+			if(average_number[modes[i]] == value)
+			{
+				adc_set_averaging(context.adc->adc, modes[i]);
+				context.adc->avg_samps = modes[i];
+				settings.sample_rate = adc_sample_rate_calc(context.adc);
+				acquire_set_rate(context.acquire, settings.sample_rate);
+				ok = true;
+			}
+		}
+	}
+	else if(strcmp(argv[1], "text") == 0)
+	{
+		ok = commands_flag(REPORT_TEXT, argv[2]);
+	}
+	else if(strcmp(argv[1], "pretty") == 0)
+	{
+		ok = commands_flag(REPORT_PRETTY, argv[2]);
+	}
+	else if(strcmp(argv[1], "raw") == 0)
+	{
+		// Report text in among the frames would cost the host frames, it goes off with raw on
+		ok = commands_flag(REPORT_RAW, argv[2]);
+		if(*context.report_flags & REPORT_RAW)
+		{
+			*context.report_flags &= ~(REPORT_TEXT | REPORT_PRETTY);
+		}
+	}
+	else if(strcmp(argv[1], "trig") == 0)
+	{
+		int8_t index = commands_lookup(trigger_names, 3, argv[2]);
+		ok = (index >= 0);
+		settings.trigger_type = (trigger_type)index;
+	}
+	else if(strcmp(argv[1], "edge") == 0)
+	{
+		int8_t index = commands_lookup(edge_names, 3, argv[2]);
+		ok = (index >= 0);
+		settings.trigger_edge = (trigger_edge)index;
+	}
+	else if(strcmp(argv[1], "level") == 0)
+	{
+		long value = 0;
+		ok = commands_number(argv[2], INT16_MIN, INT16_MAX, &value);
+		settings.trigger_level = (int16_t)value;
+	}
+	else if(strcmp(argv[1], "slope") == 0)
+	{
+		long value = 0;
+		ok = commands_number(argv[2], 1, INT16_MAX, &value);
+		settings.trigger_slope = (int16_t)value;
+	}
+	else
+	{
+		ok = false;
+	}
+
+	// Text and pretty cannot come on while raw is
+	if((*context.report_flags & REPORT_RAW) && (*context.report_flags & (REPORT_TEXT | REPORT_PRETTY)))
+	{
+		*context.report_flags &= ~(REPORT_TEXT | REPORT_PRETTY);
+		ok = false;
+	}
+
+	if(ok)
+	{
+		ok = (pipeline_set_settings(&settings) == PIPELINE_ERROR_SUCCESS);
+	}
+
+	// Replies share the UART with the raw frames, while the stream is on they go out as frames too
+	shell_frame_replies(*context.report_flags & REPORT_RAW);
+	shell_reply(ok ? "OK\r\n" : "ERR set\r\n");
+}
+
+// Blocking on purpose - the DMA keeps filling buffers, stats shows the blocks that were skipped
+static void commands_bench(uint8_t argc, char** argv)
+{
+	bench_config bench_fig = BENCH_CONFIG_DEFAULT;
+	bench_fig.sample_rate = adc_sample_rate_calc(context.adc);
+	bench_fig.write = context.write_wait;
+
+	shell_reply((bench_run(&bench_fig) == BENCH_ERROR_SUCCESS) ? "OK bench\r\n" : "ERR bench\r\n");
+}
+
+static void commands_stats(uint8_t argc, char** argv)
+{
+	uint32_t dma_blocks = context.acquire->blocks;
+	trigger_handle* trigger = pipeline_trigger();
+
+	shell_reply("dma_blocks %u\r\nprocessed %u\r\nmissed %u\r\n", (unsigned)dma_blocks,
+				(unsigned)*context.processed_blocks, (unsigned)(dma_blocks - *context.processed_blocks));
+	shell_reply("raw_dropped %u\r\ntriggers %u\r\nrx_overruns %u\r\ntext_dropped %u\r\n", (unsigned)*context.raw_dropped,
+				(unsigned)(trigger ? trigger->trigger_count : 0), (unsigned)uart_receive_overruns(),
+				(unsigned)uart_write_dropped());
+	shell_reply("dma_config_err %u\r\ndma_src_bus_err %u\r\ndma_dst_bus_err %u\r\ngap_samples %u\r\n",
+				(unsigned)context.acquire->errors[DMA_STATUS_CONFIG_ERROR], (unsigned)context.acquire->errors[DMA_STATUS_SOURCE_BUS_ERROR],
+				(unsigned)context.acquire->errors[DMA_STATUS_DEST_BUS_ERROR], (unsigned)context.acquire->gap_samples);
+	// 64 bit values split, the redlib integer printf has no %llu
+	uint64_t sample_index = acquire_read64(&context.acquire->next_sample);
+	uint64_t wall_ms = (acquire_read64(&context.acquire->wall_time) * 1000U) / context.acquire->wall_hz;
+	shell_reply("sample_index %u:%u\r\nwall_ms %u:%u\r\n", (unsigned)(sample_index >> 32), (unsigned)sample_index,
+				(unsigned)(wall_ms >> 32), (unsigned)wall_ms);
+	shell_reply("block_period %u\r\njitter %d min %d max %d\r\n", (unsigned)context.acquire->block_period,
+				(int)context.acquire->jitter_last, (int)context.acquire->jitter_min, (int)context.acquire->jitter_max);
+	shell_reply("irq_cycles %u max %u (%s)\r\n", (unsigned)context.acquire->irq_cycles,
+				(unsigned)context.acquire->irq_cycles_max, PLACEMENT_NAME);
+	shell_reply("commands %u\r\ncommand_errors %u\r\n", (unsigned)shell_command_count(), (unsigned)shell_error_count());
+
+	// Per consumer - blocks held now and at most, and the overruns it was holding blocks for
+	if(context.pool != NULL)
+	{
+		shell_reply("pool_published %u\r\npool_overruns %u\r\n", (unsigned)context.pool->published,
+					(unsigned)context.pool->overruns);
+		for(uint8_t c = 0; c < context.pool->consumer_count; c++)
+		{
+			blockpool_consumer* consumer = &context.pool->consumers[c];
+			shell_reply("%s lag %d max %d dropped %u\r\n", consumer->name, blockpool_lag(context.pool, c),
+						consumer->max_lag, (unsigned)consumer->dropped);
+		}
+	}
+}
+
+// Percentile levels on demand, worked out from the bins so nothing is stored per sample
+static void commands_hist(uint8_t argc, char** argv)
+{
+	histogram* hist = pipeline_histogram();
+	uint8_t levels[] = COMMANDS_LEVELS;
+
+	if(hist == NULL)
+	{
+		shell_reply("ERR histogram disabled\r\n");
+	}
+	else if(argc == 1)
+	{
+		for(uint8_t i = 0; i < sizeof(levels); i++)
+		{
+			uint16_t centi_db = dbfs_output(histogram_level(hist, levels[i]));
+			shell_reply("L%d -%d.%02d\r\n", levels[i], centi_db / 100, centi_db % 100);
+		}
+		shell_reply("count %u\r\n", (unsigned)hist->total);
+	}
+	else if(strcmp(argv[1], "reset") == 0)
+	{
+		histogram_reset(hist);
+		shell_reply("OK\r\n");
+	}
+	else if((strcmp(argv[1], "frame") == 0) && !uart_send_busy())
+	{
+		// The reply waits in the shell until this frame is out
+		uint8_t* payload = telemetry_put_index(telemetry_payload(commands_frame), acquire_read64(&context.acquire->next_sample));
+		uint16_t length = TELEMETRY_INDEX_BYTES + histogram_pack(hist, payload);
+		uart_send(commands_frame, telemetry_frame_close(commands_frame, TELEMETRY_TYPE_HISTOGRAM, commands_frame_sequence++, length));
+		shell_reply("OK\r\n");
+	}
+	else
+	{
+		shell_reply("ERR hist\r\n");
+	}
+}
+
+// List, pick, measure or persist the flash controller profile
+// tune blocks for ~PLATFORM_PROFILE_COUNT * PLATFORM_TUNE_BLOCKS DMA blocks, stats shows the missed ones
+static void commands_placr(uint8_t argc, char** argv)
+{
+	if(argc == 1)
+	{
+		for(uint8_t p = 0; p < PLATFORM_PROFILE_COUNT; p++)
+		{
+			const platform_profile* profile = platform_profile_get(p);
+			shell_reply("%c%d %s 0x%05x\r\n", (p == platform_current()) ? '*' : ' ', p, profile->name, (unsigned)profile->placr);
+		}
+	}
+	else if(strcmp(argv[1], "tune") == 0)
+	{
+		platform_result results[PLATFORM_PROFILE_COUNT];
+		uint8_t best;
+
+		if(platform_tune(context.acquire, results, &best) != PLATFORM_ERROR_SUCCESS)
+		{
+			shell_reply("ERR tune\r\n");
+		}
+		else
+		{
+			for(uint8_t p = 0; p < PLATFORM_PROFILE_COUNT; p++)
+			{
+				shell_reply("%s kernel %u irq %u\r\n", platform_profile_get(p)->name,
+							(unsigned)results[p].kernel_cycles, (unsigned)results[p].irq_cycles);
+			}
+			shell_reply((platform_save(context.acquire, best) == PLATFORM_ERROR_SUCCESS) ? "OK %s saved\r\n" : "ERR save %s\r\n",
+						platform_profile_get(best)->name);
+		}
+	}
+	else if(strcmp(argv[1], "save") == 0)
+	{
+		shell_reply((platform_save(context.acquire, platform_current()) == PLATFORM_ERROR_SUCCESS) ? "OK\r\n" : "ERR save\r\n");
+	}
+	else
+	{
+		long profile = 0;
+		bool ok =	commands_number(argv[1], 0, PLATFORM_PROFILE_COUNT - 1, &profile)		&&
+					(platform_apply((uint8_t)profile) == PLATFORM_ERROR_SUCCESS);
+		shell_reply(ok ? "OK\r\n" : "ERR placr\r\n");
+	}
+}
+
+// Governor report, or hand the profile choice back to it (auto) or pin a profile
+static void commands_gov(uint8_t argc, char** argv)
+{
+	const char* const names[] = GOVERNOR_PROFILE_NAMES;
+	governor_handle* gov = context.governor;
+
+	if(gov == NULL)
+	{
+		shell_reply("ERR governor disabled\r\n");
+	}
+	else if(argc == 1)
+	{
+		shell_reply("%s %s\r\nload %d%% headroom %d%%\r\n", names[gov->profile], gov->config.automatic ? "auto" : "fixed",
+					gov->load, 100 - gov->load);
+		for(uint8_t p = 0; p < GOVERNOR_PROFILE_COUNT; p++)
+		{
+			shell_reply("%s blocks %u model_nj_per_block %u\r\n", names[p], (unsigned)gov->blocks[p],
+						(unsigned)governor_block_energy(gov, (governor_profile)p));
+		}
+		shell_reply("avg_model_nj_per_block %u\r\nswitches %u failed %u missed %u\r\n", (unsigned)governor_average_energy(gov),
+					(unsigned)gov->switches, (unsigned)gov->failed_switches, (unsigned)gov->switch_missed);
+	}
+	else if(strcmp(argv[1], "auto") == 0)
+	{
+		gov->config.automatic = true;
+		shell_reply("OK\r\n");
+	}
+	else
+	{
+		// The reply goes out after the switch, on the new baud
+		int8_t profile = commands_lookup(names, GOVERNOR_PROFILE_COUNT, argv[1]);
+		bool ok = (profile >= 0) && (governor_set_profile(gov, (governor_profile)profile) == GOVERNOR_ERROR_SUCCESS);
+		gov->config.automatic &= !ok;
+		shell_reply(ok ? "OK\r\n" : "ERR gov\r\n");
+	}
+}
+
+// Block sizing report, hand the size back to it (auto), change the latency target or pin a size
+static void commands_block(uint8_t argc, char** argv)
+{
+	blocksize_handle* sizer = context.sizer;
+
+	if(sizer == NULL)
+	{
+		shell_reply("ERR block sizing disabled\r\n");
+	}
+	else if(argc == 1)
+	{
+		shell_reply("size %d %s\r\nlatency_us %u latency_size %d load %d%%\r\ngrows %u shrinks %u\r\n",
+					context.acquire->block_size, sizer->config.automatic ? "auto" : "fixed",
+					(unsigned)sizer->config.latency_us, sizer->latency_size, sizer->load,
+					(unsigned)sizer->grows, (unsigned)sizer->shrinks);
+	}
+	else if(strcmp(argv[1], "auto") == 0)
+	{
+		sizer->config.automatic = true;
+		shell_reply("OK\r\n");
+	}
+	else if((strcmp(argv[1], "latency") == 0) && (argc == 3))
+	{
+		// The size follows at the next block
+		long latency = 0;
+		bool ok = commands_number(argv[2], 0, INT32_MAX, &latency);
+		sizer->config.latency_us = ok ? (uint32_t)latency : sizer->config.latency_us;
+		shell_reply(ok ? "OK\r\n" : "ERR block\r\n");
+	}
+	else
+	{
+		long size = 0;
+		bool ok =	commands_number(argv[1], 1, UINT8_MAX, &size)								&&
+					(blocksize_set(sizer, (uint8_t)size) == BLOCKSIZE_ERROR_SUCCESS);
+		shell_reply(ok ? "OK\r\n" : "ERR block\r\n");
+	}
+}
+
+// Capture state, arm a new capture, or dump the buffer to the report console (or read it with the debugger)
+static void commands_trace(uint8_t argc, char** argv)
+{
+	#if ENABLE_TRACE
+	const char* const states[] = {"idle", "armed", "full"};
+
+	if(argc == 1)
+	{
+		shell_reply("%s packets %u\r\nbuffer 0x%08x size %u position 0x%08x\r\n", states[trace_status()],
+					(unsigned)trace_packets(), (unsigned)trace_buffer_address(), (unsigned)TRACE_BUFFER_SIZE,
+					(unsigned)trace_position());
+	}
+	else if(strcmp(argv[1], "arm") == 0)
+	{
+		trace_arm();
+		shell_reply("OK\r\n");
+	}
+	else if(strcmp(argv[1], "dump") == 0)
+	{
+		trace_dump_start();
+		shell_reply("OK\r\n");
+	}
+	else
+	{
+		shell_reply("ERR trace\r\n");
+	}
+	#else
+	shell_reply("ERR trace disabled\r\n");
+	#endif
+}
+
+// Set or clear a report flag from "0"/"1"
+static bool commands_flag(uint8_t flag, char* value)
+{
+	bool ret = true;
+
+	if(strcmp(value, "1") == 0)
+	{
+		*context.report_flags |= flag;
+	}
+	else if(strcmp(value, "0") == 0)
+	{
+		*context.report_flags &= ~flag;
+	}
+	else
+	{
+		ret = false;
+	}
+
+	return ret;
+}
+
+// Index of value in a name table, -1 if not there
+static int8_t commands_lookup(const char* const* names, uint8_t count, char* value)
+{
+	int8_t ret = -1;
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		if(strcmp(names[i], value) == 0)
+		{
+			ret = i;
+		}
+	}
+
+	return ret;
+}
+
+// Whole argument as a number (decimal, 0x hex or 0 octal) in min..max, false on anything else
+static bool commands_number(char* value, long min, long max, long* number)
+{
+	char* end;
+	*number = strtol(value, &end, 0);
+
+	return (end != value) & (*end == '\0') & (*number >= min) & (*number <= max);
+}
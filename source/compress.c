@@ -0,0 +1,296 @@
+/*
+ * compress.c
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "compress.h"
+#include "stdlib.h"
+
+/* DEFINES AND STATIC DATA */
+
+// MSB first bit packer
+typedef struct
+{
+	uint8_t* ptr;
+	uint8_t* end;
+	uint32_t acc;
+	uint8_t bits;
+	bool overflow;
+} compress_bit_writer;
+
+// MSB first bit unpacker
+typedef struct
+{
+	uint8_t* ptr;
+	uint8_t* end;
+	uint32_t acc;
+	uint8_t bits;
+	bool underflow;
+} compress_bit_reader;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void compress_put_bits(compress_bit_writer* writer, uint32_t value, uint8_t count);
+static void compress_put_rice(compress_bit_writer* writer, uint32_t value, uint8_t k);
+static uint32_t compress_get_bits(compress_bit_reader* reader, uint8_t count);
+static uint32_t compress_get_rice(compress_bit_reader* reader, uint8_t k);
+static uint16_t compress_verbatim(volatile int16_t* buffer, uint8_t buffer_size, uint8_t* out);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Encode a block of samples, returns the encoded byte count (out must hold COMPRESS_MAX_BYTES)
+uint16_t compress_encode_block(volatile int16_t* buffer, uint8_t buffer_size, uint8_t* out)
+{
+	if(buffer_size < 3)
+	{
+		return compress_verbatim(buffer, buffer_size, out);
+	}
+
+	// Pass 1 - residual size for each predictor order, one pass, no multiplies
+	int32_t x2 = buffer[0];
+	int32_t x1 = buffer[1];
+	uint32_t sum_0 = abs(x2) + abs(x1);
+	uint32_t sum_1 = abs(x1 - x2);
+	uint32_t sum_2 = 0;
+	for(uint8_t i = 2; i < buffer_size; i++)
+	{
+		int32_t x = buffer[i];
+		int32_t e1 = x - x1;
+		sum_0 += abs(x);
+		sum_1 += abs(e1);
+		sum_2 += abs(e1 - (x1 - x2));
+		x2 = x1;
+		x1 = x;
+	}
+
+	compress_method method = COMPRESS_METHOD_ORDER_0;
+	uint32_t sum = sum_0;
+	if(sum_1 < sum)
+	{
+		method = COMPRESS_METHOD_ORDER_1;
+		sum = sum_1;
+	}
+	if(sum_2 < sum)
+	{
+		method = COMPRESS_METHOD_ORDER_2;
+		sum = sum_2;
+	}
+
+	// Rice parameter from the mean residual magnitude (residuals are zigzagged, so 2x the mean)
+	uint8_t order = (uint8_t)method;
+	uint32_t residual_count = buffer_size - order;
+	uint8_t k = 0;
+	while((k < COMPRESS_MAX_RICE_K) && ((residual_count << k) < sum))
+	{
+		k++;
+	}
+
+	// Pass 2 - header, warm up samples, residuals
+	compress_bit_writer writer =
+	{
+		.ptr = out,
+		.end = out + COMPRESS_MAX_BYTES(buffer_size),
+		.acc = 0,
+		.bits = 0,
+		.overflow = false
+	};
+	compress_put_bits(&writer, method | (k << 2), 8);
+	compress_put_bits(&writer, buffer_size, 8);
+
+	x1 = 0;
+	x2 = 0;
+	for(uint8_t i = 0; i < buffer_size; i++)
+	{
+		int32_t x = buffer[i];
+		if(i < order)
+		{
+			compress_put_bits(&writer, (uint16_t)x, 16);
+		}
+		else
+		{
+			int32_t e = x;
+			if(method == COMPRESS_METHOD_ORDER_1)
+			{
+				e = x - x1;
+			}
+			else if(method == COMPRESS_METHOD_ORDER_2)
+			{
+				e = x - x1 - (x1 - x2);
+			}
+			compress_put_rice(&writer, (uint32_t)(e << 1) ^ (uint32_t)(e >> 31), k);
+		}
+		x2 = x1;
+		x1 = x;
+	}
+	compress_put_bits(&writer, 0, (8 - writer.bits) & 0x7U);
+
+	uint16_t length = writer.ptr - out;
+	if(writer.overflow)
+	{
+		length = compress_verbatim(buffer, buffer_size, out);
+	}
+
+	return length;
+}
+
+// Decode one encoded block, returns the sample count or -1 if the block is malformed
+int16_t compress_decode_block(uint8_t* in, uint16_t in_size, int16_t* out, uint8_t out_size)
+{
+	if(in_size < COMPRESS_HEADER_BYTES)
+	{
+		return -1;
+	}
+
+	compress_method method = COMPRESS_METHOD(in[0]);
+	uint8_t k = COMPRESS_RICE_K(in[0]);
+	uint8_t count = in[1];
+
+	if((count > out_size) | (k > COMPRESS_MAX_RICE_K))
+	{
+		return -1;
+	}
+
+	compress_bit_reader reader =
+	{
+		.ptr = &in[COMPRESS_HEADER_BYTES],
+		.end = &in[in_size],
+		.acc = 0,
+		.bits = 0,
+		.underflow = false
+	};
+
+	uint8_t order = (method == COMPRESS_METHOD_VERBATIM) ? count : (uint8_t)method;
+	int32_t x1 = 0;
+	int32_t x2 = 0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		int32_t x = 0;
+		if(i < order)
+		{
+			x = (int16_t)compress_get_bits(&reader, 16);
+		}
+		else
+		{
+			uint32_t u = compress_get_rice(&reader, k);
+			int32_t e = (int32_t)(u >> 1) ^ -(int32_t)(u & 1U);
+			x = e;
+			if(method == COMPRESS_METHOD_ORDER_1)
+			{
+				x = e + x1;
+			}
+			else if(method == COMPRESS_METHOD_ORDER_2)
+			{
+				x = e + x1 + (x1 - x2);
+			}
+		}
+		out[i] = (int16_t)x;
+		x2 = x1;
+		x1 = x;
+	}
+
+	return reader.underflow ? -1 : count;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Append count (<= 24) bits, anything past the end of the output sets overflow
+static void compress_put_bits(compress_bit_writer* writer, uint32_t value, uint8_t count)
+{
+	writer->acc = (writer->acc << count) | (value & ((1UL << count) - 1U));
+	writer->bits += count;
+	while(writer->bits >= 8)
+	{
+		writer->bits -= 8;
+		if(writer->ptr < writer->end)
+		{
+			*writer->ptr++ = (uint8_t)(writer->acc >> writer->bits);
+		}
+		else
+		{
+			writer->overflow = true;
+		}
+	}
+}
+
+// Unary quotient, zero stop bit, k bit remainder - or an escape and the raw value
+static void compress_put_rice(compress_bit_writer* writer, uint32_t value, uint8_t k)
+{
+	uint32_t quotient = value >> k;
+
+	if(quotient < COMPRESS_ESCAPE_QUOTIENT)
+	{
+		compress_put_bits(writer, ((1UL << quotient) - 1U) << 1, quotient + 1);
+		compress_put_bits(writer, value, k);
+	}
+	else
+	{
+		compress_put_bits(writer, (1UL << COMPRESS_ESCAPE_QUOTIENT) - 1U, COMPRESS_ESCAPE_QUOTIENT);
+		compress_put_bits(writer, value, COMPRESS_ESCAPE_BITS);
+	}
+}
+
+// Read count (<= 24) bits, reading past the end sets underflow and returns zeros
+static uint32_t compress_get_bits(compress_bit_reader* reader, uint8_t count)
+{
+	while(reader->bits < count)
+	{
+		uint8_t byte = 0;
+		if(reader->ptr < reader->end)
+		{
+			byte = *reader->ptr++;
+		}
+		else
+		{
+			reader->underflow = true;
+		}
+		reader->acc = (reader->acc << 8) | byte;
+		reader->bits += 8;
+	}
+
+	reader->bits -= count;
+	return (reader->acc >> reader->bits) & ((1UL << count) - 1U);
+}
+
+// Mirror of compress_put_rice
+static uint32_t compress_get_rice(compress_bit_reader* reader, uint8_t k)
+{
+	uint32_t quotient = 0;
+	while((quotient < COMPRESS_ESCAPE_QUOTIENT) && compress_get_bits(reader, 1) && !reader->underflow)
+	{
+		quotient++;
+	}
+
+	uint32_t value = 0;
+	if(quotient == COMPRESS_ESCAPE_QUOTIENT)
+	{
+		value = compress_get_bits(reader, COMPRESS_ESCAPE_BITS);
+	}
+	else
+	{
+		value = (quotient << k) | compress_get_bits(reader, k);
+	}
+
+	return value;
+}
+
+// Samples as is, used for tiny blocks and when the residuals would not fit
+static uint16_t compress_verbatim(volatile int16_t* buffer, uint8_t buffer_size, uint8_t* out)
+{
+	uint8_t* ptr = out;
+
+	*ptr++ = COMPRESS_METHOD_VERBATIM;
+	*ptr++ = buffer_size;
+	for(uint8_t i = 0; i < buffer_size; i++)
+	{
+		uint16_t sample = (uint16_t)buffer[i];
+		*ptr++ = (uint8_t)(sample >> 8);
+		*ptr++ = (uint8_t)sample;
+	}
+
+	return ptr - out;
+}
@@ -0,0 +1,63 @@
+/*
+ * cycle_counter.c
+ *
+ *  Created on: Dec 17, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "cycle_counter.h"
+#include "placement.h"
+
+#if defined(__arm__)
+#include "MKL25Z4.h"
+#include "fsl_clock.h"
+#else
+#include <time.h>
+#endif
+
+
+/* FUNCTION DEFINITIONS */
+
+// Start the free running counter (left alone if already running, the acquire timebase is built on it)
+void cycle_counter_init(void)
+{
+	#if defined(__arm__)
+	if(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk)
+	{
+		return;
+	}
+	SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+	#endif
+}
+
+// Current count (counts up, wraps at CYCLE_COUNTER_MASK)
+HOT_PATH uint32_t cycle_counter_now(void)
+{
+	#if defined(__arm__)
+	return CYCLE_COUNTER_MASK - SysTick->VAL;
+	#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+	#endif
+}
+
+// Counts since start, valid for spans shorter than one wrap (~350ms at 48MHz)
+// acquire_irq times itself with this, so it moves to SRAM with the rest of the ISR
+HOT_PATH uint32_t cycle_counter_elapsed(uint32_t start)
+{
+	return (cycle_counter_now() - start) & CYCLE_COUNTER_MASK;
+}
+
+// Counter ticks per second (core clock on target, 1GHz on host)
+uint32_t cycle_counter_hz(void)
+{
+	#if defined(__arm__)
+	return CLOCK_GetCoreSysClkFreq();
+	#else
+	return 1000000000UL;
+	#endif
+}
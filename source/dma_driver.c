@@ -7,10 +7,12 @@
 
 /* HEADER */
 #include "dma_driver.h"
+#include "placement.h"
+#include "bme.h"
 
 
 /* STATIC FUNCTION DECLARATIONS */
-static bool dma_bad_addr(volatile void* addr);
+static bool dma_bad_addr(const volatile void* addr);
 static bool dma_null_ptrs(dma_init_config* config);
 static bool dma_mux_null_ptrs(dma_mux_config* config);
 
@@ -36,7 +38,7 @@ dma_error dma_init(dma_init_config* config)
 	{
 		ret = DMA_ERROR_BUSY;
 	}
-	else if(config->byte_count & ~0xFFFFF)
+	else if(config->byte_count & ~DMA_BYTE_COUNT_MAX)
 	{
 		ret = DMA_ERROR_BYTE_COUNT;
 	}
@@ -46,53 +48,88 @@ dma_error dma_init(dma_init_config* config)
 	}
 	else
 	{
-		// Easy Read Address
-		DMA_Type* dma = config->dma;
-
-		// Clock Enable
-		CLOCK_EnableClock(kCLOCK_Dma0);
-
-		// Source Address
-		dma->DMA[config->channel].SAR = (uint32_t)config->src_addr;
-
-		// Destination Address
-		dma->DMA[config->channel].DAR = (uint32_t)config->dest_addr;
-
-		// Byte Count Register
-		dma->DMA[config->channel].DSR_BCR = DMA_DSR_BCR_BCR(config->byte_count);
-
-		// DMA Control Register
-		dma->DMA[config->channel].DCR = (DMA_DCR_EINT(config->interrupt))	|
-								(DMA_DCR_ERQ(config->peripheral_en))		|
-								(DMA_DCR_CS(config->steal_cycles))			|
-								(DMA_DCR_AA(config->auto_align))			|
-								(DMA_DCR_EADREQ(config->async_en))			|
-								(DMA_DCR_SINC(config->src_inc))				|
-								(DMA_DCR_SSIZE(config->src_size))			|
-								(DMA_DCR_DINC(config->dest_inc))			|
-								(DMA_DCR_DSIZE(config->dest_size))			|
-								(DMA_DCR_START(config->start))				|
-								(DMA_DCR_SMOD(config->src_mod))				|
-								(DMA_DCR_DMOD(config->dest_mod))			|
-								(DMA_DCR_D_REQ(config->auto_disable_req))	|
-								(DMA_DCR_LINKCC(config->link_mode))			|
-								(DMA_DCR_LCH1(config->link_chan_1))			|
-								(DMA_DCR_LCH2(config->link_chan_2))	;
-
-		if(config->interrupt)
-		{
-			NVIC_EnableIRQ(DMA0_IRQn);
-		}
+		// Same images a compile time setup gets, built from the config
+		dma_image image = DMA_IMAGE(config->dma, config->channel, config->src_addr, config->dest_addr, config->byte_count,
+									config->interrupt, config->peripheral_en, config->steal_cycles, config->auto_align,
+									config->async_en, config->src_inc, config->src_size, config->src_mod, config->dest_inc,
+									config->dest_size, config->dest_mod, config->auto_disable_req, config->link_mode,
+									config->link_chan_1, config->link_chan_2, config->start);
+		dma_init_image(&image);
 	}
 	return ret;
 }
 
+// DMA Initialization from prebuilt register images (checked by DMA_IMAGE_ASSERT, the channel must be idle)
+void dma_init_image(const dma_image* image)
+{
+	// Easy Read Address
+	DMA_Type* dma = image->dma;
+
+	// Clock Enable
+	CLOCK_EnableClock(kCLOCK_Dma0);
+
+	// Addresses, Byte Count, then the Control Register (ERQ goes live last)
+	dma->DMA[image->channel].SAR = (uint32_t)image->src_addr;
+	dma->DMA[image->channel].DAR = (uint32_t)image->dest_addr;
+	dma->DMA[image->channel].DSR_BCR = image->dsr_bcr;
+	dma->DMA[image->channel].DCR = image->dcr;
+
+	if(image->irq)
+	{
+		NVIC_EnableIRQ(DMA0_IRQn);
+	}
+}
+
 // Used to restart a DMA transfer on an already configured DMA Channel (resets peripheral_en)
-void dma_transfer_restart(DMA_Type* dma, dma_channel channel, volatile void* buffer_ptr, uint32_t byte_count)
+HOT_PATH void dma_transfer_restart(DMA_Type* dma, dma_channel channel, volatile void* buffer_ptr, uint32_t byte_count)
 {
 	dma->DMA[channel].DAR = (uint32_t)buffer_ptr;
-	dma->DMA[channel].DSR_BCR |= DMA_DSR_BCR_BCR(byte_count);
-	dma->DMA[channel].DCR |= DMA_DCR_ERQ(true);
+	dma->DMA[channel].DSR_BCR = DMA_DSR_BCR_BCR(byte_count);		// Write, an OR would merge in whatever BCR was left after an error
+	bme_or32(&dma->DMA[channel].DCR, DMA_DCR_ERQ_MASK);
+}
+
+// Classify how the last transfer on a channel ended
+HOT_PATH dma_status dma_channel_status(DMA_Type* dma, dma_channel channel)
+{
+	dma_status ret = DMA_STATUS_BUSY;
+	uint32_t dsr = dma->DMA[channel].DSR_BCR;
+
+	if(dsr & DMA_DSR_BCR_CE_MASK)
+	{
+		ret = DMA_STATUS_CONFIG_ERROR;
+	}
+	else if(dsr & DMA_DSR_BCR_BES_MASK)
+	{
+		ret = DMA_STATUS_SOURCE_BUS_ERROR;
+	}
+	else if(dsr & DMA_DSR_BCR_BED_MASK)
+	{
+		ret = DMA_STATUS_DEST_BUS_ERROR;
+	}
+	else if(dsr & DMA_DSR_BCR_DONE_MASK)
+	{
+		ret = DMA_STATUS_DONE;
+	}
+
+	return ret;
+}
+
+// Bytes the last transfer did not move (0 after a clean finish)
+HOT_PATH uint32_t dma_bytes_remaining(DMA_Type* dma, dma_channel channel)
+{
+	return dma->DMA[channel].DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+}
+
+// Clear DONE and every error flag on a channel (one write to DONE clears them all)
+HOT_PATH void dma_channel_clear(DMA_Type* dma, dma_channel channel)
+{
+	dma->DMA[channel].DSR_BCR = DMA_DSR_BCR_DONE(true);
+}
+
+// Stop a channel taking requests (clears ERQ), the byte count is left where it stopped
+void dma_channel_stop(DMA_Type* dma, dma_channel channel)
+{
+	bme_and32(&dma->DMA[channel].DCR, ~DMA_DCR_ERQ_MASK);
 }
 
 dma_error dma_mux_init(dma_mux_config* config)
@@ -122,16 +159,16 @@ dma_error dma_mux_init(dma_mux_config* config)
 	return ret;
 }
 
-// Enable or Disable a Mux Channel
+// Enable or Disable a Mux Channel (source and trigger bits are kept)
 void dma_mux_channel_enable(DMAMUX_Type* dma_mux, dma_channel channel, bool enable)
 {
 	if(enable)
 	{
-		dma_mux->CHCFG[channel] |= DMAMUX_CHCFG_ENBL_MASK;
+		bme_or8(&dma_mux->CHCFG[channel], DMAMUX_CHCFG_ENBL_MASK);
 	}
 	else
 	{
-		dma_mux->CHCFG[channel] &= DMAMUX_CHCFG_ENBL_MASK;
+		bme_and8(&dma_mux->CHCFG[channel], (uint8_t)~DMAMUX_CHCFG_ENBL_MASK);
 	}
 }
 
@@ -154,7 +191,7 @@ static bool dma_null_ptrs(dma_init_config* config)
 }
 
 // Determine if a supplied address is legit
-static bool dma_bad_addr(volatile void* addr)
+static bool dma_bad_addr(const volatile void* addr)
 {
 	bool ret = false;
 
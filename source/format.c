@@ -0,0 +1,142 @@
+/*
+ * format.c
+ *
+ *  Created on: Dec 18, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "format.h"
+#include <string.h>
+
+/* DEFINES AND STATIC DATA */
+
+// Digits are found by repeated subtraction - the M0+ has no divider and __aeabi_uidiv is a long loop
+#define FORMAT_POWERS			{10000, 1000, 100, 10, 1}
+#define FORMAT_DIGITS			5
+
+// Report template pieces, copied whole
+static const char format_report_adc[] = "ADC:";
+static const char format_report_dbfs[] = " - dBFS:";
+static const char format_report_tone[] = "TONE:";
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void format_digits(char* digits, uint16_t value);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Unsigned decimal, no leading zeros, returns bytes written
+uint8_t format_u16(char* out, uint16_t value)
+{
+	char digits[FORMAT_DIGITS];
+	format_digits(digits, value);
+
+	// Always keep the units digit
+	uint8_t first = 0;
+	while((first < (FORMAT_DIGITS - 1)) && (digits[first] == '0'))
+	{
+		first++;
+	}
+
+	memcpy(out, &digits[first], FORMAT_DIGITS - first);
+	return FORMAT_DIGITS - first;
+}
+
+// Hundredths of a dB as -W.DD (value is the unsigned dbfs_output result), returns bytes written
+uint8_t format_db(char* out, uint16_t centi_db)
+{
+	char digits[FORMAT_DIGITS];
+	format_digits(digits, centi_db);
+
+	// Keep the units of the whole part so 5 comes out as -0.05
+	uint8_t first = 0;
+	while((first < (FORMAT_DIGITS - 3)) && (digits[first] == '0'))
+	{
+		first++;
+	}
+
+	char* ptr = out;
+	*ptr++ = '-';
+	memcpy(ptr, &digits[first], (FORMAT_DIGITS - 2) - first);
+	ptr += (FORMAT_DIGITS - 2) - first;
+	*ptr++ = '.';
+	*ptr++ = digits[FORMAT_DIGITS - 2];
+	*ptr++ = digits[FORMAT_DIGITS - 1];
+
+	return ptr - out;
+}
+
+// Report line "ADC:<peak> - dBFS:-<dB>\n", returns bytes written (out must hold FORMAT_REPORT_BYTES)
+uint8_t format_report(char* out, uint16_t peak_counts, uint16_t centi_db)
+{
+	char* ptr = out;
+
+	memcpy(ptr, format_report_adc, sizeof(format_report_adc) - 1);
+	ptr += sizeof(format_report_adc) - 1;
+	ptr += format_u16(ptr, peak_counts);
+	memcpy(ptr, format_report_dbfs, sizeof(format_report_dbfs) - 1);
+	ptr += sizeof(format_report_dbfs) - 1;
+	ptr += format_db(ptr, centi_db);
+	*ptr++ = '\n';
+
+	return ptr - out;
+}
+
+// Tone line "TONE:<hz> - dBFS:-<dB>\n", returns bytes written (out must hold FORMAT_TONE_BYTES)
+uint8_t format_tone(char* out, uint16_t frequency, uint16_t centi_db)
+{
+	char* ptr = out;
+
+	memcpy(ptr, format_report_tone, sizeof(format_report_tone) - 1);
+	ptr += sizeof(format_report_tone) - 1;
+	ptr += format_u16(ptr, frequency);
+	memcpy(ptr, format_report_dbfs, sizeof(format_report_dbfs) - 1);
+	ptr += sizeof(format_report_dbfs) - 1;
+	ptr += format_db(ptr, centi_db);
+	*ptr++ = '\n';
+
+	return ptr - out;
+}
+
+// Bar graph of sample >> scale_shift zeros then ">\n" (same text as printf("%0*d>\n")), clipped to out_size
+uint16_t format_bar(char* out, uint16_t out_size, uint16_t sample, uint8_t scale_shift)
+{
+	uint16_t ret = 0;
+
+	if(out_size >= 3)
+	{
+		// %0*d still prints the one zero when the width is 0
+		uint16_t limit = sample >> scale_shift;
+		limit = (limit == 0) ? 1 : limit;
+		limit = (limit > (out_size - 2)) ? (out_size - 2) : limit;
+
+		memset(out, '0', limit);
+		out[limit] = '>';
+		out[limit + 1] = '\n';
+		ret = limit + 2;
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// All five digits of value, leading zeros included
+static void format_digits(char* digits, uint16_t value)
+{
+	static const uint16_t powers[] = FORMAT_POWERS;
+
+	for(uint8_t i = 0; i < FORMAT_DIGITS; i++)
+	{
+		char digit = '0';
+		while(value >= powers[i])
+		{
+			value -= powers[i];
+			digit++;
+		}
+		digits[i] = digit;
+	}
+}
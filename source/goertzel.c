@@ -0,0 +1,123 @@
+/*
+ * goertzel.c
+ *
+ *  Created on: Dec 19, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "goertzel.h"
+#include <math.h>
+
+/* DEFINES AND STATIC DATA */
+#define GOERTZEL_PI		3.14159265f
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint32_t goertzel_sqrt(uint64_t value);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Work out the coefficients for every tone at the configured sample rate
+goertzel_error goertzel_init(goertzel_bank* bank, goertzel_config* config)
+{
+	goertzel_error ret = GOERTZEL_ERROR_SUCCESS;
+
+	if(	(bank == NULL)	||
+		(config == NULL))
+	{
+		ret = GOERTZEL_ERROR_NULL_PTR;
+	}
+	else if(config->tone_count > GOERTZEL_MAX_TONES)
+	{
+		ret = GOERTZEL_ERROR_TONE_COUNT;
+	}
+	else
+	{
+		for(uint8_t i = 0; i < config->tone_count; i++)
+		{
+			if((config->frequencies[i] == 0) | ((config->frequencies[i] * 2U) >= config->sample_rate))
+			{
+				ret = GOERTZEL_ERROR_FREQUENCY;
+			}
+		}
+	}
+
+	if(ret == GOERTZEL_ERROR_SUCCESS)
+	{
+		bank->config = *config;
+
+		// Float only here, once per sample rate change
+		for(uint8_t i = 0; i < config->tone_count; i++)
+		{
+			float w = (2.0f * GOERTZEL_PI * config->frequencies[i]) / config->sample_rate;
+			bank->coeff[i] = (int32_t)lroundf(2.0f * cosf(w) * (1 << GOERTZEL_COEFF_SHIFT));
+		}
+	}
+
+	return ret;
+}
+
+// Run every tone over one block, amplitude[i] is tone i's peak in ADC counts (same scale as peak_block_max)
+void goertzel_process_block(goertzel_bank* bank, volatile int16_t* buffer, uint8_t buffer_size, uint16_t* amplitude)
+{
+	for(uint8_t i = 0; i < bank->config.tone_count; i++)
+	{
+		int32_t coeff = bank->coeff[i];
+		int32_t s1 = 0;
+		int32_t s2 = 0;
+
+		// s[n] = x[n] + 2cos(w)s[n-1] - s[n-2], |s| stays under x * N^2 / 2 so 32 bits holds a 255 sample block
+		// coeff * s1 would need 46 bits, and a 64 bit multiply is a library call on the M0+, so s1 is split at bit 16
+		// and each half takes one 32 bit MULS (|coeff| <= 2^15, low half < 2^16). The high half's product is a
+		// multiple of 2^COEFF_SHIFT, so the shift splits exactly and the result is the 64 bit one bit for bit
+		for(volatile int16_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
+		{
+			int32_t s1_high = s1 >> 16;
+			int32_t s1_low = s1 & 0xFFFF;
+			int32_t s0 = *ptr + (coeff * s1_high * (1 << (16 - GOERTZEL_COEFF_SHIFT))) +
+							((coeff * s1_low) >> GOERTZEL_COEFF_SHIFT) - s2;
+			s2 = s1;
+			s1 = s0;
+		}
+
+		// |X|^2 = s1^2 + s2^2 - 2cos(w)s1s2, a full scale sine gives |X| = N * A / 2
+		int64_t power = ((int64_t)s1 * s1) + ((int64_t)s2 * s2) -
+						(((int64_t)coeff * s1) >> GOERTZEL_COEFF_SHIFT) * s2;
+		uint32_t peak = (buffer_size == 0) ? 0 : (goertzel_sqrt((power > 0) ? (uint64_t)power : 0) * 2U) / buffer_size;
+
+		amplitude[i] = (peak > INT16_MAX) ? INT16_MAX : (uint16_t)peak;
+	}
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Integer square root, one result bit per pass
+static uint32_t goertzel_sqrt(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while(bit > value)
+	{
+		bit >>= 2;
+	}
+
+	while(bit)
+	{
+		if(value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint32_t)root;
+}
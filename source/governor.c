@@ -0,0 +1,235 @@
+/*
+ * governor.c
+ *
+ *  Created on: Dec 22, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "governor.h"
+#include "clock_config.h"
+#include "fsl_smc.h"
+#include "uart_driver.h"
+#include "pipeline.h"
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void governor_clocks(governor_profile profile);
+static uint32_t governor_missed(governor_handle* governor);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Unlock VLPR in the SMC (PMPROT is write once) and start in RUN
+governor_error governor_init(governor_handle* governor, governor_config* config)
+{
+	governor_error ret = GOVERNOR_ERROR_SUCCESS;
+
+	if(	(governor == NULL)					||
+		(config == NULL)					||
+		(config->acquire == NULL)			||
+		(config->adc == NULL)				||
+		(config->processed_blocks == NULL)	)
+	{
+		ret = GOVERNOR_ERROR_NULL_PTR;
+	}
+	else
+	{
+		governor->config = *config;
+		governor->profile = GOVERNOR_PROFILE_RUN;
+		governor->window_busy = 0;
+		governor->window_count = 0;
+		governor->window_missed = governor_missed(governor);
+		governor->hold = 0;
+		governor->backoff = config->hold_blocks;
+		governor->load = 0;
+		governor->blocks[GOVERNOR_PROFILE_RUN] = 0;
+		governor->blocks[GOVERNOR_PROFILE_VLPR] = 0;
+		governor->switches = 0;
+		governor->failed_switches = 0;
+		governor->switch_missed = 0;
+
+		SMC_SetPowerModeProtection(SMC, kSMC_AllowPowerModeAll);
+	}
+
+	return ret;
+}
+
+// Account for one processed block (busy = cycle_counter counts from picking the block up to done)
+void governor_block(governor_handle* governor, uint32_t busy)
+{
+	governor->window_busy += busy;
+	governor->window_count++;
+	governor->blocks[governor->profile]++;
+	governor->hold = (governor->hold > 0) ? (governor->hold - 1) : 0;
+}
+
+// Idle loop - decide at the end of a window and switch if needed (waits for the UART to drain)
+void governor_service(governor_handle* governor)
+{
+	if(governor->window_count < governor->config.window_blocks)
+	{
+		return;
+	}
+
+	// Both counts are in the clock the window ran at
+	uint32_t period = governor->config.acquire->block_period * governor->window_count;
+	governor->load = period ? (uint8_t)MIN(((uint64_t)governor->window_busy * 100U) / period, 100U) : 0;
+	bool missed = (governor_missed(governor) != governor->window_missed);
+
+	if(governor->config.automatic)
+	{
+		if(	(governor->profile == GOVERNOR_PROFILE_VLPR)			&&
+			(missed | (governor->load > governor->config.up_percent))	)
+		{
+			if(governor_set_profile(governor, GOVERNOR_PROFILE_RUN) == GOVERNOR_ERROR_BUSY)
+			{
+				return;		// Try again next call, keep the window
+			}
+			governor->hold = governor->config.hold_blocks;
+		}
+		else if((governor->profile == GOVERNOR_PROFILE_RUN)									&&
+				(governor->hold == 0)														&&
+				!missed																		&&
+				((governor->load * GOVERNOR_CLOCK_RATIO) < governor->config.down_percent)	)
+		{
+			governor_error error = governor_set_profile(governor, GOVERNOR_PROFILE_VLPR);
+			if(error == GOVERNOR_ERROR_BUSY)
+			{
+				return;
+			}
+
+			// The baud miss will not go away by itself - every retry is two clock switches, so wait longer each time
+			if(error == GOVERNOR_ERROR_UART)
+			{
+				governor->hold = governor->backoff;
+				governor->backoff = (uint16_t)MIN((uint32_t)governor->backoff * 2U, UINT16_MAX);
+			}
+			else
+			{
+				governor->backoff = governor->config.hold_blocks;
+			}
+		}
+	}
+
+	governor->window_busy = 0;
+	governor->window_count = 0;
+	governor->window_missed = governor_missed(governor);
+}
+
+// Switch now (the shell's manual override) - ADC timing, block period and UART baud follow the clock
+// The DMA and the ADC (ADACK) never stop, the ISR keeps running through the MCG transitions
+governor_error governor_set_profile(governor_handle* governor, governor_profile profile)
+{
+	governor_error ret = GOVERNOR_ERROR_SUCCESS;
+
+	if(profile >= GOVERNOR_PROFILE_COUNT)
+	{
+		ret = GOVERNOR_ERROR_PROFILE;
+	}
+	// Wait for the last stop bit, not just the end of the transfer - the baud changes under the shifter
+	else if(!uart_send_done())
+	{
+		ret = GOVERNOR_ERROR_BUSY;
+	}
+	else if(profile != governor->profile)
+	{
+		uint32_t missed = governor_missed(governor);
+
+		governor_clocks(profile);
+		governor->profile = profile;
+		if(profile == GOVERNOR_PROFILE_VLPR)
+		{
+			// At 4MHz the LPSCI may not get close enough to the baud, go back up if not
+			if(uart_set_clock(UART_CLOCK_MCGIRCLK, CLOCK_GetInternalRefClkFreq()) != UART_ERROR_SUCCESS)
+			{
+				governor_clocks(GOVERNOR_PROFILE_RUN);
+				governor->profile = GOVERNOR_PROFILE_RUN;
+				governor->failed_switches++;
+				ret = GOVERNOR_ERROR_UART;
+			}
+		}
+		if(governor->profile == GOVERNOR_PROFILE_RUN)
+		{
+			uart_set_clock(UART_CLOCK_PLLFLL, CLOCK_GetPllFllSelClkFreq());
+		}
+
+		// ADACK does not follow the core clock but a bus clocked ADC would, and the block period is in core counts
+		uint32_t sample_rate = adc_sample_rate_calc(governor->config.adc);
+		acquire_set_rate(governor->config.acquire, sample_rate);
+		pipeline_settings settings;
+		pipeline_get_settings(&settings);
+		if(settings.sample_rate != sample_rate)
+		{
+			settings.sample_rate = sample_rate;
+			pipeline_set_settings(&settings);
+		}
+
+		governor->switches++;
+		governor->switch_missed += governor_missed(governor) - missed;
+	}
+
+	return ret;
+}
+
+// Modelled energy per block in nJ for a profile (mV * uA * us / 1e6) - datasheet IDD, not a measurement, and the
+// core draws the same busy or polling so the load does not enter into it
+uint32_t governor_block_energy(governor_handle* governor, governor_profile profile)
+{
+	uint32_t current_ua[] = GOVERNOR_CURRENT_UA;
+	acquire_config* acquire = &governor->config.acquire->config;
+	uint64_t block_us = acquire->sample_rate ? ((uint64_t)acquire->block_size * 1000000U) / acquire->sample_rate : 0;
+
+	return (uint32_t)(((uint64_t)GOVERNOR_SUPPLY_MV * current_ua[profile] * block_us) / 1000000U);
+}
+
+uint32_t governor_average_energy(governor_handle* governor)
+{
+	uint64_t energy = 0;
+	uint64_t blocks = 0;
+
+	for(uint8_t p = 0; p < GOVERNOR_PROFILE_COUNT; p++)
+	{
+		energy += (uint64_t)governor->blocks[p] * governor_block_energy(governor, (governor_profile)p);
+		blocks += governor->blocks[p];
+	}
+
+	return blocks ? (uint32_t)(energy / blocks) : 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Same steps as BOARD_BootClockRUN/VLPR, from a running system (the MCG walks through the modes between)
+static void governor_clocks(governor_profile profile)
+{
+	if(profile == GOVERNOR_PROFILE_VLPR)
+	{
+		CLOCK_SetSimSafeDivs();
+		CLOCK_SetMcgConfig(&mcgConfig_BOARD_BootClockVLPR);
+		CLOCK_SetSimConfig(&simConfig_BOARD_BootClockVLPR);
+		SMC_SetPowerModeVlpr(SMC);
+		while(SMC_GetPowerModeState(SMC) != kSMC_PowerStateVlpr)
+		{
+		}
+		SystemCoreClock = BOARD_BOOTCLOCKVLPR_CORE_CLOCK;
+	}
+	else
+	{
+		// Out of VLPR before the clocks go back up
+		SMC_SetPowerModeRun(SMC);
+		while(SMC_GetPowerModeState(SMC) != kSMC_PowerStateRun)
+		{
+		}
+		CLOCK_SetSimSafeDivs();
+		CLOCK_SetMcgConfig(&mcgConfig_BOARD_BootClockRUN);
+		CLOCK_SetSimConfig(&simConfig_BOARD_BootClockRUN);
+		SystemCoreClock = BOARD_BOOTCLOCKRUN_CORE_CLOCK;
+	}
+}
+
+// Blocks the DMA finished that the main loop never picked up
+static uint32_t governor_missed(governor_handle* governor)
+{
+	return governor->config.acquire->blocks - *governor->config.processed_blocks;
+}
@@ -0,0 +1,154 @@
+/*
+ * histogram.c
+ *
+ *  Created on: Dec 19, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "histogram.h"
+#include <string.h>
+#include <stdlib.h>
+
+/* DEFINES AND STATIC DATA */
+#define HISTOGRAM_MAX_VALUE		0x7FFFU		// |-32768| is counted with full scale
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint8_t histogram_bin(uint16_t value);
+static void histogram_count(histogram* hist, uint8_t bin);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Empty every bin
+void histogram_reset(histogram* hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+// Bin every |x| in a block
+void histogram_add_block(histogram* hist, volatile int16_t* buffer, uint8_t buffer_size)
+{
+	for(volatile int16_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
+	{
+		histogram_count(hist, histogram_bin(abs(*ptr)));
+	}
+}
+
+// Bin one magnitude (a block max for a per block histogram)
+void histogram_add_value(histogram* hist, uint16_t value)
+{
+	histogram_count(hist, histogram_bin(value));
+}
+
+// Smallest |x| that lands in a bin
+uint16_t histogram_bin_floor(uint8_t bin)
+{
+	uint8_t octave = bin >> HISTOGRAM_SUB_BITS;
+	uint8_t sub = bin & (HISTOGRAM_BINS_PER_OCTAVE - 1);
+	uint16_t ret = 0;
+
+	if(octave > HISTOGRAM_SUB_BITS)
+	{
+		ret = (HISTOGRAM_BINS_PER_OCTAVE | sub) << (octave - 1 - HISTOGRAM_SUB_BITS);
+	}
+	else if(octave > 0)
+	{
+		// Short octaves only use the low bins, x itself is the bin within the octave
+		ret = (1U << (octave - 1)) + sub;
+	}
+
+	return ret;
+}
+
+// Level exceeded exceed_percent of the time (L10 is 10, L90 is 90), as the floor of the bin it falls in
+uint16_t histogram_level(histogram* hist, uint8_t exceed_percent)
+{
+	// Walk down from the top until exceed_percent of the counts are above
+	uint64_t target = ((uint64_t)hist->total * exceed_percent) / 100;
+	uint64_t above = 0;
+	uint8_t bin = HISTOGRAM_BINS;
+
+	while(bin > 0)
+	{
+		bin--;
+		above += hist->bins[bin];
+		if(above > target)
+		{
+			break;
+		}
+	}
+
+	return histogram_bin_floor(bin);
+}
+
+// Pack for a telemetry frame, returns HISTOGRAM_PACK_BYTES
+uint16_t histogram_pack(histogram* hist, uint8_t* payload)
+{
+	uint8_t* ptr = payload;
+
+	for(int16_t i = -1; i < HISTOGRAM_BINS; i++)
+	{
+		uint32_t value = (i < 0) ? hist->total : hist->bins[i];
+		*ptr++ = (uint8_t)value;
+		*ptr++ = (uint8_t)(value >> 8);
+		*ptr++ = (uint8_t)(value >> 16);
+		*ptr++ = (uint8_t)(value >> 24);
+	}
+
+	return HISTOGRAM_PACK_BYTES;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Bit length by halving (no CLZ on the M0+), then the next HISTOGRAM_SUB_BITS bits under the top one
+static uint8_t histogram_bin(uint16_t value)
+{
+	uint8_t octave = 0;
+	uint8_t sub = 0;
+
+	if(value > HISTOGRAM_MAX_VALUE)
+	{
+		value = HISTOGRAM_MAX_VALUE;
+	}
+
+	if(value)
+	{
+		uint16_t top = value;
+		octave = 1;
+		if(top & 0xFF00U) { top >>= 8; octave += 8; }
+		if(top & 0x00F0U) { top >>= 4; octave += 4; }
+		if(top & 0x000CU) { top >>= 2; octave += 2; }
+		if(top & 0x0002U) { octave += 1; }
+
+		if(octave > HISTOGRAM_SUB_BITS)
+		{
+			sub = (value >> (octave - 1 - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_BINS_PER_OCTAVE - 1);
+		}
+		else
+		{
+			sub = value - (1U << (octave - 1));
+		}
+	}
+
+	return (octave << HISTOGRAM_SUB_BITS) | sub;
+}
+
+// One count, halve everything once the total gets big
+static void histogram_count(histogram* hist, uint8_t bin)
+{
+	hist->bins[bin]++;
+	hist->total++;
+
+	if(hist->total >= HISTOGRAM_TOTAL_LIMIT)
+	{
+		hist->total = 0;
+		for(uint8_t i = 0; i < HISTOGRAM_BINS; i++)
+		{
+			hist->bins[i] >>= 1;
+			hist->total += hist->bins[i];
+		}
+	}
+}
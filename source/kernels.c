@@ -0,0 +1,433 @@
+/*
+ * kernels.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+// Intrinsics first, CMSIS defines __I/__O/__IO that their headers use as names
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86			1
+#else
+#define KERNELS_X86			0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KERNELS_NEON_BUILT	1
+#else
+#define KERNELS_NEON_BUILT	0
+#endif
+
+#include "kernels.h"
+#include "peak_detect.h"
+
+/* DEFINES AND STATIC DATA */
+#define KERNELS_SIMD_TARGET(isa)	__attribute__((target(isa)))
+#define KERNELS_FULL_SCALE			32767		// dbfs_output clamps here
+
+#if KERNELS_X86 || KERNELS_NEON_BUILT
+static const uint32_t kernels_counts[] = dBFS_LUT_COUNTS;
+static const uint32_t kernels_db[] = dBFS_LUT_dB;
+static const uint32_t kernels_slope[] = dBFS_LUT_SLOPE;
+#endif
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint16_t scalar_block_max(const int16_t* buffer, uint32_t count);
+static uint64_t scalar_energy(const int16_t* buffer, uint32_t count);
+static void scalar_dbfs(const uint16_t* input, uint16_t* output, uint32_t count);
+static bool kernels_supported(kernels_variant variant);
+
+#if KERNELS_X86
+static uint16_t sse2_block_max(const int16_t* buffer, uint32_t count);
+static uint64_t sse2_energy(const int16_t* buffer, uint32_t count);
+static void sse2_dbfs(const uint16_t* input, uint16_t* output, uint32_t count);
+static uint16_t avx2_block_max(const int16_t* buffer, uint32_t count);
+static uint64_t avx2_energy(const int16_t* buffer, uint32_t count);
+static void avx2_dbfs(const uint16_t* input, uint16_t* output, uint32_t count);
+#endif
+
+#if KERNELS_NEON_BUILT
+static uint16_t neon_block_max(const int16_t* buffer, uint32_t count);
+static uint64_t neon_energy(const int16_t* buffer, uint32_t count);
+static void neon_dbfs(const uint16_t* input, uint16_t* output, uint32_t count);
+#endif
+
+static const kernels_table kernels_tables[KERNELS_VARIANTS] =
+{
+	[KERNELS_SCALAR] = {"scalar", scalar_block_max, scalar_energy, scalar_dbfs},
+	#if KERNELS_X86
+	[KERNELS_SSE2] = {"sse2", sse2_block_max, sse2_energy, sse2_dbfs},
+	[KERNELS_AVX2] = {"avx2", avx2_block_max, avx2_energy, avx2_dbfs},
+	#endif
+	#if KERNELS_NEON_BUILT
+	[KERNELS_NEON] = {"neon", neon_block_max, neon_energy, neon_dbfs},
+	#endif
+};
+
+
+/* FUNCTION DEFINITIONS */
+
+// A variant's kernels, NULL if it is not built in or this CPU lacks it
+const kernels_table* kernels_get(kernels_variant variant)
+{
+	const kernels_table* ret = NULL;
+
+	if(	(variant < KERNELS_VARIANTS)				&&
+		(kernels_tables[variant].name != NULL)		&&
+		kernels_supported(variant)					)
+	{
+		ret = &kernels_tables[variant];
+	}
+
+	return ret;
+}
+
+// Fastest variant this CPU runs - later in the enum is wider
+const kernels_table* kernels_best(void)
+{
+	const kernels_table* ret = NULL;
+
+	for(int8_t variant = KERNELS_VARIANTS - 1; (variant >= 0) && (ret == NULL); variant--)
+	{
+		ret = kernels_get((kernels_variant)variant);
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+static bool kernels_supported(kernels_variant variant)
+{
+	bool ret = true;
+
+	#if KERNELS_X86
+	__builtin_cpu_init();
+	if(variant == KERNELS_SSE2)
+	{
+		ret = __builtin_cpu_supports("sse2");
+	}
+	else if(variant == KERNELS_AVX2)
+	{
+		ret = __builtin_cpu_supports("avx2");
+	}
+	#else
+	(void)variant;
+	#endif
+
+	return ret;
+}
+
+// Scalar - the firmware kernels in pieces they take, also the tails of the wide ones
+static uint16_t scalar_block_max(const int16_t* buffer, uint32_t count)
+{
+	uint16_t max = 0;
+
+	while(count)
+	{
+		uint8_t size = (uint8_t)MIN(count, UINT8_MAX);
+		uint16_t block_max = peak_block_max((volatile int16_t*)buffer, size);
+		max = MAX(max, block_max);
+		buffer += size;
+		count -= size;
+	}
+
+	return max;
+}
+
+static uint64_t scalar_energy(const int16_t* buffer, uint32_t count)
+{
+	uint64_t energy = 0;
+
+	while(count)
+	{
+		uint8_t size = (uint8_t)MIN(count, UINT8_MAX);
+		energy += peak_block_energy((volatile int16_t*)buffer, size);
+		buffer += size;
+		count -= size;
+	}
+
+	return energy;
+}
+
+static void scalar_dbfs(const uint16_t* input, uint16_t* output, uint32_t count)
+{
+	for(uint32_t i = 0; i < count; i++)
+	{
+		output[i] = (uint16_t)dbfs_output(input[i]);
+	}
+}
+
+#if KERNELS_X86
+
+// |x| as unsigned (INT16_MIN is 32768), biased by 0x8000 so the signed pmaxsw orders it
+KERNELS_SIMD_TARGET("sse2") static uint16_t sse2_block_max(const int16_t* buffer, uint32_t count)
+{
+	const __m128i bias = _mm_set1_epi16((int16_t)0x8000);
+	__m128i max[2] = {bias, bias};
+	uint32_t i = 0;
+
+	for(; (i + 16) <= count; i += 16)
+	{
+		for(uint8_t n = 0; n < 2; n++)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)&buffer[i + (8 * n)]);
+			__m128i sign = _mm_srai_epi16(x, 15);
+			__m128i magnitude = _mm_sub_epi16(_mm_xor_si128(x, sign), sign);
+			max[n] = _mm_max_epi16(max[n], _mm_xor_si128(magnitude, bias));
+		}
+	}
+
+	__m128i all = _mm_max_epi16(max[0], max[1]);
+	all = _mm_max_epi16(all, _mm_shuffle_epi32(all, _MM_SHUFFLE(1, 0, 3, 2)));
+	all = _mm_max_epi16(all, _mm_shuffle_epi32(all, _MM_SHUFFLE(2, 3, 0, 1)));
+	all = _mm_max_epi16(all, _mm_shufflelo_epi16(all, _MM_SHUFFLE(2, 3, 0, 1)));
+	uint16_t wide = (uint16_t)(_mm_cvtsi128_si32(all) ^ 0x8000);
+	uint16_t tail = scalar_block_max(&buffer[i], count - i);
+
+	return MAX(wide, tail);
+}
+
+// pmaddwd gives a^2 + b^2 per lane, up to 2^31 so it is widened unsigned
+KERNELS_SIMD_TARGET("sse2") static uint64_t sse2_energy(const int16_t* buffer, uint32_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+	uint64_t lanes[2];
+	uint32_t i = 0;
+
+	for(; (i + 8) <= count; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)&buffer[i]);
+		__m128i pairs = _mm_madd_epi16(x, x);
+		sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(pairs, zero));
+		sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(pairs, zero));
+	}
+	_mm_storeu_si128((__m128i*)lanes, sum);
+
+	return lanes[0] + lanes[1] + scalar_energy(&buffer[i], count - i);
+}
+
+// Low 32 bits of each 32 bit product, SSE2 only multiplies the even lanes
+KERNELS_SIMD_TARGET("sse2") static inline __m128i sse2_mullo_epi32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+								_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// dbfs_output on 4 lanes - the float exponent is the table segment, SSE2 has no variable shuffle so the table
+// reads are per lane (0 has no exponent, its segment is 0 with no slope, which is dbfs_output's first entry)
+KERNELS_SIMD_TARGET("sse2") static inline __m128i sse2_dbfs_lanes(__m128i input)
+{
+	const __m128i full_scale = _mm_set1_epi32(KERNELS_FULL_SCALE);
+	__m128i over = _mm_cmpgt_epi32(input, full_scale);
+	input = _mm_or_si128(_mm_and_si128(over, full_scale), _mm_andnot_si128(over, input));
+
+	uint32_t exponent[4];
+	uint32_t db[4];
+	uint32_t counts[4];
+	uint32_t slope[4];
+	_mm_storeu_si128((__m128i*)exponent, _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(input)), 23));
+	for(uint8_t lane = 0; lane < 4; lane++)
+	{
+		uint32_t segment = exponent[lane] ? (exponent[lane] - 127) : 0;
+		db[lane] = kernels_db[segment];
+		counts[lane] = kernels_counts[segment];
+		slope[lane] = exponent[lane] ? kernels_slope[segment + 1] : 0;
+	}
+
+	__m128i line = sse2_mullo_epi32(_mm_sub_epi32(input, _mm_loadu_si128((const __m128i*)counts)),
+									_mm_loadu_si128((const __m128i*)slope));
+	__m128i db_lanes = _mm_loadu_si128((const __m128i*)db);
+
+	return _mm_sub_epi32(db_lanes, _mm_srli_epi32(line, 16));
+}
+
+KERNELS_SIMD_TARGET("sse2") static void sse2_dbfs(const uint16_t* input, uint16_t* output, uint32_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t i = 0;
+
+	for(; (i + 8) <= count; i += 8)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)&input[i]);
+		__m128i low = sse2_dbfs_lanes(_mm_unpacklo_epi16(x, zero));
+		__m128i high = sse2_dbfs_lanes(_mm_unpackhi_epi16(x, zero));
+		_mm_storeu_si128((__m128i*)&output[i], _mm_packs_epi32(low, high));		// 12700 at most, no saturation
+	}
+	scalar_dbfs(&input[i], &output[i], count - i);
+}
+
+KERNELS_SIMD_TARGET("avx2") static uint16_t avx2_block_max(const int16_t* buffer, uint32_t count)
+{
+	__m256i max[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+	uint32_t i = 0;
+
+	for(; (i + 32) <= count; i += 32)
+	{
+		for(uint8_t n = 0; n < 2; n++)
+		{
+			__m256i x = _mm256_loadu_si256((const __m256i*)&buffer[i + (16 * n)]);
+			max[n] = _mm256_max_epu16(max[n], _mm256_abs_epi16(x));		// INT16_MIN stays 0x8000, 32768 unsigned
+		}
+	}
+
+	__m256i both = _mm256_max_epu16(max[0], max[1]);
+	__m128i all = _mm_max_epu16(_mm256_castsi256_si128(both), _mm256_extracti128_si256(both, 1));
+	// phminposuw finds the smallest, of the complement that is the largest
+	all = _mm_minpos_epu16(_mm_xor_si128(all, _mm_set1_epi16(-1)));
+	uint16_t wide = (uint16_t)~_mm_cvtsi128_si32(all);
+	uint16_t tail = scalar_block_max(&buffer[i], count - i);
+
+	return MAX(wide, tail);
+}
+
+KERNELS_SIMD_TARGET("avx2") static uint64_t avx2_energy(const int16_t* buffer, uint32_t count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i sum = zero;
+	uint64_t lanes[4];
+	uint32_t i = 0;
+
+	for(; (i + 16) <= count; i += 16)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)&buffer[i]);
+		__m256i pairs = _mm256_madd_epi16(x, x);
+		sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(pairs, zero));
+		sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(pairs, zero));
+	}
+	_mm256_storeu_si256((__m256i*)lanes, sum);
+
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalar_energy(&buffer[i], count - i);
+}
+
+// dbfs_output on 8 lanes - the float exponent is the table segment, two permutes cover the 16 entries
+KERNELS_SIMD_TARGET("avx2") static inline __m256i avx2_dbfs_lanes(__m256i input)
+{
+	const __m256i db_table[2] = {_mm256_loadu_si256((const __m256i*)&kernels_db[0]),
+									_mm256_loadu_si256((const __m256i*)&kernels_db[8])};
+	const __m256i slope_table[2] = {_mm256_loadu_si256((const __m256i*)&kernels_slope[1]),
+									_mm256_set_epi32(0, kernels_slope[15], kernels_slope[14], kernels_slope[13],
+														kernels_slope[12], kernels_slope[11], kernels_slope[10],
+														kernels_slope[9])};
+	const __m256i one = _mm256_set1_epi32(1);
+
+	input = _mm256_min_epu32(input, _mm256_set1_epi32(KERNELS_FULL_SCALE));
+
+	// Exact in a float up to 2^24, so the exponent is floor(log2(input)) - the segment below the input
+	__m256i segment = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(input)), 23),
+										_mm256_set1_epi32(127));
+	__m256i upper = _mm256_cmpgt_epi32(segment, _mm256_set1_epi32(7));
+	__m256i db = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(db_table[0], segment),
+									_mm256_permutevar8x32_epi32(db_table[1], segment), upper);
+	__m256i slope = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(slope_table[0], segment),
+										_mm256_permutevar8x32_epi32(slope_table[1], segment), upper);
+	__m256i counts = _mm256_sub_epi32(_mm256_sllv_epi32(one, segment), one);
+
+	__m256i line = _mm256_mullo_epi32(_mm256_sub_epi32(input, counts), slope);
+	__m256i output = _mm256_sub_epi32(db, _mm256_srli_epi32(line, 16));
+
+	// 0 has no exponent, it is the first table entry
+	__m256i silent = _mm256_cmpeq_epi32(input, _mm256_setzero_si256());
+
+	return _mm256_blendv_epi8(output, _mm256_set1_epi32(kernels_db[0]), silent);
+}
+
+KERNELS_SIMD_TARGET("avx2") static void avx2_dbfs(const uint16_t* input, uint16_t* output, uint32_t count)
+{
+	uint32_t i = 0;
+
+	for(; (i + 16) <= count; i += 16)
+	{
+		__m256i low = avx2_dbfs_lanes(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&input[i])));
+		__m256i high = avx2_dbfs_lanes(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)&input[i + 8])));
+		// packus works in 128 bit halves, the permute puts the quarters back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i*)&output[i], packed);
+	}
+	scalar_dbfs(&input[i], &output[i], count - i);
+}
+
+#endif
+
+#if KERNELS_NEON_BUILT
+
+// vabsq_s16 wraps INT16_MIN to itself, 32768 once it is read unsigned
+static uint16_t neon_block_max(const int16_t* buffer, uint32_t count)
+{
+	uint16x8_t max[2] = {vdupq_n_u16(0), vdupq_n_u16(0)};
+	uint32_t i = 0;
+
+	for(; (i + 16) <= count; i += 16)
+	{
+		for(uint8_t n = 0; n < 2; n++)
+		{
+			max[n] = vmaxq_u16(max[n], vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(&buffer[i + (8 * n)]))));
+		}
+	}
+
+	uint16_t wide = vmaxvq_u16(vmaxq_u16(max[0], max[1]));
+	uint16_t tail = scalar_block_max(&buffer[i], count - i);
+
+	return MAX(wide, tail);
+}
+
+static uint64_t neon_energy(const int16_t* buffer, uint32_t count)
+{
+	uint64x2_t sum = vdupq_n_u64(0);
+	uint32_t i = 0;
+
+	for(; (i + 8) <= count; i += 8)
+	{
+		int16x8_t x = vld1q_s16(&buffer[i]);
+		sum = vpadalq_u32(sum, vreinterpretq_u32_s32(vmull_s16(vget_low_s16(x), vget_low_s16(x))));
+		sum = vpadalq_u32(sum, vreinterpretq_u32_s32(vmull_high_s16(x, x)));
+	}
+
+	return vaddvq_u64(sum) + scalar_energy(&buffer[i], count - i);
+}
+
+// dbfs_output on 4 lanes, same threshold walk as SSE2
+static inline uint32x4_t neon_dbfs_lanes(uint32x4_t input)
+{
+	input = vminq_u32(input, vdupq_n_u32(KERNELS_FULL_SCALE));
+
+	uint32x4_t db = vdupq_n_u32(kernels_db[0]);
+	uint32x4_t counts = vdupq_n_u32(0);
+	uint32x4_t slope = vdupq_n_u32(0);
+	for(uint8_t k = 0; k < (dBFS_LUT_ENTRIES - 1); k++)
+	{
+		uint32x4_t above = vcgtq_u32(input, vdupq_n_u32(kernels_counts[k]));
+		db = vbslq_u32(above, vdupq_n_u32(kernels_db[k]), db);
+		counts = vbslq_u32(above, vdupq_n_u32(kernels_counts[k]), counts);
+		slope = vbslq_u32(above, vdupq_n_u32(kernels_slope[k + 1]), slope);
+	}
+
+	uint32x4_t line = vmulq_u32(vsubq_u32(input, counts), slope);
+
+	return vsubq_u32(db, vshrq_n_u32(line, 16));
+}
+
+static void neon_dbfs(const uint16_t* input, uint16_t* output, uint32_t count)
+{
+	uint32_t i = 0;
+
+	for(; (i + 8) <= count; i += 8)
+	{
+		uint16x8_t x = vld1q_u16(&input[i]);
+		uint32x4_t low = neon_dbfs_lanes(vmovl_u16(vget_low_u16(x)));
+		uint32x4_t high = neon_dbfs_lanes(vmovl_high_u16(x));
+		vst1q_u16(&output[i], vcombine_u16(vmovn_u32(low), vmovn_u32(high)));
+	}
+	scalar_dbfs(&input[i], &output[i], count - i);
+}
+
+#endif
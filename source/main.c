@@ -43,21 +43,35 @@
 /* APPLICATION INCLUDES */
 #include "adc_driver.h"
 #include "dma_driver.h"
-#include "peak_detect.h"
+#include "acquire.h"
+#include "pipeline.h"
+#include "compress.h"
+#include "telemetry.h"
+#include "uart_driver.h"
+#include "bench.h"
+#include "commands.h"
+#include "format.h"
+#include "oversample.h"
+#include "placement.h"
+#include "platform.h"
+#include "governor.h"
+#include "blocksize.h"
+#include "acquire_setup.h"
+#include "blockpool.h"
+#include "capture.h"
+#include "cycle_counter.h"
+#include "rtt.h"
+#include "trace.h"
 
 
 /* DEFINES AND TYPEDEFS */
 #define PRINT_PRETTY_LINES	1
 #define PRINT_TEXT_OUT		1
+#define PRETTY_SCALE_SHIFT	8			// Bar length is dBFS >> this
 #if PRINT_PRETTY_LINES && PRINT_TEXT_OUT
 #warning Printing Lines and Text is very slow and may break the program
 #endif
 
-#define BUFF_DOUBLE_SIZE	128
-#define BUFF_ITEM_BYTES		2
-#define BUFF_DOUBLE_BYTES	(BUFF_DOUBLE_SIZE*BUFF_ITEM_BYTES)
-#define BUFF_HALF_SIZE		(BUFF_DOUBLE_SIZE/2)
-#define BUFF_HALF_BYTES		(BUFF_HALF_SIZE*BUFF_ITEM_BYTES)
 #define RAND_GPIO_BASE		GPIOE
 #define RAND_GPIO_PORT		PORTE
 #define RAND_GPIO_PIN		5
@@ -65,10 +79,126 @@
 #define RAND_PORT_SETUP		{.driveStrength = kPORT_HighDriveStrength, .mux = kPORT_MuxAsGpio, .pullSelect = kPORT_PullDown}
 #define RAND_GPIO_CLOCK		kCLOCK_PortE
 
+#define TRIGGER_STREAM_CHUNK	16
+#define TRIGGER_LINE_BYTES		22			// TRIG4294967295:-32768\n
+
+#define RUN_BENCHMARK		0
+
+#define ENABLE_RAW_STREAM	0
+#define RAW_STREAM_BAUD		115200
+
+// Software oversampling - ADC runs unaveraged, blocks feed peak detection as is and a decimated high resolution stream
+#define ENABLE_OVERSAMPLE	0
+#define OVERSAMPLE_BITS		2		// 18 bit output at 1/16 of the raw rate
+#define OVERSAMPLE_FRAME_SAMPLES	32
+
+#define ENABLE_SHELL		1
+#define SHELL_RX_RING_SIZE	64
+
+// Low latency - the block being filled runs through the per sample stages a chunk at a time as the DMA byte count
+// shows samples landing, so the alarm LED follows the signal within a chunk instead of a whole block.
+// Block results are the same, shell commands, snapshot streaming and clock changes wait for a block boundary.
+#define ENABLE_LOW_LATENCY	0
+#define LOW_LATENCY_CHUNK	8			// Samples
+#define ALARM_LEVEL			16384		// Block max |x| that lights the alarm
+#define ALARM_GPIO_BASE		BOARD_LED_RED_GPIO
+#define ALARM_GPIO_PORT		BOARD_LED_RED_GPIO_PORT
+#define ALARM_GPIO_PIN		BOARD_LED_RED_GPIO_PIN
+#define ALARM_GPIO_SETUP	{kGPIO_DigitalOutput, 1}		// LED is active low
+#define ALARM_PORT_SETUP	{.driveStrength = kPORT_LowDriveStrength, .mux = kPORT_MuxAsGpio, .pullSelect = kPORT_PullDisable}
+#define ALARM_GPIO_CLOCK	kCLOCK_PortB
+
+// Frames and report text go to the RTT rings (rtt.h ENABLE_RTT) instead of the UART
+// A frame is only dropped when the probe has fallen a whole ring behind
+// On the UART the text is queued in the driver and goes out between frames, nothing else writes to UART0 (the
+// SDK debug console is not started), so frames, report text and shell replies never interleave
+#if ENABLE_RTT
+#define STREAM_BUSY(frame)				(rtt_space(RTT_UP_TELEMETRY) < sizeof(frame))
+#define STREAM_SEND(frame, length)		rtt_write(RTT_UP_TELEMETRY, frame, length)
+#define REPORT_WRITE(text, length)		rtt_write(RTT_UP_TERMINAL, text, length)
+#define REPORT_SPACE()					rtt_space(RTT_UP_TERMINAL)
+#define REPORT_WRITE_WAIT				report_write_wait
+#else
+#define STREAM_BUSY(frame)				uart_send_busy()
+#define STREAM_SEND(frame, length)		uart_send(frame, length)
+#define REPORT_WRITE(text, length)		uart_write(text, length)
+#define REPORT_SPACE()					uart_write_space()
+#define REPORT_WRITE_WAIT				uart_write_wait
+#endif
+
+// Clock governor - steps between RUN (48MHz) and VLPR (4MHz) on the measured per block processing load
+#define ENABLE_GOVERNOR		0
+
+// Adaptive block length - short blocks for latency, longer ones while the main loop is falling behind
+#define ENABLE_BLOCKSIZE	0
+
+// Block pool - the DMA fills reference counted blocks in place and the meter and the raw stream each take every
+// block from their own queue, so a slow consumer holds blocks instead of dropping them or having them refilled
+#define ENABLE_BLOCK_POOL	0
+#if ENABLE_BLOCK_POOL && ENABLE_LOW_LATENCY
+#error Low latency chunks follow the block being filled, the meter can be pool blocks behind it
+#endif
+
+// ADC and DMA setups are the field lists in acquire_setup.h, the configs below are filled from them
+// With static init the same lists are checked at build time and init writes register images folded into flash
+// (tools/image_check builds this configuration on the host)
+#define ENABLE_STATIC_INIT	0
+
 /* GLOBALS */
-volatile int16_t buffer[BUFF_DOUBLE_SIZE];
-volatile bool active_DMA_buffer = 0;
-volatile void* const buffer_ptr_lut[] = {&buffer[0], &buffer[BUFF_HALF_SIZE]};
+PLACEMENT_LINK_CHECK;			// Fails the link when ENABLE_RAM_HOT_PATH is on without the split memory map
+volatile int16_t buffer[ENABLE_BLOCK_POOL ? (BLOCKPOOL_BLOCKS * BUFF_HALF_SIZE) : BUFF_DOUBLE_SIZE];
+acquire_handle acquire;
+uint32_t processed_block_count = 0;
+// Text and pretty stay off while the raw stream is on
+uint8_t report_flags = ENABLE_RAW_STREAM ? REPORT_RAW : ((PRINT_TEXT_OUT ? REPORT_TEXT : 0) | (PRINT_PRETTY_LINES ? REPORT_PRETTY : 0));
+uint32_t raw_dropped = 0;
+#if ENABLE_RAW_STREAM
+uint8_t raw_frame[TELEMETRY_FRAME_BYTES(TELEMETRY_INDEX_BYTES + COMPRESS_MAX_BYTES(BUFF_HALF_SIZE))];
+uint8_t raw_sequence = 0;
+uint8_t info_frame[TELEMETRY_FRAME_BYTES(CAPTURE_INFO_BYTES)];
+uint8_t info_sequence = 0;
+bool info_due = true;
+#endif
+char report_line[MAX(FORMAT_REPORT_BYTES, FORMAT_TONE_BYTES)];
+char pretty_line[FORMAT_BAR_BYTES(PRETTY_SCALE_SHIFT)];
+#if ENABLE_OVERSAMPLE
+oversample_handle hires;
+int32_t hires_samples[OVERSAMPLE_FRAME_SAMPLES + OVERSAMPLE_MAX_OUTPUTS(BUFF_HALF_SIZE, 1)];
+uint8_t hires_count = 0;
+uint8_t hires_frame[TELEMETRY_FRAME_BYTES(1 + TELEMETRY_INDEX_BYTES + (OVERSAMPLE_FRAME_SAMPLES * 4))];
+uint8_t hires_sequence = 0;
+#endif
+#if ENABLE_SHELL
+uint8_t shell_rx_ring[SHELL_RX_RING_SIZE];
+#endif
+#if ENABLE_GOVERNOR
+governor_handle governor;
+#endif
+#if ENABLE_BLOCKSIZE
+blocksize_handle sizer;
+#endif
+#if ENABLE_BLOCK_POOL
+blockpool pool;
+uint8_t pool_meter;
+uint8_t pool_raw;
+#endif
+#if ENABLE_TRACE
+char trace_line[TRACE_LINE_BYTES];
+#endif
+#if ENABLE_LOW_LATENCY
+uint8_t chunk_done = 0;			// Samples of the filling half already through pipeline_process_chunk
+bool alarm_on = false;
+uint32_t alarm_count = 0;
+uint64_t alarm_sample = 0;		// Sample index of the chunk the last alarm came up in
+#endif
+
+#if ENABLE_RTT
+// Bench rows, the ring's own mode decides what a full ring does
+static void report_write_wait(const char* text, size_t length)
+{
+	rtt_write(RTT_UP_TERMINAL, text, length);
+}
+#endif
 
 
 /*
@@ -80,10 +210,20 @@ int main(void)
     BOARD_InitBootPins();
     BOARD_InitBootClocks();
     BOARD_InitBootPeripherals();
-  	/* Init FSL debug console. */
-    BOARD_InitDebugConsole();
+    // No FSL debug console - UART0 belongs to uart_driver, its blocking writes would land inside frames
+
+    // SETUP RTT CONSOLE (before anything that reports)
+	#if ENABLE_RTT
+    rtt_init();
+	#endif
 
-    PRINTF("START\n");
+    // SETUP MTB TRACE (stopped until "trace arm")
+	#if ENABLE_TRACE
+    trace_init();
+	#endif
+
+    // SETUP FLASH CONTROLLER (saved PLACR profile, "placr tune" picks one)
+    platform_error platform_err = platform_init();
 
     // SETUP RANDOM GPIO
     CLOCK_EnableClock(RAND_GPIO_CLOCK);
@@ -92,69 +232,374 @@ int main(void)
     gpio_pin_config_t pin_fig = RAND_GPIO_SETUP;
     GPIO_PinInit(RAND_GPIO_BASE, RAND_GPIO_PIN, &pin_fig);
 
+    // SETUP ALARM LED
+	#if ENABLE_LOW_LATENCY
+    CLOCK_EnableClock(ALARM_GPIO_CLOCK);
+    port_pin_config_t alarm_port_fig = ALARM_PORT_SETUP;
+    PORT_SetPinConfig(ALARM_GPIO_PORT, ALARM_GPIO_PIN, &alarm_port_fig);
+    gpio_pin_config_t alarm_pin_fig = ALARM_GPIO_SETUP;
+    GPIO_PinInit(ALARM_GPIO_BASE, ALARM_GPIO_PIN, &alarm_pin_fig);
+	#endif
+
     // SETUP DMAMUX
     dma_mux_config dma_mux_fig_chan0 = DMA_MUX_CONFIG_DEFAULT;
     dma_error dma_mux_0_err = dma_mux_init(&dma_mux_fig_chan0);
 
     // SETUP DMA
-    dma_init_config dma_fig_chan0 = DMA_INIT_CONFIG_DEFAULT;
-    dma_fig_chan0.dma = DMA0;
-    dma_fig_chan0.src_addr = &(ADC0->R[ADC_MUX_A]);
-    dma_fig_chan0.dest_addr = &buffer[0];
-    dma_fig_chan0.byte_count = BUFF_HALF_BYTES;
-    dma_fig_chan0.src_size = DMA_SIZE_16;
-    dma_fig_chan0.dest_size = DMA_SIZE_16;
-    dma_fig_chan0.interrupt = true;
-    dma_fig_chan0.peripheral_en = true;
-    dma_fig_chan0.steal_cycles = true;
-    dma_fig_chan0.dest_inc = true;
-    dma_fig_chan0.auto_disable_req = true;
-
+    dma_init_config dma_fig_chan0 = {DMA_FIG_SETUP};
+	#if ENABLE_STATIC_INIT
+    DMA_IMAGE_ASSERT(DMA_FIG_SETUP);
+    static const dma_image dma_image_chan0 = DMA_IMAGE(DMA_FIG_SETUP);
+    dma_init_image(&dma_image_chan0);
+    dma_error dma_0_err = DMA_ERROR_SUCCESS;
+	#else
     dma_error dma_0_err = dma_init(&dma_fig_chan0);
+	#endif
+
+    // SETUP DOUBLE BUFFER / ERROR RECOVERY
+    acquire_config acquire_fig = ACQUIRE_CONFIG_DEFAULT;
+    acquire_fig.dma = dma_fig_chan0.dma;
+    acquire_fig.channel = dma_fig_chan0.channel;
+    acquire_fig.buffer = buffer;
+    acquire_fig.block_size = BUFF_HALF_SIZE;
 
+    // SETUP BLOCK POOL (consumers subscribe before the DMA mux is enabled)
+    blockpool_error pool_err = BLOCKPOOL_ERROR_SUCCESS;
+	#if ENABLE_BLOCK_POOL
+    blockpool_config pool_fig = BLOCKPOOL_CONFIG_DEFAULT;
+    pool_fig.buffer = buffer;
+    pool_fig.block_size = BUFF_HALF_SIZE;
+    pool_err = blockpool_init(&pool, &pool_fig);
+    pool_err = (pool_err == BLOCKPOOL_ERROR_SUCCESS) ? blockpool_subscribe(&pool, "meter", &pool_meter) : pool_err;
+		#if ENABLE_RAW_STREAM
+    pool_err = (pool_err == BLOCKPOOL_ERROR_SUCCESS) ? blockpool_subscribe(&pool, "raw", &pool_raw) : pool_err;
+		#endif
+    acquire_fig.pool = &pool;
+	#endif
+    acquire_error acquire_err = acquire_init(&acquire, &acquire_fig);
 
-    // SETUP ADC
-    adc_init_config adc_fig = ADC_INIT_CONFIG_DEFAULT;
-    adc_fig.channel = ADC_CHAN_DAD0;
-    adc_fig.bits = ADC_BITS_16BIT_DIFF;
-    adc_fig.continuous = ADC_CONTINUOUS_CONTINUOUS;
-    adc_fig.avg_samps = ADC_SAMP_AVG_4;
-    adc_fig.sample_cycle_add = ADC_SMP_CYCLE_ADD_HS_22;
-    adc_fig.port = PORTE;
-    adc_fig.pin_1 = 20;
-    adc_fig.pin_2 = 21;
-    adc_fig.dma_mode = ADC_DMA_ENABLED;
 
+    // SETUP ADC (adc_fig stays for the rate math, the governor and the shell)
+    adc_init_config adc_fig = {ADC_FIG_SETUP};
+	#if ENABLE_STATIC_INIT
+    ADC_IMAGE_ASSERT(ADC_FIG_SETUP);
+    static const adc_image adc_image_0 = ADC_IMAGE(ADC_FIG_SETUP);
+    adc_error adc_err = adc_init_image(&adc_image_0);
+	#else
     adc_error adc_err = adc_init(&adc_fig);
+	#endif
+    acquire_set_rate(&acquire, adc_sample_rate_calc(&adc_fig));
+
+    // SETUP PROCESSING
+    pipeline_error pipe_err = pipeline_init(adc_sample_rate_calc(&adc_fig));
+
+    // SETUP CONSOLE / RAW STREAM / SHELL UART
+    uart_init_config uart_fig = UART_INIT_CONFIG_DEFAULT;
+    uart_fig.baud = RAW_STREAM_BAUD;
+    uart_error uart_err = uart_init(&uart_fig);
+    REPORT_WRITE("START\n", 6);
+
+    // SETUP OVERSAMPLING
+    oversample_error os_err = OVERSAMPLE_ERROR_SUCCESS;
+	#if ENABLE_OVERSAMPLE
+    oversample_config os_fig = OVERSAMPLE_CONFIG_DEFAULT;
+    os_fig.extra_bits = OVERSAMPLE_BITS;
+    os_err = oversample_init(&hires, &os_fig);
+	#endif
+
+    // SETUP CLOCK GOVERNOR
+    governor_error gov_err = GOVERNOR_ERROR_SUCCESS;
+	#if ENABLE_GOVERNOR
+    governor_config gov_fig = GOVERNOR_CONFIG_DEFAULT;
+    gov_fig.acquire = &acquire;
+    gov_fig.adc = &adc_fig;
+    gov_fig.processed_blocks = &processed_block_count;
+    gov_err = governor_init(&governor, &gov_fig);
+	#endif
+
+    // SETUP BLOCK SIZING (after the rate is set, the latency size comes from it)
+    blocksize_error size_err = BLOCKSIZE_ERROR_SUCCESS;
+	#if ENABLE_BLOCKSIZE
+    blocksize_config size_fig = BLOCKSIZE_CONFIG_DEFAULT;
+    size_fig.acquire = &acquire;
+    size_fig.processed_blocks = &processed_block_count;
+    size_err = blocksize_init(&sizer, &size_fig);
+	#endif
+
+    // SETUP SHELL
+    commands_error cmd_err = COMMANDS_ERROR_SUCCESS;
+	#if ENABLE_SHELL
+    commands_context cmd_context = {.adc = &adc_fig, .report_flags = &report_flags, .acquire = &acquire,
+    								.processed_blocks = &processed_block_count, .raw_dropped = &raw_dropped,
+									.write_wait = REPORT_WRITE_WAIT};
+		#if ENABLE_GOVERNOR
+    cmd_context.governor = &governor;
+		#endif
+		#if ENABLE_BLOCKSIZE
+    cmd_context.sizer = &sizer;
+		#endif
+		#if ENABLE_BLOCK_POOL
+    cmd_context.pool = &pool;
+		#endif
+    cmd_err = commands_init(&cmd_context, shell_rx_ring, sizeof(shell_rx_ring));
+	#endif
 
     if(	(dma_0_err != DMA_ERROR_SUCCESS)	|
 		(adc_err != ADC_ERROR_SUCCESS)		|
-		(dma_mux_0_err != DMA_ERROR_SUCCESS))
+		(dma_mux_0_err != DMA_ERROR_SUCCESS)|
+		(acquire_err != ACQUIRE_ERROR_SUCCESS)	|
+		(pipe_err != PIPELINE_ERROR_SUCCESS)	|
+		(uart_err != UART_ERROR_SUCCESS)	|
+		(cmd_err != COMMANDS_ERROR_SUCCESS)	|
+		(os_err != OVERSAMPLE_ERROR_SUCCESS)	|
+		(platform_err != PLATFORM_ERROR_SUCCESS)	|
+		(gov_err != GOVERNOR_ERROR_SUCCESS)	|
+		(size_err != BLOCKSIZE_ERROR_SUCCESS)	|
+		(pool_err != BLOCKPOOL_ERROR_SUCCESS))
     {
     	__asm__("BKPT");
     }
 
+	#if RUN_BENCHMARK
+    // Block size sweep before acquisition starts, CSV out the console
+    bench_config bench_fig = BENCH_CONFIG_DEFAULT;
+    bench_fig.sample_rate = adc_sample_rate_calc(&adc_fig);
+    bench_fig.write = REPORT_WRITE_WAIT;
+    bench_run(&bench_fig);
+	#endif
+
     // Enable DMA Mux
     dma_mux_channel_enable(dma_mux_fig_chan0.dma_mux, dma_mux_fig_chan0.channel, true);
 
-    bool last_active_DMA_buffer = active_DMA_buffer;
-    uint16_t output_adc_counts = 0;
-    uint16_t output_dbfs = 0;
+	#if !ENABLE_BLOCK_POOL
+    bool last_active_DMA_buffer = acquire.active;
+	#endif
+    pipeline_output output = {0};
 
     while(1)
     {
-    	if(active_DMA_buffer != last_active_DMA_buffer)
+		#if ENABLE_BLOCK_POOL
+    	// Oldest block the meter has not released, the DMA leaves it alone until every consumer has
+    	blockpool_block* block = blockpool_peek(&pool, pool_meter);
+    	if(block != NULL)
+		#else
+    	if(acquire.active != last_active_DMA_buffer)
+		#endif
     	{
-			output_adc_counts = peak_output(buffer_ptr_lut[last_active_DMA_buffer], BUFF_HALF_SIZE, 1);
-			output_dbfs = dbfs_output(output_adc_counts);
+    		TRACE_REGION_START();
 
-			#if PRINT_TEXT_OUT
-			uint16_t out_whole = output_dbfs/100;
-			uint16_t out_decimal = output_dbfs - (out_whole * 100);
-				printf("ADC:%d - dBFS:-%d.%d\n", output_adc_counts, out_whole, out_decimal);
+			#if ENABLE_GOVERNOR
+    		uint32_t busy_start = cycle_counter_now();
 			#endif
-			#if PRINT_PRETTY_LINES
-				pretty_print(output_dbfs, 8);
+
+			#if ENABLE_BLOCK_POOL
+    		volatile int16_t* block_buffer = block->samples;
+    		uint8_t block_samples = block->count;
+    		output.first_sample = block->first_sample;
+			#else
+    		// Short after a DMA error, only the samples before the faulted transfer are good
+    		volatile int16_t* block_buffer = acquire_half(&acquire, last_active_DMA_buffer);
+    		uint8_t block_samples = acquire.samples[last_active_DMA_buffer];
+    		output.first_sample = acquire.first_sample[last_active_DMA_buffer];
+			#endif
+
+			#if ENABLE_LOW_LATENCY
+			// Most of the block went through a chunk at a time while it filled, only the tail is left
+			if(chunk_done < block_samples)
+			{
+				pipeline_process_chunk(block_buffer + chunk_done, block_samples - chunk_done);
+			}
+			pipeline_finish_block(block_buffer, block_samples, &output);
+
+			// A crossing in the tail comes up here, a block under the level clears the alarm
+			if((output.block_max >= ALARM_LEVEL) && !alarm_on)
+			{
+				ALARM_GPIO_BASE->PCOR = 1U << ALARM_GPIO_PIN;
+				alarm_on = true;
+				alarm_count++;
+				alarm_sample = output.first_sample + chunk_done;
+			}
+			else if((output.block_max < ALARM_LEVEL) && alarm_on)
+			{
+				ALARM_GPIO_BASE->PSOR = 1U << ALARM_GPIO_PIN;
+				alarm_on = false;
+			}
+			chunk_done = 0;
+			#else
+			pipeline_process_block(block_buffer, block_samples, &output);
+			#endif
+
+			processed_block_count++;
+
+			#if ENABLE_RAW_STREAM && !ENABLE_BLOCK_POOL
+			// Compress the block straight into the frame, drop it if the last frame is still going out
+			if(report_flags & REPORT_RAW)
+			{
+				if(STREAM_BUSY(raw_frame))
+				{
+					raw_dropped++;
+				}
+				else
+				{
+					uint8_t* payload = telemetry_put_index(telemetry_payload(raw_frame), output.first_sample);
+					uint16_t raw_length = compress_encode_block(block_buffer, block_samples, payload);
+					STREAM_SEND(raw_frame, telemetry_frame_close(raw_frame, TELEMETRY_TYPE_RAW_BLOCK, raw_sequence,
+								TELEMETRY_INDEX_BYTES + raw_length));
+				}
+				raw_sequence++;		// Host sees dropped blocks as sequence gaps
+				info_due |= (raw_sequence == 0);
+			}
+			#endif
+
+			#if ENABLE_OVERSAMPLE
+			// Collect a frame of high resolution samples, send it if the UART is free (host sees drops as sequence gaps)
+			hires_count += oversample_process_block(&hires, block_buffer, block_samples, &hires_samples[hires_count]);
+			if(hires_count >= OVERSAMPLE_FRAME_SAMPLES)
+			{
+				if(STREAM_BUSY(hires_frame))
+				{
+					raw_dropped++;
+				}
+				else
+				{
+					uint8_t* payload = telemetry_payload(hires_frame);
+					*payload++ = OVERSAMPLE_BITS;
+					payload = telemetry_put_index(payload, hires.outputs - hires_count);	// Counted in output samples
+					for(uint8_t i = 0; i < OVERSAMPLE_FRAME_SAMPLES; i++)
+					{
+						*payload++ = (uint8_t)hires_samples[i];
+						*payload++ = (uint8_t)(hires_samples[i] >> 8);
+						*payload++ = (uint8_t)(hires_samples[i] >> 16);
+						*payload++ = (uint8_t)(hires_samples[i] >> 24);
+					}
+					STREAM_SEND(hires_frame, telemetry_frame_close(hires_frame, TELEMETRY_TYPE_HIRES_BLOCK, hires_sequence,
+								1 + TELEMETRY_INDEX_BYTES + (OVERSAMPLE_FRAME_SAMPLES * 4)));
+				}
+				hires_sequence++;
+
+				hires_count -= OVERSAMPLE_FRAME_SAMPLES;
+				memmove(hires_samples, &hires_samples[OVERSAMPLE_FRAME_SAMPLES], hires_count * sizeof(int32_t));
+			}
+			#endif
+
+			if(report_flags & REPORT_TEXT)
+			{
+				REPORT_WRITE(report_line, format_report(report_line, output.peak_counts, output.dbfs));
+				for(uint8_t i = 0; i < output.tone_count; i++)
+				{
+					REPORT_WRITE(report_line, format_tone(report_line, pipeline_tones()->config.frequencies[i], output.tone_dbfs[i]));
+				}
+			}
+			if(report_flags & REPORT_PRETTY)
+			{
+				REPORT_WRITE(pretty_line, format_bar(pretty_line, sizeof(pretty_line), output.dbfs, PRETTY_SCALE_SHIFT));
+			}
+
+			#if ENABLE_BLOCK_POOL
+			blockpool_release(&pool, pool_meter);
+			#else
+			last_active_DMA_buffer = !last_active_DMA_buffer;	// Only process each completed block once
+			#endif
+
+			TRACE_REGION_END();
+
+			#if ENABLE_GOVERNOR
+			governor_block(&governor, cycle_counter_elapsed(busy_start));
+			#endif
+
+			#if ENABLE_BLOCKSIZE
+			// Goes in at the re-arm after the one already running
+			blocksize_block(&sizer);
+			#endif
+    	}
+    	else
+    	{
+			#if ENABLE_LOW_LATENCY
+    		// Block still filling - take what has landed once there is a chunk of it
+    		uint8_t landed = acquire_landed(&acquire, last_active_DMA_buffer);
+    		if(landed >= (chunk_done + LOW_LATENCY_CHUNK))
+    		{
+    			uint16_t running_max = pipeline_process_chunk(acquire_half(&acquire, last_active_DMA_buffer) + chunk_done,
+    															landed - chunk_done);
+    			if((running_max >= ALARM_LEVEL) && !alarm_on)
+    			{
+    				ALARM_GPIO_BASE->PCOR = 1U << ALARM_GPIO_PIN;
+    				alarm_on = true;
+    				alarm_count++;
+    				alarm_sample = acquire_read64(&acquire.next_sample) + chunk_done;	// The filling half's first index
+    			}
+    			chunk_done = landed;
+    			continue;
+    		}
+
+    		// The background work below can change settings or re-arm the trigger, keep it to before the first chunk
+    		if(chunk_done != 0)
+    		{
+    			continue;
+    		}
+			#endif
+
+			#if ENABLE_RAW_STREAM
+    		// What the raw samples are - at the start and every 256 raw frames, so a host that joins late gets it and
+    		// a rate or block size change (governor, block sizer) reaches the capture file
+    		if(info_due && (report_flags & REPORT_RAW) && !STREAM_BUSY(info_frame))
+    		{
+    			capture_info info;
+    			capture_info_from_adc(&info, &adc_fig, adc_sample_rate_calc(&adc_fig), acquire.block_size);
+    			STREAM_SEND(info_frame, telemetry_frame_close(info_frame, TELEMETRY_TYPE_CAPTURE_INFO, info_sequence++,
+    						capture_info_pack(&info, telemetry_payload(info_frame))));
+    			info_due = false;
+    		}
+			#endif
+
+			#if ENABLE_RAW_STREAM && ENABLE_BLOCK_POOL
+    		// Raw stream is its own consumer - its oldest block waits in the pool while the last frame goes out,
+    		// the frame sequence is the block's so pool overruns still show up as gaps on the host
+    		blockpool_block* raw_block = blockpool_peek(&pool, pool_raw);
+    		if((raw_block != NULL) && !((report_flags & REPORT_RAW) && STREAM_BUSY(raw_frame)))
+    		{
+    			if(report_flags & REPORT_RAW)
+    			{
+    				uint8_t* payload = telemetry_put_index(telemetry_payload(raw_frame), raw_block->first_sample);
+    				uint16_t raw_length = compress_encode_block(raw_block->samples, raw_block->count, payload);
+    				STREAM_SEND(raw_frame, telemetry_frame_close(raw_frame, TELEMETRY_TYPE_RAW_BLOCK,
+    							(uint8_t)raw_block->sequence, TELEMETRY_INDEX_BYTES + raw_length));
+    			}
+    			info_due |= ((uint8_t)raw_block->sequence == 0xFFU);
+    			blockpool_release(&pool, pool_raw);
+    		}
+			#endif
+
+			#if ENABLE_TRIGGER
+    		// Background - stream a frozen snapshot a chunk at a time while there is no block to process
+    		// Only as many samples as the console has room for, so no snapshot line is dropped
+    		int16_t* snap_samples = NULL;
+    		uint16_t snap_count = trigger_stream_next(pipeline_trigger(), &snap_samples,
+    													MIN(TRIGGER_STREAM_CHUNK, REPORT_SPACE() / TRIGGER_LINE_BYTES));
+    		for(uint16_t i = 0; i < snap_count; i++)
+    		{
+    			REPORT_WRITE(report_line, snprintf(report_line, sizeof(report_line), "TRIG%u:%d\n",
+    							(unsigned)output.trigger_count, snap_samples[i]));
+    		}
+			#endif
+
+			#if ENABLE_SHELL
+    		// Commands only run here, between blocks, so a setting never changes part way through one
+    		shell_service();
+			#endif
+
+			#if ENABLE_GOVERNOR
+    		// Clock switches happen between blocks too, the DMA keeps filling through them
+    		governor_service(&governor);
+			#endif
+
+			#if ENABLE_TRACE
+    		// A requested trace dump goes out a line at a time between blocks
+    		uint16_t trace_length = trace_dump_line(trace_line);
+    		if(trace_length)
+    		{
+    			REPORT_WRITE(trace_line, trace_length);
+    		}
 			#endif
     	}
     }
@@ -162,20 +607,16 @@ int main(void)
     return 0 ;
 }
 
-void DMA0_IRQHandler()
+// No critical section - the DMA register updates are plain writes or BME ops, and the main loop only
+// writes single words of acquire (rate, jitter and irq max resets)
+HOT_PATH void DMA0_IRQHandler()
 {
-	uint32_t primask = DisableGlobalIRQ();						// Disable Interrupts
-	GPIO_SetPinsOutput(RAND_GPIO_BASE, 1 << RAND_GPIO_PIN);		// Turn on Pin
-
-	DMA0->DMA[DMA_CHANNEL_0].DSR_BCR |= DMA_DSR_BCR_DONE(true);	// Clear Interrupt on the channel that finished
-
-	active_DMA_buffer = !active_DMA_buffer;						// Swap Buffers
-
-	volatile void* buff_ptr = buffer_ptr_lut[active_DMA_buffer];// Look up the Buffer Ptr (mainly for readability)
+	GPIO_SetPinsOutput(RAND_GPIO_BASE, 1 << RAND_GPIO_PIN);		// Turn on Pin (PSOR write)
+	TRACE_REGION_START();
 
-	dma_transfer_restart(DMA0, DMA_CHANNEL_0, buff_ptr, BUFF_HALF_BYTES);	// Enable DMA
+	acquire_irq(&acquire);										// Check for errors, clear, swap buffers, re-arm
 
-	GPIO_ClearPinsOutput(RAND_GPIO_BASE, 1 << RAND_GPIO_PIN);		// Turn off Pin
-	EnableGlobalIRQ(primask);									// Enable Interrupts
+	TRACE_REGION_END();
+	GPIO_ClearPinsOutput(RAND_GPIO_BASE, 1 << RAND_GPIO_PIN);		// Turn off Pin (PCOR write)
 }
 
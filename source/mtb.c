@@ -51,6 +51,12 @@
  
 /* This is a template for board specific configuration created by MCUXpresso IDE Project Wizard.*/
 
+// The profiling trace (trace.h) brings its own, larger buffer
+#include "trace.h"
+#if ENABLE_TRACE && !defined (__MTB_DISABLE)
+  #define __MTB_DISABLE
+#endif
+
 // Allow MTB to be removed by setting a define (via command line)
 #if !defined (__MTB_DISABLE)
 
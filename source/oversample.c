@@ -0,0 +1,64 @@
+/*
+ * oversample.c
+ *
+ *  Created on: Dec 20, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "oversample.h"
+
+
+/* FUNCTION DEFINITIONS */
+
+// Set the decimation ratio and clear the running sum
+oversample_error oversample_init(oversample_handle* handle, oversample_config* config)
+{
+	oversample_error ret = OVERSAMPLE_ERROR_SUCCESS;
+
+	if(	(handle == NULL)	||
+		(config == NULL))
+	{
+		ret = OVERSAMPLE_ERROR_NULL_PTR;
+	}
+	else if((config->extra_bits == 0) | (config->extra_bits > OVERSAMPLE_MAX_EXTRA_BITS))
+	{
+		ret = OVERSAMPLE_ERROR_EXTRA_BITS;
+	}
+	else
+	{
+		handle->config = *config;
+		handle->ratio = OVERSAMPLE_RATIO(config->extra_bits);
+		handle->count = 0;
+		handle->sum = 0;
+		handle->outputs = 0;
+	}
+
+	return ret;
+}
+
+// Decimate one raw block, returns how many high resolution samples went into out
+uint8_t oversample_process_block(oversample_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int32_t* out)
+{
+	uint8_t written = 0;
+	int32_t sum = handle->sum;
+	uint16_t count = handle->count;
+
+	// Sum of 4^n samples has 2n more bits, keeping n of them is the resolution gain (the ADC noise is the dither)
+	for(volatile int16_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
+	{
+		sum += *ptr;
+		if(++count == handle->ratio)
+		{
+			out[written++] = sum >> handle->config.extra_bits;
+			sum = 0;
+			count = 0;
+		}
+	}
+
+	handle->sum = sum;
+	handle->count = count;
+	handle->outputs += written;
+
+	return written;
+}
@@ -7,25 +7,30 @@
 
 /* HEADER */
 #include "peak_detect.h"
+#include "placement.h"
 
 /* DEFINES AND STATIC DATA */
-#define dBFS_LUT_COUNTS	{0,1,3,7,15,31,63,127,255,511,1023,2047,4095,8191,16383,32767}
-#define dBFS_LUT_dB	{12700,9000,8100,7300,6700,6000,5400,4800,4200,3600,3000,2400,1800,1200,600,0}
-#define dBFS_LUT_SLOPE {0,196804805,14745600,6553600,2457600,1433600,614400,307200,153600,76800,38400,19200,9600,4800,2400,1200}
-#define dBFS_LUT_ENTRIES 16
-
 static uint32_t dBFS_Counts[] = dBFS_LUT_COUNTS;
 static uint32_t	dBFS_dB[] = dBFS_LUT_dB;
 static uint32_t dBFS_Slope[] = dBFS_LUT_SLOPE;
 
 /* FUNCTION DEFINITIONS */
-uint16_t peak_output(volatile int16_t* buffer, uint8_t buffer_size, uint8_t decay_shift)
+
+// Empty the hold, decay periods count from sample 0
+void peak_state_reset(peak_state* state)
 {
-	// Calc Decay Number
-	static uint16_t decay_number = 0;
-	decay_number >>= decay_shift;
+	state->held = 0;
+	state->decay_mark = 0;
+}
 
-	// Find Max in Buffer
+HOT_PATH uint16_t peak_output(peak_state* state, volatile int16_t* buffer, uint8_t buffer_size, uint8_t decay_shift)
+{
+	return peak_hold(state, peak_block_max(buffer, buffer_size), decay_shift);
+}
+
+// Find the largest |x| in a buffer
+HOT_PATH uint16_t peak_block_max(volatile int16_t* buffer, uint8_t buffer_size)
+{
 	uint16_t max = 0;
 	for(volatile int16_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
 	{
@@ -35,19 +40,60 @@ uint16_t peak_output(volatile int16_t* buffer, uint8_t buffer_size, uint8_t deca
 		}
 	}
 
-	if(max > decay_number)
+	return max;
+}
+
+// Sum of x^2 over a buffer, each square fits 32 bits but a block of them does not
+HOT_PATH uint64_t peak_block_energy(volatile int16_t* buffer, uint8_t buffer_size)
+{
+	uint64_t energy = 0;
+	for(volatile int16_t* ptr = &buffer[0]; ptr < &buffer[buffer_size]; ptr++)
+	{
+		int32_t sample = *ptr;
+		energy += (uint32_t)(sample * sample);
+	}
+
+	return energy;
+}
+
+// Decay the held peak, return the larger of the decayed peak and the block max
+HOT_PATH uint16_t peak_hold(peak_state* state, uint16_t block_max, uint8_t decay_shift)
+{
+	// Calc Decay Number
+	uint16_t decay_number = state->held >> decay_shift;
+
+	if(block_max > decay_number)
 	{
-		decay_number = max;
+		decay_number = block_max;
 	}
+	state->held = decay_number;
 
 	return decay_number;
 }
 
+// Same, decaying once for every 2^decay_bits samples the block start moved on since the last block
+// One step per block at full size, none for most short ones, and a missed block's steps land on the next
+HOT_PATH uint16_t peak_hold_at(peak_state* state, uint16_t block_max, uint64_t first_sample, uint8_t decay_bits,
+								uint8_t decay_shift)
+{
+	uint64_t mark = first_sample >> decay_bits;
+	uint64_t shift = (mark - state->decay_mark) * decay_shift;
+	state->decay_mark = mark;
+
+	return peak_hold(state, block_max, (uint8_t)MIN(shift, 16U));
+}
+
 // Take a ADC Reading and Convert to 16 bit scale dBFS - note result is unsigned but all values should be presented as negative
-int16_t dbfs_output(uint16_t input)
+HOT_PATH int16_t dbfs_output(uint16_t input)
 {
 	uint32_t output = 0;
 
+	// The last LUT entry is full scale, past it there is no slope to interpolate on
+	if(input > dBFS_Counts[dBFS_LUT_ENTRIES - 1])
+	{
+		input = dBFS_Counts[dBFS_LUT_ENTRIES - 1];
+	}
+
 	// Find the LUT entry we need to look near
 	uint8_t index = 0;
 	uint16_t input_abs = abs(input);
@@ -73,9 +119,3 @@ int16_t dbfs_output(uint16_t input)
 
 	return (uint16_t)output;
 }
-
-void pretty_print(uint16_t sample, uint8_t scale_shift)
-{
-	uint16_t limit = ( sample >> scale_shift);
-	printf("%0*d>\n", limit, 0);
-}
@@ -0,0 +1,260 @@
+/*
+ * pipeline.c
+ *
+ *  Created on: Dec 16, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "pipeline.h"
+#include "telemetry.h"
+
+/* DEFINES AND STATIC DATA */
+#if ENABLE_TRIGGER
+static int16_t trigger_history[TRIGGER_HISTORY_SIZE];
+static trigger_handle trigger;
+#endif
+#if ENABLE_GOERTZEL
+static goertzel_bank tones;
+#endif
+#if ENABLE_HISTOGRAM
+static histogram amplitude_histogram;
+#endif
+static pipeline_settings settings;
+static uint16_t chunk_max = 0;			// Largest |x| of the block so far
+static peak_state meter;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static pipeline_error pipeline_tones_init(uint32_t sample_rate);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Set up every enabled processing stage for the ADC sample rate
+pipeline_error pipeline_init(uint32_t sample_rate)
+{
+	pipeline_error ret = PIPELINE_ERROR_SUCCESS;
+
+	#if ENABLE_TRIGGER
+	trigger_config trig_fig = TRIGGER_SETUP;
+	if(trigger_init(&trigger, &trig_fig) != TRIGGER_ERROR_SUCCESS)
+	{
+		ret = PIPELINE_ERROR_TRIGGER;
+	}
+	#else
+	trigger_config trig_fig = TRIGGER_CONFIG_DEFAULT;
+	#endif
+
+	settings.decay_shift = PEAK_DECAY_SHIFT;
+	settings.trigger_type = trig_fig.type;
+	settings.trigger_edge = trig_fig.edge;
+	settings.trigger_level = trig_fig.level;
+	settings.trigger_slope = trig_fig.slope;
+	settings.sample_rate = sample_rate;
+	peak_state_reset(&meter);
+
+	#if ENABLE_HISTOGRAM
+	histogram_reset(&amplitude_histogram);
+	#endif
+
+	if(ret == PIPELINE_ERROR_SUCCESS)
+	{
+		ret = pipeline_tones_init(sample_rate);
+	}
+
+	return ret;
+}
+
+// Read the current runtime settings
+pipeline_error pipeline_get_settings(pipeline_settings* settings_out)
+{
+	pipeline_error ret = PIPELINE_ERROR_SUCCESS;
+
+	if(settings_out == NULL)
+	{
+		ret = PIPELINE_ERROR_NULL_PTR;
+	}
+	else
+	{
+		*settings_out = settings;
+	}
+
+	return ret;
+}
+
+// Change runtime settings, trigger changes re-arm the trigger (the trigger count carries on)
+pipeline_error pipeline_set_settings(pipeline_settings* settings_in)
+{
+	pipeline_error ret = PIPELINE_ERROR_SUCCESS;
+
+	if(settings_in == NULL)
+	{
+		ret = PIPELINE_ERROR_NULL_PTR;
+	}
+	else
+	{
+		#if ENABLE_TRIGGER
+		// Only the condition changes, the window and history sizes stay, so the config is updated in place and the
+		// re-arm waits for a fresh pre trigger window instead of starting over from trigger_init
+		if(	(settings_in->trigger_type != trigger.config.type)		|
+			(settings_in->trigger_edge != trigger.config.edge)		|
+			(settings_in->trigger_level != trigger.config.level)	|
+			(settings_in->trigger_slope != trigger.config.slope)	)
+		{
+			trigger.config.type = settings_in->trigger_type;
+			trigger.config.edge = settings_in->trigger_edge;
+			trigger.config.level = settings_in->trigger_level;
+			trigger.config.slope = settings_in->trigger_slope;
+			trigger_rearm(&trigger);
+		}
+		#endif
+
+		if((ret == PIPELINE_ERROR_SUCCESS) && (settings_in->sample_rate != settings.sample_rate))
+		{
+			ret = pipeline_tones_init(settings_in->sample_rate);
+		}
+
+		if(ret == PIPELINE_ERROR_SUCCESS)
+		{
+			settings = *settings_in;
+		}
+	}
+
+	return ret;
+}
+
+// Run one completed DMA block through the processing chain
+void pipeline_process_block(volatile int16_t* buffer, uint8_t buffer_size, pipeline_output* output)
+{
+	pipeline_process_chunk(buffer, buffer_size);
+	pipeline_finish_block(buffer, buffer_size, output);
+}
+
+// Per sample stages over the next samples of the block, returns the block max so far
+// The trigger and the per sample histogram carry their state from sample to sample, so chunks add up to the block
+uint16_t pipeline_process_chunk(volatile int16_t* buffer, uint8_t count)
+{
+	#if ENABLE_TRIGGER
+	// Trigger scan doubles as the peak scan
+	uint16_t max = trigger_process_block(&trigger, buffer, count);
+	#else
+	uint16_t max = peak_block_max(buffer, count);
+	#endif
+
+	#if ENABLE_HISTOGRAM && HISTOGRAM_PER_SAMPLE
+	histogram_add_block(&amplitude_histogram, buffer, count);
+	#endif
+
+	chunk_max = (max > chunk_max) ? max : chunk_max;
+
+	return chunk_max;
+}
+
+// Per block stages, once every sample of the block has been through pipeline_process_chunk
+void pipeline_finish_block(volatile int16_t* buffer, uint8_t buffer_size, pipeline_output* output)
+{
+	output->block_max = chunk_max;
+	chunk_max = 0;
+	#if ENABLE_TRIGGER
+	output->trigger_count = trigger.trigger_count;
+	#else
+	output->trigger_count = 0;
+	#endif
+
+	output->peak_counts = peak_hold_at(&meter, output->block_max, output->first_sample, PEAK_DECAY_BITS,
+										settings.decay_shift);
+	output->dbfs = dbfs_output(output->peak_counts);
+
+	#if ENABLE_HISTOGRAM && !HISTOGRAM_PER_SAMPLE
+	histogram_add_value(&amplitude_histogram, output->block_max);
+	#endif
+
+	#if ENABLE_GOERTZEL
+	// Tone amplitudes land in tone_dbfs first, then convert in place
+	goertzel_process_block(&tones, buffer, buffer_size, output->tone_dbfs);
+	output->tone_count = tones.config.tone_count;
+	for(uint8_t i = 0; i < output->tone_count; i++)
+	{
+		output->tone_dbfs[i] = dbfs_output(output->tone_dbfs[i]);
+	}
+	#else
+	(void)buffer;
+	(void)buffer_size;
+	output->tone_count = 0;
+	#endif
+}
+
+// Trigger engine owned by the pipeline (NULL if disabled), main streams its snapshots
+trigger_handle* pipeline_trigger(void)
+{
+	#if ENABLE_TRIGGER
+	return &trigger;
+	#else
+	return NULL;
+	#endif
+}
+
+// Tone bank owned by the pipeline (NULL if disabled), for the tone frequencies
+goertzel_bank* pipeline_tones(void)
+{
+	#if ENABLE_GOERTZEL
+	return &tones;
+	#else
+	return NULL;
+	#endif
+}
+
+// Amplitude histogram owned by the pipeline (NULL if disabled)
+histogram* pipeline_histogram(void)
+{
+	#if ENABLE_HISTOGRAM
+	return &amplitude_histogram;
+	#else
+	return NULL;
+	#endif
+}
+
+// Pack a result for a telemetry frame, returns PIPELINE_OUTPUT_BYTES
+uint16_t pipeline_output_pack(pipeline_output* output, uint8_t* payload)
+{
+	payload[0] = (uint8_t)output->block_max;
+	payload[1] = (uint8_t)(output->block_max >> 8);
+	payload[2] = (uint8_t)output->peak_counts;
+	payload[3] = (uint8_t)(output->peak_counts >> 8);
+	payload[4] = (uint8_t)output->dbfs;
+	payload[5] = (uint8_t)(output->dbfs >> 8);
+	payload[6] = (uint8_t)output->trigger_count;
+	payload[7] = (uint8_t)(output->trigger_count >> 8);
+	payload[8] = (uint8_t)(output->trigger_count >> 16);
+	payload[9] = (uint8_t)(output->trigger_count >> 24);
+	telemetry_put_index(&payload[10], output->first_sample);
+
+	return PIPELINE_OUTPUT_BYTES;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Coefficients for the configured tones at this sample rate
+static pipeline_error pipeline_tones_init(uint32_t sample_rate)
+{
+	pipeline_error ret = PIPELINE_ERROR_SUCCESS;
+
+	#if ENABLE_GOERTZEL
+	uint16_t frequencies[] = GOERTZEL_TONES;
+	goertzel_config tone_fig = GOERTZEL_CONFIG_DEFAULT;
+	tone_fig.sample_rate = sample_rate;
+	tone_fig.tone_count = GOERTZEL_TONE_COUNT;
+	memcpy(tone_fig.frequencies, frequencies, sizeof(frequencies));
+
+	if(goertzel_init(&tones, &tone_fig) != GOERTZEL_ERROR_SUCCESS)
+	{
+		ret = PIPELINE_ERROR_GOERTZEL;
+	}
+	#else
+	(void)sample_rate;
+	#endif
+
+	return ret;
+}
@@ -0,0 +1,226 @@
+/*
+ * platform.c
+ *
+ *  Created on: Dec 21, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "platform.h"
+#include "cycle_counter.h"
+#include "peak_detect.h"
+
+/* DEFINES AND STATIC DATA */
+static const platform_profile platform_profiles[PLATFORM_PROFILE_COUNT] = PLATFORM_PROFILES;
+static uint8_t platform_profile_now = 0;
+static int16_t platform_block[PLATFORM_TUNE_SIZE];
+static volatile uint16_t platform_sink;
+
+// Magic, profile, and the two added so a half written record does not pass
+typedef struct
+{
+	uint32_t magic;
+	uint32_t profile;
+	uint32_t check;
+} platform_record;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint32_t platform_record_address(flash_config_t* flash);
+static uint32_t platform_time_kernels(void);
+static uint32_t platform_time_irq(acquire_handle* acquire);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Apply the saved profile, or the reset profile if nothing valid is saved
+platform_error platform_init(void)
+{
+	flash_config_t flash;
+	uint8_t profile = 0;
+
+	if(FLASH_Init(&flash) == kStatus_FLASH_Success)
+	{
+		platform_record* record = (platform_record*)platform_record_address(&flash);
+		if(	(record->magic == PLATFORM_RECORD_MAGIC)						&
+			(record->check == (record->magic + record->profile))			&
+			(record->profile < PLATFORM_PROFILE_COUNT)						)
+		{
+			profile = (uint8_t)record->profile;
+		}
+	}
+
+	return platform_apply(profile);
+}
+
+// Set PLACR from a profile and clear the flash cache
+platform_error platform_apply(uint8_t profile)
+{
+	platform_error ret = PLATFORM_ERROR_SUCCESS;
+
+	if(profile >= PLATFORM_PROFILE_COUNT)
+	{
+		ret = PLATFORM_ERROR_PROFILE;
+	}
+	else
+	{
+		// CFCC is write 1 to clear, so stale lines from the last profile are not used
+		MCM->PLACR = (MCM->PLACR & ~PLATFORM_PLACR_MASK) | platform_profiles[profile].placr | MCM_PLACR_CFCC_MASK;
+		platform_profile_now = profile;
+	}
+
+	return ret;
+}
+
+// Profile in use and the profile table
+uint8_t platform_current(void)
+{
+	return platform_profile_now;
+}
+
+const platform_profile* platform_profile_get(uint8_t profile)
+{
+	return (profile < PLATFORM_PROFILE_COUNT) ? &platform_profiles[profile] : NULL;
+}
+
+// Time the kernels and the ISR under every profile, then apply the one with the lowest total per block
+platform_error platform_tune(acquire_handle* acquire, platform_result* results, uint8_t* best)
+{
+	platform_error ret = PLATFORM_ERROR_SUCCESS;
+
+	if(	(acquire == NULL)	||
+		(results == NULL)	|
+		(best == NULL)		)
+	{
+		ret = PLATFORM_ERROR_NULL_PTR;
+	}
+	else
+	{
+		// Noisy ramp, same as the bench so the numbers line up
+		uint32_t lfsr = 0xACE1U;
+		for(uint8_t i = 0; i < PLATFORM_TUNE_SIZE; i++)
+		{
+			lfsr = (lfsr >> 1) ^ (-(lfsr & 1U) & 0xB400U);
+			platform_block[i] = (int16_t)((i * 1024) + (lfsr & 0xFFU) - 32768);
+		}
+
+		cycle_counter_init();
+		uint32_t best_total = UINT32_MAX;
+		uint8_t start_profile = platform_profile_now;
+		*best = start_profile;
+
+		for(uint8_t p = 0; (p < PLATFORM_PROFILE_COUNT) && (ret == PLATFORM_ERROR_SUCCESS); p++)
+		{
+			platform_apply(p);
+			results[p].kernel_cycles = platform_time_kernels();
+			results[p].irq_cycles = platform_time_irq(acquire);
+
+			if(results[p].irq_cycles == 0)
+			{
+				ret = PLATFORM_ERROR_NO_BLOCKS;
+			}
+			else if((results[p].kernel_cycles + results[p].irq_cycles) < best_total)
+			{
+				best_total = results[p].kernel_cycles + results[p].irq_cycles;
+				*best = p;
+			}
+		}
+
+		// A failed run goes back to where it started
+		platform_apply((ret == PLATFORM_ERROR_SUCCESS) ? *best : start_profile);
+	}
+
+	return ret;
+}
+
+// Write the profile to the flash record - interrupts and the DMA are off for the erase and the conversions it
+// costs are charged to the acquire gap count, so the sample index stays continuous. A record that is already
+// there is left alone
+platform_error platform_save(acquire_handle* acquire, uint8_t profile)
+{
+	platform_error ret = PLATFORM_ERROR_SUCCESS;
+	flash_config_t flash;
+
+	if(acquire == NULL)
+	{
+		ret = PLATFORM_ERROR_NULL_PTR;
+	}
+	else if(profile >= PLATFORM_PROFILE_COUNT)
+	{
+		ret = PLATFORM_ERROR_PROFILE;
+	}
+	else if(FLASH_Init(&flash) != kStatus_FLASH_Success)
+	{
+		ret = PLATFORM_ERROR_FLASH;
+	}
+	else
+	{
+		uint32_t address = platform_record_address(&flash);
+		platform_record record = {PLATFORM_RECORD_MAGIC, profile, PLATFORM_RECORD_MAGIC + profile};
+
+		// Already stored (a tune that kept the saved profile, a repeated save) - no erase, so no flash wear and no
+		// stretch with the DMA stopped
+		if(memcmp((const void*)address, &record, sizeof(record)) != 0)
+		{
+			// Nothing may run from flash while the FTFA has it busy - the erase outlasts many blocks, so the DMA
+			// stops rather than overrun and the lost conversions go down as a gap
+			uint32_t primask = DisableGlobalIRQ();
+			acquire_suspend(acquire);
+			status_t status = FLASH_Erase(&flash, address, flash.PFlashSectorSize, kFLASH_ApiEraseKey);
+			if(status == kStatus_FLASH_Success)
+			{
+				status = FLASH_Program(&flash, address, (uint32_t*)&record, sizeof(record));
+			}
+			acquire_resume(acquire);
+			EnableGlobalIRQ(primask);
+
+			// The record was just rewritten under the cache
+			platform_apply(platform_profile_now);
+
+			if(status != kStatus_FLASH_Success)
+			{
+				ret = PLATFORM_ERROR_FLASH;
+			}
+		}
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Start of the last program flash sector
+static uint32_t platform_record_address(flash_config_t* flash)
+{
+	return flash->PFlashBlockBase + flash->PFlashTotalSize - flash->PFlashSectorSize;
+}
+
+// Counts per block for the peak and dBFS kernels (peak_hold is left out, it is a shift and a compare)
+static uint32_t platform_time_kernels(void)
+{
+	uint32_t start = cycle_counter_now();
+
+	for(uint8_t b = 0; b < PLATFORM_TUNE_BLOCKS; b++)
+	{
+		platform_sink = dbfs_output(peak_block_max(platform_block, PLATFORM_TUNE_SIZE));
+	}
+
+	return cycle_counter_elapsed(start) / PLATFORM_TUNE_BLOCKS;
+}
+
+// Worst acquire_irq time over the next PLATFORM_TUNE_BLOCKS DMA blocks, 0 if the DMA is not running
+static uint32_t platform_time_irq(acquire_handle* acquire)
+{
+	uint32_t start = cycle_counter_now();
+	uint32_t blocks = acquire->blocks;
+	acquire->irq_cycles_max = 0;
+
+	// A block is ~2.4ms, give up well inside one counter wrap
+	while(	((acquire->blocks - blocks) < PLATFORM_TUNE_BLOCKS)				&&
+			(cycle_counter_elapsed(start) < (CYCLE_COUNTER_MASK / 2))		)
+	{
+	}
+
+	return ((acquire->blocks - blocks) < PLATFORM_TUNE_BLOCKS) ? 0 : acquire->irq_cycles_max;
+}
@@ -0,0 +1,184 @@
+/*
+ * rtt.c
+ *
+ *  Created on: Dec 23, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "rtt.h"
+#include <string.h>
+
+/* DEFINES AND STATIC DATA */
+
+// The data has to be in RAM before the index that hands it over (the probe reads while the core runs)
+#define RTT_BARRIER()		__asm volatile("" ::: "memory")
+#define RTT_MIN(a, b)		(((a) < (b)) ? (a) : (b))
+#define RTT_STALL_NONE		0xFFFFFFFFUL
+
+static rtt_control rtt;
+static uint8_t rtt_up_terminal[RTT_UP_TERMINAL_SIZE];
+static uint8_t rtt_up_telemetry[RTT_UP_TELEMETRY_SIZE];
+static uint8_t rtt_down_terminal[RTT_DOWN_TERMINAL_SIZE];
+static uint32_t rtt_drops[RTT_UP_COUNT];
+static uint32_t rtt_stall_read[RTT_UP_COUNT];		// Read index a BLOCK write gave up at, RTT_STALL_NONE if none
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void rtt_ring_init(rtt_ring* ring, const char* name, uint8_t* buffer, uint32_t size);
+static uint32_t rtt_ring_put(rtt_ring* ring, const uint8_t* data, uint32_t length);
+static uint32_t rtt_ring_free(rtt_ring* ring);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Build the control block and rings
+void rtt_init(void)
+{
+	memset(&rtt, 0, sizeof(rtt));
+	rtt.up_count = RTT_UP_COUNT;
+	rtt.down_count = RTT_DOWN_COUNT;
+
+	rtt_ring_init(&rtt.up[RTT_UP_TERMINAL], "Terminal", rtt_up_terminal, sizeof(rtt_up_terminal));
+	rtt_ring_init(&rtt.up[RTT_UP_TELEMETRY], "Telemetry", rtt_up_telemetry, sizeof(rtt_up_telemetry));
+	rtt_ring_init(&rtt.down[RTT_DOWN_TERMINAL], "Terminal", rtt_down_terminal, sizeof(rtt_down_terminal));
+
+	for(uint8_t i = 0; i < RTT_UP_COUNT; i++)
+	{
+		rtt_drops[i] = 0;
+		rtt_stall_read[i] = RTT_STALL_NONE;
+	}
+
+	// Id last, from two pieces so the control block holds the only whole copy a probe scan can match
+	RTT_BARRIER();
+	strcpy(&rtt.id[6], " RTT");
+	RTT_BARRIER();
+	memcpy(rtt.id, "SEGGER", 6);
+}
+
+// Queue bytes on an up channel, returns the bytes written (0 when a SKIP record did not fit)
+uint32_t rtt_write(rtt_up_channel channel, const void* data, uint32_t length)
+{
+	rtt_ring* ring = &rtt.up[channel];
+	const uint8_t* bytes = data;
+	uint32_t written = 0;
+
+	switch(ring->flags & RTT_MODE_MASK)
+	{
+		case RTT_MODE_SKIP:
+			if(rtt_ring_free(ring) >= length)
+			{
+				written = rtt_ring_put(ring, bytes, length);
+			}
+			break;
+
+		case RTT_MODE_BLOCK:
+			// Gave up before and the probe has not read since (none attached, or halted) - SKIP instead of waiting
+			if(ring->read == rtt_stall_read[channel])
+			{
+				written = (rtt_ring_free(ring) >= length) ? rtt_ring_put(ring, bytes, length) : 0;
+				break;
+			}
+			rtt_stall_read[channel] = RTT_STALL_NONE;
+
+			// Hand over what fits until it is all gone, the probe frees room as it reads
+			for(uint32_t polls = 0; (written < length) && (polls < RTT_BLOCK_POLLS); )
+			{
+				uint32_t put = rtt_ring_put(ring, &bytes[written], RTT_MIN(length - written, rtt_ring_free(ring)));
+				written += put;
+				polls = put ? 0 : (polls + 1);
+			}
+			if(written < length)
+			{
+				rtt_stall_read[channel] = ring->read;
+			}
+			break;
+
+		default:
+			written = rtt_ring_put(ring, bytes, RTT_MIN(length, rtt_ring_free(ring)));
+			break;
+	}
+
+	rtt_drops[channel] += (written < length);
+
+	return written;
+}
+
+// Room left on an up channel
+uint32_t rtt_space(rtt_up_channel channel)
+{
+	return rtt_ring_free(&rtt.up[channel]);
+}
+
+// Take up to max bytes the host sent on a down channel
+uint32_t rtt_read(rtt_down_channel channel, void* data, uint32_t max)
+{
+	rtt_ring* ring = &rtt.down[channel];
+	uint8_t* buffer = (uint8_t*)(uintptr_t)ring->buffer;
+	uint8_t* bytes = data;
+	uint32_t write = ring->write;
+	uint32_t read = ring->read;
+	uint32_t count = RTT_MIN(RTT_RING_USED(write, read, ring->size), max);
+
+	// Up to the end of the ring, then from the start
+	uint32_t first = RTT_MIN(count, ring->size - read);
+	memcpy(bytes, &buffer[read], first);
+	memcpy(&bytes[first], buffer, count - first);
+
+	read += count;
+	RTT_BARRIER();
+	ring->read = (read >= ring->size) ? (read - ring->size) : read;
+
+	return count;
+}
+
+// Records skipped or cut on an up channel because the host was not keeping up
+uint32_t rtt_dropped(rtt_up_channel channel)
+{
+	return rtt_drops[channel];
+}
+
+// Control block address, for a probe or a simulation that is not scanning RAM
+rtt_control* rtt_control_block(void)
+{
+	return &rtt;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Point a descriptor at its buffer, empty and in SKIP mode
+static void rtt_ring_init(rtt_ring* ring, const char* name, uint8_t* buffer, uint32_t size)
+{
+	ring->name = (uint32_t)(uintptr_t)name;
+	ring->buffer = (uint32_t)(uintptr_t)buffer;
+	ring->size = size;
+	ring->write = 0;
+	ring->read = 0;
+	ring->flags = RTT_MODE_SKIP;
+}
+
+// Copy in (length must fit), then publish the new write index
+static uint32_t rtt_ring_put(rtt_ring* ring, const uint8_t* data, uint32_t length)
+{
+	uint8_t* buffer = (uint8_t*)(uintptr_t)ring->buffer;
+	uint32_t write = ring->write;
+
+	// Up to the end of the ring, then from the start
+	uint32_t first = RTT_MIN(length, ring->size - write);
+	memcpy(&buffer[write], data, first);
+	memcpy(buffer, &data[first], length - first);
+
+	write += length;
+	RTT_BARRIER();
+	ring->write = (write >= ring->size) ? (write - ring->size) : write;
+
+	return length;
+}
+
+// Room on an up ring, one byte is kept free so full and empty differ
+static uint32_t rtt_ring_free(rtt_ring* ring)
+{
+	uint32_t read = ring->read;
+	return RTT_RING_FREE(ring->write, read, ring->size);
+}
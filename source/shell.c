@@ -0,0 +1,244 @@
+/*
+ * shell.c
+ *
+ *  Created on: Dec 18, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "shell.h"
+#include "rtt.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+/* DEFINES AND STATIC DATA */
+static shell_config shell;
+static char shell_line[SHELL_LINE_MAX + 1];
+static uint8_t shell_line_length = 0;
+static bool shell_line_overflow = false;
+static uint8_t shell_rx[SHELL_RX_PER_CALL];
+static uint8_t shell_rx_count = 0;
+static uint8_t shell_rx_index = 0;
+static bool shell_rx_rtt = false;		// shell_rx came from the RTT down channel, the reply goes back there
+static uint8_t shell_reply_frame[TELEMETRY_FRAME_BYTES(SHELL_REPLY_MAX)];		// The reply is built in the payload
+static char* const shell_reply_buffer = (char*)&shell_reply_frame[TELEMETRY_HEADER_BYTES];
+static uint16_t shell_reply_length = 0;
+static bool shell_reply_pending = false;
+static bool shell_reply_framed = false;
+static uint8_t shell_reply_sequence = 0;
+
+_Static_assert(SHELL_REPLY_MAX <= TELEMETRY_MAX_PAYLOAD, "a reply has to fit one text frame");
+static uint32_t shell_commands_run = 0;
+static uint32_t shell_errors = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void shell_execute(void);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Start receiving commands (uart_init must have been called)
+shell_error shell_init(shell_config* config)
+{
+	shell_error ret = SHELL_ERROR_SUCCESS;
+
+	if(	(config == NULL)			||
+		(config->commands == NULL)	||
+		(config->rx_ring == NULL)	)
+	{
+		ret = SHELL_ERROR_NULL_PTR;
+	}
+	else if(uart_receive_start(config->rx_ring, config->rx_ring_size) != UART_ERROR_SUCCESS)
+	{
+		ret = SHELL_ERROR_UART;
+	}
+	else
+	{
+		shell = *config;
+		shell_line_length = 0;
+		shell_reply_length = 0;
+		shell_reply_pending = false;
+	}
+
+	return ret;
+}
+
+// Poll from the main loop - sends any waiting reply, parses what has arrived, runs at most one command
+void shell_service(void)
+{
+	// A reply waiting for the UART, or still going out of shell_reply_buffer, holds off the next command
+	if(shell_reply_pending)
+	{
+		if(uart_send_busy())
+		{
+			return;
+		}
+		if(shell_reply_length && shell_reply_framed)
+		{
+			uart_send(shell_reply_frame, telemetry_frame_close(shell_reply_frame, TELEMETRY_TYPE_TEXT,
+						shell_reply_sequence++, shell_reply_length));
+			shell_reply_length = 0;
+			return;
+		}
+		if(shell_reply_length)
+		{
+			uart_send((uint8_t*)shell_reply_buffer, shell_reply_length);
+			shell_reply_length = 0;
+			return;
+		}
+		shell_reply_pending = false;
+	}
+
+	// Bytes left over from the last call go first
+	if(shell_rx_index == shell_rx_count)
+	{
+		shell_rx_count = uart_receive(shell_rx, sizeof(shell_rx));
+		shell_rx_index = 0;
+		shell_rx_rtt = false;
+		#if ENABLE_RTT
+		if(shell_rx_count == 0)
+		{
+			shell_rx_count = rtt_read(RTT_DOWN_TERMINAL, shell_rx, sizeof(shell_rx));
+			shell_rx_rtt = true;
+		}
+		#endif
+	}
+
+	while(shell_rx_index < shell_rx_count)
+	{
+		char c = (char)shell_rx[shell_rx_index++];
+
+		if((c == '\r') | (c == '\n'))
+		{
+			if(shell_line_length)
+			{
+				shell_line[shell_line_length] = '\0';
+				shell_reply_length = 0;
+				if(shell_line_overflow)
+				{
+					shell_errors++;
+					shell_reply("ERR line too long\r\n");
+				}
+				else
+				{
+					shell_execute();
+				}
+			}
+			shell_line_length = 0;
+			shell_line_overflow = false;
+
+			// One command per call keeps the time bounded, the rest of shell_rx waits for the next call
+			if(shell_reply_length)
+			{
+				#if ENABLE_RTT
+				if(shell_rx_rtt)
+				{
+					// Queued whole or dropped, the ring never makes the shell wait
+					rtt_write(RTT_UP_TERMINAL, shell_reply_buffer, shell_reply_length);
+					shell_reply_length = 0;
+					break;
+				}
+				#endif
+				shell_reply_pending = true;
+				break;
+			}
+		}
+		else if(shell_line_length < SHELL_LINE_MAX)
+		{
+			shell_line[shell_line_length++] = c;
+		}
+		else
+		{
+			shell_line_overflow = true;
+		}
+	}
+}
+
+// Append formatted text to the reply of the running command
+void shell_reply(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	int written = vsnprintf(&shell_reply_buffer[shell_reply_length], SHELL_REPLY_MAX - shell_reply_length, format, args);
+	if(written > 0)
+	{
+		shell_reply_length = MIN(shell_reply_length + written, SHELL_REPLY_MAX - 1);
+	}
+
+	va_end(args);
+}
+
+// Send UART replies as TELEMETRY_TYPE_TEXT frames (raw stream on, so the host framer keeps them) or as plain text
+// Decided when the reply goes out, so the reply to the command that turns the stream on is framed already
+void shell_frame_replies(bool framed)
+{
+	shell_reply_framed = framed;
+}
+
+// Print the command table
+void shell_help(void)
+{
+	for(uint8_t i = 0; i < shell.command_count; i++)
+	{
+		shell_reply("%s - %s\r\n", shell.commands[i].name, shell.commands[i].help);
+	}
+}
+
+// Commands run and lines that did not match a command
+uint32_t shell_command_count(void)
+{
+	return shell_commands_run;
+}
+
+uint32_t shell_error_count(void)
+{
+	return shell_errors;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Split the line on spaces and run the matching command
+static void shell_execute(void)
+{
+	char* argv[SHELL_ARGS_MAX];
+	uint8_t argc = 0;
+	char* ptr = shell_line;
+
+	while(*ptr && (argc < SHELL_ARGS_MAX))
+	{
+		while(*ptr == ' ')
+		{
+			*ptr++ = '\0';
+		}
+		if(*ptr)
+		{
+			argv[argc++] = ptr;
+		}
+		while(*ptr && (*ptr != ' '))
+		{
+			ptr++;
+		}
+	}
+
+	if(argc == 0)
+	{
+		return;
+	}
+
+	for(uint8_t i = 0; i < shell.command_count; i++)
+	{
+		if(strcmp(argv[0], shell.commands[i].name) == 0)
+		{
+			shell_commands_run++;
+			shell.commands[i].handler(argc, argv);
+			return;
+		}
+	}
+
+	shell_errors++;
+	shell_reply("ERR unknown command %s\r\n", argv[0]);
+}
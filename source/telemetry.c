@@ -0,0 +1,194 @@
+/*
+ * telemetry.c
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "telemetry.h"
+#include "compress.h"
+
+_Static_assert(TELEMETRY_MAX_PAYLOAD >= (TELEMETRY_INDEX_BYTES + COMPRESS_MAX_BYTES(UINT8_MAX)),
+				"a verbatim raw block of 255 samples does not fit a frame");
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint16_t telemetry_checksum(uint8_t* data, uint16_t length);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Pointer to where the payload goes in a frame buffer, so producers can encode in place
+uint8_t* telemetry_payload(uint8_t* frame)
+{
+	return &frame[TELEMETRY_HEADER_BYTES];
+}
+
+// Write/read a 64 bit sample index (LE, byte at a time so any alignment works), put returns the byte after it
+uint8_t* telemetry_put_index(uint8_t* ptr, uint64_t index)
+{
+	for(uint8_t i = 0; i < TELEMETRY_INDEX_BYTES; i++)
+	{
+		*ptr++ = (uint8_t)index;
+		index >>= 8;
+	}
+
+	return ptr;
+}
+
+uint64_t telemetry_get_index(uint8_t* ptr)
+{
+	uint64_t index = 0;
+
+	for(uint8_t i = TELEMETRY_INDEX_BYTES; i > 0; i--)
+	{
+		index = (index << 8) | ptr[i - 1];
+	}
+
+	return index;
+}
+
+// Fill in the header and checksum around an in place payload, returns the total frame bytes
+uint16_t telemetry_frame_close(uint8_t* frame, telemetry_type type, uint8_t sequence, uint16_t length)
+{
+	frame[0] = TELEMETRY_SYNC_0;
+	frame[1] = TELEMETRY_SYNC_1;
+	frame[2] = (uint8_t)type;
+	frame[3] = sequence;
+	frame[4] = (uint8_t)length;
+	frame[5] = (uint8_t)(length >> 8);
+
+	uint16_t sum = telemetry_checksum(&frame[2], length + (TELEMETRY_HEADER_BYTES - 2));
+	frame[TELEMETRY_HEADER_BYTES + length] = (uint8_t)sum;
+	frame[TELEMETRY_HEADER_BYTES + length + 1] = (uint8_t)(sum >> 8);
+
+	return TELEMETRY_FRAME_BYTES(length);
+}
+
+// Reset a frame parser
+void telemetry_parser_init(telemetry_parser* parser)
+{
+	parser->state = TELEMETRY_PARSE_SYNC_0;
+	parser->index = 0;
+	parser->length = 0;
+	parser->bad_frames = 0;
+}
+
+// Push one received byte, returns true when parser->frame holds a complete, checked frame
+bool telemetry_parse_byte(telemetry_parser* parser, uint8_t byte)
+{
+	bool ret = false;
+
+	switch(parser->state)
+	{
+		case TELEMETRY_PARSE_SYNC_0:
+			if(byte == TELEMETRY_SYNC_0)
+			{
+				parser->frame[0] = byte;
+				parser->state = TELEMETRY_PARSE_SYNC_1;
+			}
+			break;
+
+		case TELEMETRY_PARSE_SYNC_1:
+			if(byte == TELEMETRY_SYNC_1)
+			{
+				parser->frame[1] = byte;
+				parser->index = 2;
+				parser->state = TELEMETRY_PARSE_HEADER;
+			}
+			else if(byte != TELEMETRY_SYNC_0)
+			{
+				parser->state = TELEMETRY_PARSE_SYNC_0;
+			}
+			break;
+
+		case TELEMETRY_PARSE_HEADER:
+			parser->frame[parser->index++] = byte;
+			if(parser->index == TELEMETRY_HEADER_BYTES)
+			{
+				parser->length = telemetry_frame_length(parser->frame);
+				if(parser->length > TELEMETRY_MAX_PAYLOAD)
+				{
+					parser->bad_frames++;
+					parser->state = TELEMETRY_PARSE_SYNC_0;
+				}
+				else
+				{
+					parser->state = (parser->length) ? TELEMETRY_PARSE_PAYLOAD : TELEMETRY_PARSE_TRAILER;
+				}
+			}
+			break;
+
+		case TELEMETRY_PARSE_PAYLOAD:
+			parser->frame[parser->index++] = byte;
+			if(parser->index == TELEMETRY_HEADER_BYTES + parser->length)
+			{
+				parser->state = TELEMETRY_PARSE_TRAILER;
+			}
+			break;
+
+		case TELEMETRY_PARSE_TRAILER:
+			parser->frame[parser->index++] = byte;
+			if(parser->index == TELEMETRY_FRAME_BYTES(parser->length))
+			{
+				uint16_t sum = telemetry_checksum(&parser->frame[2], parser->length + (TELEMETRY_HEADER_BYTES - 2));
+				uint16_t sent = parser->frame[parser->index - 2] | (parser->frame[parser->index - 1] << 8);
+				if(sum == sent)
+				{
+					ret = true;
+				}
+				else
+				{
+					parser->bad_frames++;
+				}
+				parser->state = TELEMETRY_PARSE_SYNC_0;
+			}
+			break;
+	}
+
+	return ret;
+}
+
+// Field access on a frame
+telemetry_type telemetry_frame_type(uint8_t* frame)
+{
+	return (telemetry_type)frame[2];
+}
+
+uint8_t telemetry_frame_sequence(uint8_t* frame)
+{
+	return frame[3];
+}
+
+uint16_t telemetry_frame_length(uint8_t* frame)
+{
+	return frame[4] | (frame[5] << 8);
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Fletcher-16, two adds per byte with the modulo deferred (no divide on the M0+)
+static uint16_t telemetry_checksum(uint8_t* data, uint16_t length)
+{
+	uint32_t sum_1 = 0xFFU;
+	uint32_t sum_2 = 0xFFU;
+
+	while(length)
+	{
+		// 20 bytes keeps sum_2 inside 16 bits before folding
+		uint16_t chunk = (length > 20) ? 20 : length;
+		length -= chunk;
+		while(chunk--)
+		{
+			sum_1 += *data++;
+			sum_2 += sum_1;
+		}
+		sum_1 = (sum_1 & 0xFFU) + (sum_1 >> 8);
+		sum_2 = (sum_2 & 0xFFU) + (sum_2 >> 8);
+	}
+	sum_1 = (sum_1 & 0xFFU) + (sum_1 >> 8);
+	sum_2 = (sum_2 & 0xFFU) + (sum_2 >> 8);
+
+	return (uint16_t)((sum_2 << 8) | sum_1);
+}
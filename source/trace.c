@@ -0,0 +1,145 @@
+/*
+ * trace.c
+ *
+ *  Created on: Dec 24, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "trace.h"
+#include <stdio.h>
+
+/* DEFINES AND STATIC DATA */
+_Static_assert(((TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0) && (TRACE_BUFFER_SIZE >= 16),
+				"TRACE_BUFFER_SIZE must be a power of 2 from 16");
+
+// MASTER.MASK - the pointer wraps inside 2^(MASK + 4) bytes
+#define TRACE_MASK				(__builtin_ctz(TRACE_BUFFER_SIZE) - 4)
+
+// The MTB writes the packets itself, the buffer only has to be in SRAM and aligned to its size
+static uint32_t trace_buffer[TRACE_BUFFER_SIZE / sizeof(uint32_t)] __attribute__((aligned(TRACE_BUFFER_SIZE)));
+static uint32_t trace_start = 0;				// POSITION of the first packet (offset from MTB->BASE)
+static uint16_t trace_dump_index = 0;
+static bool trace_dumping = false;
+
+volatile bool trace_armed = false;
+uint32_t trace_end = 0;							// POSITION of the last packet, AUTOSTOP turns the MTB off there
+
+
+/* FUNCTION DEFINITIONS */
+
+// Point the MTB at the buffer, stopped
+void trace_init(void)
+{
+	// POINTER is the offset into the SRAM the MTB sees, which starts at BASE
+	trace_start = (uint32_t)trace_buffer - MTB->BASE;
+	trace_end = trace_start + TRACE_BUFFER_SIZE - TRACE_PACKET_BYTES;
+	trace_armed = false;
+	trace_dumping = false;
+
+	MTB->MASTER = MTB_MASTER_MASK(TRACE_MASK);
+	MTB->POSITION = trace_start;
+	MTB->FLOW = MTB_FLOW_WATERMARK(trace_end >> MTB_FLOW_WATERMARK_SHIFT) | MTB_FLOW_AUTOSTOP_MASK;
+}
+
+// Start a new capture at the next traced region
+void trace_arm(void)
+{
+	MTB->MASTER &= ~MTB_MASTER_EN_MASK;
+	MTB->POSITION = trace_start;		// WRAP cleared with it
+	trace_dumping = false;
+	trace_armed = true;
+}
+
+// Stop capturing (a capture in progress is kept)
+void trace_disarm(void)
+{
+	trace_armed = false;
+	MTB->MASTER &= ~MTB_MASTER_EN_MASK;
+}
+
+// Capture state and the packets in the buffer
+trace_state trace_status(void)
+{
+	trace_state ret = TRACE_STATE_IDLE;
+
+	if((MTB->POSITION & MTB_POSITION_POINTER_MASK) >= trace_end)
+	{
+		ret = TRACE_STATE_FULL;
+	}
+	else if(trace_armed)
+	{
+		ret = TRACE_STATE_ARMED;
+	}
+
+	return ret;
+}
+
+uint32_t trace_packets(void)
+{
+	uint32_t position = MTB->POSITION;
+	uint32_t used = (position & MTB_POSITION_POINTER_MASK) - trace_start;
+
+	// AUTOSTOP keeps the buffer from wrapping, but a debugger may have cleared FLOW
+	return (position & MTB_POSITION_WRAP_MASK) ? (TRACE_BUFFER_SIZE / TRACE_PACKET_BYTES) : (used / TRACE_PACKET_BYTES);
+}
+
+// Buffer address and the raw POSITION register, for reading the buffer with a debugger instead
+uint32_t trace_buffer_address(void)
+{
+	return (uint32_t)trace_buffer;
+}
+
+uint32_t trace_position(void)
+{
+	return MTB->POSITION;
+}
+
+// Start a console dump (disarms), then take one line per call until it returns 0
+void trace_dump_start(void)
+{
+	trace_disarm();
+	trace_dump_index = 0;
+	trace_dumping = true;
+}
+
+uint16_t trace_dump_line(char* line)
+{
+	int length = 0;
+
+	if(trace_dumping)
+	{
+		uint32_t packets = trace_packets();
+		bool wrapped = (MTB->POSITION & MTB_POSITION_WRAP_MASK) != 0;
+		uint32_t first = (uint32_t)trace_dump_index * TRACE_LINE_PACKETS;
+
+		if(trace_dump_index == 0)
+		{
+			length = snprintf(line, TRACE_LINE_BYTES, TRACE_TAG " %08x %u %u %u\n", (unsigned)trace_buffer_address(),
+								(unsigned)TRACE_BUFFER_SIZE, (unsigned)packets, (unsigned)wrapped);
+		}
+		else if(first - TRACE_LINE_PACKETS < packets)
+		{
+			// Oldest first - after a wrap that is the packet at the write pointer
+			uint32_t oldest = wrapped ? (((MTB->POSITION & MTB_POSITION_POINTER_MASK) - trace_start) / TRACE_PACKET_BYTES) : 0;
+			first -= TRACE_LINE_PACKETS;
+			length = snprintf(line, TRACE_LINE_BYTES, TRACE_TAG " %u", (unsigned)first);
+			for(uint32_t p = first; (p < packets) && (p < (first + TRACE_LINE_PACKETS)); p++)
+			{
+				uint32_t slot = ((oldest + p) % (TRACE_BUFFER_SIZE / TRACE_PACKET_BYTES)) * 2;
+				length += snprintf(&line[length], TRACE_LINE_BYTES - length, " %08x %08x",
+									(unsigned)trace_buffer[slot], (unsigned)trace_buffer[slot + 1]);
+			}
+			line[length++] = '\n';
+		}
+		else
+		{
+			length = snprintf(line, TRACE_LINE_BYTES, TRACE_TAG " end\n");
+			trace_dumping = false;
+		}
+
+		trace_dump_index++;
+	}
+
+	return (uint16_t)length;
+}
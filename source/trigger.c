@@ -0,0 +1,300 @@
+/*
+ * trigger.c
+ *
+ *  Created on: Dec 14, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "trigger.h"
+#include "peak_detect.h"
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static uint16_t trigger_scan_copy(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size);
+static uint16_t trigger_scan_level(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int16_t* hit);
+static uint16_t trigger_scan_edge(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int16_t* hit);
+static uint16_t trigger_scan_slope(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int16_t* hit);
+
+
+/* FUNCTION DEFINITIONS */
+
+// Initialize a trigger engine and arm it
+trigger_error trigger_init(trigger_handle* handle, trigger_config* config)
+{
+	// Initialize
+	trigger_error ret = TRIGGER_ERROR_SUCCESS;
+
+	if(	(handle == NULL)	||
+		(config == NULL)	||
+		(config->history == NULL))
+	{
+		ret = TRIGGER_ERROR_NULL_PTR;
+	}
+	else if((config->history_size == 0) |
+			(config->history_size & (config->history_size - 1)))
+	{
+		ret = TRIGGER_ERROR_HISTORY_SIZE;
+	}
+	// Window plus one block in flight must fit or the pre trigger samples get overwritten
+	else if((uint32_t)config->pre_samples + config->post_samples + config->block_size > config->history_size)
+	{
+		ret = TRIGGER_ERROR_WINDOW_SIZE;
+	}
+	else
+	{
+		handle->config = *config;
+		handle->history_mask = config->history_size - 1;
+		handle->write_index = 0;
+		handle->last_sample = 0;
+		handle->trigger_count = 0;
+		memset(config->history, 0, config->history_size * sizeof(int16_t));
+		trigger_rearm(handle);
+	}
+
+	return ret;
+}
+
+// Feed a block to the history ring, evaluate the trigger, return the block max |x| (for peak_hold)
+// Each trigger type gets its own loop so the per sample cost stays one copy, one abs and one compare
+uint16_t trigger_process_block(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size)
+{
+	uint16_t max = 0;
+
+	if(handle->state == TRIGGER_STATE_STREAMING)
+	{
+		// History is frozen until the snapshot is out, plain peak scan only
+		max = peak_block_max(buffer, buffer_size);
+	}
+	else
+	{
+		uint16_t start = handle->write_index;
+		uint16_t written_after = 0;	// Samples written at or after the trigger sample
+		int16_t hit = -1;
+
+		if(handle->state == TRIGGER_STATE_ARMED)
+		{
+			// After a re-arm the history and last_sample are from before the snapshot, so the first samples only
+			// refill the pre trigger window (and seed last_sample) and the scan starts on the sample after them
+			uint8_t fill = MIN(handle->fill_remaining, buffer_size);
+			uint16_t scan_max = 0;
+
+			if(fill)
+			{
+				max = trigger_scan_copy(handle, buffer, fill);
+				handle->fill_remaining -= fill;
+				handle->write_index = (start + fill) & handle->history_mask;
+				handle->last_sample = buffer[fill - 1];
+			}
+
+			switch(handle->config.type)
+			{
+				case TRIGGER_TYPE_LEVEL:
+					scan_max = trigger_scan_level(handle, &buffer[fill], buffer_size - fill, &hit);
+					break;
+				case TRIGGER_TYPE_EDGE:
+					scan_max = trigger_scan_edge(handle, &buffer[fill], buffer_size - fill, &hit);
+					break;
+				case TRIGGER_TYPE_SLOPE:
+					scan_max = trigger_scan_slope(handle, &buffer[fill], buffer_size - fill, &hit);
+					break;
+			}
+			max = MAX(max, scan_max);
+			hit += (hit >= 0) ? fill : 0;
+		}
+		else
+		{
+			max = trigger_scan_copy(handle, buffer, buffer_size);
+			written_after = buffer_size;
+		}
+
+		handle->write_index = (start + buffer_size) & handle->history_mask;
+		handle->last_sample = handle->config.history[(handle->write_index - 1) & handle->history_mask];
+
+		if(hit >= 0)
+		{
+			uint16_t trigger_index = (start + hit) & handle->history_mask;
+			handle->trigger_count++;
+			handle->state = TRIGGER_STATE_POST;
+			handle->post_remaining = handle->config.post_samples;
+			handle->stream_index = (trigger_index - handle->config.pre_samples) & handle->history_mask;
+			handle->stream_remaining = handle->config.pre_samples + handle->config.post_samples;
+			written_after = buffer_size - hit;
+		}
+
+		// Close the post trigger window and freeze the history
+		if(handle->state == TRIGGER_STATE_POST)
+		{
+			if(handle->post_remaining <= written_after)
+			{
+				handle->post_remaining = 0;
+				handle->state = TRIGGER_STATE_STREAMING;
+			}
+			else
+			{
+				handle->post_remaining -= written_after;
+			}
+		}
+	}
+
+	return max;
+}
+
+// Get the next contiguous piece of a frozen snapshot, returns the sample count (0 when done)
+// Samples are handed out in place from the frozen history, the engine re-arms after the last piece
+uint16_t trigger_stream_next(trigger_handle* handle, int16_t** samples, uint16_t max_samples)
+{
+	uint16_t count = 0;
+
+	if(handle->state == TRIGGER_STATE_STREAMING)
+	{
+		if(handle->stream_remaining == 0)
+		{
+			trigger_rearm(handle);
+		}
+		else
+		{
+			// Stop at the end of the ring so the piece stays contiguous
+			uint16_t to_end = handle->config.history_size - handle->stream_index;
+			count = MIN(MIN(handle->stream_remaining, to_end), max_samples);
+
+			*samples = &handle->config.history[handle->stream_index];
+			handle->stream_index = (handle->stream_index + count) & handle->history_mask;
+			handle->stream_remaining -= count;
+		}
+	}
+
+	return count;
+}
+
+// Drop the rest of the snapshot and re-arm, the trigger waits for a fresh pre trigger window
+// At least one fresh sample, so edge and slope never compare against a sample from before the re-arm
+void trigger_rearm(trigger_handle* handle)
+{
+	handle->state = TRIGGER_STATE_ARMED;
+	handle->post_remaining = 0;
+	handle->stream_remaining = 0;
+	handle->fill_remaining = MAX(handle->config.pre_samples, 1);
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Copy into the history and track max |x|, no trigger evaluation
+static uint16_t trigger_scan_copy(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size)
+{
+	int16_t* history = handle->config.history;
+	uint16_t mask = handle->history_mask;
+	uint16_t index = handle->write_index;
+	uint16_t max = 0;
+
+	for(uint8_t i = 0; i < buffer_size; i++)
+	{
+		int16_t sample = buffer[i];
+		history[index] = sample;
+		index = (index + 1) & mask;
+
+		uint16_t sample_abs = abs(sample);
+		if(sample_abs > max)
+		{
+			max = sample_abs;
+		}
+	}
+
+	return max;
+}
+
+// Level trigger falls out of the peak scan, only a block that reaches level gets a second look
+static uint16_t trigger_scan_level(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int16_t* hit)
+{
+	uint16_t max = trigger_scan_copy(handle, buffer, buffer_size);
+	uint16_t level = (uint16_t)abs(handle->config.level);
+
+	if(max >= level)
+	{
+		int16_t* history = handle->config.history;
+		uint16_t mask = handle->history_mask;
+		uint16_t index = handle->write_index;
+
+		for(uint8_t i = 0; i < buffer_size; i++)
+		{
+			if((uint16_t)abs(history[(index + i) & mask]) >= level)
+			{
+				*hit = i;
+				break;
+			}
+		}
+	}
+
+	return max;
+}
+
+// Edge trigger, rising is below->at or above level, falling is at or above->below level
+static uint16_t trigger_scan_edge(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int16_t* hit)
+{
+	int16_t* history = handle->config.history;
+	uint16_t mask = handle->history_mask;
+	uint16_t index = handle->write_index;
+	int16_t level = handle->config.level;
+	bool rise_ok = (handle->config.edge != TRIGGER_EDGE_FALLING);
+	bool fall_ok = (handle->config.edge != TRIGGER_EDGE_RISING);
+	bool last_below = (handle->last_sample < level);
+	uint16_t max = 0;
+
+	for(uint8_t i = 0; i < buffer_size; i++)
+	{
+		int16_t sample = buffer[i];
+		history[index] = sample;
+		index = (index + 1) & mask;
+
+		uint16_t sample_abs = abs(sample);
+		if(sample_abs > max)
+		{
+			max = sample_abs;
+		}
+
+		bool below = (sample < level);
+		if((below != last_below) && (*hit < 0) && (below ? fall_ok : rise_ok))
+		{
+			*hit = i;
+		}
+		last_below = below;
+	}
+
+	return max;
+}
+
+// Slope trigger on the first difference
+static uint16_t trigger_scan_slope(trigger_handle* handle, volatile int16_t* buffer, uint8_t buffer_size, int16_t* hit)
+{
+	int16_t* history = handle->config.history;
+	uint16_t mask = handle->history_mask;
+	uint16_t index = handle->write_index;
+	int32_t slope = abs(handle->config.slope);
+	int32_t rise_limit = (handle->config.edge != TRIGGER_EDGE_FALLING) ? slope : INT32_MAX;
+	int32_t fall_limit = (handle->config.edge != TRIGGER_EDGE_RISING) ? -slope : INT32_MIN;
+	int16_t last = handle->last_sample;
+	uint16_t max = 0;
+
+	for(uint8_t i = 0; i < buffer_size; i++)
+	{
+		int16_t sample = buffer[i];
+		history[index] = sample;
+		index = (index + 1) & mask;
+
+		uint16_t sample_abs = abs(sample);
+		if(sample_abs > max)
+		{
+			max = sample_abs;
+		}
+
+		int32_t delta = (int32_t)sample - last;
+		if(((delta >= rise_limit) | (delta <= fall_limit)) && (*hit < 0))
+		{
+			*hit = i;
+		}
+		last = sample;
+	}
+
+	return max;
+}
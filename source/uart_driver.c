@@ -0,0 +1,279 @@
+/*
+ * uart_driver.c
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ */
+
+/* HEADER */
+#include "uart_driver.h"
+
+/* DEFINES AND STATIC DATA */
+static lpsci_handle_t uart_handle;
+static volatile uint32_t uart_rx_overruns = 0;
+static uint32_t uart_baud = 0;		// 0 until uart_init succeeds
+
+// Console text queue - the main loop moves tail, the transfer callback moves head
+static char uart_tx_ring[UART_TX_RING_SIZE];
+static volatile uint16_t uart_tx_head = 0;		// First byte not yet sent
+static volatile uint16_t uart_tx_tail = 0;		// Where the next write goes
+static volatile uint16_t uart_tx_sending = 0;	// Bytes from head in the transfer going out, 0 for a frame
+static uint32_t uart_tx_dropped = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static bool uart_null_ptrs(uart_init_config* config);
+static void uart_callback(UART0_Type* base, lpsci_handle_t* handle, status_t status, void* user_data);
+static void uart_tx_next(void);
+
+
+/* FUNCTION DEFINITIONS */
+
+// UART Initialization (LPSCI0, interrupt driven transfers)
+uart_error uart_init(uart_init_config* config)
+{
+	// Initialize
+	uart_error ret = UART_ERROR_SUCCESS;
+
+	if(uart_null_ptrs(config))
+	{
+		ret = UART_ERROR_NULL_PTR;
+	}
+	else if(config->uart != UART0)
+	{
+		ret = UART_ERROR_UNKNOWN_UART;
+	}
+	else
+	{
+		// Same clock source as BOARD_InitDebugConsole
+		CLOCK_SetLpsci0Clock(UART_CLOCK_PLLFLL);
+		uint32_t clock_freq = (config->clock_freq) ? config->clock_freq : CLOCK_GetPllFllSelClkFreq();
+
+		lpsci_config_t lpsci_fig;
+		LPSCI_GetDefaultConfig(&lpsci_fig);
+		lpsci_fig.baudRate_Bps = config->baud;
+		lpsci_fig.enableTx = true;
+		lpsci_fig.enableRx = true;
+
+		if(LPSCI_Init(config->uart, &lpsci_fig, clock_freq) != kStatus_Success)
+		{
+			ret = UART_ERROR_BAUD;
+		}
+		else
+		{
+			LPSCI_TransferCreateHandle(config->uart, &uart_handle, uart_callback, NULL);
+			uart_baud = config->baud;
+		}
+	}
+
+	return ret;
+}
+
+// Start sending a buffer in the background, buffer must stay put until uart_send_busy() is false
+uart_error uart_send(uint8_t* data, size_t length)
+{
+	uart_error ret = UART_ERROR_SUCCESS;
+	lpsci_transfer_t xfer = {.data = data, .dataSize = length};
+
+	if(data == NULL)
+	{
+		ret = UART_ERROR_NULL_PTR;
+	}
+	// Queued text goes first, the callback only starts text transfers while the queue is not empty
+	else if((uart_tx_head != uart_tx_tail) || (LPSCI_TransferSendNonBlocking(UART0, &uart_handle, &xfer) != kStatus_Success))
+	{
+		ret = UART_ERROR_BUSY;
+	}
+
+	return ret;
+}
+
+// Check if a background send is still in progress (queued console text counts)
+bool uart_send_busy(void)
+{
+	uint32_t count = 0;
+	return	(uart_tx_head != uart_tx_tail)		||
+			(LPSCI_TransferGetSendCount(UART0, &uart_handle, &count) != kStatus_NoTransferInProgress);
+}
+
+// Nothing queued, no transfer and the last stop bit out of the shifter (TC) - safe to change the clock or baud
+// The transfer ends when its last byte is loaded into the data register, a character time before TC
+bool uart_send_done(void)
+{
+	return !uart_send_busy() && (UART0->S1 & UART0_S1_TC_MASK);
+}
+
+// Queue console text behind whatever is going out, copied so the caller's buffer is free at once
+uart_error uart_write(const char* text, size_t length)
+{
+	uart_error ret = UART_ERROR_SUCCESS;
+
+	if(text == NULL)
+	{
+		ret = UART_ERROR_NULL_PTR;
+	}
+	else if((uart_baud == 0) || (length > uart_write_space()))
+	{
+		uart_tx_dropped++;
+		ret = UART_ERROR_BUSY;
+	}
+	else
+	{
+		uint16_t tail = uart_tx_tail;
+		for(size_t i = 0; i < length; i++)
+		{
+			uart_tx_ring[tail] = text[i];
+			tail = (tail + 1) % UART_TX_RING_SIZE;
+		}
+		uart_tx_tail = tail;
+
+		// Nothing going out means no callback is coming to start the queue, so start it here. With the
+		// interrupts off the callback cannot finish a transfer and start the queue between the check and the start
+		uint32_t primask = DisableGlobalIRQ();
+		uint32_t count = 0;
+		if(LPSCI_TransferGetSendCount(UART0, &uart_handle, &count) == kStatus_NoTransferInProgress)
+		{
+			uart_tx_next();
+		}
+		EnableGlobalIRQ(primask);
+	}
+
+	return ret;
+}
+
+// Same, waiting for room - for long output that runs with the main loop stopped (bench), never from an ISR
+// Pieces of half the queue so a write longer than the queue still goes out
+void uart_write_wait(const char* text, size_t length)
+{
+	while(uart_baud && length)
+	{
+		size_t piece = MIN(length, UART_TX_RING_SIZE / 2);
+		if(piece <= uart_write_space())
+		{
+			uart_write(text, piece);
+			text += piece;
+			length -= piece;
+		}
+	}
+}
+
+// Room left in the console text queue (one byte stays free so a full queue is not an empty one)
+size_t uart_write_space(void)
+{
+	uint16_t head = uart_tx_head;
+	uint16_t tail = uart_tx_tail;
+
+	return UART_TX_RING_SIZE - 1 - ((tail >= head) ? (tail - head) : (UART_TX_RING_SIZE - head + tail));
+}
+
+// Writes dropped because the console text queue was short of room
+uint32_t uart_write_dropped(void)
+{
+	return uart_tx_dropped;
+}
+
+// Start interrupt driven receive into a ring buffer
+uart_error uart_receive_start(uint8_t* ring, size_t ring_size)
+{
+	uart_error ret = UART_ERROR_SUCCESS;
+
+	if(ring == NULL)
+	{
+		ret = UART_ERROR_NULL_PTR;
+	}
+	else
+	{
+		LPSCI_TransferStartRingBuffer(UART0, &uart_handle, ring, ring_size);
+	}
+
+	return ret;
+}
+
+// Copy out whatever has been received (up to max), never waits
+// Only asks the SDK for what is already in the ring so the receive can never go pending
+size_t uart_receive(uint8_t* data, size_t max)
+{
+	size_t received = 0;
+	uint16_t head = uart_handle.rxRingBufferHead;
+	uint16_t tail = uart_handle.rxRingBufferTail;
+	size_t available = (head >= tail) ? (head - tail) : (uart_handle.rxRingBufferSize - tail + head);
+
+	if(available && max && (uart_handle.rxRingBuffer != NULL))
+	{
+		lpsci_transfer_t xfer = {.data = data, .dataSize = MIN(available, max)};
+		LPSCI_TransferReceiveNonBlocking(UART0, &uart_handle, &xfer, &received);
+	}
+
+	return received;
+}
+
+// Bytes lost because the receive ring was full
+uint32_t uart_receive_overruns(void)
+{
+	return uart_rx_overruns;
+}
+
+// Move the UART to a new clock (UART0SRC select) and keep the baud from uart_init, call once uart_send_done()
+uart_error uart_set_clock(uint8_t source, uint32_t clock_freq)
+{
+	uart_error ret = UART_ERROR_SUCCESS;
+
+	if(uart_baud)
+	{
+		CLOCK_SetLpsci0Clock(source);
+		if(LPSCI_SetBaudRate(UART0, uart_baud, clock_freq) != kStatus_Success)
+		{
+			ret = UART_ERROR_BAUD;
+		}
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Check for NULL Pointers
+static bool uart_null_ptrs(uart_init_config* config)
+{
+	bool ret = false;
+
+	if(	(config == NULL)			||
+		(config->uart == NULL)		)
+	{
+		ret = true;
+	}
+
+	return ret;
+}
+
+// Transfer events from the SDK IRQ handler - count overruns, and at the end of a send move on to the queued text
+static void uart_callback(UART0_Type* base, lpsci_handle_t* handle, status_t status, void* user_data)
+{
+	if(status == kStatus_LPSCI_RxRingBufferOverrun)
+	{
+		uart_rx_overruns++;
+	}
+	else if(status == kStatus_LPSCI_TxIdle)
+	{
+		uart_tx_head = (uart_tx_head + uart_tx_sending) % UART_TX_RING_SIZE;
+		uart_tx_sending = 0;
+		uart_tx_next();
+	}
+}
+
+// Send the queued text up to the queue end or the tail (the rest goes from the next callback)
+// Called with no transfer going out, from the callback or with the interrupts off
+static void uart_tx_next(void)
+{
+	uint16_t head = uart_tx_head;
+	uint16_t tail = uart_tx_tail;
+
+	if(head != tail)
+	{
+		lpsci_transfer_t xfer = {.data = (uint8_t*)&uart_tx_ring[head]};
+		xfer.dataSize = (tail > head) ? (tail - head) : (UART_TX_RING_SIZE - head);
+		uart_tx_sending = xfer.dataSize;
+		LPSCI_TransferSendNonBlocking(UART0, &uart_handle, &xfer);
+	}
+}
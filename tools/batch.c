@@ -0,0 +1,864 @@
+/*
+ * batch.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ *
+ * Offline metering of capture archives - the firmware's block max, peak hold (peak_hold_at, the pipeline's decay
+ * on the sample index) and dBFS, plus Goertzel tones, over WAV or raw int16 captures, on every core.
+ * Each file is mapped and cut into block aligned segments, and a work stealing thread pool runs two jobs per
+ * segment: analyze (every stage from an empty hold) and format (fix the hold up with the real one carried in,
+ * then the CSV text). The hold after n blocks from a carried in hold c is max(hold from empty, c >> the decay
+ * shift so far), so the main thread carries the hold from segment to segment in order as the analyses land
+ * and the output is the same as one serial pass (-t checks). Columns are replay's, less trigger_count.
+ * Block max runs on the widest kernels.c variant the CPU has, the -t serial pass on the firmware's own.
+ *
+ * Adding a stage: a field in batch_result, the work in batch_analyze, and if it keeps state across blocks, a
+ * carry in batch_format that gets from "segment run from empty" to "segment run after the one before it".
+ *
+ * Build:
+ *   gcc -O2 -pthread -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o batch batch.c \
+ *       ../source/peak_detect.c ../source/goertzel.c ../source/format.c ../source/kernels.c ../source/capture.c -lm
+ *
+ * Use:
+ *   batch [-j threads] [-s segment_blocks] [-c channel] [-r rate] [-f hz,hz..] capture.wav > blocks.csv
+ *   batch ... a.wav b.raw ...		several files each go to <file>.csv
+ *   -q prints a summary line per file instead of the blocks
+ *   -t also runs a plain serial pass and compares, exit code 0 is a pass
+ *   -b throughput (-q) at 1, 2, 4 .. -j threads
+ *   Raw captures (rawstream -b) are mono int16 little endian at -r Hz (27000 if not given)
+ *   Capture files (rawstream -c, captool -w) are read in place, at their own rate if they have one
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pipeline.h"
+#include "kernels.h"
+#include "capture.h"
+
+/* DEFINES AND STATIC DATA */
+#define BATCH_BLOCK				BUFF_HALF_SIZE
+#define BATCH_SAMPLE_RATE		27000
+#define BATCH_SEGMENT_BLOCKS	4096			// 256k samples per job
+#define BATCH_WINDOW			4				// Segments in flight per thread, bounds the memory
+#define BATCH_MAX_THREADS		64
+#define BATCH_LINE_BYTES		(24 + 6 * 4 + 6 * GOERTZEL_MAX_TONES)
+
+// Mapped Capture
+typedef struct
+{
+	const char* path;
+	uint8_t* map;
+	size_t map_bytes;
+	const uint8_t* data;		// First frame
+	uint64_t frames;
+	uint16_t channels;
+	uint16_t channel;
+	uint8_t bytes_per_sample;
+	uint8_t bits;
+	uint32_t sample_rate;
+	bool is_capture;			// Capture file, blocks come from its chunks instead of data
+	capture_reader capture;
+} batch_source;
+
+// Per block results - one field per stage
+typedef struct
+{
+	uint16_t block_max;
+	uint16_t hold;				// peak_hold_at from an empty hold at the segment start
+	uint16_t dbfs;				// Of hold, batch_format redoes it where the carried hold wins
+	uint16_t tone_dbfs[GOERTZEL_MAX_TONES];
+} batch_result;
+
+typedef enum
+{
+	BATCH_SEGMENT_QUEUED,
+	BATCH_SEGMENT_ANALYZED,
+	BATCH_SEGMENT_FORMATTED
+} batch_segment_state;
+
+// Segment (analyze fills results and end, the main thread sets carry, format fills text)
+typedef struct
+{
+	uint64_t first_block;
+	uint32_t blocks;
+	batch_result* results;
+	uint64_t start_mark;		// Decay periods up to the block before the first, as the serial pass has it
+	peak_state end;				// After the last block, from an empty hold
+	uint16_t carry;				// Real hold before the first block
+	char* text;
+	size_t length;
+	uint16_t max_peak;
+	batch_segment_state state;
+} batch_segment;
+
+typedef enum
+{
+	BATCH_JOB_ANALYZE,
+	BATCH_JOB_FORMAT
+} batch_job_type;
+
+typedef struct
+{
+	batch_job_type type;
+	uint32_t segment;
+} batch_job;
+
+// Per worker deque - the owner pops the newest, thieves take the oldest
+typedef struct
+{
+	pthread_mutex_t lock;
+	batch_job* jobs;
+	uint32_t capacity;
+	uint32_t top;				// Oldest
+	uint32_t bottom;			// One past the newest
+} batch_deque;
+
+// Run State (one file at a time)
+typedef struct
+{
+	const batch_source* source;
+	batch_segment* segments;
+	uint32_t segment_count;
+	uint32_t segment_blocks;
+	bool text;
+	uint8_t decay_shift;
+	const kernels_table* kernels;		// Block max, the serial pass keeps the firmware's for -t
+	goertzel_bank tones;
+	uint8_t tone_count;
+} batch_run;
+
+static batch_run run;
+static batch_deque deques[BATCH_MAX_THREADS];
+static pthread_t workers[BATCH_MAX_THREADS];
+static uint32_t thread_count = 1;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_work = PTHREAD_COND_INITIALIZER;		// Jobs queued or stopping
+static pthread_cond_t batch_done = PTHREAD_COND_INITIALIZER;		// A segment changed state
+static uint32_t queued = 0;
+static bool stopping = false;
+static uint32_t next_deque = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static bool batch_open(batch_source* source, const char* path, uint16_t channel, uint32_t raw_rate);
+static void batch_close(batch_source* source);
+static int batch_file(FILE* out, char** text, size_t* length, uint16_t* max_peak);
+static int batch_serial(const batch_source* source, char** text, size_t* length);
+static void batch_pool_start(uint32_t threads);
+static void batch_pool_stop(void);
+static void batch_submit(batch_job_type type, uint32_t segment);
+static bool batch_next_job(uint32_t self, batch_job* job);
+static void* batch_worker(void* arg);
+static void batch_analyze(batch_segment* segment, int16_t* scratch);
+static void batch_format(batch_segment* segment);
+static volatile int16_t* batch_block(const batch_source* source, uint64_t block, int16_t* scratch);
+static size_t batch_line(char* line, uint64_t block, uint16_t block_max, uint16_t peak_counts, uint16_t dbfs,
+							const uint16_t* tone_dbfs);
+static void batch_wait(uint32_t segment, batch_segment_state state);
+static bool batch_reached(uint32_t segment, batch_segment_state state);
+static uint32_t batch_read_le(const uint8_t* bytes, uint8_t count);
+static double batch_now(void);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t segment_blocks = BATCH_SEGMENT_BLOCKS;
+	uint32_t raw_rate = BATCH_SAMPLE_RATE;
+	uint16_t channel = 0;
+	uint16_t frequencies[GOERTZEL_MAX_TONES] = GOERTZEL_TONES;
+	uint8_t tone_count = ENABLE_GOERTZEL ? GOERTZEL_TONE_COUNT : 0;
+	bool quiet = false;
+	bool test = false;
+	bool scaling = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "j:s:c:r:f:qtb")) != -1)
+	{
+		switch(opt)
+		{
+			case 'j':
+				threads = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				segment_blocks = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				channel = (uint16_t)atoi(optarg);
+				break;
+			case 'r':
+				raw_rate = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				tone_count = 0;
+				for(char* hz = strtok(optarg, ","); hz && (tone_count < GOERTZEL_MAX_TONES); hz = strtok(NULL, ","))
+				{
+					frequencies[tone_count++] = (uint16_t)atoi(hz);
+				}
+				break;
+			case 'q':
+				quiet = true;
+				break;
+			case 't':
+				test = true;
+				break;
+			case 'b':
+				scaling = true;
+				quiet = true;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-j threads] [-s segment_blocks] [-c channel] [-r rate] [-f hz,hz] [-q|-t|-b] "
+						"capture.(wav|raw) ...\n", argv[0]);
+				return 2;
+		}
+	}
+	threads = MAX(MIN(threads, BATCH_MAX_THREADS), 1U);
+	segment_blocks = MAX(segment_blocks, 1U);
+	if(optind >= argc)
+	{
+		fprintf(stderr, "no captures\n");
+		return 2;
+	}
+
+	int ret = 0;
+	for(int f = optind; f < argc; f++)
+	{
+		batch_source source;
+		if(!batch_open(&source, argv[f], channel, raw_rate))
+		{
+			fprintf(stderr, "%s: cannot open capture\n", argv[f]);
+			ret = 1;
+			continue;
+		}
+
+		// Same stage setup as pipeline_init, tones at the capture's rate
+		goertzel_config tone_fig = GOERTZEL_CONFIG_DEFAULT;
+		tone_fig.sample_rate = source.sample_rate;
+		tone_fig.tone_count = tone_count;
+		memcpy(tone_fig.frequencies, frequencies, sizeof(frequencies));
+		if(tone_count && (goertzel_init(&run.tones, &tone_fig) != GOERTZEL_ERROR_SUCCESS))
+		{
+			fprintf(stderr, "%s: tones do not fit the sample rate\n", argv[f]);
+			batch_close(&source);
+			ret = 1;
+			continue;
+		}
+		run.tone_count = tone_count;
+		run.decay_shift = PEAK_DECAY_SHIFT;
+		run.kernels = kernels_best();
+		run.source = &source;
+		run.segment_blocks = segment_blocks;
+		run.segment_count = (uint32_t)(((source.frames / BATCH_BLOCK) + segment_blocks - 1) / segment_blocks);
+		run.segments = malloc(MAX(run.segment_count, 1U) * sizeof(batch_segment));
+		double megabytes = (double)source.frames * source.channels * source.bytes_per_sample / 1e6;
+
+		if(scaling)
+		{
+			// Throughput only, the same work at each thread count
+			double base = 0;
+			for(uint32_t t = 1; t <= threads; t = (t < threads) ? MIN(t * 2, threads) : (threads + 1))
+			{
+				uint16_t max_peak = 0;
+				double start = batch_now();
+				batch_pool_start(t);
+				batch_file(NULL, NULL, NULL, &max_peak);
+				batch_pool_stop();
+				double wall = batch_now() - start;
+				base = (t == 1) ? wall : base;
+				printf("%s threads %u %.3f s %.1f MB/s speedup %.2f\n", argv[f], t, wall, megabytes / wall, base / wall);
+			}
+		}
+		else if(test)
+		{
+			// Parallel text in memory against one plain serial pass
+			char* parallel = NULL;
+			char* serial = NULL;
+			size_t parallel_length = 0;
+			size_t serial_length = 0;
+			uint16_t max_peak = 0;
+
+			double start = batch_now();
+			batch_pool_start(threads);
+			batch_file(NULL, &parallel, &parallel_length, &max_peak);
+			batch_pool_stop();
+			double parallel_wall = batch_now() - start;
+
+			start = batch_now();
+			batch_serial(&source, &serial, &serial_length);
+			double serial_wall = batch_now() - start;
+
+			bool same = (parallel_length == serial_length) && !memcmp(parallel, serial, serial_length);
+			printf("%s %llu blocks, %u segments, %u threads %s %.1f MB/s, serial %.1f MB/s, %s\n", argv[f],
+					(unsigned long long)(source.frames / BATCH_BLOCK), run.segment_count, threads, run.kernels->name,
+					megabytes / parallel_wall, megabytes / serial_wall, same ? "PASS" : "FAIL");
+			ret |= same ? 0 : 1;
+			free(parallel);
+			free(serial);
+		}
+		else
+		{
+			// One file to stdout, several to <file>.csv
+			FILE* out = stdout;
+			char name[4096];
+			if(!quiet && ((argc - optind) > 1))
+			{
+				snprintf(name, sizeof(name), "%s.csv", argv[f]);
+				out = fopen(name, "w");
+			}
+			if((out == NULL) && !quiet)
+			{
+				fprintf(stderr, "%s: cannot write %s\n", argv[f], name);
+				ret = 1;
+			}
+			else
+			{
+				uint16_t max_peak = 0;
+				double start = batch_now();
+				batch_pool_start(threads);
+				batch_file(quiet ? NULL : out, NULL, NULL, &max_peak);
+				batch_pool_stop();
+				double wall = batch_now() - start;
+				if(quiet)
+				{
+					printf("%s %llu blocks, max peak %u (-%.2f dBFS), %.3f s, %.1f MB/s\n", argv[f],
+							(unsigned long long)(source.frames / BATCH_BLOCK), max_peak, dbfs_output(max_peak) / 100.0,
+							wall, megabytes / wall);
+				}
+				else if(out != stdout)
+				{
+					fclose(out);
+				}
+			}
+		}
+
+		free(run.segments);
+		batch_close(&source);
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Map a WAV (PCM 8/16/24/32 bit, any channel count, replay's conversion) or a raw int16 LE capture
+static bool batch_open(batch_source* source, const char* path, uint16_t channel, uint32_t raw_rate)
+{
+	memset(source, 0, sizeof(*source));
+	source->path = path;
+
+	int fd = open(path, O_RDONLY);
+	struct stat info;
+	if((fd < 0) || fstat(fd, &info) || (info.st_size == 0))
+	{
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+		return false;
+	}
+	source->map_bytes = (size_t)info.st_size;
+	source->map = mmap(NULL, source->map_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(source->map == MAP_FAILED)
+	{
+		return false;
+	}
+	madvise(source->map, source->map_bytes, MADV_SEQUENTIAL);
+
+	const uint8_t* bytes = source->map;
+	if((source->map_bytes >= CAPTURE_HEADER_BYTES) && !memcmp(bytes, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)))
+	{
+		// Capture file, its reader maps it again and the block reads go through the chunks
+		batch_close(source);
+		if(capture_open(&source->capture, path) != CAPTURE_ERROR_SUCCESS)
+		{
+			return false;
+		}
+		source->is_capture = true;
+		source->channels = 1;
+		source->bytes_per_sample = 2;
+		source->bits = 16;
+		source->frames = source->capture.samples;
+		source->sample_rate = source->capture.info.sample_rate ? source->capture.info.sample_rate : raw_rate;
+		return true;
+	}
+
+	if((source->map_bytes < 12) || memcmp(bytes, "RIFF", 4) || memcmp(&bytes[8], "WAVE", 4))
+	{
+		source->data = bytes;
+		source->channels = 1;
+		source->bytes_per_sample = 2;
+		source->bits = 16;
+		source->frames = source->map_bytes / 2;
+		source->sample_rate = raw_rate;
+		return true;
+	}
+
+	// Walk the chunks for fmt and data
+	size_t offset = 12;
+	while((offset + 8) <= source->map_bytes)
+	{
+		uint32_t size = batch_read_le(&bytes[offset + 4], 4);
+		const uint8_t* body = &bytes[offset + 8];
+
+		if(!memcmp(&bytes[offset], "fmt ", 4) && (size >= 16) && ((offset + 8 + 16) <= source->map_bytes))
+		{
+			uint16_t format = batch_read_le(&body[0], 2);
+			source->channels = batch_read_le(&body[2], 2);
+			source->sample_rate = batch_read_le(&body[4], 4);
+			source->bits = batch_read_le(&body[14], 2);
+			if(((format != 1) && (format != 0xFFFE)) || (source->bits % 8) || (source->bits > 32) ||
+				(source->bits == 0) || (channel >= source->channels))
+			{
+				fprintf(stderr, "unsupported WAV format\n");
+				batch_close(source);
+				return false;
+			}
+			source->bytes_per_sample = source->bits / 8;
+		}
+		else if(!memcmp(&bytes[offset], "data", 4) && source->bits)
+		{
+			size = (uint32_t)MIN((size_t)size, source->map_bytes - (offset + 8));
+			source->data = body;
+			source->channel = channel;
+			source->frames = size / ((uint32_t)source->bytes_per_sample * source->channels);
+			return true;
+		}
+		offset += 8 + size + (size & 1U);
+	}
+
+	batch_close(source);
+	return false;
+}
+
+static void batch_close(batch_source* source)
+{
+	if(source->map && (source->map != MAP_FAILED))
+	{
+		munmap(source->map, source->map_bytes);
+	}
+	source->map = NULL;
+	if(source->is_capture)
+	{
+		capture_close(&source->capture);
+		source->is_capture = false;
+	}
+}
+
+// Whole file through the pool - analyses run ahead by a window, the hold is carried and the text written in order
+// Text goes to out, or collects in *text, or neither (-q, only max_peak)
+static int batch_file(FILE* out, char** text, size_t* length, uint16_t* max_peak)
+{
+	uint32_t window = thread_count * BATCH_WINDOW;
+	uint32_t submitted = 0;
+	uint32_t carried = 0;
+	uint16_t carry = 0;
+	size_t capacity = 0;
+
+	run.text = (out != NULL) || (text != NULL);
+	for(uint32_t s = 0; s < run.segment_count; s++)
+	{
+		memset(&run.segments[s], 0, sizeof(batch_segment));
+		run.segments[s].first_block = (uint64_t)s * run.segment_blocks;
+		run.segments[s].blocks = (uint32_t)MIN((uint64_t)run.segment_blocks,
+												(run.source->frames / BATCH_BLOCK) - run.segments[s].first_block);
+	}
+	if(out)
+	{
+		fprintf(out, "block,first_sample,block_max,peak_counts,dbfs");
+		for(uint8_t i = 0; i < run.tone_count; i++)
+		{
+			fprintf(out, ",tone_%u", run.tones.config.frequencies[i]);
+		}
+		fprintf(out, "\n");
+	}
+
+	for(; (submitted < run.segment_count) && (submitted < window); submitted++)
+	{
+		batch_submit(BATCH_JOB_ANALYZE, submitted);
+	}
+
+	for(uint32_t written = 0; written < run.segment_count; written++)
+	{
+		// Carry the hold into every segment analyzed so far (at least up to this one), each format can start on its own
+		while((carried <= written) || ((carried < run.segment_count) && batch_reached(carried, BATCH_SEGMENT_ANALYZED)))
+		{
+			batch_segment* segment = &run.segments[carried];
+			batch_wait(carried, BATCH_SEGMENT_ANALYZED);
+			segment->carry = carry;
+			uint64_t steps = (segment->end.decay_mark - segment->start_mark) * run.decay_shift;
+			carry = MAX(segment->end.held, (uint16_t)(carry >> MIN(steps, 16U)));
+			batch_submit(BATCH_JOB_FORMAT, carried);
+			carried++;
+		}
+
+		batch_segment* segment = &run.segments[written];
+		batch_wait(written, BATCH_SEGMENT_FORMATTED);
+		if(out)
+		{
+			fwrite(segment->text, 1, segment->length, out);
+		}
+		else if(text)
+		{
+			if((*length + segment->length + 1) > capacity)
+			{
+				capacity = (capacity + segment->length + 1) * 2;
+				*text = realloc(*text, capacity);
+			}
+			memcpy(&(*text)[*length], segment->text, segment->length);
+			*length += segment->length;
+		}
+		*max_peak = MAX(*max_peak, segment->max_peak);
+		free(segment->text);
+		free(segment->results);
+		segment->text = NULL;
+		segment->results = NULL;
+
+		if(submitted < run.segment_count)
+		{
+			batch_submit(BATCH_JOB_ANALYZE, submitted++);
+		}
+	}
+
+	return 0;
+}
+
+// Plain serial pass - one hold from block 0, the stage calls the pipeline makes, for -t to compare against
+static int batch_serial(const batch_source* source, char** text, size_t* length)
+{
+	uint64_t blocks = source->frames / BATCH_BLOCK;
+	size_t capacity = (blocks + 1) * BATCH_LINE_BYTES;
+	int16_t scratch[BATCH_BLOCK];
+	uint16_t tone_dbfs[GOERTZEL_MAX_TONES];
+	peak_state peak;
+
+	peak_state_reset(&peak);
+	*text = malloc(capacity);
+	*length = 0;
+
+	for(uint64_t b = 0; b < blocks; b++)
+	{
+		volatile int16_t* samples = batch_block(source, b, scratch);
+		uint16_t block_max = peak_block_max(samples, BATCH_BLOCK);
+		uint16_t peak_counts = peak_hold_at(&peak, block_max, b * BATCH_BLOCK, PEAK_DECAY_BITS, run.decay_shift);
+		if(run.tone_count)
+		{
+			goertzel_process_block(&run.tones, samples, BATCH_BLOCK, tone_dbfs);
+			for(uint8_t i = 0; i < run.tone_count; i++)
+			{
+				tone_dbfs[i] = dbfs_output(tone_dbfs[i]);
+			}
+		}
+		*length += batch_line(&(*text)[*length], b, block_max, peak_counts, dbfs_output(peak_counts), tone_dbfs);
+	}
+
+	return 0;
+}
+
+// Workers and their deques, jobs for one file at a time
+static void batch_pool_start(uint32_t threads)
+{
+	uint32_t capacity = (threads * BATCH_WINDOW * 2) + 2;
+
+	thread_count = threads;
+	stopping = false;
+	queued = 0;
+	for(uint32_t t = 0; t < threads; t++)
+	{
+		pthread_mutex_init(&deques[t].lock, NULL);
+		deques[t].jobs = malloc(capacity * sizeof(batch_job));
+		deques[t].capacity = capacity;
+		deques[t].top = 0;
+		deques[t].bottom = 0;
+	}
+	for(uint32_t t = 0; t < threads; t++)
+	{
+		pthread_create(&workers[t], NULL, batch_worker, (void*)(uintptr_t)t);
+	}
+}
+
+static void batch_pool_stop(void)
+{
+	pthread_mutex_lock(&batch_lock);
+	stopping = true;
+	pthread_cond_broadcast(&batch_work);
+	pthread_mutex_unlock(&batch_lock);
+
+	// Every worker out before any deque goes, a worker still stealing locks the others'
+	for(uint32_t t = 0; t < thread_count; t++)
+	{
+		pthread_join(workers[t], NULL);
+	}
+	for(uint32_t t = 0; t < thread_count; t++)
+	{
+		pthread_mutex_destroy(&deques[t].lock);
+		free(deques[t].jobs);
+	}
+}
+
+// Deal jobs round the deques, idle workers steal them back out
+static void batch_submit(batch_job_type type, uint32_t segment)
+{
+	batch_deque* deque = &deques[next_deque];
+	next_deque = (next_deque + 1) % thread_count;
+
+	pthread_mutex_lock(&deque->lock);
+	deque->jobs[deque->bottom % deque->capacity] = (batch_job){type, segment};
+	deque->bottom++;
+	pthread_mutex_unlock(&deque->lock);
+
+	pthread_mutex_lock(&batch_lock);
+	queued++;
+	pthread_cond_signal(&batch_work);
+	pthread_mutex_unlock(&batch_lock);
+}
+
+// Own deque newest first, then the oldest job of any other, false once stopping with nothing queued
+static bool batch_next_job(uint32_t self, batch_job* job)
+{
+	while(true)
+	{
+		for(uint32_t n = 0; n < thread_count; n++)
+		{
+			batch_deque* deque = &deques[(self + n) % thread_count];
+			bool found = false;
+
+			pthread_mutex_lock(&deque->lock);
+			if(deque->top != deque->bottom)
+			{
+				if(n == 0)
+				{
+					deque->bottom--;
+					*job = deque->jobs[deque->bottom % deque->capacity];
+				}
+				else
+				{
+					*job = deque->jobs[deque->top % deque->capacity];
+					deque->top++;
+				}
+				found = true;
+			}
+			pthread_mutex_unlock(&deque->lock);
+
+			if(found)
+			{
+				pthread_mutex_lock(&batch_lock);
+				queued--;
+				pthread_mutex_unlock(&batch_lock);
+				return true;
+			}
+		}
+
+		pthread_mutex_lock(&batch_lock);
+		while((queued == 0) && !stopping)
+		{
+			pthread_cond_wait(&batch_work, &batch_lock);
+		}
+		bool done = (queued == 0) && stopping;
+		pthread_mutex_unlock(&batch_lock);
+		if(done)
+		{
+			return false;
+		}
+	}
+}
+
+static void* batch_worker(void* arg)
+{
+	uint32_t self = (uint32_t)(uintptr_t)arg;
+	int16_t scratch[BATCH_BLOCK];
+	batch_job job;
+
+	while(batch_next_job(self, &job))
+	{
+		batch_segment* segment = &run.segments[job.segment];
+		if(job.type == BATCH_JOB_ANALYZE)
+		{
+			batch_analyze(segment, scratch);
+		}
+		else
+		{
+			batch_format(segment);
+		}
+
+		pthread_mutex_lock(&batch_lock);
+		segment->state = (job.type == BATCH_JOB_ANALYZE) ? BATCH_SEGMENT_ANALYZED : BATCH_SEGMENT_FORMATTED;
+		pthread_cond_broadcast(&batch_done);
+		pthread_mutex_unlock(&batch_lock);
+	}
+
+	return NULL;
+}
+
+// Every stage over a segment from an empty hold - the decay count starts where the serial pass has it
+static void batch_analyze(batch_segment* segment, int16_t* scratch)
+{
+	uint64_t first = segment->first_block;
+
+	segment->results = malloc(MAX(segment->blocks, 1U) * sizeof(batch_result));
+	peak_state_reset(&segment->end);
+	segment->end.decay_mark = first ? (((first - 1) * BATCH_BLOCK) >> PEAK_DECAY_BITS) : 0;
+	segment->start_mark = segment->end.decay_mark;
+
+	for(uint32_t b = 0; b < segment->blocks; b++)
+	{
+		batch_result* result = &segment->results[b];
+		volatile int16_t* samples = batch_block(run.source, first + b, scratch);
+
+		result->block_max = run.kernels->block_max((const int16_t*)samples, BATCH_BLOCK);
+		result->hold = peak_hold_at(&segment->end, result->block_max, (first + b) * BATCH_BLOCK, PEAK_DECAY_BITS,
+									run.decay_shift);
+		result->dbfs = dbfs_output(result->hold);
+		if(run.tone_count)
+		{
+			goertzel_process_block(&run.tones, samples, BATCH_BLOCK, result->tone_dbfs);
+			for(uint8_t i = 0; i < run.tone_count; i++)
+			{
+				result->tone_dbfs[i] = dbfs_output(result->tone_dbfs[i]);
+			}
+		}
+	}
+}
+
+// Carried hold in, then the text - only the first blocks differ unless the decay is off
+static void batch_format(batch_segment* segment)
+{
+	char* line = run.text ? malloc(((size_t)segment->blocks * BATCH_LINE_BYTES) + 1) : NULL;
+	size_t length = 0;
+	uint16_t max_peak = 0;
+
+	for(uint32_t b = 0; b < segment->blocks; b++)
+	{
+		batch_result* result = &segment->results[b];
+		uint64_t block = segment->first_block + b;
+		uint64_t steps = (((block * BATCH_BLOCK) >> PEAK_DECAY_BITS) - segment->start_mark) * run.decay_shift;
+		uint16_t carried = (uint16_t)(segment->carry >> MIN(steps, 16U));
+		uint16_t peak_counts = result->hold;
+		uint16_t dbfs = result->dbfs;
+
+		if(carried > peak_counts)
+		{
+			peak_counts = carried;
+			dbfs = dbfs_output(peak_counts);
+		}
+		max_peak = MAX(max_peak, peak_counts);
+
+		if(line)
+		{
+			length += batch_line(&line[length], block, result->block_max, peak_counts, dbfs, result->tone_dbfs);
+		}
+	}
+
+	segment->text = line;
+	segment->length = length;
+	segment->max_peak = max_peak;
+}
+
+// One block of the selected channel as the ADC would give it, in place when the capture is mono 16 bit
+static volatile int16_t* batch_block(const batch_source* source, uint64_t block, int16_t* scratch)
+{
+	if(source->is_capture)
+	{
+		// In place unless the block straddles two chunks
+		uint64_t position = block * BATCH_BLOCK;
+		capture_slice slice;
+		capture_chunk(&source->capture, capture_seek_position(&source->capture, position), &slice);
+		if((position + BATCH_BLOCK) <= (slice.position + slice.count))
+		{
+			return (volatile int16_t*)&slice.samples[position - slice.position];
+		}
+
+		for(uint8_t i = 0; i < BATCH_BLOCK; i++, position++)
+		{
+			if(position >= (slice.position + slice.count))
+			{
+				capture_chunk(&source->capture, capture_seek_position(&source->capture, position), &slice);
+			}
+			scratch[i] = slice.samples[position - slice.position];
+		}
+		return scratch;
+	}
+
+	uint32_t frame_bytes = (uint32_t)source->bytes_per_sample * source->channels;
+	const uint8_t* frame = &source->data[block * BATCH_BLOCK * frame_bytes];
+
+	if((frame_bytes == 2) && !((uintptr_t)frame & 1U))
+	{
+		return (volatile int16_t*)frame;
+	}
+
+	// Keep the top 16 bits, 8 bit WAV is offset binary
+	frame += source->channel * source->bytes_per_sample;
+	for(uint8_t i = 0; i < BATCH_BLOCK; i++, frame += frame_bytes)
+	{
+		uint32_t raw = batch_read_le(frame, source->bytes_per_sample);
+		scratch[i] = (source->bytes_per_sample == 1) ? (int16_t)((raw ^ 0x80U) << 8) : (int16_t)(raw >> (source->bits - 16));
+	}
+
+	return scratch;
+}
+
+// replay's CSV line, less trigger_count
+static size_t batch_line(char* line, uint64_t block, uint16_t block_max, uint16_t peak_counts, uint16_t dbfs,
+							const uint16_t* tone_dbfs)
+{
+	int length = sprintf(line, "%llu,%llu,%u,%u,%u", (unsigned long long)block,
+							(unsigned long long)(block * BATCH_BLOCK), block_max, peak_counts, dbfs);
+	for(uint8_t i = 0; i < run.tone_count; i++)
+	{
+		length += sprintf(&line[length], ",%u", tone_dbfs[i]);
+	}
+	line[length++] = '\n';
+
+	return (size_t)length;
+}
+
+static void batch_wait(uint32_t segment, batch_segment_state state)
+{
+	pthread_mutex_lock(&batch_lock);
+	while(run.segments[segment].state < state)
+	{
+		pthread_cond_wait(&batch_done, &batch_lock);
+	}
+	pthread_mutex_unlock(&batch_lock);
+}
+
+static bool batch_reached(uint32_t segment, batch_segment_state state)
+{
+	pthread_mutex_lock(&batch_lock);
+	bool reached = (run.segments[segment].state >= state);
+	pthread_mutex_unlock(&batch_lock);
+
+	return reached;
+}
+
+// Little endian field from a byte array
+static uint32_t batch_read_le(const uint8_t* bytes, uint8_t count)
+{
+	uint32_t value = 0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		value |= (uint32_t)bytes[i] << (8 * i);
+	}
+
+	return value;
+}
+
+static double batch_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (now.tv_nsec / 1e9);
+}
@@ -0,0 +1,54 @@
+/*
+ * bench_host.c
+ *
+ *  Created on: Dec 17, 2018
+ *      Author: Dominic Doty
+ *
+ * Runs the bench.c block size sweep on the host (RUN_BENCHMARK in main.c runs the same code on target).
+ *
+ * Build:
+ *   gcc -O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o bench_host bench_host.c \
+ *       ../source/bench.c ../source/cycle_counter.c ../source/peak_detect.c ../source/format.c \
+ *       ../source/goertzel.c -lm
+ *
+ * Use:
+ *   bench_host [-r sample_rate] [-n samples_per_point] > sweep.csv
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	bench_config config = BENCH_CONFIG_DEFAULT;
+	int opt;
+
+	while((opt = getopt(argc, argv, "r:n:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'r':
+				config.sample_rate = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				config.samples_per_point = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r sample_rate] [-n samples_per_point]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	bench_error err = bench_run(&config);
+	if(err != BENCH_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "bench error %d\n", err);
+	}
+
+	return err;
+}
@@ -0,0 +1,237 @@
+/*
+ * bench_m0.c
+ *
+ *  Created on: Dec 26, 2018
+ *      Author: Dominic Doty
+ *
+ * Cortex-M0+ cost table for the DSP kernels. Host numbers (bench_host) say little about the M0+ - no divide,
+ * no DSP instructions, 16 bit Thumb - so this is cross compiled for cortex-m0plus and run under qemu-arm with
+ * the execlog plugin. mtb_decode then counts every kernel's instructions and M0+ cycle estimates from the log,
+ * one bench_m0_<kernel> call per block, and compares them against tools/bench_m0.txt.
+ * bench_m0.sh does all of it. There is no bench_m0.txt in the tree yet - the table only ever comes from a run,
+ * never by hand, and the first "bench_m0.sh -u" on a machine with the cross compiler and qemu writes the baseline
+ * to commit. Until then there is nothing to diff against and the script only regenerates the table.
+ *
+ * The numbers are instruction counts through the real kernels on a fixed input, so they only move when the
+ * code does. The libc and libgcc helpers the kernels call are counted too (ARM state ones at 1 cycle each,
+ * mtb_decode says how many there were).
+ *
+ * Build:
+ *   arm-linux-gnueabi-gcc -static -O2 -mthumb -mcpu=cortex-m0plus -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS \
+ *       -I../drivers -o bench_m0 bench_m0.c ../source/peak_detect.c ../source/format.c ../source/goertzel.c \
+ *       ../source/histogram.c ../source/compress.c ../source/oversample.c ../source/trigger.c -lm
+ *   gcc -O2 ... (same sources) runs it natively to check the checksums match
+ *
+ * Use:
+ *   ./bench_m0.sh [-u]		build, run, regenerate and diff (-u replaces bench_m0.txt), or by hand:
+ *   qemu-arm -plugin libexeclog.so -d plugin -D bench_m0.log ./bench_m0 [-n blocks]
+ *   mtb_decode -e bench_m0 -x bench_m0.log -k bench_m0_ -c bench_m0.txt > new.txt && mv new.txt bench_m0.txt
+ *   (non zero exit when a kernel got more than 1% slower per call, -r sets the percent)
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "peak_detect.h"
+#include "format.h"
+#include "goertzel.h"
+#include "histogram.h"
+#include "compress.h"
+#include "oversample.h"
+#include "trigger.h"
+
+/* DEFINES AND STATIC DATA */
+#define BENCH_M0_BLOCK			64			// BUFF_HALF_SIZE
+#define BENCH_M0_BLOCKS			16			// Calls per kernel, enough to average the data dependent branches
+#define BENCH_M0_SAMPLE_RATE	27000
+#define BENCH_M0_TONES			{1000, 2000, 4000, 8000}
+#define BENCH_M0_HISTORY		256
+#define BENCH_M0_DECAY_SHIFT	1
+
+// One kernel call on block n, returns something of the result so the call is not thrown away
+typedef uint32_t (*bench_m0_kernel)(uint32_t n);
+
+typedef struct
+{
+	const char* name;
+	bench_m0_kernel kernel;
+} bench_m0_entry;
+
+static int16_t bench_m0_buffer[BENCH_M0_BLOCKS][BENCH_M0_BLOCK];
+static goertzel_bank bench_m0_bank;
+static histogram bench_m0_hist;
+static oversample_handle bench_m0_decimator;
+static trigger_handle bench_m0_engine;
+static peak_state bench_m0_peak;
+static int16_t bench_m0_history[BENCH_M0_HISTORY];
+static uint8_t bench_m0_packed[COMPRESS_MAX_BYTES(BENCH_M0_BLOCK)];
+static int32_t bench_m0_hires[OVERSAMPLE_MAX_OUTPUTS(BENCH_M0_BLOCK, OVERSAMPLE_MAX_EXTRA_BITS)];
+static char bench_m0_report[FORMAT_REPORT_BYTES];
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void bench_m0_setup(void);
+static uint32_t bench_m0_peak_block_max(uint32_t n);
+static uint32_t bench_m0_peak_output(uint32_t n);
+static uint32_t bench_m0_dbfs_output(uint32_t n);
+static uint32_t bench_m0_goertzel(uint32_t n);
+static uint32_t bench_m0_histogram(uint32_t n);
+static uint32_t bench_m0_compress(uint32_t n);
+static uint32_t bench_m0_oversample(uint32_t n);
+static uint32_t bench_m0_trigger(uint32_t n);
+static uint32_t bench_m0_format_report(uint32_t n);
+
+static const bench_m0_entry bench_m0_kernels[] =
+{
+	{"peak_block_max",	bench_m0_peak_block_max},
+	{"peak_output",		bench_m0_peak_output},
+	{"dbfs_output",		bench_m0_dbfs_output},
+	{"goertzel",		bench_m0_goertzel},
+	{"histogram",		bench_m0_histogram},
+	{"compress",		bench_m0_compress},
+	{"oversample",		bench_m0_oversample},
+	{"trigger",			bench_m0_trigger},
+	{"format_report",	bench_m0_format_report}
+};
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	uint32_t blocks = BENCH_M0_BLOCKS;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				blocks = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n blocks]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	bench_m0_setup();
+
+	// The checksums are the same natively and emulated, if not the cross build is computing something else
+	for(uint8_t k = 0; k < sizeof(bench_m0_kernels) / sizeof(bench_m0_kernels[0]); k++)
+	{
+		uint32_t checksum = 0;
+		for(uint32_t n = 0; n < blocks; n++)
+		{
+			checksum = (checksum * 31U) + bench_m0_kernels[k].kernel(n % BENCH_M0_BLOCKS);
+		}
+		printf("%-16s %08x\n", bench_m0_kernels[k].name, (unsigned)checksum);
+	}
+
+	return 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Noisy ramps at eight levels, so the peak, dB and compressor paths see quiet and loud blocks
+static void bench_m0_setup(void)
+{
+	goertzel_config tones = GOERTZEL_CONFIG_DEFAULT;
+	oversample_config oversample = OVERSAMPLE_CONFIG_DEFAULT;
+	trigger_config trigger = TRIGGER_CONFIG_DEFAULT;
+	uint16_t frequencies[] = BENCH_M0_TONES;
+	uint32_t lfsr = 0xACE1U;
+
+	for(uint32_t n = 0; n < BENCH_M0_BLOCKS; n++)
+	{
+		int32_t amplitude = 256 << (n % 8);
+		for(uint32_t i = 0; i < BENCH_M0_BLOCK; i++)
+		{
+			lfsr = (lfsr >> 1) ^ (-(lfsr & 1U) & 0xB400U);
+			int32_t triangle = (int32_t)((((n * BENCH_M0_BLOCK) + i) * 512U) & 0xFFFFU) - 32768;
+			bench_m0_buffer[n][i] = (int16_t)(((triangle * amplitude) >> 15) + (int32_t)(lfsr & 0x3FU) - 32);
+		}
+	}
+
+	tones.sample_rate = BENCH_M0_SAMPLE_RATE;
+	tones.tone_count = sizeof(frequencies) / sizeof(frequencies[0]);
+	for(uint8_t t = 0; t < tones.tone_count; t++)
+	{
+		tones.frequencies[t] = frequencies[t];
+	}
+	goertzel_init(&bench_m0_bank, &tones);
+
+	histogram_reset(&bench_m0_hist);
+	oversample_init(&bench_m0_decimator, &oversample);
+
+	trigger.level = 8192;
+	trigger.pre_samples = BENCH_M0_BLOCK;
+	trigger.post_samples = BENCH_M0_BLOCK;
+	trigger.block_size = BENCH_M0_BLOCK;
+	trigger.history = bench_m0_history;
+	trigger.history_size = BENCH_M0_HISTORY;
+	trigger_init(&bench_m0_engine, &trigger);
+}
+
+// The bench_m0_ prefix is what mtb_decode -k looks for, keep them out of line
+__attribute__((noinline)) static uint32_t bench_m0_peak_block_max(uint32_t n)
+{
+	return peak_block_max(bench_m0_buffer[n], BENCH_M0_BLOCK);
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_peak_output(uint32_t n)
+{
+	return peak_output(&bench_m0_peak, bench_m0_buffer[n], BENCH_M0_BLOCK, BENCH_M0_DECAY_SHIFT);
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_dbfs_output(uint32_t n)
+{
+	return (uint16_t)dbfs_output((uint16_t)(bench_m0_buffer[n][n] & INT16_MAX));
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_goertzel(uint32_t n)
+{
+	uint16_t amplitude[GOERTZEL_MAX_TONES];
+
+	goertzel_process_block(&bench_m0_bank, bench_m0_buffer[n], BENCH_M0_BLOCK, amplitude);
+
+	return amplitude[0] ^ amplitude[bench_m0_bank.config.tone_count - 1];
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_histogram(uint32_t n)
+{
+	histogram_add_block(&bench_m0_hist, bench_m0_buffer[n], BENCH_M0_BLOCK);
+
+	return bench_m0_hist.total;
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_compress(uint32_t n)
+{
+	return compress_encode_block(bench_m0_buffer[n], BENCH_M0_BLOCK, bench_m0_packed);
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_oversample(uint32_t n)
+{
+	uint8_t outputs = oversample_process_block(&bench_m0_decimator, bench_m0_buffer[n], BENCH_M0_BLOCK, bench_m0_hires);
+
+	return outputs ? (uint32_t)bench_m0_hires[0] : 0;
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_trigger(uint32_t n)
+{
+	uint16_t block_max = trigger_process_block(&bench_m0_engine, bench_m0_buffer[n], BENCH_M0_BLOCK);
+
+	// Keep it triggering, the armed and post window paths are both in the count
+	if(bench_m0_engine.state == TRIGGER_STATE_STREAMING)
+	{
+		trigger_rearm(&bench_m0_engine);
+	}
+
+	return block_max ^ (bench_m0_engine.trigger_count << 16);
+}
+
+__attribute__((noinline)) static uint32_t bench_m0_format_report(uint32_t n)
+{
+	return format_report(bench_m0_report, (uint16_t)bench_m0_buffer[n][0], (uint16_t)(n * 731U));
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# bench_m0.sh
+#
+#  Created on: Dec 26, 2018
+#      Author: Dominic Doty
+#
+# Regenerates the Cortex-M0+ kernel cost table (see bench_m0.c) and diffs it against the committed
+# tools/bench_m0.txt. The cross build and the native build have to print the same checksums first,
+# so a table is never taken from kernels that compute something else on the target.
+#
+# Needs arm-linux-gnueabi-gcc, qemu-arm and its execlog plugin (QEMU_PLUGIN_DIR, default below).
+#
+# Use (from tools/):
+#   ./bench_m0.sh			new table in bench_m0.new, diff against bench_m0.txt, exit code 1 on a regression
+#   ./bench_m0.sh -u		same, then bench_m0.new replaces bench_m0.txt (commit it with the kernel change)
+
+set -e
+cd "$(dirname "$0")"
+
+CROSS=${CROSS:-arm-linux-gnueabi-gcc}
+QEMU=${QEMU:-qemu-arm}
+QEMU_PLUGIN_DIR=${QEMU_PLUGIN_DIR:-/usr/lib/qemu/plugins}
+WORK=${WORK:-/tmp/bench_m0.$$}
+
+CFLAGS="-O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers"
+SOURCES="bench_m0.c ../source/peak_detect.c ../source/format.c ../source/goertzel.c ../source/histogram.c \
+	../source/compress.c ../source/oversample.c ../source/trigger.c"
+
+for tool in "$CROSS" "$QEMU" gcc; do
+	command -v "$tool" > /dev/null || { echo "bench_m0.sh: $tool not found" >&2; exit 2; }
+done
+[ -f "$QEMU_PLUGIN_DIR/libexeclog.so" ] || { echo "bench_m0.sh: no $QEMU_PLUGIN_DIR/libexeclog.so" >&2; exit 2; }
+
+mkdir -p "$WORK"
+trap 'rm -rf "$WORK"' EXIT
+
+gcc -O2 -o "$WORK/mtb_decode" mtb_decode.c
+gcc $CFLAGS -o "$WORK/bench_m0_host" $SOURCES -lm
+$CROSS -static -mthumb -mcpu=cortex-m0plus $CFLAGS -o "$WORK/bench_m0" $SOURCES -lm
+
+"$WORK/bench_m0_host" > "$WORK/host.sum"
+$QEMU -plugin "$QEMU_PLUGIN_DIR/libexeclog.so" -d plugin -D "$WORK/bench_m0.log" "$WORK/bench_m0" > "$WORK/m0.sum"
+if ! cmp -s "$WORK/host.sum" "$WORK/m0.sum"; then
+	echo "bench_m0.sh: checksums differ between the host and the M0+ build" >&2
+	diff "$WORK/host.sum" "$WORK/m0.sum" >&2
+	exit 1
+fi
+
+# mtb_decode reports regressions against the old table through its exit code, the diff is for the reader
+status=0
+if [ -f bench_m0.txt ]; then
+	"$WORK/mtb_decode" -e "$WORK/bench_m0" -x "$WORK/bench_m0.log" -k bench_m0_ -c bench_m0.txt > bench_m0.new || status=1
+	diff -u bench_m0.txt bench_m0.new || true
+else
+	"$WORK/mtb_decode" -e "$WORK/bench_m0" -x "$WORK/bench_m0.log" -k bench_m0_ > bench_m0.new
+	echo "bench_m0.sh: no bench_m0.txt yet, run with -u and commit it" >&2
+fi
+
+if [ "$1" = "-u" ]; then
+	mv bench_m0.new bench_m0.txt
+fi
+
+exit $status
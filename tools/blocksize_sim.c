@@ -0,0 +1,402 @@
+/*
+ * blocksize_sim.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ *
+ * Runs acquire.c, blocksize.c and the pipeline against a DMA register block in host RAM, one conversion per
+ * sample tick, with main.c's loop as the consumer. Processing a block costs cycles at 48MHz - a fixed overhead,
+ * a per sample part, and in the burst phases a report write that stalls half the blocks (a busy UART).
+ * Fixed short blocks, fixed full blocks and adaptive sizing go through the same calm/burst pattern:
+ *   missed  blocks the main loop never saw (two flips between looks)
+ *   late    blocks still being processed when the DMA started refilling their half
+ *   latency processing done minus the block's first sample, in samples, calm and burst phases apart
+ * Checks every block is the consecutive conversions from its first_sample and its armed size, that the sample
+ * index ends on the conversion count, that 8/16/32 sample blocks hold the same peak as 64 sample blocks at every
+ * 64 sample boundary, that blocks resized at random decay the held peak in the same number of samples, and that
+ * adaptive sizing misses fewer blocks than short blocks with lower calm latency than full ones.
+ *
+ * Build:
+ *   gcc -O2 -no-pie -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o blocksize_sim blocksize_sim.c \
+ *       ../source/acquire.c ../source/blockpool.c ../source/dma_driver.c ../source/cycle_counter.c \
+ *       ../source/blocksize.c ../source/pipeline.c ../source/peak_detect.c ../source/trigger.c \
+ *       ../source/telemetry.c ../source/goertzel.c ../source/format.c ../source/histogram.c -lm
+ *   (-no-pie keeps the static buffers below 4 GB so the 32 bit DAR holds a usable pointer)
+ *
+ * Use:
+ *   blocksize_sim [-s seed]		exit code 0 is a pass
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "acquire.h"
+#include "blocksize.h"
+#include "pipeline.h"
+
+/* DEFINES AND STATIC DATA */
+#define SIM_BLOCK				BUFF_HALF_SIZE
+#define SIM_SAMPLE_RATE			27000
+#define SIM_CYCLES_PER_SAMPLE	(48000000 / SIM_SAMPLE_RATE)
+
+// Consumer cost per block, and the burst phase report stall
+#define SIM_COST_BLOCK			3000
+#define SIM_COST_SAMPLE			40
+#define SIM_COST_STALL			60000
+#define SIM_STALL_ONE_IN		2
+
+// Load pattern - calm then burst, repeated
+#define SIM_CALM_SAMPLES		200000
+#define SIM_BURST_SAMPLES		100000
+#define SIM_LOAD_SAMPLES		(4 * (SIM_CALM_SAMPLES + SIM_BURST_SAMPLES))
+
+// Ballistics signal - loud noise, then quiet for the hold to decay through
+#define SIM_LOUD_SAMPLES		1000
+#define SIM_SEGMENT_SAMPLES		3000
+#define SIM_QUIET_LEVEL			16
+#define SIM_DECAYED_LEVEL		2048
+#define SIM_DECAY_SAMPLES		60000
+#define SIM_DECAY_SEGMENTS		(SIM_DECAY_SAMPLES / SIM_SEGMENT_SAMPLES)
+
+#define SIM_MAX_BLOCKS			(SIM_LOAD_SAMPLES / 8 + 2)
+
+// Run Setup
+typedef struct
+{
+	const char* name;
+	uint8_t size;			// Fixed size, 0 for adaptive
+	bool random;			// New power of 2 size every block
+	bool load;				// Calm/burst report load, off is overhead only
+} sim_mode;
+
+// Run Results
+typedef struct
+{
+	uint32_t processed;
+	uint32_t missed;
+	uint32_t late;
+	uint64_t latency[2];	// Calm, burst
+	uint32_t latency_blocks[2];
+	uint64_t samples;
+	uint32_t failures;
+	uint32_t grows;
+	uint32_t shrinks;
+} sim_stats;
+
+// Per processed block, for the ballistics checks
+typedef struct
+{
+	uint64_t end_sample;
+	uint16_t peak_counts;
+} sim_record;
+
+static DMA_Type sim_dma;
+static int16_t sim_buffer[SIM_BLOCK * 2];
+static uint32_t sim_index[SIM_BLOCK * 2];		// Conversion number of each buffer slot
+static uint32_t sim_conversion;
+static sim_record sim_records[4][SIM_MAX_BLOCKS];
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void sim_run(const sim_mode* mode, uint32_t total, sim_stats* stats, sim_record* records);
+static void sim_convert(acquire_handle* acquire);
+static int16_t sim_signal(uint32_t n);
+static bool sim_burst(uint64_t sample);
+static uint32_t sim_random(void);
+static uint32_t sim_decay_end(const sim_record* records, uint32_t count, uint32_t segment);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	const sim_mode load_modes[] =
+	{
+		{"fixed_8",		8,			false,	true},
+		{"fixed_64",	SIM_BLOCK,	false,	true},
+		{"adaptive",	0,			false,	true}
+	};
+	const sim_mode ballistic_modes[] =
+	{
+		{"fixed_64",	SIM_BLOCK,	false,	false},
+		{"fixed_8",		8,			false,	false},
+		{"fixed_32",	32,			false,	false},
+		{"random",		SIM_BLOCK,	true,	false}
+	};
+	sim_stats load[3];
+	sim_stats ballistic[4];
+	uint32_t failures = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 's':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	printf("mode       blocks  missed  late  calm_latency  burst_latency  mean_size  grows  shrinks\n");
+	for(uint8_t m = 0; m < 3; m++)
+	{
+		sim_run(&load_modes[m], SIM_LOAD_SAMPLES, &load[m], sim_records[0]);
+		printf("%-9s %7u %7u %5u %13.1f %14.1f %10.1f %6u %8u\n", load_modes[m].name, load[m].processed,
+				load[m].missed, load[m].late, (double)load[m].latency[0] / MAX(load[m].latency_blocks[0], 1U),
+				(double)load[m].latency[1] / MAX(load[m].latency_blocks[1], 1U),
+				(double)load[m].samples / MAX(load[m].processed, 1U), load[m].grows, load[m].shrinks);
+		failures += load[m].failures;
+	}
+
+	// Lost blocks are what the bigger blocks buy back, the calm latency is what the small ones buy
+	uint32_t lost_small = load[0].missed + load[0].late;
+	uint32_t lost_adaptive = load[2].missed + load[2].late;
+	double calm_full = (double)load[1].latency[0] / MAX(load[1].latency_blocks[0], 1U);
+	double calm_adaptive = (double)load[2].latency[0] / MAX(load[2].latency_blocks[0], 1U);
+	if(lost_adaptive * 10 >= lost_small)
+	{
+		failures++;
+		fprintf(stderr, "adaptive lost %u blocks, fixed_8 %u\n", lost_adaptive, lost_small);
+	}
+	if(calm_adaptive * 2 >= calm_full)
+	{
+		failures++;
+		fprintf(stderr, "adaptive calm latency %.1f, fixed_64 %.1f\n", calm_adaptive, calm_full);
+	}
+
+	for(uint8_t m = 0; m < 4; m++)
+	{
+		sim_run(&ballistic_modes[m], SIM_DECAY_SAMPLES, &ballistic[m], sim_records[m]);
+		failures += ballistic[m].failures;
+	}
+
+	// Short aligned blocks end on every 64 sample boundary, the hold there is the 64 sample block's exactly
+	uint32_t mismatches = 0;
+	for(uint8_t m = 1; m < 3; m++)
+	{
+		uint32_t r = 0;
+		for(uint32_t b = 0; b < ballistic[m].processed; b++)
+		{
+			while((r < ballistic[0].processed) && (sim_records[0][r].end_sample < sim_records[m][b].end_sample))
+			{
+				r++;
+			}
+			if(	(r < ballistic[0].processed)											&&
+				(sim_records[0][r].end_sample == sim_records[m][b].end_sample)		&&
+				(sim_records[0][r].peak_counts != sim_records[m][b].peak_counts)	)
+			{
+				mismatches++;
+			}
+		}
+	}
+	failures += (mismatches != 0);
+
+	// Resized blocks straddle the decay boundaries, the hold falls within a block or so of the same sample
+	uint32_t worst = 0;
+	for(uint32_t s = 0; s < SIM_DECAY_SEGMENTS; s++)
+	{
+		for(uint8_t m = 1; m < 4; m++)
+		{
+			uint32_t reference = sim_decay_end(sim_records[0], ballistic[0].processed, s);
+			uint32_t end = sim_decay_end(sim_records[m], ballistic[m].processed, s);
+			uint32_t difference = (end > reference) ? (end - reference) : (reference - end);
+			worst = MAX(worst, difference);
+		}
+	}
+	failures += (worst > (2 * PEAK_DECAY_SAMPLES));
+
+	printf("peak hold mismatches at 64 sample boundaries %u, worst decay time difference %u samples (random mean size %.1f)\n",
+			mismatches, worst, (double)ballistic[3].samples / MAX(ballistic[3].processed, 1U));
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// One run from a cold start, a conversion per tick and the main loop in between
+static void sim_run(const sim_mode* mode, uint32_t total, sim_stats* stats, sim_record* records)
+{
+	acquire_handle acquire;
+	acquire_config acquire_fig = ACQUIRE_CONFIG_DEFAULT;
+	blocksize_handle sizer;
+	blocksize_config size_fig = BLOCKSIZE_CONFIG_DEFAULT;
+	uint32_t processed = 0;
+	pipeline_output output = {0};
+
+	*stats = (sim_stats){0};
+	sim_conversion = 0;
+
+	// dma_init() would talk to the clock gate and NVIC, arm the first half by hand instead
+	acquire_fig.dma = &sim_dma;
+	acquire_fig.buffer = sim_buffer;
+	acquire_fig.block_size = SIM_BLOCK;
+	acquire_fig.sample_rate = SIM_SAMPLE_RATE;
+	acquire_init(&acquire, &acquire_fig);
+	dma_transfer_restart(&sim_dma, DMA_CHANNEL_0, sim_buffer, SIM_BLOCK * sizeof(int16_t));
+	if(mode->size)
+	{
+		acquire_set_block_size(&acquire, mode->size);
+	}
+	else
+	{
+		size_fig.acquire = &acquire;
+		size_fig.processed_blocks = &processed;
+		blocksize_init(&sizer, &size_fig);
+	}
+
+	pipeline_init(SIM_SAMPLE_RATE);
+
+	bool last_active = acquire.active;
+	uint64_t busy_until = 0;
+	bool pending = false;
+	uint32_t picked_blocks = 0;
+
+	for(uint32_t tick = 0; tick < total; tick++)
+	{
+		uint64_t now = (uint64_t)tick * SIM_CYCLES_PER_SAMPLE;
+
+		sim_convert(&acquire);
+
+		if(busy_until > now)
+		{
+			continue;
+		}
+
+		// Processing done - the half it was reading was refilling if the DMA finished the next one meanwhile
+		if(pending)
+		{
+			stats->late += (acquire.blocks != picked_blocks);
+			if(mode->size == 0)
+			{
+				blocksize_block(&sizer);
+			}
+			else if(mode->random)
+			{
+				acquire_set_block_size(&acquire, (uint8_t)(8U << (sim_random() % 4)));
+			}
+			pending = false;
+		}
+
+		if(acquire.active == last_active)
+		{
+			continue;
+		}
+
+		// main.c's block branch
+		volatile int16_t* half = acquire_half(&acquire, last_active);
+		uint8_t samples = acquire.samples[last_active];
+		uint32_t first = sim_index[half - sim_buffer];
+		if(	(samples != acquire.armed[last_active])	|
+			(first != (uint32_t)acquire.first_sample[last_active]))
+		{
+			stats->failures++;
+			fprintf(stderr, "%s block %u: %u samples armed %u, first_sample %llu conversion %u\n", mode->name,
+					processed, samples, acquire.armed[last_active],
+					(unsigned long long)acquire.first_sample[last_active], first);
+		}
+		for(uint8_t i = 1; i < samples; i++)
+		{
+			if(sim_index[(half - sim_buffer) + i] != (first + i))
+			{
+				stats->failures++;
+				fprintf(stderr, "%s block %u: sample %u is conversion %u\n", mode->name, processed, i,
+						sim_index[(half - sim_buffer) + i]);
+				break;
+			}
+		}
+
+		output.first_sample = acquire.first_sample[last_active];
+		pipeline_process_block(half, samples, &output);
+		records[stats->processed].end_sample = output.first_sample + samples;
+		records[stats->processed].peak_counts = output.peak_counts;
+
+		bool burst = mode->load && sim_burst(output.first_sample);
+		uint64_t cost = SIM_COST_BLOCK + ((uint64_t)SIM_COST_SAMPLE * samples);
+		cost += (burst && ((sim_random() % SIM_STALL_ONE_IN) == 0)) ? SIM_COST_STALL : 0;
+		busy_until = now + cost;
+		picked_blocks = acquire.blocks;
+		pending = true;
+
+		stats->latency[burst] += ((busy_until / SIM_CYCLES_PER_SAMPLE) - output.first_sample);
+		stats->latency_blocks[burst]++;
+		stats->samples += samples;
+		stats->processed++;
+		processed++;
+		last_active = !last_active;
+	}
+
+	stats->missed = acquire.blocks - processed - (acquire.active != last_active);
+	if(acquire.next_sample + acquire_landed(&acquire, acquire.active) != sim_conversion)
+	{
+		stats->failures++;
+		fprintf(stderr, "%s: next_sample %llu + landed %u, %u conversions\n", mode->name,
+				(unsigned long long)acquire.next_sample, acquire_landed(&acquire, acquire.active), sim_conversion);
+	}
+	if(mode->size == 0)
+	{
+		stats->grows = sizer.grows;
+		stats->shrinks = sizer.shrinks;
+	}
+}
+
+// One conversion into the armed DAR, DONE and the ISR when BCR runs out - DSR_BCR and DAR move like the silicon
+static void sim_convert(acquire_handle* acquire)
+{
+	int16_t* dest = (int16_t*)(uintptr_t)sim_dma.DMA[DMA_CHANNEL_0].DAR;
+	uint32_t bcr = sim_dma.DMA[DMA_CHANNEL_0].DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+
+	*dest = sim_signal(sim_conversion);
+	sim_index[dest - sim_buffer] = sim_conversion++;
+	sim_dma.DMA[DMA_CHANNEL_0].DAR += sizeof(int16_t);
+	bcr -= sizeof(int16_t);
+	sim_dma.DMA[DMA_CHANNEL_0].DSR_BCR = (bcr ? 0 : DMA_DSR_BCR_DONE_MASK) | DMA_DSR_BCR_BCR(bcr);
+
+	if(bcr == 0)
+	{
+		acquire_irq(acquire);
+	}
+}
+
+// Loud noise at a level that changes every segment, then near silence
+static int16_t sim_signal(uint32_t n)
+{
+	uint32_t hash = n * 2654435761U;
+	hash ^= hash >> 15;
+	uint32_t segment = (n / SIM_SEGMENT_SAMPLES) * 2246822519U;
+	int32_t level = ((n % SIM_SEGMENT_SAMPLES) < SIM_LOUD_SAMPLES) ? (int32_t)(16384 + ((segment >> 17) & 0x3FFFU)) :
+					SIM_QUIET_LEVEL;
+
+	return (int16_t)((((int32_t)(hash & 0xFFFFU) - 32768) * level) >> 15);
+}
+
+static bool sim_burst(uint64_t sample)
+{
+	return (sample % (SIM_CALM_SAMPLES + SIM_BURST_SAMPLES)) >= SIM_CALM_SAMPLES;
+}
+
+static uint32_t sim_random(void)
+{
+	return (uint32_t)rand();
+}
+
+// Sample the hold first reads decayed after a segment goes quiet
+static uint32_t sim_decay_end(const sim_record* records, uint32_t count, uint32_t segment)
+{
+	uint64_t quiet = ((uint64_t)segment * SIM_SEGMENT_SAMPLES) + SIM_LOUD_SAMPLES;
+
+	for(uint32_t b = 0; b < count; b++)
+	{
+		if((records[b].end_sample > quiet) && (records[b].peak_counts < SIM_DECAYED_LEVEL))
+		{
+			return (uint32_t)(records[b].end_sample - quiet);
+		}
+	}
+
+	return UINT32_MAX;
+}
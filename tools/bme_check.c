@@ -0,0 +1,231 @@
+/*
+ * bme_check.c
+ *
+ *  Created on: Dec 22, 2018
+ *      Author: Dominic Doty
+ *
+ * Checks the bme.h alias math on the host. Every decorated address the macros build is decoded the way
+ * the KL25 reference manual (BME chapter) lays the fields out, the op is applied to a model register, and
+ * the result is compared with the plain C read-modify-write it replaces. The register offsets the drivers
+ * use are also checked against hand worked aliases, both as raw addresses and through the MKL25Z4.h
+ * register pointers the drivers actually pass in.
+ *
+ * Build:
+ *   gcc -O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o bme_check bme_check.c
+ *
+ * Use:
+ *   bme_check [-n random_cases] [-s seed]		exit code 0 is a pass
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "MKL25Z4.h"
+#include "bme.h"
+
+/* DEFINES AND STATIC DATA */
+typedef enum
+{
+	CHECK_OP_AND,
+	CHECK_OP_OR,
+	CHECK_OP_XOR,
+	CHECK_OP_BFI,
+	CHECK_OP_BAD
+} check_op;
+
+// What the BME pulls out of a decorated store address
+typedef struct
+{
+	check_op op;
+	uint32_t offset;
+	uint8_t bit;
+	uint8_t width;
+} check_decode;
+
+// Driver registers and the aliases worked out by hand from the reference manual tables
+typedef struct
+{
+	const char* name;
+	uint32_t alias;
+	uint32_t expected;
+} check_known;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static check_decode check_decode_store(uint32_t alias);
+static uint32_t check_apply(check_decode decode, uint32_t reg, uint32_t data);
+static uint32_t check_random(void);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	uint32_t cases = 100000;
+	uint32_t failures = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				cases = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n random_cases] [-s seed]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	// DMA0 DCR0 0x4000810C, DMAMUX0 CHCFG0 0x40021000, ADC0 SC1A 0x4003B000, SC3 0x4003B024
+	check_known known[] =
+	{
+		{"dma dcr0 or",			BME_OR_ADDR(0x4000810CUL),				0x4800810CUL},
+		{"dmamux chcfg0 and",	BME_AND_ADDR(0x40021000UL),				0x44021000UL},
+		{"dmamux chcfg0 or",	BME_OR_ADDR(0x40021000UL),				0x48021000UL},
+		{"adc sc3 xor",			BME_XOR_ADDR(0x4003B024UL),				0x4C03B024UL},
+		{"adc sc1a bfi 0,6",	BME_BFI_ADDR(0x4003B000UL, 0, 6),		0x502BB000UL},
+		{"adc sc3 bfi 0,3",		BME_BFI_ADDR(0x4003B024UL, 0, 3),		0x5013B024UL},
+		{"uart0 s1 lac1 4",		BME_LAC1_ADDR(0x4006A004UL, 4),			0x4886A004UL},
+		{"uart0 s1 las1 7",		BME_LAS1_ADDR(0x4006A004UL, 7),			0x4CE6A004UL},
+		{"top bfi 31,1",		BME_BFI_ADDR(0x4007FFFCUL, 31, 1),		0x5F87FFFCUL},
+		{"wide bfi 16,16",		BME_BFI_ADDR(0x40000000UL, 16, 16),		0x58780000UL},
+
+		// Same aliases from the device header pointers - register addresses from the reference manual memory map
+		{"&DMA0 DCR0 or",		BME_OR_ADDR(&DMA0->DMA[0].DCR),			0x4800810CUL},
+		{"&DMA0 DCR3 and",		BME_AND_ADDR(&DMA0->DMA[3].DCR),		0x4400813CUL},
+		{"&DMAMUX0 CHCFG0 or",	BME_OR_ADDR(&DMAMUX0->CHCFG[0]),		0x48021000UL},
+		{"&ADC0 SC1A bfi 0,6",	BME_BFI_ADDR(&ADC0->SC1[0], 0, 6),		0x502BB000UL},
+		{"&ADC0 SC3 xor",		BME_XOR_ADDR(&ADC0->SC3),				0x4C03B024UL},
+		{"&UART0 S1 las1 7",	BME_LAS1_ADDR(&UART0->S1, 7),			0x4CE6A004UL}
+	};
+
+	for(uint8_t i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+	{
+		if(known[i].alias != known[i].expected)
+		{
+			failures++;
+			fprintf(stderr, "%s: 0x%08x, expected 0x%08x\n", known[i].name, (unsigned)known[i].alias, (unsigned)known[i].expected);
+		}
+	}
+
+	// The register blocks the drivers hand to bme_*() have to sit inside the decorated window
+	failures += !BME_IN_RANGE(&DMA0->DMA[3].DCR) | !BME_IN_RANGE(&DMAMUX0->CHCFG[3]) |
+				!BME_IN_RANGE(&ADC0->SC3) | !BME_IN_RANGE(&UART0->S1) | BME_IN_RANGE(&GPIOA->PDOR);
+
+	// Random registers, offsets, masks and fields, decoded and applied against the plain C version
+	for(uint32_t c = 0; c < cases; c++)
+	{
+		uint32_t offset = check_random() & BME_PERIPH_MASK & ~3UL;
+		uint32_t address = BME_PERIPH_BASE | offset;
+		uint32_t reg = check_random();
+		uint32_t data = check_random();
+		uint8_t width = 1 + (check_random() % BME_MAX_WIDTH);
+		uint8_t bit = check_random() % (33 - width);
+		uint32_t field = (0xFFFFFFFFUL >> (32 - width)) << bit;
+
+		struct
+		{
+			uint32_t alias;
+			uint32_t expected;
+		} ops[] =
+		{
+			{BME_AND_ADDR(address),				reg & data},
+			{BME_OR_ADDR(address),				reg | data},
+			{BME_XOR_ADDR(address),				reg ^ data},
+			{BME_BFI_ADDR(address, bit, width),	(reg & ~field) | (data & field)}
+		};
+
+		for(uint8_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+		{
+			check_decode decode = check_decode_store(ops[i].alias);
+			uint32_t result = check_apply(decode, reg, data);
+
+			if((decode.offset != offset) | (result != ops[i].expected))
+			{
+				failures++;
+				fprintf(stderr, "alias 0x%08x (op %d bit %u width %u): 0x%08x, expected 0x%08x\n",
+						(unsigned)ops[i].alias, i, bit, width, (unsigned)result, (unsigned)ops[i].expected);
+			}
+		}
+
+		// Host fallbacks in bme.h are the reference the firmware aliases replace
+		volatile uint32_t model = reg;
+		bme_bfi32(&model, bit, width, data);
+		failures += (model != ops[3].expected) | (bme_ubfx32(&model, bit, width) != ((data & field) >> bit));
+	}
+
+	printf("%u known aliases, %u random cases, %u failures\n", (unsigned)(sizeof(known) / sizeof(known[0])),
+			(unsigned)cases, (unsigned)failures);
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// addr[31:29] = 010, addr[28] set is BFI (b in [27:23], w-1 in [22:19]), else addr[28:26] = 001 AND, 010 OR, 011 XOR
+static check_decode check_decode_store(uint32_t alias)
+{
+	check_decode decode = {CHECK_OP_BAD, alias & BME_PERIPH_MASK, 0, 32};
+
+	if((alias >> 29) != 0x2U)
+	{
+		decode.op = CHECK_OP_BAD;
+	}
+	else if(alias & (1UL << 28))
+	{
+		decode.op = CHECK_OP_BFI;
+		decode.bit = (alias >> 23) & 0x1FU;
+		decode.width = ((alias >> 19) & 0xFU) + 1;
+	}
+	else
+	{
+		const check_op ops[] = {CHECK_OP_BAD, CHECK_OP_AND, CHECK_OP_OR, CHECK_OP_XOR};
+		decode.op = ((alias >> 26) & 0x3U) ? ops[(alias >> 26) & 0x3U] : CHECK_OP_BAD;
+		decode.op = ((alias >> 19) & 0x7FU) ? CHECK_OP_BAD : decode.op;		// addr[25:19] must be clear
+	}
+
+	return decode;
+}
+
+// What the BME writes back to the register
+static uint32_t check_apply(check_decode decode, uint32_t reg, uint32_t data)
+{
+	uint32_t ret = 0xDEADBEEFUL;
+
+	switch(decode.op)
+	{
+		case CHECK_OP_AND:
+			ret = reg & data;
+			break;
+		case CHECK_OP_OR:
+			ret = reg | data;
+			break;
+		case CHECK_OP_XOR:
+			ret = reg ^ data;
+			break;
+		case CHECK_OP_BFI:
+			if((decode.bit + decode.width) <= 32)
+			{
+				uint32_t field = (0xFFFFFFFFUL >> (32 - decode.width)) << decode.bit;
+				ret = (reg & ~field) | (data & field);
+			}
+			break;
+		default:
+			break;
+	}
+
+	return ret;
+}
+
+// 32 random bits from rand()'s 15
+static uint32_t check_random(void)
+{
+	return ((uint32_t)rand() << 30) ^ ((uint32_t)rand() << 15) ^ (uint32_t)rand();
+}
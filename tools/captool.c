@@ -0,0 +1,606 @@
+/*
+ * captool.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ *
+ * Capture files (capture.h) from the shell - what is in one, raw int16 in, samples out from a seek point straight
+ * from the map, and following one rawstream -c is still writing. -T checks the format against itself: a writer
+ * with index gaps and clock steps runs in a thread while the main thread keeps refreshing a reader on the same
+ * file, and the samples and seeks of the live and the closed file are held to what was written and a linear scan.
+ *
+ * Build:
+ *   gcc -O2 -pthread -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o captool captool.c \
+ *       ../source/capture.c
+ *
+ * Use:
+ *   captool capture.cap									header, info and chunks
+ *   captool -w [-r rate] [-n chunk_samples] out.cap < samples.raw	raw int16 LE to a capture (times from the rate)
+ *   captool -x [-s sample | -t seconds] [-l samples] capture.cap > samples.raw
+ *   captool -f capture.cap > samples.raw					follow a live capture until rawstream closes it
+ *   captool -T [-d dir]									self test, exit code 0 is a pass
+ *   -s is a firmware sample index, -t seconds after the first chunk, both start at the chunk holding them
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "capture.h"
+
+/* DEFINES AND STATIC DATA */
+#define CAPTOOL_SAMPLE_RATE		27000
+#define CAPTOOL_READ_SAMPLES	4096
+#define CAPTOOL_FOLLOW_US		20000
+#define TEST_BLOCKS				20000
+#define TEST_CHUNK_SAMPLES		1000			// Not a whole number of blocks, so blocks straddle chunks
+#define TEST_MAX_BLOCK			200
+#define TEST_PROBES				32				// Seeks per check held to a linear scan
+
+// Self Test - what the writer thread wrote, for the linear scans
+typedef struct
+{
+	const char* path;
+	uint64_t position[TEST_BLOCKS];
+	uint16_t count[TEST_BLOCKS];
+	volatile uint32_t written;				// Blocks appended so far
+	volatile bool done;
+} test_state;
+
+static test_state test;
+static uint32_t failures = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static int captool_info(const char* path);
+static int captool_write(const char* path, uint32_t sample_rate, uint32_t chunk_samples);
+static int captool_extract(const char* path, bool by_time, double seek, uint64_t limit);
+static int captool_follow(const char* path);
+static int captool_test(const char* dir);
+static void* test_writer(void* arg);
+static void test_check(const capture_reader* reader, const char* what);
+static int16_t test_sample(uint64_t position);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	bool write = false;
+	bool extract = false;
+	bool follow = false;
+	bool self_test = false;
+	bool by_time = false;
+	double seek = 0;
+	uint64_t limit = UINT64_MAX;
+	uint32_t sample_rate = CAPTOOL_SAMPLE_RATE;
+	uint32_t chunk_samples = CAPTURE_CHUNK_SAMPLES;
+	const char* dir = "/tmp";
+	int opt;
+
+	while((opt = getopt(argc, argv, "wxfTs:t:l:r:n:d:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'w':
+				write = true;
+				break;
+			case 'x':
+				extract = true;
+				break;
+			case 'f':
+				follow = true;
+				break;
+			case 'T':
+				self_test = true;
+				break;
+			case 's':
+				seek = strtod(optarg, NULL);
+				break;
+			case 't':
+				seek = strtod(optarg, NULL);
+				by_time = true;
+				break;
+			case 'l':
+				limit = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				sample_rate = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				chunk_samples = strtoul(optarg, NULL, 10);
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-w [-r rate] [-n chunk] | -x [-s sample | -t seconds] [-l samples] | -f] "
+						"capture.cap, or -T [-d dir]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if(self_test)
+	{
+		return captool_test(dir);
+	}
+	if(optind >= argc)
+	{
+		fprintf(stderr, "no capture\n");
+		return 2;
+	}
+	if(write && ((sample_rate == 0) || (chunk_samples == 0)))
+	{
+		fprintf(stderr, "rate and chunk size must be above 0\n");
+		return 2;
+	}
+
+	const char* path = argv[optind];
+	if(write)
+	{
+		return captool_write(path, sample_rate, chunk_samples);
+	}
+	else if(extract)
+	{
+		return captool_extract(path, by_time, seek, limit);
+	}
+	else if(follow)
+	{
+		return captool_follow(path);
+	}
+
+	return captool_info(path);
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+static int captool_info(const char* path)
+{
+	capture_reader reader;
+	if(capture_open(&reader, path) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "%s: not a capture file\n", path);
+		return 1;
+	}
+
+	const capture_info* info = &reader.info;
+	static const char* sources[] = {"none", "firmware", "host"};
+	printf("%s: %s, %llu samples in %llu chunks of up to %u, %llu bytes\n", path,
+			reader.closed ? "closed" : "live", (unsigned long long)reader.samples,
+			(unsigned long long)reader.chunk_count, reader.header->chunk_samples, (unsigned long long)reader.map_bytes);
+	printf("info: %s, %u Hz, block %u", (info->source <= CAPTURE_SOURCE_HOST) ? sources[info->source] : "?",
+			info->sample_rate, info->block_size);
+	if(info->source == CAPTURE_SOURCE_FIRMWARE)
+	{
+		printf(", channel %u bits %u avg %u clock %u/%u cycles+ %u low power %u mux %u ref %u continuous %u "
+				"trigger %u compare %u (%u, %u)", info->channel, info->bits, info->avg_samps, info->clock,
+				info->clock_div, info->sample_cycle_add, info->low_power, info->mux, info->ref_volt, info->continuous,
+				info->trigger, info->compare_mode, info->compare_1, info->compare_2);
+	}
+	printf("\n");
+
+	// Chunks, and where the firmware index jumps
+	if(reader.chunk_count)
+	{
+		capture_slice first;
+		capture_slice last;
+		capture_chunk(&reader, 0, &first);
+		capture_chunk(&reader, reader.chunk_count - 1, &last);
+		printf("samples %llu..%llu, %.3f s of host time\n", (unsigned long long)first.first_sample,
+				(unsigned long long)(last.first_sample + last.count),
+				(double)(last.time_ns - first.time_ns) / 1e9);
+
+		uint64_t gaps = 0;
+		uint64_t missing = 0;
+		for(uint64_t c = 1; c < reader.chunk_count; c++)
+		{
+			capture_slice before;
+			capture_slice slice;
+			capture_chunk(&reader, c - 1, &before);
+			capture_chunk(&reader, c, &slice);
+			if(slice.first_sample != (before.first_sample + before.count))
+			{
+				gaps++;
+				missing += slice.first_sample - (before.first_sample + before.count);
+			}
+		}
+		printf("%llu gaps, %llu samples missing\n", (unsigned long long)gaps, (unsigned long long)missing);
+	}
+
+	capture_close(&reader);
+
+	return 0;
+}
+
+// Times are the rate's, from now, so -t seeks work on converted captures too
+static int captool_write(const char* path, uint32_t sample_rate, uint32_t chunk_samples)
+{
+	static int16_t samples[CAPTOOL_READ_SAMPLES];
+	capture_info info = {.source = CAPTURE_SOURCE_HOST, .sample_rate = sample_rate};
+	capture_writer_config capture_fig = CAPTURE_WRITER_CONFIG_DEFAULT;
+	capture_writer writer;
+	struct timespec now;
+	uint64_t position = 0;
+	size_t count;
+
+	capture_fig.path = path;
+	capture_fig.chunk_samples = chunk_samples;
+	capture_fig.info = &info;
+	if(capture_create(&writer, &capture_fig) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "cannot create %s\n", path);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	uint64_t start_ns = ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+	capture_error ret = CAPTURE_ERROR_SUCCESS;
+	while((ret == CAPTURE_ERROR_SUCCESS) && ((count = fread(samples, sizeof(int16_t), CAPTOOL_READ_SAMPLES, stdin)) > 0))
+	{
+		ret = capture_append(&writer, samples, (uint32_t)count, position,
+								start_ns + ((position * 1000000000ULL) / sample_rate));
+		position += count;
+	}
+
+	if((capture_finish(&writer) != CAPTURE_ERROR_SUCCESS) || (ret != CAPTURE_ERROR_SUCCESS))
+	{
+		fprintf(stderr, "%s: write failed\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+// Chunks straight from the map to stdout
+static int captool_extract(const char* path, bool by_time, double seek, uint64_t limit)
+{
+	capture_reader reader;
+	capture_slice slice;
+
+	if(capture_open(&reader, path) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "%s: not a capture file\n", path);
+		return 1;
+	}
+
+	uint64_t chunk = 0;
+	if(reader.chunk_count && by_time)
+	{
+		capture_chunk(&reader, 0, &slice);
+		chunk = capture_seek_time(&reader, slice.time_ns + (uint64_t)(seek * 1e9));
+	}
+	else if(reader.chunk_count)
+	{
+		chunk = capture_seek_sample(&reader, (uint64_t)seek);
+	}
+
+	for(; (chunk < reader.chunk_count) && limit; chunk++)
+	{
+		capture_chunk(&reader, chunk, &slice);
+		uint32_t count = (slice.count < limit) ? slice.count : (uint32_t)limit;
+		fwrite(slice.samples, sizeof(int16_t), count, stdout);
+		limit -= count;
+	}
+
+	capture_close(&reader);
+
+	return 0;
+}
+
+// New chunks as they are committed, until the writer puts the index in
+static int captool_follow(const char* path)
+{
+	capture_reader reader;
+	capture_slice slice;
+	uint64_t chunk = 0;
+
+	if(capture_open(&reader, path) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "%s: not a capture file\n", path);
+		return 1;
+	}
+
+	while(true)
+	{
+		for(; chunk < reader.chunk_count; chunk++)
+		{
+			capture_chunk(&reader, chunk, &slice);
+			fwrite(slice.samples, sizeof(int16_t), slice.count, stdout);
+		}
+		fflush(stdout);
+		if(reader.closed)
+		{
+			break;
+		}
+
+		usleep(CAPTOOL_FOLLOW_US);
+		if(capture_refresh(&reader) != CAPTURE_ERROR_SUCCESS)
+		{
+			fprintf(stderr, "%s: damaged\n", path);
+			capture_close(&reader);
+			return 1;
+		}
+	}
+
+	capture_close(&reader);
+
+	return 0;
+}
+
+// Live reader against a writer thread, then the closed file, then a file with nothing in it
+static int captool_test(const char* dir)
+{
+	char path[512];
+	pthread_t writer;
+	capture_reader reader;
+	uint32_t refreshes = 0;
+
+	snprintf(path, sizeof(path), "%s/captool_test_%d.cap", dir, (int)getpid());
+	test.path = path;
+	test.written = 0;
+	test.done = false;
+
+	// The writer creates the file, wait for the header
+	pthread_create(&writer, NULL, test_writer, NULL);
+	while(access(path, F_OK) || (capture_open(&reader, path) != CAPTURE_ERROR_SUCCESS))
+	{
+		usleep(100);
+	}
+
+	bool was_live = !reader.closed;
+	while(!reader.closed)
+	{
+		// Everything the reader sees was written, and the seeks agree with a scan of it
+		uint32_t written = test.written;
+		if(capture_refresh(&reader) != CAPTURE_ERROR_SUCCESS)
+		{
+			fprintf(stderr, "refresh failed after %u blocks\n", written);
+			failures++;
+			break;
+		}
+		if(!reader.closed)
+		{
+			test_check(&reader, "live");
+			refreshes++;
+		}
+		usleep(50);
+	}
+	pthread_join(writer, NULL);
+
+	if(!was_live || (refreshes < 2))
+	{
+		fprintf(stderr, "the reader never saw the capture live\n");
+		failures++;
+	}
+	if(reader.samples != (test.position[TEST_BLOCKS - 1] + test.count[TEST_BLOCKS - 1]))
+	{
+		fprintf(stderr, "closed capture has %llu samples\n", (unsigned long long)reader.samples);
+		failures++;
+	}
+	test_check(&reader, "closed");
+	capture_close(&reader);
+
+	// Reopened from cold, the trailing index in place
+	if(capture_open(&reader, path) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "reopen failed\n");
+		failures++;
+	}
+	else
+	{
+		test_check(&reader, "reopened");
+		capture_close(&reader);
+	}
+	unlink(path);
+
+	// Nothing appended (a NULL info is turned away), then something that is not a capture
+	capture_writer_config capture_fig = CAPTURE_WRITER_CONFIG_DEFAULT;
+	capture_writer empty;
+	capture_fig.path = path;
+	if(	(capture_create(&empty, &capture_fig) != CAPTURE_ERROR_SUCCESS)	||
+		(capture_set_info(&empty, NULL) != CAPTURE_ERROR_NULL_PTR)		||
+		(capture_set_info(NULL, NULL) != CAPTURE_ERROR_NULL_PTR)		||
+		(capture_finish(&empty) != CAPTURE_ERROR_SUCCESS)				||
+		(capture_open(&reader, path) != CAPTURE_ERROR_SUCCESS)			)
+	{
+		fprintf(stderr, "empty capture failed\n");
+		failures++;
+	}
+	else
+	{
+		capture_slice slice;
+		if(!reader.closed || reader.chunk_count || (capture_chunk(&reader, 0, &slice) != CAPTURE_ERROR_RANGE))
+		{
+			fprintf(stderr, "empty capture has chunks\n");
+			failures++;
+		}
+		capture_close(&reader);
+	}
+	FILE* junk = fopen(path, "wb");
+	for(uint32_t i = 0; i < CAPTURE_HEADER_BYTES; i++)
+	{
+		fputc('W', junk);
+	}
+	fclose(junk);
+	if(capture_open(&reader, path) != CAPTURE_ERROR_FORMAT)
+	{
+		fprintf(stderr, "junk opened as a capture\n");
+		failures++;
+	}
+	unlink(path);
+
+	printf("%u live refreshes, %s\n", refreshes, failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+// Odd sized blocks with the odd index gap and host clock step back, flushed now and then as rawstream would not
+static void* test_writer(void* arg)
+{
+	(void)arg;
+	static int16_t samples[CAPTURE_CHUNK_SAMPLES];
+	capture_writer_config capture_fig = CAPTURE_WRITER_CONFIG_DEFAULT;
+	capture_info info = {.source = CAPTURE_SOURCE_HOST, .sample_rate = CAPTOOL_SAMPLE_RATE, .block_size = 64};
+	capture_writer writer;
+	uint64_t first_sample = 1000;
+	uint64_t time_ns = 1000000000ULL;
+	uint64_t position = 0;
+
+	capture_fig.path = test.path;
+	capture_fig.chunk_samples = TEST_CHUNK_SAMPLES;
+	capture_fig.info = &info;
+	if(capture_create(&writer, &capture_fig) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "create failed\n");
+		failures++;
+		test.done = true;
+		return NULL;
+	}
+
+	srand(1);
+	for(uint32_t b = 0; b < TEST_BLOCKS; b++)
+	{
+		uint16_t count = 1 + (rand() % TEST_MAX_BLOCK);
+		first_sample += (rand() % 50) ? 0 : (1 + (rand() % 5000));
+		time_ns += (rand() % 100) ? (1000000ULL * count / 27) : 0;
+		uint64_t stamp = (rand() % 200) ? time_ns : (time_ns - 500000000ULL);
+
+		for(uint16_t i = 0; i < count; i++)
+		{
+			samples[i] = test_sample(position + i);
+		}
+		if(capture_append(&writer, samples, count, first_sample, stamp) != CAPTURE_ERROR_SUCCESS)
+		{
+			fprintf(stderr, "append failed\n");
+			failures++;
+			break;
+		}
+		if(!(rand() % 300))
+		{
+			capture_flush(&writer);
+		}
+
+		test.position[b] = position;
+		test.count[b] = count;
+		first_sample += count;
+		position += count;
+		__atomic_store_n(&test.written, b + 1, __ATOMIC_RELEASE);
+		if(!(b % 64))
+		{
+			usleep(100);
+		}
+	}
+
+	if(capture_finish(&writer) != CAPTURE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "finish failed\n");
+		failures++;
+	}
+	test.done = true;
+
+	return NULL;
+}
+
+// Samples, positions and seeks of what the reader has, against what was written
+static void test_check(const capture_reader* reader, const char* what)
+{
+	uint64_t position = 0;
+	uint64_t last_time = 0;
+	capture_slice slice;
+
+	for(uint64_t c = 0; c < reader->chunk_count; c++)
+	{
+		capture_chunk(reader, c, &slice);
+		if(	(slice.position != position)										||
+			(slice.count == 0)													|
+			(slice.count > TEST_CHUNK_SAMPLES)									|
+			(slice.time_ns < last_time)											|
+			((uintptr_t)slice.samples % CAPTURE_ALIGN)							)
+		{
+			if(failures++ < 20)
+			{
+				fprintf(stderr, "%s chunk %llu: position %llu count %u\n", what, (unsigned long long)c,
+						(unsigned long long)slice.position, slice.count);
+			}
+		}
+		for(uint32_t i = 0; i < slice.count; i++)
+		{
+			if(slice.samples[i] != test_sample(position + i))
+			{
+				if(failures++ < 20)
+				{
+					fprintf(stderr, "%s sample %llu wrong\n", what, (unsigned long long)(position + i));
+				}
+				break;
+			}
+		}
+
+		// A position in this chunk seeks to it
+		uint64_t probe = position + (rand() % slice.count);
+		if(capture_seek_position(reader, probe) != c)
+		{
+			if(failures++ < 20)
+			{
+				fprintf(stderr, "%s position %llu not in chunk %llu\n", what, (unsigned long long)probe,
+						(unsigned long long)c);
+			}
+		}
+
+		last_time = slice.time_ns;
+		position += slice.count;
+	}
+
+	// Sample and time seeks, inside chunks, on chunk starts and in gaps, against a linear scan
+	for(uint32_t p = 0; reader->chunk_count && (p < TEST_PROBES); p++)
+	{
+		capture_chunk(reader, rand() % reader->chunk_count, &slice);
+		uint64_t sample = slice.first_sample + (rand() % (slice.count + 3000));
+		uint64_t time_ns = slice.time_ns + ((rand() % 3) ? 0 : (rand() % 100000000));
+		uint64_t want_sample = 0;
+		uint64_t want_time = 0;
+		for(uint64_t s = 0; s < reader->chunk_count; s++)
+		{
+			capture_slice other;
+			capture_chunk(reader, s, &other);
+			want_sample = (other.first_sample <= sample) ? s : want_sample;
+			want_time = (other.time_ns <= time_ns) ? s : want_time;
+		}
+		if(	(capture_seek_sample(reader, sample) != want_sample)	||
+			(capture_seek_time(reader, time_ns) != want_time)		)
+		{
+			if(failures++ < 20)
+			{
+				fprintf(stderr, "%s seek: sample %llu gave %llu want %llu, time gave %llu want %llu\n", what,
+						(unsigned long long)sample, (unsigned long long)capture_seek_sample(reader, sample),
+						(unsigned long long)want_sample, (unsigned long long)capture_seek_time(reader, time_ns),
+						(unsigned long long)want_time);
+			}
+		}
+	}
+
+	if(position != reader->samples)
+	{
+		failures++;
+		fprintf(stderr, "%s: chunks hold %llu samples, reader says %llu\n", what, (unsigned long long)position,
+				(unsigned long long)reader->samples);
+	}
+
+	// Never ahead of the writer (which can be part way through the next block)
+	uint32_t written = __atomic_load_n(&test.written, __ATOMIC_ACQUIRE);
+	uint64_t written_samples = (written ? (test.position[written - 1] + test.count[written - 1]) : 0) + TEST_MAX_BLOCK;
+	if(reader->samples > written_samples)
+	{
+		failures++;
+		fprintf(stderr, "%s: reader has %llu samples, only %llu written\n", what, (unsigned long long)reader->samples,
+				(unsigned long long)written_samples);
+	}
+}
+
+// Known sample at each stored position
+static int16_t test_sample(uint64_t position)
+{
+	return (int16_t)((position * 2654435761ULL) >> 7);
+}
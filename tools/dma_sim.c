@@ -0,0 +1,182 @@
+/*
+ * dma_sim.c
+ *
+ *  Created on: Dec 20, 2018
+ *      Author: Dominic Doty
+ *
+ * Runs acquire.c and the dma_driver.c restart path against a DMA register block in host RAM.
+ * The "DMA" copies a counting ADC stream into whatever DAR/BCR the driver armed, and injects
+ * CE/BES/BED errors part way through blocks. The consumer side is main.c's loop.
+ * Checks every block is re-armed on the other half with a written (not ORed) BCR, and that the
+ * samples delivered plus the gap count add up to every conversion made, and that each block's
+ * first_sample index is the conversion number of its first sample.
+ *
+ * Build:
+ *   gcc -O2 -no-pie -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o dma_sim dma_sim.c \
+ *       ../source/acquire.c ../source/blockpool.c ../source/dma_driver.c ../source/cycle_counter.c
+ *   (-no-pie keeps the static buffers below 4 GB so the 32 bit DAR holds a usable pointer)
+ *
+ * Use:
+ *   dma_sim [-b blocks] [-e error_one_in_n] [-s seed]		exit code 0 is a pass
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "acquire.h"
+
+/* DEFINES AND STATIC DATA */
+#define SIM_BLOCK		64
+
+static DMA_Type sim_dma;
+static int16_t sim_buffer[SIM_BLOCK * 2];
+static int16_t sim_next_conversion = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static dma_status sim_transfer(uint32_t error_one_in);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	uint32_t blocks = 100000;
+	uint32_t error_one_in = 50;
+	int opt;
+
+	while((opt = getopt(argc, argv, "b:e:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b':
+				blocks = strtoul(optarg, NULL, 10);
+				break;
+			case 'e':
+				error_one_in = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-b blocks] [-e error_one_in_n] [-s seed]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	// dma_init() would talk to the clock gate and NVIC, arm the first half by hand instead
+	acquire_handle acquire;
+	acquire_config acquire_fig = ACQUIRE_CONFIG_DEFAULT;
+	acquire_fig.dma = &sim_dma;
+	acquire_fig.buffer = sim_buffer;
+	acquire_fig.block_size = SIM_BLOCK;
+	if(acquire_init(&acquire, &acquire_fig) != ACQUIRE_ERROR_SUCCESS)
+	{
+		return 1;
+	}
+	dma_transfer_restart(&sim_dma, DMA_CHANNEL_0, sim_buffer, SIM_BLOCK * sizeof(int16_t));
+
+	bool last_active = acquire.active;
+	int16_t expected = 0;
+	uint64_t delivered = 0;
+	uint64_t skipped = 0;
+	uint32_t failures = 0;
+	uint32_t injected[DMA_STATUS_COUNT] = {0};
+
+	for(uint32_t b = 0; b < blocks; b++)
+	{
+		// "Hardware" runs until done or an error, then the ISR
+		dma_status status = sim_transfer(error_one_in);
+		injected[status]++;
+		volatile int16_t* next_half = acquire_half(&acquire, !acquire.active);
+		acquire_irq(&acquire);
+
+		if(	(sim_dma.DMA[DMA_CHANNEL_0].DAR != (uint32_t)(uintptr_t)next_half)							|
+			(sim_dma.DMA[DMA_CHANNEL_0].DSR_BCR != DMA_DSR_BCR_BCR(SIM_BLOCK * sizeof(int16_t)))		|
+			!(sim_dma.DMA[DMA_CHANNEL_0].DCR & DMA_DCR_ERQ_MASK))
+		{
+			failures++;
+			fprintf(stderr, "block %u: not re-armed on the other half with a full BCR (DSR_BCR 0x%08x)\n",
+					b, (unsigned)sim_dma.DMA[DMA_CHANNEL_0].DSR_BCR);
+		}
+
+		// Main loop side - walk the good samples, anything missing has to be in the gap count
+		if(acquire.active != last_active)
+		{
+			volatile int16_t* half = acquire_half(&acquire, last_active);
+			if(acquire.samples[last_active] && ((int16_t)acquire.first_sample[last_active] != half[0]))
+			{
+				failures++;
+				fprintf(stderr, "block %u: first_sample %llu does not match conversion %d\n",
+						b, (unsigned long long)acquire.first_sample[last_active], half[0]);
+			}
+			for(uint8_t i = 0; i < acquire.samples[last_active]; i++)
+			{
+				skipped += (uint16_t)(half[i] - expected);
+				expected = half[i] + 1;
+			}
+			delivered += acquire.samples[last_active];
+			last_active = !last_active;
+		}
+	}
+
+	// The conversion lost to the last error, if it was at the very end, has no sample after it yet
+	skipped += (uint16_t)(sim_next_conversion - expected);
+
+	printf("blocks %u, delivered %llu, skipped %llu, gap_samples %u, next_sample %llu\n", acquire.blocks,
+			(unsigned long long)delivered, (unsigned long long)skipped, acquire.gap_samples,
+			(unsigned long long)acquire.next_sample);
+	printf("injected done %u ce %u bes %u bed %u, counted done %u ce %u bes %u bed %u\n",
+			injected[DMA_STATUS_DONE], injected[DMA_STATUS_CONFIG_ERROR], injected[DMA_STATUS_SOURCE_BUS_ERROR],
+			injected[DMA_STATUS_DEST_BUS_ERROR], acquire.errors[DMA_STATUS_DONE], acquire.errors[DMA_STATUS_CONFIG_ERROR],
+			acquire.errors[DMA_STATUS_SOURCE_BUS_ERROR], acquire.errors[DMA_STATUS_DEST_BUS_ERROR]);
+
+	for(uint8_t s = 0; s < DMA_STATUS_BUSY; s++)
+	{
+		failures += (injected[s] != acquire.errors[s]);
+	}
+	failures += (skipped != acquire.gap_samples);
+	failures += ((int16_t)acquire.next_sample != sim_next_conversion);
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Move samples into the armed DAR until BCR runs out or an injected error, leave DSR_BCR like the silicon
+static dma_status sim_transfer(uint32_t error_one_in)
+{
+	DMA_Type* dma = &sim_dma;
+	int16_t* dest = (int16_t*)(uintptr_t)dma->DMA[DMA_CHANNEL_0].DAR;
+	uint32_t bcr = dma->DMA[DMA_CHANNEL_0].DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+	dma_status status = DMA_STATUS_DONE;
+	uint32_t fail_at = UINT32_MAX;
+
+	if(error_one_in && ((rand() % error_one_in) == 0))
+	{
+		status = (dma_status)(DMA_STATUS_CONFIG_ERROR + (rand() % 3));
+		// Config errors are caught before anything moves, bus errors on the failing transfer
+		fail_at = (status == DMA_STATUS_CONFIG_ERROR) ? 0 : (rand() % (bcr / sizeof(int16_t)));
+	}
+
+	for(uint32_t i = 0; bcr; i++)
+	{
+		if(i == fail_at)
+		{
+			sim_next_conversion++;		// The conversion the failed transfer was moving is gone
+			break;
+		}
+		*dest++ = sim_next_conversion++;
+		bcr -= sizeof(int16_t);
+	}
+
+	uint32_t flags = DMA_DSR_BCR_DONE_MASK;
+	flags |= (status == DMA_STATUS_CONFIG_ERROR) ? DMA_DSR_BCR_CE_MASK : 0;
+	flags |= (status == DMA_STATUS_SOURCE_BUS_ERROR) ? DMA_DSR_BCR_BES_MASK : 0;
+	flags |= (status == DMA_STATUS_DEST_BUS_ERROR) ? DMA_DSR_BCR_BED_MASK : 0;
+	dma->DMA[DMA_CHANNEL_0].DSR_BCR = flags | DMA_DSR_BCR_BCR(bcr);
+
+	return status;
+}
@@ -0,0 +1,127 @@
+/*
+ * image_check.c
+ *
+ *  Created on: Dec 22, 2018
+ *      Author: Dominic Doty
+ *
+ * Builds main.c's ENABLE_STATIC_INIT configuration on the host. The ADC_FIG_SETUP and DMA_FIG_SETUP lists from
+ * acquire_setup.h go through ADC_IMAGE_ASSERT / DMA_IMAGE_ASSERT and ADC_IMAGE / DMA_IMAGE exactly as main.c has
+ * them (ADC both with and without ENABLE_OVERSAMPLE), so a list or macro change that breaks the static init build
+ * breaks this one too. The folded images are then compared with register values worked out by hand from the
+ * reference manual ADC and DMA chapters.
+ * With -DIMAGE_CHECK_BAD=1..4 a broken list goes through the asserts instead, and the build has to fail.
+ *
+ * Build:
+ *   gcc -O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o image_check image_check.c
+ *
+ * Use:
+ *   image_check		exit code 0 is a pass
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include "acquire_setup.h"
+
+/* DEFINES AND STATIC DATA */
+
+// main.c's buffer, the DMA list points the destination at it
+static volatile int16_t buffer[BUFF_DOUBLE_SIZE];
+
+// The lists and images the firmware gets with ENABLE_STATIC_INIT 1
+#define ENABLE_OVERSAMPLE	0
+ADC_IMAGE_ASSERT(ADC_FIG_SETUP);
+static const adc_image image_adc = ADC_IMAGE(ADC_FIG_SETUP);
+#undef ENABLE_OVERSAMPLE
+
+#define ENABLE_OVERSAMPLE	1
+ADC_IMAGE_ASSERT(ADC_FIG_SETUP);
+static const adc_image image_adc_oversample = ADC_IMAGE(ADC_FIG_SETUP);
+#undef ENABLE_OVERSAMPLE
+
+DMA_IMAGE_ASSERT(DMA_FIG_SETUP);
+static const dma_image image_dma = DMA_IMAGE(DMA_FIG_SETUP);
+
+// Lists the asserts must turn away (one per build)
+#if IMAGE_CHECK_BAD == 1		// Odd byte count with 16 bit transfers
+DMA_IMAGE_ASSERT(DMA0, DMA_CHANNEL_0, &(ADC0->R[ADC_MUX_A]), &buffer[0], BUFF_HALF_BYTES + 1, true, true, true, false,
+				false, false, DMA_SIZE_16, DMA_MOD_NONE, true, DMA_SIZE_16, DMA_MOD_NONE, true, DMA_LINK_NONE,
+				DMA_LINK_DMA_CHAN_0, DMA_LINK_DMA_CHAN_0, false);
+#elif IMAGE_CHECK_BAD == 2		// START with ERQ
+DMA_IMAGE_ASSERT(DMA0, DMA_CHANNEL_0, &(ADC0->R[ADC_MUX_A]), &buffer[0], BUFF_HALF_BYTES, true, true, true, false,
+				false, false, DMA_SIZE_16, DMA_MOD_NONE, true, DMA_SIZE_16, DMA_MOD_NONE, true, DMA_LINK_NONE,
+				DMA_LINK_DMA_CHAN_0, DMA_LINK_DMA_CHAN_0, true);
+#elif IMAGE_CHECK_BAD == 3		// Diff channel in a single ended mode
+ADC_IMAGE_ASSERT(ADC0, ADC_NO_INT, ADC_CHAN_DAD0, ADC_POWER_NORMAL_MODE, ADC_CLOCK_SEL_ADACK, ADC_CLOCK_DIV_1,
+				ADC_SMP_CYCLE_ADD_HS_22, ADC_BITS_16BIT, ADC_SAMP_AVG_4, ADC_MUX_A, ADC_ASYNC_CLOCK_ONLY_ADC,
+				ADC_COMPARE_DISABLED, 0, 0, ADC_TRIGGER_SOFTWARE, ADC_DMA_ENABLED, ADC_REFERENCE_VOLT_DEFAULT,
+				ADC_CONTINUOUS_CONTINUOUS, PORTE, 20, 21);
+#elif IMAGE_CHECK_BAD == 4		// ALTCLK, no known rate
+ADC_IMAGE_ASSERT(ADC0, ADC_NO_INT, ADC_CHAN_DAD0, ADC_POWER_NORMAL_MODE, ADC_CLOCK_SEL_ALTCLK, ADC_CLOCK_DIV_1,
+				ADC_SMP_CYCLE_ADD_HS_22, ADC_BITS_16BIT_DIFF, ADC_SAMP_AVG_4, ADC_MUX_A, ADC_ASYNC_CLOCK_ONLY_ADC,
+				ADC_COMPARE_DISABLED, 0, 0, ADC_TRIGGER_SOFTWARE, ADC_DMA_ENABLED, ADC_REFERENCE_VOLT_DEFAULT,
+				ADC_CONTINUOUS_CONTINUOUS, PORTE, 20, 21);
+#endif
+
+// Image fields and the values worked out by hand
+typedef struct
+{
+	const char* name;
+	uintptr_t value;
+	uintptr_t expected;
+} check_known;
+
+
+/* FUNCTION DEFINITIONS */
+int main(void)
+{
+	uint32_t failures = 0;
+
+	// CFG1: ADLSMP (long sample for the +22) | MODE 11 (16 bit) | ADICLK 11 (ADACK)
+	// CFG2: ADHSC (the HS adders), ADLSTS 00 (+20), MUXSEL A, ADACKEN off
+	// SC2: DMAEN, software trigger, VREFH/L; SC3: ADCO | AVGE with AVGS 00 (4 samples), AVGE off oversampling
+	// SC1: DIFF | ADCH 00000 (DAD0), no AIEN
+	// DCR: EINT | ERQ | CS | SSIZE 10 (16 bit) | DINC | DSIZE 10 | D_REQ; BCR is a half buffer in bytes
+	check_known known[] =
+	{
+		{"adc base",			(uintptr_t)image_adc.adc,					0x4003B000UL},
+		{"adc port",			(uintptr_t)image_adc.port,					0x4004D000UL},
+		{"adc pin_1",			image_adc.pin_1,							20},
+		{"adc pin_2",			image_adc.pin_2,							21},
+		{"adc cfg1",			image_adc.cfg1,								0x0000001FUL},
+		{"adc cfg2",			image_adc.cfg2,								0x00000004UL},
+		{"adc sc2",				image_adc.sc2,								0x00000004UL},
+		{"adc sc3",				image_adc.sc3,								0x0000000CUL},
+		{"adc sc3 oversample",	image_adc_oversample.sc3,					0x00000008UL},
+		{"adc cv1",				image_adc.cv1,								0},
+		{"adc cv2",				image_adc.cv2,								0},
+		{"adc sc2 trigger",		image_adc.sc2_trigger,						0},
+		{"adc sc1",				image_adc.sc1,								0x00000020UL},
+		{"adc irq",				image_adc.irq,								false},
+		{"dma base",			(uintptr_t)image_dma.dma,					0x40008000UL},
+		{"dma channel",			image_dma.channel,							0},
+		{"dma src (ADC0 RA)",	(uintptr_t)image_dma.src_addr,				0x4003B010UL},
+		{"dma dest",			(uintptr_t)image_dma.dest_addr,				(uintptr_t)&buffer[0]},
+		{"dma dsr_bcr",			image_dma.dsr_bcr,							BUFF_HALF_BYTES},
+		{"dma dcr",				image_dma.dcr,								0xE02C0080UL},
+		{"dma irq",				image_dma.irq,								true}
+	};
+
+	for(uint8_t i = 0; i < sizeof(known) / sizeof(known[0]); i++)
+	{
+		if(known[i].value != known[i].expected)
+		{
+			failures++;
+			fprintf(stderr, "%s: 0x%08lx, expected 0x%08lx\n", known[i].name, (unsigned long)known[i].value,
+					(unsigned long)known[i].expected);
+		}
+	}
+
+	// Every other field must match between the two ADC images
+	failures += (image_adc.cfg1 != image_adc_oversample.cfg1) || (image_adc.cfg2 != image_adc_oversample.cfg2) ||
+				(image_adc.sc1 != image_adc_oversample.sc1) || (image_adc.sc2 != image_adc_oversample.sc2);
+
+	printf("%u image fields, %u failures\n", (unsigned)(sizeof(known) / sizeof(known[0])), (unsigned)failures);
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
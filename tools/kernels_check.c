@@ -0,0 +1,324 @@
+/*
+ * kernels_check.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ *
+ * Holds every kernels.c variant this CPU runs to the scalar one (the firmware's peak_block_max, peak_block_energy
+ * and dbfs_output) bit for bit. Random blocks of random length and alignment - uniform, quiet, sparse spikes,
+ * INT16_MIN sprinkled in - then the edges: all INT16_MIN, all INT16_MAX, full scale square waves of several
+ * periods, silence, a lone INT16_MIN in the last (tail) slot, and every dBFS input 0..65535.
+ * With -b it then reports GB/s of input per kernel per variant.
+ *
+ * Build:
+ *   gcc -O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o kernels_check kernels_check.c \
+ *       ../source/kernels.c ../source/peak_detect.c ../source/format.c
+ *
+ * Use:
+ *   kernels_check [-n random_blocks] [-s seed] [-b] [-m bench_megabytes]		exit code 0 is a pass
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "kernels.h"
+
+/* DEFINES AND STATIC DATA */
+#define CHECK_MAX_BLOCK		4096
+#define CHECK_MAX_OFFSET	31				// Start up to this many samples off the allocation
+#define CHECK_DBFS_INPUTS	65536
+#define BENCH_MIN_SECONDS	0.25
+
+static int16_t check_buffer[CHECK_MAX_BLOCK + CHECK_MAX_OFFSET];
+static uint16_t check_input[CHECK_DBFS_INPUTS + CHECK_MAX_OFFSET];
+static uint16_t check_expect[CHECK_DBFS_INPUTS];
+static uint16_t check_output[CHECK_DBFS_INPUTS];
+static uint32_t failures = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static void check_block(const char* what, const int16_t* buffer, uint32_t count);
+static void check_dbfs(const char* what, const uint16_t* input, uint32_t count);
+static void check_fill(int16_t* buffer, uint32_t count, uint8_t pattern);
+static void bench(uint32_t megabytes);
+static double check_now(void);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	uint32_t blocks = 20000;
+	uint32_t megabytes = 64;
+	bool run_bench = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:s:bm:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				blocks = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			case 'b':
+				run_bench = true;
+				break;
+			case 'm':
+				megabytes = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n random_blocks] [-s seed] [-b] [-m bench_megabytes]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	printf("variants:");
+	for(uint8_t v = 0; v < KERNELS_VARIANTS; v++)
+	{
+		const kernels_table* kernels = kernels_get((kernels_variant)v);
+		printf(" %s", kernels ? kernels->name : "-");
+	}
+	printf(", best %s\n", kernels_best()->name);
+
+	// Random blocks, random length and start
+	for(uint32_t b = 0; b < blocks; b++)
+	{
+		uint32_t offset = rand() % (CHECK_MAX_OFFSET + 1);
+		uint32_t count = rand() % (CHECK_MAX_BLOCK + 1);
+		check_fill(&check_buffer[offset], count, rand() % 4);
+		check_block("random", &check_buffer[offset], count);
+	}
+
+	// Edges, every length up to a few vectors so each tail size comes up
+	for(uint32_t count = 0; count <= 100; count++)
+	{
+		for(uint32_t offset = 0; offset < 2; offset++)
+		{
+			int16_t* buffer = &check_buffer[offset];
+
+			for(uint32_t i = 0; i < count; i++)
+			{
+				buffer[i] = INT16_MIN;
+			}
+			check_block("all INT16_MIN", buffer, count);
+
+			for(uint32_t i = 0; i < count; i++)
+			{
+				buffer[i] = INT16_MAX;
+			}
+			check_block("all INT16_MAX", buffer, count);
+
+			for(uint32_t period = 1; period <= 32; period <<= 1)
+			{
+				for(uint32_t i = 0; i < count; i++)
+				{
+					buffer[i] = ((i / period) & 1) ? INT16_MIN : INT16_MAX;
+				}
+				check_block("square INT16_MIN/MAX", buffer, count);
+
+				for(uint32_t i = 0; i < count; i++)
+				{
+					buffer[i] = ((i / period) & 1) ? -INT16_MAX : INT16_MAX;
+				}
+				check_block("square -MAX/MAX", buffer, count);
+			}
+
+			memset(buffer, 0, count * sizeof(int16_t));
+			check_block("silence", buffer, count);
+			if(count)
+			{
+				buffer[count - 1] = INT16_MIN;
+				check_block("INT16_MIN last", buffer, count);
+				buffer[count - 1] = 0;
+				buffer[0] = INT16_MIN;
+				check_block("INT16_MIN first", buffer, count);
+			}
+		}
+	}
+
+	// dBFS - every input at every start alignment in a vector, then random runs
+	for(uint32_t offset = 0; offset < 16; offset++)
+	{
+		for(uint32_t i = 0; i < CHECK_DBFS_INPUTS; i++)
+		{
+			check_input[offset + i] = (uint16_t)i;
+		}
+		check_dbfs("every input", &check_input[offset], CHECK_DBFS_INPUTS);
+	}
+	for(uint32_t b = 0; b < blocks; b++)
+	{
+		uint32_t offset = rand() % (CHECK_MAX_OFFSET + 1);
+		uint32_t count = rand() % (CHECK_MAX_BLOCK + 1);
+		for(uint32_t i = 0; i < count; i++)
+		{
+			check_input[offset + i] = (uint16_t)rand() >> (rand() % 16);
+		}
+		check_dbfs("random", &check_input[offset], count);
+	}
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	if(run_bench)
+	{
+		bench(megabytes);
+	}
+
+	return failures ? 1 : 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Every variant against scalar on one block
+static void check_block(const char* what, const int16_t* buffer, uint32_t count)
+{
+	const kernels_table* reference = kernels_get(KERNELS_SCALAR);
+	uint16_t max = reference->block_max(buffer, count);
+	uint64_t energy = reference->energy(buffer, count);
+
+	for(uint8_t v = KERNELS_SCALAR + 1; v < KERNELS_VARIANTS; v++)
+	{
+		const kernels_table* kernels = kernels_get((kernels_variant)v);
+		if(kernels == NULL)
+		{
+			continue;
+		}
+
+		uint16_t got_max = kernels->block_max(buffer, count);
+		uint64_t got_energy = kernels->energy(buffer, count);
+		if((got_max != max) || (got_energy != energy))
+		{
+			// One line per kind of block, not per block
+			if(failures++ < 20)
+			{
+				fprintf(stderr, "%s %s (%u samples): max %u want %u, energy %llu want %llu\n", kernels->name, what,
+						count, got_max, max, (unsigned long long)got_energy, (unsigned long long)energy);
+			}
+		}
+	}
+}
+
+static void check_dbfs(const char* what, const uint16_t* input, uint32_t count)
+{
+	const kernels_table* reference = kernels_get(KERNELS_SCALAR);
+	reference->dbfs(input, check_expect, count);
+
+	for(uint8_t v = KERNELS_SCALAR + 1; v < KERNELS_VARIANTS; v++)
+	{
+		const kernels_table* kernels = kernels_get((kernels_variant)v);
+		if(kernels == NULL)
+		{
+			continue;
+		}
+
+		memset(check_output, 0xA5, sizeof(check_output));
+		kernels->dbfs(input, check_output, count);
+		for(uint32_t i = 0; i < count; i++)
+		{
+			if(check_output[i] != check_expect[i])
+			{
+				if(failures++ < 20)
+				{
+					fprintf(stderr, "%s dbfs %s: input %u gave %u want %u\n", kernels->name, what, input[i],
+							check_output[i], check_expect[i]);
+				}
+				break;
+			}
+		}
+	}
+}
+
+// 0 uniform, 1 quiet, 2 sparse spikes, 3 uniform with INT16_MIN sprinkled in
+static void check_fill(int16_t* buffer, uint32_t count, uint8_t pattern)
+{
+	for(uint32_t i = 0; i < count; i++)
+	{
+		int16_t sample = (int16_t)(rand() & 0xFFFF);
+		switch(pattern)
+		{
+			case 1:
+				sample = (int16_t)((rand() % 201) - 100);
+				break;
+			case 2:
+				sample = (rand() % 500) ? (int16_t)((rand() % 21) - 10) : sample;
+				break;
+			case 3:
+				sample = (rand() % 300) ? sample : INT16_MIN;
+				break;
+			default:
+				break;
+		}
+		buffer[i] = sample;
+	}
+}
+
+// Input GB/s per kernel per variant, over a buffer well past the caches
+static void bench(uint32_t megabytes)
+{
+	uint32_t count = (megabytes << 20) / sizeof(int16_t);
+	int16_t* samples = malloc(count * sizeof(int16_t));
+	uint16_t* levels = malloc(count * sizeof(uint16_t));
+	uint16_t* output = malloc(count * sizeof(uint16_t));
+	volatile uint64_t sink = 0;
+
+	check_fill(samples, count, 0);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		levels[i] = (uint16_t)rand() >> (rand() % 16);
+	}
+
+	printf("variant,block_max GB/s,energy GB/s,dbfs GB/s\n");
+	for(uint8_t v = 0; v < KERNELS_VARIANTS; v++)
+	{
+		const kernels_table* kernels = kernels_get((kernels_variant)v);
+		if(kernels == NULL)
+		{
+			continue;
+		}
+
+		double rate[3];
+		for(uint8_t k = 0; k < 3; k++)
+		{
+			uint32_t passes = 0;
+			double start = check_now();
+			double wall;
+			do
+			{
+				if(k == 0)
+				{
+					sink += kernels->block_max(samples, count);
+				}
+				else if(k == 1)
+				{
+					sink += kernels->energy(samples, count);
+				}
+				else
+				{
+					kernels->dbfs(levels, output, count);
+					sink += output[passes % count];
+				}
+				passes++;
+				wall = check_now() - start;
+			} while(wall < BENCH_MIN_SECONDS);
+			rate[k] = ((double)passes * count * sizeof(int16_t)) / wall / 1e9;
+		}
+		printf("%s,%.2f,%.2f,%.2f\n", kernels->name, rate[0], rate[1], rate[2]);
+	}
+
+	free(samples);
+	free(levels);
+	free(output);
+}
+
+static double check_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (now.tv_nsec / 1e9);
+}
@@ -0,0 +1,1106 @@
+/*
+ * mtb_decode.c
+ *
+ *  Created on: Dec 24, 2018
+ *      Author: Dominic Doty
+ *
+ * Host side of the MTB trace (ENABLE_TRACE in trace.h). Every packet is a taken branch (source, destination),
+ * so the code between one packet's destination and the next packet's source ran straight through. The
+ * instructions in those runs are read out of the .axf, counted, given M0+ cycle estimates and charged to the
+ * function they are in and to the call path that got there (BL/BLX pushes, a branch to the saved return
+ * address pops, A bit packets are exception entries).
+ *
+ * Cycles are zero wait state estimates (the flash stalls and bus waits do not show in a branch trace), use
+ * them to rank and compare, and the stats irq_cycles / bench rows for absolute numbers.
+ *
+ * The same decoder reads the qemu execlog plugin's instruction log, which is how bench_m0.c's kernels are
+ * costed: -k prints calls, instructions and cycles per call of every function named with the prefix, and -c
+ * compares against the last table and fails when a kernel got slower.
+ *
+ * Build:
+ *   gcc -O2 -o mtb_decode mtb_decode.c
+ *
+ * Use:
+ *   mtb_decode -e DMA_Project.axf < console.log			MTB lines from "trace dump", flat profile
+ *   mtb_decode -e DMA_Project.axf -f < console.log		folded call paths (flamegraph.pl input)
+ *   mtb_decode -e DMA_Project.axf -b mtb.bin -n packets [-o oldest]	raw buffer read with the debugger
+ *   mtb_decode -e bench_m0 -x bench_m0.log -k bench_m0_ [-c last.txt [-r percent]] > bench_m0.txt
+ *   mtb_decode -t										decode a built in trace against a built in image
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+/* DEFINES AND STATIC DATA */
+#define DECODE_MAX_FILE			(4 * 1024 * 1024)
+#define DECODE_MAX_PACKETS		65536
+#define DECODE_MAX_SYMBOLS		4096
+#define DECODE_MAX_SEGMENTS		8
+#define DECODE_MAX_DEPTH		16
+#define DECODE_MAX_PATHS		2048
+#define DECODE_MAX_RUN			8192		// Instructions in one straight run before the packets are called bad
+#define DECODE_EXCEPTION_ENTRY	15			// M0+ stacking cycles
+#define DECODE_EXCEPTION_RETURN	10			// M0+ unstacking cycles
+#define DECODE_UNKNOWN			-1
+#define DECODE_MAX_KERNELS		256
+#define DECODE_REGRESSION		1.0			// Percent more cycles per call -c calls a regression
+
+// Same tag trace.c writes
+#define DECODE_TAG				"MTB"
+
+// ELF32 (little endian ARM) - only what the loader reads
+typedef struct
+{
+	uint8_t ident[16];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t phoff;
+	uint32_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} decode_elf_header;
+
+typedef struct
+{
+	uint32_t type;
+	uint32_t offset;
+	uint32_t vaddr;
+	uint32_t paddr;
+	uint32_t filesz;
+	uint32_t memsz;
+	uint32_t flags;
+	uint32_t align;
+} decode_elf_program;
+
+typedef struct
+{
+	uint32_t name;
+	uint32_t type;
+	uint32_t flags;
+	uint32_t addr;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t link;
+	uint32_t info;
+	uint32_t addralign;
+	uint32_t entsize;
+} decode_elf_section;
+
+typedef struct
+{
+	uint32_t name;
+	uint32_t value;
+	uint32_t size;
+	uint8_t info;
+	uint8_t other;
+	uint16_t shndx;
+} decode_elf_symbol;
+
+#define DECODE_ELF_MACHINE_ARM	40
+#define DECODE_ELF_PT_LOAD		1
+#define DECODE_ELF_SHT_SYMTAB	2
+#define DECODE_ELF_STT_FUNC		2
+
+// Code image and function table out of the ELF (addresses are where the code runs, RAM functions included)
+typedef struct
+{
+	uint32_t address;
+	uint32_t size;
+	const uint8_t* data;
+} decode_segment;
+
+typedef struct
+{
+	uint32_t address;
+	uint32_t size;
+	const char* name;
+} decode_function;
+
+typedef struct
+{
+	decode_segment segments[DECODE_MAX_SEGMENTS];
+	uint8_t segment_count;
+	decode_function functions[DECODE_MAX_SYMBOLS];
+	uint32_t function_count;
+} decode_image;
+
+// One MTB packet with the flag bits split off
+typedef struct
+{
+	uint32_t source;
+	uint32_t destination;
+	bool exception;				// A bit - the source is the interrupted instruction, not a branch
+	bool start;					// S bit - first packet after the MTB was turned on
+} decode_packet;
+
+// Call stack frame
+typedef struct
+{
+	int32_t function;			// Caller
+	uint32_t return_address;
+	bool exception;
+} decode_frame;
+
+// Totals per call path (callers then the function the code ran in)
+typedef struct
+{
+	int32_t functions[DECODE_MAX_DEPTH + 1];
+	uint8_t depth;
+	uint64_t instructions;
+	uint64_t cycles;
+} decode_path;
+
+typedef struct
+{
+	decode_frame stack[DECODE_MAX_DEPTH];
+	uint8_t depth;
+	decode_path paths[DECODE_MAX_PATHS];
+	uint32_t path_count;
+	uint32_t entries[DECODE_MAX_SYMBOLS + 1];		// Calls and exceptions into each function, [0] is unknown
+	uint32_t previous;							// Destination of the last packet
+	bool running;
+	uint32_t last_path;							// Most runs charge the same path as the one before
+	uint32_t bad_runs;
+	uint32_t calls;
+	uint32_t exceptions;
+	uint32_t foreign;							// Logged instructions that are not Thumb in the image (ARM state libc)
+} decode_state;
+
+static uint8_t decode_file[DECODE_MAX_FILE];
+static decode_packet decode_packets[DECODE_MAX_PACKETS];
+static decode_image decode_elf;
+static decode_state decode;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static bool decode_load_elf(const uint8_t* file, uint32_t length, decode_image* image);
+static int decode_compare_functions(const void* a, const void* b);
+static int32_t decode_function_at(decode_image* image, uint32_t address);
+static bool decode_halfword(decode_image* image, uint32_t address, uint16_t* halfword);
+static uint8_t decode_instruction(decode_image* image, uint32_t address, bool taken, uint8_t* cycles, bool* call);
+static uint32_t decode_text(FILE* in, decode_packet* packets, uint32_t max);
+static uint32_t decode_binary(const uint8_t* data, uint32_t length, uint32_t count, uint32_t oldest, decode_packet* packets);
+static void decode_trace(decode_image* image, decode_packet* packets, uint32_t count, decode_state* state);
+static void decode_run(decode_image* image, decode_state* state, uint32_t address, decode_packet* packet);
+static void decode_branch(decode_image* image, decode_state* state, decode_packet* packet);
+static void decode_charge(decode_image* image, decode_state* state, int32_t function, uint32_t instructions, uint32_t cycles);
+static void decode_execlog(decode_image* image, FILE* in, decode_state* state);
+static void decode_execute(decode_image* image, decode_state* state, uint32_t address, uint32_t next);
+static void decode_report(decode_image* image, decode_state* state, bool folded);
+static uint32_t decode_kernels(decode_image* image, decode_state* state, const char* prefix, const char* last_file, double percent);
+static int decode_compare_names(const void* a, const void* b);
+static int decode_self_test(void);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	const char* elf_file = NULL;
+	const char* binary_file = NULL;
+	const char* execlog_file = NULL;
+	const char* kernel_prefix = NULL;
+	const char* last_file = NULL;
+	uint32_t binary_packets = 0;
+	uint32_t oldest = 0;
+	double percent = DECODE_REGRESSION;
+	bool folded = false;
+	int ret = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "e:b:n:o:x:k:c:r:ft")) != -1)
+	{
+		switch(opt)
+		{
+			case 'e':
+				elf_file = optarg;
+				break;
+			case 'b':
+				binary_file = optarg;
+				break;
+			case 'n':
+				binary_packets = strtoul(optarg, NULL, 0);
+				break;
+			case 'o':
+				oldest = strtoul(optarg, NULL, 0);
+				break;
+			case 'x':
+				execlog_file = optarg;
+				break;
+			case 'k':
+				kernel_prefix = optarg;
+				break;
+			case 'c':
+				last_file = optarg;
+				break;
+			case 'r':
+				percent = strtod(optarg, NULL);
+				break;
+			case 'f':
+				folded = true;
+				break;
+			case 't':
+				return decode_self_test();
+			default:
+				fprintf(stderr, "usage: %s -e image.axf [-f] [-b buffer.bin -n packets [-o oldest] | -x execlog] "
+						"[-k prefix [-c last.txt] [-r percent]] < console.log | -t\n", argv[0]);
+				return 2;
+		}
+	}
+
+	FILE* in = elf_file ? fopen(elf_file, "rb") : NULL;
+	if(in == NULL)
+	{
+		fprintf(stderr, "need the firmware image (-e)\n");
+		return 2;
+	}
+	uint32_t length = fread(decode_file, 1, sizeof(decode_file), in);
+	fclose(in);
+	if(!decode_load_elf(decode_file, length, &decode_elf))
+	{
+		fprintf(stderr, "%s is not a little endian ARM ELF with a symbol table\n", elf_file);
+		return 1;
+	}
+
+	// The ELF stays in decode_file (the names point into it), the raw buffer goes in after it
+	uint32_t count = 0;
+	if(execlog_file != NULL)
+	{
+		FILE* log = fopen(execlog_file, "r");
+		if(log == NULL)
+		{
+			fprintf(stderr, "cannot open %s\n", execlog_file);
+			return 2;
+		}
+		decode_execlog(&decode_elf, log, &decode);
+		fclose(log);
+	}
+	else if(binary_file != NULL)
+	{
+		FILE* raw = fopen(binary_file, "rb");
+		if(raw == NULL)
+		{
+			fprintf(stderr, "cannot open %s\n", binary_file);
+			return 2;
+		}
+		uint32_t raw_length = fread(&decode_file[length], 1, sizeof(decode_file) - length, raw);
+		fclose(raw);
+		count = decode_binary(&decode_file[length], raw_length, binary_packets, oldest, decode_packets);
+	}
+	else
+	{
+		count = decode_text(stdin, decode_packets, DECODE_MAX_PACKETS);
+	}
+	decode_trace(&decode_elf, decode_packets, count, &decode);
+
+	if(kernel_prefix != NULL)
+	{
+		ret = (decode_kernels(&decode_elf, &decode, kernel_prefix, last_file, percent) > 0);
+	}
+	else
+	{
+		decode_report(&decode_elf, &decode, folded);
+	}
+
+	return ret;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Load segments and function symbols, false if it is not a usable image
+static bool decode_load_elf(const uint8_t* file, uint32_t length, decode_image* image)
+{
+	decode_elf_header header;
+
+	if(length < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, file, sizeof(header));
+	if(	(memcmp(header.ident, "\x7f" "ELF", 4) != 0) || (header.ident[4] != 1) || (header.ident[5] != 1)	||
+		(header.machine != DECODE_ELF_MACHINE_ARM)																||
+		((header.phoff + ((uint64_t)header.phnum * sizeof(decode_elf_program))) > length)						||
+		((header.shoff + ((uint64_t)header.shnum * sizeof(decode_elf_section))) > length)						)
+	{
+		return false;
+	}
+
+	image->segment_count = 0;
+	for(uint16_t i = 0; (i < header.phnum) && (image->segment_count < DECODE_MAX_SEGMENTS); i++)
+	{
+		decode_elf_program program;
+		memcpy(&program, &file[header.phoff + (i * header.phentsize)], sizeof(program));
+		if((program.type == DECODE_ELF_PT_LOAD) && program.filesz && ((program.offset + (uint64_t)program.filesz) <= length))
+		{
+			image->segments[image->segment_count++] = (decode_segment){program.vaddr, program.filesz, &file[program.offset]};
+		}
+	}
+
+	image->function_count = 0;
+	for(uint16_t i = 0; i < header.shnum; i++)
+	{
+		decode_elf_section symtab;
+		decode_elf_section strtab;
+		memcpy(&symtab, &file[header.shoff + (i * header.shentsize)], sizeof(symtab));
+		if((symtab.type != DECODE_ELF_SHT_SYMTAB) || (symtab.link >= header.shnum))
+		{
+			continue;
+		}
+		memcpy(&strtab, &file[header.shoff + (symtab.link * header.shentsize)], sizeof(strtab));
+
+		for(uint32_t s = 0; (s < (symtab.size / sizeof(decode_elf_symbol))) && (image->function_count < DECODE_MAX_SYMBOLS); s++)
+		{
+			decode_elf_symbol symbol;
+			memcpy(&symbol, &file[symtab.offset + (s * sizeof(symbol))], sizeof(symbol));
+			if(((symbol.info & 0xFU) == DECODE_ELF_STT_FUNC) && symbol.size && (symbol.name < strtab.size))
+			{
+				// Thumb functions have bit 0 set in the symbol value
+				image->functions[image->function_count++] = (decode_function){symbol.value & ~1UL, symbol.size,
+																(const char*)&file[strtab.offset + symbol.name]};
+			}
+		}
+	}
+
+	qsort(image->functions, image->function_count, sizeof(decode_function), decode_compare_functions);
+
+	return (image->segment_count > 0) && (image->function_count > 0);
+}
+
+static int decode_compare_functions(const void* a, const void* b)
+{
+	const decode_function* fa = a;
+	const decode_function* fb = b;
+	return (fa->address > fb->address) - (fa->address < fb->address);
+}
+
+// Function containing an address, DECODE_UNKNOWN outside every symbol
+static int32_t decode_function_at(decode_image* image, uint32_t address)
+{
+	int32_t low = 0;
+	int32_t high = (int32_t)image->function_count - 1;
+
+	while(low <= high)
+	{
+		int32_t middle = (low + high) / 2;
+		decode_function* function = &image->functions[middle];
+		if(address < function->address)
+		{
+			high = middle - 1;
+		}
+		else if(address >= (function->address + function->size))
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			return middle;
+		}
+	}
+
+	return DECODE_UNKNOWN;
+}
+
+static bool decode_halfword(decode_image* image, uint32_t address, uint16_t* halfword)
+{
+	for(uint8_t i = 0; i < image->segment_count; i++)
+	{
+		decode_segment* segment = &image->segments[i];
+		if((address >= segment->address) && ((address - segment->address + 2) <= segment->size))
+		{
+			*halfword = segment->data[address - segment->address] | (segment->data[address - segment->address + 1] << 8);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Size in bytes (0 outside the image) and M0+ cycles of one Thumb instruction
+static uint8_t decode_instruction(decode_image* image, uint32_t address, bool taken, uint8_t* cycles, bool* call)
+{
+	uint16_t first;
+	uint16_t second = 0;
+
+	*call = false;
+	if(!decode_halfword(image, address, &first))
+	{
+		return 0;
+	}
+
+	// 32 bit encodings start 0b11101, 0b11110 or 0b11111
+	if((first >> 11) >= 0x1DU)
+	{
+		decode_halfword(image, address + 2, &second);
+		*call = ((first & 0xF800U) == 0xF000U) && ((second & 0xC000U) == 0xC000U);		// BL, BLX to ARM state
+		*cycles = 3;																	// BL, DMB/DSB/ISB, MRS/MSR
+		return 4;
+	}
+
+	uint8_t registers = __builtin_popcount(first & 0xFFU);
+
+	if((first & 0xFF80U) == 0x4780U)					// BLX register
+	{
+		*call = true;
+		*cycles = 2;
+	}
+	else if((first & 0xFF00U) == 0x4700U)				// BX
+	{
+		*cycles = 2;
+	}
+	else if(((first & 0xFF87U) == 0x4687U) ||			// MOV pc, register
+			((first & 0xF000U) == 0xE000U))				// B
+	{
+		*cycles = 2;
+	}
+	else if((first & 0xF000U) == 0xD000U)				// B<cond>, SVC/UDF
+	{
+		*cycles = taken ? 2 : 1;
+	}
+	else if(((first & 0xF800U) == 0x4800U) ||			// LDR literal
+			((first >= 0x5000U) && (first < 0xA000U)))	// Loads and stores
+	{
+		*cycles = 2;
+	}
+	else if((first & 0xFE00U) == 0xB400U)				// PUSH
+	{
+		*cycles = 1 + registers + ((first >> 8) & 1U);
+	}
+	else if((first & 0xFE00U) == 0xBC00U)				// POP, with PC it is a branch too
+	{
+		*cycles = 1 + registers + (((first >> 8) & 1U) ? 3 : 0);
+	}
+	else if((first & 0xF000U) == 0xC000U)				// LDM/STM
+	{
+		*cycles = 1 + registers;
+	}
+	else
+	{
+		*cycles = 1;
+	}
+
+	return 2;
+}
+
+// MTB lines from the console, anything else in the log is skipped
+static uint32_t decode_text(FILE* in, decode_packet* packets, uint32_t max)
+{
+	char line[256];
+	uint32_t count = 0;
+	uint32_t expected = 0;
+	bool header = false;
+
+	while(fgets(line, sizeof(line), in) != NULL)
+	{
+		char* mtb = strstr(line, DECODE_TAG " ");
+		unsigned address;
+		unsigned size;
+		unsigned packet_count;
+		unsigned wrapped;
+		unsigned first;
+		int used;
+
+		if(mtb == NULL)
+		{
+			continue;
+		}
+		mtb += strlen(DECODE_TAG " ");
+
+		if(sscanf(mtb, "%x %u %u %u", &address, &size, &packet_count, &wrapped) == 4)
+		{
+			// A new dump starts over
+			count = 0;
+			expected = packet_count;
+			header = true;
+			fprintf(stderr, "buffer 0x%08x, %u bytes, %u packets%s\n", address, size, packet_count, wrapped ? " (wrapped)" : "");
+		}
+		else if(header && (sscanf(mtb, "%u%n", &first, &used) == 1) && (first == count))
+		{
+			unsigned source;
+			unsigned destination;
+			int more;
+			mtb += used;
+			while((count < max) && (sscanf(mtb, "%x %x%n", &source, &destination, &more) == 2))
+			{
+				packets[count++] = (decode_packet){source & ~1U, destination & ~1U, source & 1U, destination & 1U};
+				mtb += more;
+			}
+		}
+	}
+
+	if(count != expected)
+	{
+		fprintf(stderr, "%u of %u packets in the log\n", (unsigned)count, (unsigned)expected);
+	}
+
+	return count;
+}
+
+// Raw buffer, count packets from slot 0, or the whole buffer from the oldest slot after a wrap
+static uint32_t decode_binary(const uint8_t* data, uint32_t length, uint32_t count, uint32_t oldest, decode_packet* packets)
+{
+	uint32_t slots = length / 8;
+	count = (count && (count < slots)) ? count : slots;
+	count = (count < DECODE_MAX_PACKETS) ? count : DECODE_MAX_PACKETS;
+
+	for(uint32_t p = 0; p < count; p++)
+	{
+		const uint8_t* slot = &data[((oldest + p) % slots) * 8];
+		uint32_t source = slot[0] | (slot[1] << 8) | (slot[2] << 16) | ((uint32_t)slot[3] << 24);
+		uint32_t destination = slot[4] | (slot[5] << 8) | (slot[6] << 16) | ((uint32_t)slot[7] << 24);
+		packets[p] = (decode_packet){source & ~1U, destination & ~1U, source & 1U, destination & 1U};
+	}
+
+	return count;
+}
+
+// Walk the packets, charging each straight run and following calls, returns and exceptions (carries on from the last call)
+static void decode_trace(decode_image* image, decode_packet* packets, uint32_t count, decode_state* state)
+{
+	for(uint32_t p = 0; p < count; p++)
+	{
+		decode_packet* packet = &packets[p];
+
+		if(packet->start)
+		{
+			// Nothing is known about the callers of where tracing picked up
+			state->depth = 0;
+		}
+		else if(state->running)
+		{
+			decode_run(image, state, state->previous, packet);
+		}
+
+		decode_branch(image, state, packet);
+		state->previous = packet->destination;
+		state->running = true;
+	}
+}
+
+// The run from the last destination to this packet's source (the source itself is the branch, unless it was interrupted)
+static void decode_run(decode_image* image, decode_state* state, uint32_t address, decode_packet* packet)
+{
+	uint32_t end = packet->source;
+	uint32_t instructions = 0;
+	int32_t function = decode_function_at(image, address);
+	uint32_t function_instructions = 0;
+	uint32_t function_cycles = 0;
+	bool bad = (address > end) && !(packet->exception && (address == end));
+
+	while(!bad && (packet->exception ? (address < end) : (address <= end)))
+	{
+		uint8_t cycles;
+		bool call;
+		uint8_t size = decode_instruction(image, address, (address == end), &cycles, &call);
+		int32_t here = decode_function_at(image, address);
+
+		if((size == 0) || (++instructions > DECODE_MAX_RUN))
+		{
+			bad = true;
+			break;
+		}
+
+		// Falling through into the next function (or out of one into padding) moves the charge along
+		if(here != function)
+		{
+			decode_charge(image, state, function, function_instructions, function_cycles);
+			function = here;
+			function_instructions = 0;
+			function_cycles = 0;
+		}
+		function_instructions++;
+		function_cycles += cycles;
+		address += size;
+	}
+
+	if(bad)
+	{
+		state->bad_runs++;
+		state->depth = 0;
+	}
+	else
+	{
+		decode_charge(image, state, function, function_instructions, function_cycles);
+	}
+}
+
+// Follow the branch itself - a call or exception pushes, a branch to a saved return address pops back to that frame
+static void decode_branch(decode_image* image, decode_state* state, decode_packet* packet)
+{
+	uint8_t cycles;
+	bool call = false;
+	uint8_t size = packet->exception ? 0 : decode_instruction(image, packet->source, true, &cycles, &call);
+	int8_t frame = (int8_t)state->depth - 1;
+
+	// Not only the top frame - a tail call or a lost packet leaves frames behind that the outer return clears
+	while((frame >= 0) && (packet->destination != state->stack[frame].return_address))
+	{
+		frame--;
+	}
+
+	if(frame >= 0)
+	{
+		// Unstacking is the handler's, charge it before the frame goes
+		if(state->stack[frame].exception)
+		{
+			decode_charge(image, state, decode_function_at(image, packet->source), 0, DECODE_EXCEPTION_RETURN);
+		}
+		state->depth = (uint8_t)frame;
+	}
+	else if((packet->exception || call) && (state->depth < DECODE_MAX_DEPTH))
+	{
+		int32_t callee = decode_function_at(image, packet->destination);
+
+		state->stack[state->depth++] = (decode_frame){decode_function_at(image, packet->source),
+														packet->source + size, packet->exception};
+		state->calls += !packet->exception;
+		state->exceptions += packet->exception;
+		state->entries[callee + 1]++;
+		if(packet->exception)
+		{
+			decode_charge(image, state, callee, 0, DECODE_EXCEPTION_ENTRY);
+		}
+	}
+}
+
+// Add to the path made of the callers on the stack and the function the code ran in
+static void decode_charge(decode_image* image, decode_state* state, int32_t function, uint32_t instructions, uint32_t cycles)
+{
+	decode_path key = {0};
+
+	(void)image;
+	if((instructions == 0) && (cycles == 0))
+	{
+		return;
+	}
+
+	for(uint8_t i = 0; i < state->depth; i++)
+	{
+		key.functions[key.depth++] = state->stack[i].function;
+	}
+	key.functions[key.depth++] = function;
+
+	for(uint32_t p = 0; p < state->path_count; p++)
+	{
+		uint32_t index = (p == 0) ? state->last_path : ((p == state->last_path) ? 0 : p);
+		decode_path* path = &state->paths[index];
+		if((path->depth == key.depth) && (memcmp(path->functions, key.functions, key.depth * sizeof(int32_t)) == 0))
+		{
+			path->instructions += instructions;
+			path->cycles += cycles;
+			state->last_path = index;
+			return;
+		}
+	}
+
+	if(state->path_count < DECODE_MAX_PATHS)
+	{
+		key.instructions = instructions;
+		key.cycles = cycles;
+		state->last_path = state->path_count;
+		state->paths[state->path_count++] = key;
+	}
+}
+
+// qemu execlog plugin lines ("cpu, pc, opcode, "disassembly"..."), anything else in the log is skipped
+static void decode_execlog(decode_image* image, FILE* in, decode_state* state)
+{
+	char line[256];
+	uint32_t last = 0;
+	bool have = false;
+
+	while(fgets(line, sizeof(line), in) != NULL)
+	{
+		unsigned cpu;
+		unsigned pc;
+		unsigned opcode;
+
+		if(sscanf(line, "%u, 0x%x, 0x%x", &cpu, &pc, &opcode) != 3)
+		{
+			continue;
+		}
+		pc &= ~1U;
+		if(have)
+		{
+			decode_execute(image, state, last, pc);
+		}
+		last = pc;
+		have = true;
+	}
+
+	// The last instruction did not branch anywhere the log shows
+	if(have)
+	{
+		decode_execute(image, state, last, last + 2);
+	}
+}
+
+// Charge one logged instruction, then follow it as a branch packet if the next one is not the next in line
+static void decode_execute(decode_image* image, decode_state* state, uint32_t address, uint32_t next)
+{
+	uint32_t step = next - address;
+	bool sequential = (step == 2) || (step == 4);
+	uint8_t cycles;
+	bool call;
+	uint8_t size = decode_instruction(image, address, !sequential, &cycles, &call);
+
+	// The cost model is Thumb, an ARM state instruction shows up as a 4 byte step over a 2 byte decode
+	if((size == 0) || (sequential && (step != size)))
+	{
+		state->foreign++;
+		cycles = 1;
+	}
+	decode_charge(image, state, decode_function_at(image, address), 1, cycles);
+
+	if(!sequential)
+	{
+		decode_packet packet = {address, next, false, false};
+		decode_branch(image, state, &packet);
+	}
+}
+
+// Flat profile (self time per function) or folded call paths
+static void decode_report(decode_image* image, decode_state* state, bool folded)
+{
+	static uint64_t self_instructions[DECODE_MAX_SYMBOLS + 1];
+	static uint64_t self_cycles[DECODE_MAX_SYMBOLS + 1];
+	uint64_t total = 0;
+
+	for(uint32_t p = 0; p < state->path_count; p++)
+	{
+		decode_path* path = &state->paths[p];
+		int32_t leaf = path->functions[path->depth - 1];
+		total += path->cycles;
+
+		if(folded)
+		{
+			for(uint8_t i = 0; i < path->depth; i++)
+			{
+				int32_t f = path->functions[i];
+				printf("%s%s", i ? ";" : "", (f == DECODE_UNKNOWN) ? "?" : image->functions[f].name);
+			}
+			printf(" %llu\n", (unsigned long long)path->cycles);
+		}
+		else
+		{
+			self_instructions[leaf + 1] += path->instructions;
+			self_cycles[leaf + 1] += path->cycles;
+		}
+	}
+
+	if(!folded)
+	{
+		printf("%-32s %10s %10s %6s\n", "function", "instr", "cycles", "%");
+		// Biggest first, one pass per line is plenty for a few hundred functions
+		for(;;)
+		{
+			int64_t best = -1;
+			for(uint32_t f = 0; f <= image->function_count; f++)
+			{
+				if(self_cycles[f] && ((best < 0) || (self_cycles[f] > self_cycles[best])))
+				{
+					best = f;
+				}
+			}
+			if(best < 0)
+			{
+				break;
+			}
+			printf("%-32s %10llu %10llu %6.2f\n", best ? image->functions[best - 1].name : "?",
+					(unsigned long long)self_instructions[best], (unsigned long long)self_cycles[best],
+					(100.0 * self_cycles[best]) / total);
+			self_cycles[best] = 0;
+		}
+		printf("%u calls, %u exceptions, %u bad runs\n", (unsigned)state->calls, (unsigned)state->exceptions,
+				(unsigned)state->bad_runs);
+	}
+}
+
+// Per call cost of every function named with the prefix (callees included), against the last table if there is one
+static uint32_t decode_kernels(decode_image* image, decode_state* state, const char* prefix, const char* last_file, double percent)
+{
+	static uint64_t instructions[DECODE_MAX_SYMBOLS + 1];
+	static uint64_t cycles[DECODE_MAX_SYMBOLS + 1];
+	static uint32_t kernels[DECODE_MAX_KERNELS];
+	static struct
+	{
+		char name[64];
+		unsigned long long cycles;
+	} last[DECODE_MAX_KERNELS];
+	uint32_t kernel_count = 0;
+	uint32_t last_count = 0;
+	uint32_t regressions = 0;
+
+	// A function is in a path once however deep it recursed
+	for(uint32_t p = 0; p < state->path_count; p++)
+	{
+		decode_path* path = &state->paths[p];
+		for(uint8_t i = 0; i < path->depth; i++)
+		{
+			int32_t f = path->functions[i];
+			bool seen = false;
+			for(uint8_t j = 0; j < i; j++)
+			{
+				seen |= (path->functions[j] == f);
+			}
+			if(!seen)
+			{
+				instructions[f + 1] += path->instructions;
+				cycles[f + 1] += path->cycles;
+			}
+		}
+	}
+
+	FILE* in = last_file ? fopen(last_file, "r") : NULL;
+	if(in != NULL)
+	{
+		char line[256];
+		unsigned calls;
+		unsigned long long per_call;
+		while((fgets(line, sizeof(line), in) != NULL) && (last_count < DECODE_MAX_KERNELS))
+		{
+			if(sscanf(line, "%63s %u %llu %llu", last[last_count].name, &calls, &per_call, &last[last_count].cycles) == 4)
+			{
+				last_count++;
+			}
+		}
+		fclose(in);
+	}
+	else if(last_file != NULL)
+	{
+		fprintf(stderr, "no %s, nothing to compare against\n", last_file);
+	}
+
+	for(uint32_t f = 0; (f < image->function_count) && (kernel_count < DECODE_MAX_KERNELS); f++)
+	{
+		if((strncmp(image->functions[f].name, prefix, strlen(prefix)) == 0) && state->entries[f + 1])
+		{
+			kernels[kernel_count++] = f;
+		}
+	}
+	qsort(kernels, kernel_count, sizeof(uint32_t), decode_compare_names);
+
+	printf("%-32s %8s %12s %12s %8s\n", "kernel", "calls", "instr/call", "cycles/call", "change%");
+	for(uint32_t k = 0; k < kernel_count; k++)
+	{
+		uint32_t f = kernels[k];
+		uint32_t calls = state->entries[f + 1];
+		unsigned long long per_call = cycles[f + 1] / calls;
+		char change[16] = "new";
+
+		for(uint32_t l = 0; l < last_count; l++)
+		{
+			if((strcmp(last[l].name, image->functions[f].name) == 0) && last[l].cycles)
+			{
+				double delta = (100.0 * ((double)per_call - (double)last[l].cycles)) / last[l].cycles;
+				snprintf(change, sizeof(change), "%+.2f%s", delta, (delta > percent) ? "!" : "");
+				regressions += (delta > percent);
+			}
+		}
+		printf("%-32s %8u %12llu %12llu %8s\n", image->functions[f].name, (unsigned)calls,
+				(unsigned long long)(instructions[f + 1] / calls), per_call, change);
+	}
+
+	if(state->foreign)
+	{
+		fprintf(stderr, "%u instructions outside the Thumb cost model (costed 1 cycle each)\n", (unsigned)state->foreign);
+	}
+	if(regressions)
+	{
+		fprintf(stderr, "%u kernels over +%.2f%% cycles per call\n", (unsigned)regressions, percent);
+	}
+
+	return regressions;
+}
+
+static int decode_compare_names(const void* a, const void* b)
+{
+	return strcmp(decode_elf.functions[*(const uint32_t*)a].name, decode_elf.functions[*(const uint32_t*)b].name);
+}
+
+// A made up image and trace with known answers: main loops, calls f, and is interrupted by isr
+static int decode_self_test(void)
+{
+	static uint8_t elf[1024];
+	static char log[1024];
+	uint32_t failures = 0;
+
+	// Code at 0x1000 - NOPs, with main's BL f at 0x1008, B 0x1000 at 0x101E, f's BX LR at 0x102E, isr's at 0x104E
+	const uint32_t base = 0x1000;
+	uint16_t code[0x28];
+	for(uint8_t i = 0; i < 0x28; i++)
+	{
+		code[i] = 0xBF00U;
+	}
+	code[0x04] = 0xF000U;		// BL
+	code[0x05] = 0xF80AU;
+	code[0x0F] = 0xE7EFU;		// B
+	code[0x17] = 0x4770U;		// BX LR
+	code[0x27] = 0x4770U;
+
+	// Header, one load segment, symtab and strtab sections
+	const char strings[] = "\0main\0f\0isr";
+	decode_elf_symbol symbols[] =
+	{
+		{0, 0, 0, 0, 0, 0},
+		{1, 0x1000 | 1, 0x20, DECODE_ELF_STT_FUNC, 0, 1},
+		{6, 0x1020 | 1, 0x10, DECODE_ELF_STT_FUNC, 0, 1},
+		{8, 0x1040 | 1, 0x10, DECODE_ELF_STT_FUNC, 0, 1}
+	};
+	uint32_t code_offset = sizeof(decode_elf_header) + sizeof(decode_elf_program);
+	uint32_t symbol_offset = code_offset + sizeof(code);
+	uint32_t string_offset = symbol_offset + sizeof(symbols);
+	uint32_t section_offset = (string_offset + sizeof(strings) + 3) & ~3U;
+	decode_elf_header header = {{0x7F, 'E', 'L', 'F', 1, 1, 1}, 2, DECODE_ELF_MACHINE_ARM, 1, base | 1,
+								sizeof(decode_elf_header), section_offset, 0, sizeof(decode_elf_header),
+								sizeof(decode_elf_program), 1, sizeof(decode_elf_section), 3, 0};
+	decode_elf_program program = {DECODE_ELF_PT_LOAD, code_offset, base, base, sizeof(code), sizeof(code), 5, 4};
+	decode_elf_section sections[3] =
+	{
+		{0},
+		{0, DECODE_ELF_SHT_SYMTAB, 0, 0, symbol_offset, sizeof(symbols), 2, 1, 4, sizeof(decode_elf_symbol)},
+		{0, 3, 0, 0, string_offset, sizeof(strings), 0, 0, 1, 0}
+	};
+	memcpy(elf, &header, sizeof(header));
+	memcpy(&elf[sizeof(header)], &program, sizeof(program));
+	memcpy(&elf[code_offset], code, sizeof(code));
+	memcpy(&elf[symbol_offset], symbols, sizeof(symbols));
+	memcpy(&elf[string_offset], strings, sizeof(strings));
+	memcpy(&elf[section_offset], sections, sizeof(sections));
+
+	if(!decode_load_elf(elf, section_offset + sizeof(sections), &decode_elf))
+	{
+		printf("image did not load\nFAIL\n");
+		return 1;
+	}
+
+	// Start on the loop branch, call f, return, isr interrupts at 0x1010, returns, loop branch again
+	const uint32_t trace[][2] =
+	{
+		{0x101E, 0x1000 | 1},
+		{0x1008, 0x1020},
+		{0x102E, 0x100C},
+		{0x1010 | 1, 0x1040},
+		{0x104E, 0x1010},
+		{0x101E, 0x1000}
+	};
+	uint32_t count = sizeof(trace) / sizeof(trace[0]);
+
+	// Through the console format, the way trace.c prints it
+	int length = snprintf(log, sizeof(log), "START\n" DECODE_TAG " 1ffff800 2048 %u 0\n", (unsigned)count);
+	for(uint32_t p = 0; p < count; p += 4)
+	{
+		length += snprintf(&log[length], sizeof(log) - length, DECODE_TAG " %u", (unsigned)p);
+		for(uint32_t i = p; (i < count) && (i < (p + 4)); i++)
+		{
+			length += snprintf(&log[length], sizeof(log) - length, " %08x %08x", (unsigned)trace[i][0], (unsigned)trace[i][1]);
+		}
+		length += snprintf(&log[length], sizeof(log) - length, "\n");
+	}
+	length += snprintf(&log[length], sizeof(log) - length, "some report text\n" DECODE_TAG " end\n");
+
+	FILE* in = fmemopen(log, length, "r");
+	count = decode_text(in, decode_packets, DECODE_MAX_PACKETS);
+	fclose(in);
+	memset(&decode, 0, sizeof(decode));
+	decode_trace(&decode_elf, decode_packets, count, &decode);
+
+	// main: 0x1000-0x1008 (4 NOP + BL), 0x100C-0x100E (2 NOP), 0x1010-0x101E (7 NOP + B)
+	// f: 7 NOP + BX, isr: 7 NOP + BX plus the exception entry and return
+	struct
+	{
+		const char* path;
+		uint64_t instructions;
+		uint64_t cycles;
+	} expected[] =
+	{
+		{"main",		4 + 1 + 2 + 7 + 1,	4 + 3 + 2 + 7 + 2},
+		{"main;f",		8,					7 + 2},
+		{"main;isr",	8,					DECODE_EXCEPTION_ENTRY + 7 + 2 + DECODE_EXCEPTION_RETURN}
+	};
+
+	failures += (count != 6) | (decode.bad_runs != 0) | (decode.calls != 1) | (decode.exceptions != 1) | (decode.depth != 0);
+	failures += (decode.path_count != (sizeof(expected) / sizeof(expected[0])));
+	for(uint8_t e = 0; e < sizeof(expected) / sizeof(expected[0]); e++)
+	{
+		bool found = false;
+		for(uint32_t p = 0; p < decode.path_count; p++)
+		{
+			char name[64] = "";
+			for(uint8_t i = 0; i < decode.paths[p].depth; i++)
+			{
+				strcat(name, i ? ";" : "");
+				strcat(name, decode_elf.functions[decode.paths[p].functions[i]].name);
+			}
+			if(strcmp(name, expected[e].path) == 0)
+			{
+				found = true;
+				if((decode.paths[p].instructions != expected[e].instructions) || (decode.paths[p].cycles != expected[e].cycles))
+				{
+					failures++;
+					printf("%s: %llu instructions %llu cycles, expected %llu %llu\n", name,
+							(unsigned long long)decode.paths[p].instructions, (unsigned long long)decode.paths[p].cycles,
+							(unsigned long long)expected[e].instructions, (unsigned long long)expected[e].cycles);
+				}
+			}
+		}
+		failures += !found;
+	}
+
+	// The raw buffer path gives the same packets, rotated the way a wrapped buffer is
+	uint8_t raw[sizeof(trace)];
+	for(uint32_t p = 0; p < count; p++)
+	{
+		uint32_t slot = (p + 2) % count;
+		for(uint8_t b = 0; b < 4; b++)
+		{
+			raw[(slot * 8) + b] = (uint8_t)(trace[p][0] >> (8 * b));
+			raw[(slot * 8) + 4 + b] = (uint8_t)(trace[p][1] >> (8 * b));
+		}
+	}
+	static decode_packet raw_packets[8];
+	failures += (decode_binary(raw, sizeof(raw), 0, 2, raw_packets) != count);
+	failures += (memcmp(raw_packets, decode_packets, count * sizeof(decode_packet)) != 0);
+
+	decode_report(&decode_elf, &decode, false);
+	decode_report(&decode_elf, &decode, true);
+
+	// The same program as an execlog, main calls f and goes round once: 16 instructions in main, 8 in f
+	static const uint32_t executed[] =
+	{
+		0x1000, 0x1002, 0x1004, 0x1006, 0x1008,
+		0x1020, 0x1022, 0x1024, 0x1026, 0x1028, 0x102A, 0x102C, 0x102E,
+		0x100C, 0x100E, 0x1010, 0x1012, 0x1014, 0x1016, 0x1018, 0x101A, 0x101C, 0x101E,
+		0x1000
+	};
+	length = 0;
+	for(uint32_t i = 0; i < sizeof(executed) / sizeof(executed[0]); i++)
+	{
+		uint16_t opcode = code[(executed[i] - base) / 2];
+		length += snprintf(&log[length], sizeof(log) - length, "0, 0x%x, 0x%x, \"\"\n", (unsigned)executed[i], opcode);
+	}
+	in = fmemopen(log, length, "r");
+	memset(&decode, 0, sizeof(decode));
+	decode_execlog(&decode_elf, in, &decode);
+	fclose(in);
+
+	failures += (decode.path_count != 2) | (decode.calls != 1) | (decode.depth != 0) | (decode.foreign != 0);
+	failures += (decode.paths[0].instructions != 16) | (decode.paths[0].cycles != (4 + 3 + 9 + 2 + 1));
+	failures += (decode.paths[1].instructions != 8) | (decode.paths[1].cycles != (7 + 2));
+	failures += (decode_kernels(&decode_elf, &decode, "f", NULL, DECODE_REGRESSION) != 0);
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * oversample_model.c
+ *
+ *  Created on: Dec 20, 2018
+ *      Author: Dominic Doty
+ *
+ * Host model of ADC hardware averaging (adc_samp_average) against oversample.c, measured as ENOB.
+ * A sine is made at the raw ADC rate, noise is added in 16 bit LSBs and it is quantized like the ADC.
+ * Hardware averaging rounds the mean of N conversions back to 16 bits, software keeps the extra bits.
+ * ENOB comes from a least squares sine fit at the known frequency: (SINAD - 1.76 + full scale margin) / 6.02.
+ *
+ * Build:
+ *   gcc -O2 -I../include -o oversample_model oversample_model.c ../source/oversample.c -lm
+ *
+ * Use:
+ *   oversample_model [-r raw_rate] [-f tone_hz] [-a amplitude_dbfs] [-s noise_lsb_rms] [-n outputs]
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include "oversample.h"
+
+/* DEFINES AND STATIC DATA */
+#define MODEL_BLOCK				64
+#define MODEL_HW_AVERAGES		{4, 8, 16, 32}		// ADC_SAMP_AVG_4..32
+#define MODEL_FULL_SCALE		32768.0
+
+// Model Settings
+typedef struct
+{
+	double raw_rate;
+	double tone_hz;
+	double amplitude_dbfs;
+	double noise_lsb;
+	uint32_t outputs;
+} model_config;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static int16_t model_conversion(model_config* config, uint64_t n);
+static double model_gaussian(void);
+static double model_enob(double* samples, uint32_t count, double rate, double tone_hz, double lsb);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	model_config config = {.raw_rate = 108000.0, .tone_hz = 101.0, .amplitude_dbfs = -1.0, .noise_lsb = 4.0, .outputs = 8192};
+	int opt;
+
+	while((opt = getopt(argc, argv, "r:f:a:s:n:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'r': config.raw_rate = atof(optarg); break;
+			case 'f': config.tone_hz = atof(optarg); break;
+			case 'a': config.amplitude_dbfs = atof(optarg); break;
+			case 's': config.noise_lsb = atof(optarg); break;
+			case 'n': config.outputs = strtoul(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "usage: %s [-r raw_rate] [-f tone_hz] [-a amplitude_dbfs] [-s noise_lsb_rms] [-n outputs]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	double* samples = malloc(sizeof(double) * config.outputs);
+	if(samples == NULL)
+	{
+		return 1;
+	}
+
+	printf("mode,ratio,output_rate,output_bits,enob,enob_gain\n");
+
+	// Raw conversions are the reference
+	srand(1);
+	for(uint32_t i = 0; i < config.outputs; i++)
+	{
+		samples[i] = model_conversion(&config, i);
+	}
+	double raw_enob = model_enob(samples, config.outputs, config.raw_rate, config.tone_hz, 1.0);
+	printf("raw,1,%.0f,16,%.2f,0.00\n", config.raw_rate, raw_enob);
+
+	// Hardware averaging - N conversions per result, result rounded back to 16 bits
+	uint32_t hw_averages[] = MODEL_HW_AVERAGES;
+	for(uint8_t a = 0; a < sizeof(hw_averages) / sizeof(hw_averages[0]); a++)
+	{
+		srand(1);
+		for(uint32_t i = 0; i < config.outputs; i++)
+		{
+			int32_t sum = 0;
+			for(uint32_t k = 0; k < hw_averages[a]; k++)
+			{
+				sum += model_conversion(&config, ((uint64_t)i * hw_averages[a]) + k);
+			}
+			samples[i] = floor(((double)sum / hw_averages[a]) + 0.5);
+		}
+		double rate = config.raw_rate / hw_averages[a];
+		double enob = model_enob(samples, config.outputs, rate, config.tone_hz, 1.0);
+		printf("hardware,%u,%.0f,16,%.2f,%.2f\n", hw_averages[a], rate, enob, enob - raw_enob);
+	}
+
+	// Software oversample/decimate through oversample.c, block at a time like the DMA
+	for(uint8_t bits = 1; bits <= OVERSAMPLE_MAX_EXTRA_BITS; bits++)
+	{
+		oversample_config os_fig = {.extra_bits = bits};
+		oversample_handle handle;
+		int16_t block[MODEL_BLOCK];
+		int32_t out[OVERSAMPLE_MAX_OUTPUTS(MODEL_BLOCK, 1)];
+		uint32_t produced = 0;
+		uint64_t n = 0;
+
+		oversample_init(&handle, &os_fig);
+		srand(1);
+		while(produced < config.outputs)
+		{
+			for(uint8_t i = 0; i < MODEL_BLOCK; i++)
+			{
+				block[i] = model_conversion(&config, n++);
+			}
+			uint8_t count = oversample_process_block(&handle, block, MODEL_BLOCK, out);
+			for(uint8_t i = 0; (i < count) && (produced < config.outputs); i++)
+			{
+				samples[produced++] = out[i];
+			}
+		}
+		double rate = config.raw_rate / OVERSAMPLE_RATIO(bits);
+		double enob = model_enob(samples, config.outputs, rate, config.tone_hz, 1.0 / (1 << bits));
+		printf("software,%u,%.0f,%u,%.2f,%.2f\n", OVERSAMPLE_RATIO(bits), rate, 16 + bits, enob, enob - raw_enob);
+	}
+
+	free(samples);
+	return 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// One 16 bit differential conversion of the test tone at raw sample n
+static int16_t model_conversion(model_config* config, uint64_t n)
+{
+	double amplitude = MODEL_FULL_SCALE * pow(10.0, config->amplitude_dbfs / 20.0);
+	double x = amplitude * sin(2.0 * M_PI * config->tone_hz * n / config->raw_rate) + config->noise_lsb * model_gaussian();
+	x = floor(x + 0.5);
+
+	return (int16_t)((x > INT16_MAX) ? INT16_MAX : ((x < INT16_MIN) ? INT16_MIN : x));
+}
+
+// Box-Muller, rand() is plenty for a noise floor
+static double model_gaussian(void)
+{
+	double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// Fit a + b sin + c cos at the tone, ENOB from the residual (lsb scales samples back to 16 bit LSBs)
+static double model_enob(double* samples, uint32_t count, double rate, double tone_hz, double lsb)
+{
+	double m[3][4] = {{0}};
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		double basis[3] = {1.0, sin(2.0 * M_PI * tone_hz * i / rate), cos(2.0 * M_PI * tone_hz * i / rate)};
+		for(uint8_t r = 0; r < 3; r++)
+		{
+			for(uint8_t c = 0; c < 3; c++)
+			{
+				m[r][c] += basis[r] * basis[c];
+			}
+			m[r][3] += basis[r] * samples[i] * lsb;
+		}
+	}
+
+	// 3x3 normal equations, Gauss-Jordan
+	for(uint8_t p = 0; p < 3; p++)
+	{
+		for(uint8_t r = 0; r < 3; r++)
+		{
+			if(r != p)
+			{
+				double f = m[r][p] / m[p][p];
+				for(uint8_t c = 0; c < 4; c++)
+				{
+					m[r][c] -= f * m[p][c];
+				}
+			}
+		}
+	}
+	double a = m[0][3] / m[0][0];
+	double b = m[1][3] / m[1][1];
+	double c = m[2][3] / m[2][2];
+
+	double noise = 0.0;
+	for(uint32_t i = 0; i < count; i++)
+	{
+		double fit = a + b * sin(2.0 * M_PI * tone_hz * i / rate) + c * cos(2.0 * M_PI * tone_hz * i / rate);
+		double e = (samples[i] * lsb) - fit;
+		noise += e * e;
+	}
+	noise = sqrt(noise / count);
+
+	double signal = sqrt((b * b) + (c * c)) / sqrt(2.0);
+	double sinad = 20.0 * log10(signal / noise);
+	double margin = 20.0 * log10((MODEL_FULL_SCALE / sqrt(2.0)) / signal);
+
+	return (sinad - 1.76 + margin) / 6.02;
+}
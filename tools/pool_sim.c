@@ -0,0 +1,237 @@
+/*
+ * pool_sim.c
+ *
+ *  Created on: Dec 27, 2018
+ *      Author: Dominic Doty
+ *
+ * Runs acquire.c in pool mode and blockpool.c against a DMA register block in host RAM, with three consumers
+ * reading the blocks in place - a meter that keeps up, a logger that stalls for a few blocks now and then, and
+ * one that falls well behind in long bursts. Injects CE/BES/BED errors like dma_sim so short blocks go through too.
+ * Checks the DMA is never armed on a block a consumer holds, that every block a consumer releases still holds
+ * the conversions from its first_sample on (nothing refilled under it), that each consumer sees every published
+ * block in order with the overruns as its only sequence gaps, and that every block is free again once the
+ * consumers drain. Prints per consumer lag and drops, the slow stages should be the ones with the drops.
+ *
+ * Build:
+ *   gcc -O2 -no-pie -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o pool_sim pool_sim.c \
+ *       ../source/acquire.c ../source/blockpool.c ../source/dma_driver.c ../source/cycle_counter.c
+ *   (-no-pie keeps the static buffers below 4 GB so the 32 bit DAR holds a usable pointer)
+ *
+ * Use:
+ *   pool_sim [-b blocks] [-e error_one_in_n] [-s seed]		exit code 0 is a pass
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "acquire.h"
+#include "blockpool.h"
+
+/* DEFINES AND STATIC DATA */
+#define SIM_BLOCK			64
+#define SIM_CONSUMERS		3
+#define SIM_NAMES			{"meter", "logger", "uplink"}
+#define SIM_STALL_ONE_IN	{0, 40, 400}		// Chance per block of a stall starting, 0 never stalls
+#define SIM_STALL_BLOCKS	{0, 3, 12}			// Block periods a stall lasts
+
+static DMA_Type sim_dma;
+static int16_t sim_buffer[BLOCKPOOL_BLOCKS * SIM_BLOCK];
+static uint32_t sim_index[BLOCKPOOL_BLOCKS * SIM_BLOCK];	// Conversion number of each buffer slot
+static uint32_t sim_conversion = 0;
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static dma_status sim_transfer(uint32_t error_one_in);
+static uint32_t sim_check(blockpool_block* block);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	const char* names[] = SIM_NAMES;
+	const uint32_t stall_one_in[] = SIM_STALL_ONE_IN;
+	const uint32_t stall_blocks[] = SIM_STALL_BLOCKS;
+	uint32_t blocks = 100000;
+	uint32_t error_one_in = 200;
+	int opt;
+
+	while((opt = getopt(argc, argv, "b:e:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'b':
+				blocks = strtoul(optarg, NULL, 10);
+				break;
+			case 'e':
+				error_one_in = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-b blocks] [-e error_one_in_n] [-s seed]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	blockpool pool;
+	blockpool_config pool_fig = BLOCKPOOL_CONFIG_DEFAULT;
+	pool_fig.buffer = sim_buffer;
+	pool_fig.block_size = SIM_BLOCK;
+	uint8_t consumers[SIM_CONSUMERS];
+	bool ok = (blockpool_init(&pool, &pool_fig) == BLOCKPOOL_ERROR_SUCCESS);
+	for(uint8_t c = 0; c < SIM_CONSUMERS; c++)
+	{
+		ok &= (blockpool_subscribe(&pool, names[c], &consumers[c]) == BLOCKPOOL_ERROR_SUCCESS);
+	}
+
+	// dma_init() would talk to the clock gate and NVIC, arm pool block 0 by hand instead
+	acquire_handle acquire;
+	acquire_config acquire_fig = ACQUIRE_CONFIG_DEFAULT;
+	acquire_fig.dma = &sim_dma;
+	acquire_fig.buffer = sim_buffer;
+	acquire_fig.block_size = SIM_BLOCK;
+	acquire_fig.pool = &pool;
+	ok &= (acquire_init(&acquire, &acquire_fig) == ACQUIRE_ERROR_SUCCESS);
+	if(!ok)
+	{
+		return 1;
+	}
+	dma_transfer_restart(&sim_dma, DMA_CHANNEL_0, sim_buffer, SIM_BLOCK * sizeof(int16_t));
+
+	uint32_t failures = 0;
+	uint32_t stall[SIM_CONSUMERS] = {0};
+	uint32_t last_sequence[SIM_CONSUMERS] = {0};
+	uint32_t gaps[SIM_CONSUMERS] = {0};
+	uint32_t received[SIM_CONSUMERS] = {0};
+
+	for(uint32_t b = 0; b <= blocks; b++)
+	{
+		// Last pass only drains
+		if(b < blocks)
+		{
+			sim_transfer(error_one_in);
+			acquire_irq(&acquire);
+
+			int16_t* armed = (int16_t*)(uintptr_t)sim_dma.DMA[DMA_CHANNEL_0].DAR;
+			uint8_t slot = (uint8_t)((armed - sim_buffer) / SIM_BLOCK);
+			if(pool.refs[slot] != 0)
+			{
+				failures++;
+				fprintf(stderr, "block %u: DMA armed on pool block %u with %u references\n", b, slot, pool.refs[slot]);
+			}
+		}
+
+		// Consumers - take everything queued unless stalled
+		for(uint8_t c = 0; c < SIM_CONSUMERS; c++)
+		{
+			if((b < blocks) && stall[c])
+			{
+				stall[c]--;
+				continue;
+			}
+			if((b < blocks) && stall_one_in[c] && ((rand() % stall_one_in[c]) == 0))
+			{
+				stall[c] = stall_blocks[c];
+				continue;
+			}
+
+			blockpool_block* block;
+			while((block = blockpool_peek(&pool, consumers[c])) != NULL)
+			{
+				if(block->sequence <= last_sequence[c])
+				{
+					failures++;
+					fprintf(stderr, "%s: sequence %u after %u\n", names[c], block->sequence, last_sequence[c]);
+				}
+				gaps[c] += block->sequence - last_sequence[c] - 1;
+				last_sequence[c] = block->sequence;
+				failures += sim_check(block);
+				received[c]++;
+				blockpool_release(&pool, consumers[c]);
+			}
+		}
+	}
+
+	uint32_t held = 0;
+	for(uint8_t i = 0; i < BLOCKPOOL_BLOCKS; i++)
+	{
+		held += pool.refs[i];
+	}
+	failures += (held != 0);
+	failures += ((pool.published + pool.overruns) != acquire.blocks);
+
+	printf("blocks %u, published %u, overruns %u, held after drain %u\n", acquire.blocks, pool.published,
+			pool.overruns, held);
+	for(uint8_t c = 0; c < SIM_CONSUMERS; c++)
+	{
+		gaps[c] += acquire.blocks - last_sequence[c];		// Overruns after the last block it saw
+		printf("%-8s received %u, gaps %u, max_lag %u, dropped %u\n", names[c], received[c], gaps[c],
+				pool.consumers[c].max_lag, pool.consumers[c].dropped);
+		failures += (gaps[c] != pool.overruns);
+		failures += ((received[c] + gaps[c]) != acquire.blocks);
+	}
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Move samples into the armed DAR until BCR runs out or an injected error, leave DSR_BCR like the silicon
+static dma_status sim_transfer(uint32_t error_one_in)
+{
+	DMA_Type* dma = &sim_dma;
+	int16_t* dest = (int16_t*)(uintptr_t)dma->DMA[DMA_CHANNEL_0].DAR;
+	uint32_t bcr = dma->DMA[DMA_CHANNEL_0].DSR_BCR & DMA_DSR_BCR_BCR_MASK;
+	dma_status status = DMA_STATUS_DONE;
+	uint32_t fail_at = UINT32_MAX;
+
+	if(error_one_in && ((rand() % error_one_in) == 0))
+	{
+		status = (dma_status)(DMA_STATUS_CONFIG_ERROR + (rand() % 3));
+		fail_at = (status == DMA_STATUS_CONFIG_ERROR) ? 0 : (rand() % (bcr / sizeof(int16_t)));
+	}
+
+	for(uint32_t i = 0; bcr; i++)
+	{
+		if(i == fail_at)
+		{
+			sim_conversion++;		// The conversion the failed transfer was moving is gone
+			break;
+		}
+		*dest = (int16_t)sim_conversion;
+		sim_index[dest - sim_buffer] = sim_conversion++;
+		dest++;
+		bcr -= sizeof(int16_t);
+	}
+
+	uint32_t flags = DMA_DSR_BCR_DONE_MASK;
+	flags |= (status == DMA_STATUS_CONFIG_ERROR) ? DMA_DSR_BCR_CE_MASK : 0;
+	flags |= (status == DMA_STATUS_SOURCE_BUS_ERROR) ? DMA_DSR_BCR_BES_MASK : 0;
+	flags |= (status == DMA_STATUS_DEST_BUS_ERROR) ? DMA_DSR_BCR_BED_MASK : 0;
+	dma->DMA[DMA_CHANNEL_0].DSR_BCR = flags | DMA_DSR_BCR_BCR(bcr);
+
+	return status;
+}
+
+// A held block still has the conversions it was published with
+static uint32_t sim_check(blockpool_block* block)
+{
+	uint32_t offset = (uint32_t)(block->samples - sim_buffer);
+
+	for(uint8_t i = 0; i < block->count; i++)
+	{
+		if(	(sim_index[offset + i] != (uint32_t)(block->first_sample + i))		|
+			(block->samples[i] != (int16_t)(block->first_sample + i))			)
+		{
+			fprintf(stderr, "sequence %u: sample %u is conversion %u, first_sample %llu\n", block->sequence, i,
+					sim_index[offset + i], (unsigned long long)block->first_sample);
+			return 1;
+		}
+	}
+
+	return 0;
+}
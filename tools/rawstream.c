@@ -0,0 +1,503 @@
+/*
+ * rawstream.c
+ *
+ *  Created on: Dec 15, 2018
+ *      Author: Dominic Doty
+ *
+ * Host side of the compressed raw sample stream (ENABLE_RAW_STREAM in main.c).
+ * Built from the same compress.c/telemetry.c the firmware uses so the round trip is bit exact.
+ *
+ * Capture info frames (ADC setup, rate, block size) go to stderr, and into the header with -c.
+ * Shell replies sent while the stream is on come as text frames and go to stderr too.
+ *
+ * Build:
+ *   gcc -O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o rawstream rawstream.c \
+ *       ../source/compress.c ../source/telemetry.c ../source/capture.c
+ *
+ * Use:
+ *   rawstream [-b] < capture.bin > samples.csv		decode a UART capture (-b writes int16 LE instead of CSV)
+ *   rawstream -x [-b] < capture.bin > hires.csv		decode the ENABLE_OVERSAMPLE stream (-b writes int32 LE)
+ *   rawstream -c capture.cap < capture.bin				decode into a capture file (captool), readable while it grows
+ *   rawstream -e [-n block] [-r rate] < samples.raw > frames.bin	encode int16 LE samples the way the firmware does
+ *   (-r starts with an info frame carrying the rate and block size)
+ *
+ * Round trip check:
+ *   rawstream -e < samples.raw | rawstream -b | cmp - samples.raw
+ *   rawstream -T [-s seed]		self test, exit code 0 is a pass - every block size 1-255 through the encoder,
+ *   a frame and the parser and back, on patterns that make every predictor order, the Rice escape and the
+ *   verbatim fallback come up (held to it), with INT16_MIN/INT16_MAX runs and full scale square waves
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "compress.h"
+#include "telemetry.h"
+#include "capture.h"
+
+/* DEFINES AND STATIC DATA */
+#define RAWSTREAM_DEFAULT_BLOCK	64
+#define RAWSTREAM_MAX_BLOCK		255
+#define TEST_PATTERNS			10
+#define TEST_RANDOM_BLOCKS		20000
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static int rawstream_encode(uint8_t block_size, uint32_t sample_rate);
+static int rawstream_decode(bool binary, bool hires, const char* capture_path);
+static void rawstream_info(const capture_info* info);
+static int rawstream_test(void);
+static uint32_t test_block(const int16_t* samples, uint8_t count, uint64_t index);
+static void test_fill(int16_t* samples, uint8_t count, uint8_t pattern);
+static bool test_escaped(const uint8_t* block, const int16_t* samples, uint8_t count);
+
+static uint32_t test_methods[COMPRESS_METHOD_VERBATIM + 1];
+static uint32_t test_escapes = 0;
+static uint32_t failures = 0;
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	bool encode = false;
+	bool binary = false;
+	bool hires = false;
+	bool self_test = false;
+	int block_size = RAWSTREAM_DEFAULT_BLOCK;
+	uint32_t sample_rate = 0;
+	const char* capture_path = NULL;
+	int opt;
+
+	while((opt = getopt(argc, argv, "ebxn:r:c:Ts:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'e':
+				encode = true;
+				break;
+			case 'b':
+				binary = true;
+				break;
+			case 'x':
+				hires = true;
+				break;
+			case 'n':
+				block_size = atoi(optarg);
+				break;
+			case 'r':
+				sample_rate = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				capture_path = optarg;
+				break;
+			case 'T':
+				self_test = true;
+				break;
+			case 's':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-x] [-b | -c capture.cap] | -e [-n block] [-r rate] | -T [-s seed]\n",
+						argv[0]);
+				return 2;
+		}
+	}
+
+	if(self_test)
+	{
+		return rawstream_test();
+	}
+
+	if((block_size < 1) | (block_size > RAWSTREAM_MAX_BLOCK))
+	{
+		fprintf(stderr, "block size must be 1-%d\n", RAWSTREAM_MAX_BLOCK);
+		return 2;
+	}
+
+	if(capture_path && hires)
+	{
+		fprintf(stderr, "capture files hold int16 samples, not the hires stream\n");
+		return 2;
+	}
+
+	return encode ? rawstream_encode((uint8_t)block_size, sample_rate) : rawstream_decode(binary, hires, capture_path);
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// int16 LE in, telemetry frames out, compression stats on stderr
+static int rawstream_encode(uint8_t block_size, uint32_t sample_rate)
+{
+	static uint8_t frame[TELEMETRY_FRAME_BYTES(TELEMETRY_INDEX_BYTES + COMPRESS_MAX_BYTES(RAWSTREAM_MAX_BLOCK))];
+	int16_t samples[RAWSTREAM_MAX_BLOCK];
+	uint8_t sequence = 0;
+	uint64_t sample_index = 0;
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	size_t count;
+
+	// The firmware leads with what the samples are, from here only the rate and block size are known
+	if(sample_rate)
+	{
+		capture_info info = {.source = CAPTURE_SOURCE_HOST, .sample_rate = sample_rate, .block_size = block_size};
+		uint16_t length = capture_info_pack(&info, telemetry_payload(frame));
+		fwrite(frame, 1, telemetry_frame_close(frame, TELEMETRY_TYPE_CAPTURE_INFO, 0, length), stdout);
+	}
+
+	while((count = fread(samples, sizeof(int16_t), block_size, stdin)) > 0)
+	{
+		uint8_t* payload = telemetry_put_index(telemetry_payload(frame), sample_index);
+		uint16_t length = TELEMETRY_INDEX_BYTES + compress_encode_block(samples, (uint8_t)count, payload);
+		uint16_t frame_length = telemetry_frame_close(frame, TELEMETRY_TYPE_RAW_BLOCK, sequence++, length);
+		sample_index += count;
+		fwrite(frame, 1, frame_length, stdout);
+		bytes_in += count * sizeof(int16_t);
+		bytes_out += frame_length;
+	}
+
+	if(bytes_in)
+	{
+		fprintf(stderr, "%llu -> %llu bytes (%.2f bits/sample on the wire)\n",
+				(unsigned long long)bytes_in, (unsigned long long)bytes_out,
+				(8.0 * bytes_out) / (bytes_in / sizeof(int16_t)));
+	}
+
+	return 0;
+}
+
+// Telemetry frames in, samples out, gaps and bad frames on stderr
+// The sample column is the firmware's own index, so dropped frames and DMA gaps show up as jumps in it
+static int rawstream_decode(bool binary, bool hires, const char* capture_path)
+{
+	static telemetry_parser parser;
+	int16_t samples[RAWSTREAM_MAX_BLOCK];
+	int32_t hires_samples[TELEMETRY_MAX_PAYLOAD / 4];
+	telemetry_type wanted = hires ? TELEMETRY_TYPE_HIRES_BLOCK : TELEMETRY_TYPE_RAW_BLOCK;
+	uint64_t sample_index = 0;
+	uint32_t blocks = 0;
+	uint32_t bad_blocks = 0;
+	uint32_t missing_blocks = 0;
+	uint64_t missing_samples = 0;
+	uint8_t expected_sequence = 0;
+	capture_info info;
+	uint8_t info_bytes[CAPTURE_INFO_BYTES] = {0};
+	capture_writer capture;
+	int c;
+
+	telemetry_parser_init(&parser);
+	if(capture_path)
+	{
+		capture_writer_config capture_fig = CAPTURE_WRITER_CONFIG_DEFAULT;
+		capture_fig.path = capture_path;
+		if(capture_create(&capture, &capture_fig) != CAPTURE_ERROR_SUCCESS)
+		{
+			fprintf(stderr, "cannot create %s\n", capture_path);
+			return 1;
+		}
+	}
+
+	while((c = getchar()) != EOF)
+	{
+		if(!telemetry_parse_byte(&parser, (uint8_t)c))
+		{
+			continue;
+		}
+
+		// Info comes again every 256 raw frames, only a change is news
+		if(	(telemetry_frame_type(parser.frame) == TELEMETRY_TYPE_CAPTURE_INFO)							&&
+			capture_info_unpack(telemetry_payload(parser.frame), telemetry_frame_length(parser.frame), &info)	&&
+			memcmp(telemetry_payload(parser.frame), info_bytes, CAPTURE_INFO_BYTES)							)
+		{
+			memcpy(info_bytes, telemetry_payload(parser.frame), CAPTURE_INFO_BYTES);
+			rawstream_info(&info);
+			if(capture_path)
+			{
+				capture_set_info(&capture, &info);
+			}
+		}
+
+		// Shell replies
+		if(telemetry_frame_type(parser.frame) == TELEMETRY_TYPE_TEXT)
+		{
+			fwrite(telemetry_payload(parser.frame), 1, telemetry_frame_length(parser.frame), stderr);
+		}
+
+		if(telemetry_frame_type(parser.frame) != wanted)
+		{
+			continue;
+		}
+
+		uint8_t sequence = telemetry_frame_sequence(parser.frame);
+		if(blocks && (sequence != expected_sequence))
+		{
+			uint8_t gap = sequence - expected_sequence;
+			missing_blocks += gap;
+			fprintf(stderr, "gap of %u frames after sample %llu\n", gap, (unsigned long long)sample_index);
+		}
+		expected_sequence = sequence + 1;
+
+		// Index of the frame's first sample, after extra_bits on the hires stream
+		uint8_t* payload = telemetry_payload(parser.frame);
+		uint16_t header = hires ? (1 + TELEMETRY_INDEX_BYTES) : TELEMETRY_INDEX_BYTES;
+		if(telemetry_frame_length(parser.frame) < header)
+		{
+			bad_blocks++;
+			continue;
+		}
+		uint64_t index = telemetry_get_index(hires ? &payload[1] : payload);
+		if(blocks && (index != sample_index))
+		{
+			fprintf(stderr, "gap of %lld samples before sample %llu\n",
+					(long long)(index - sample_index), (unsigned long long)index);
+			missing_samples += index - sample_index;
+		}
+		sample_index = index;
+		blocks++;
+
+		if(hires)
+		{
+			// extra_bits, index, then int32 LE samples in 1/2^extra_bits LSBs
+			uint16_t count = (telemetry_frame_length(parser.frame) - header) / 4;
+			for(uint16_t i = 0; i < count; i++)
+			{
+				uint8_t* ptr = &payload[header + (i * 4)];
+				hires_samples[i] = (int32_t)(ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+			}
+
+			if(binary)
+			{
+				fwrite(hires_samples, sizeof(int32_t), count, stdout);
+			}
+			else
+			{
+				for(uint16_t i = 0; i < count; i++)
+				{
+					printf("%llu,%d,%u\n", (unsigned long long)(sample_index + i), hires_samples[i], payload[0]);
+				}
+			}
+			sample_index += count;
+			continue;
+		}
+
+		int16_t count = compress_decode_block(&payload[header], telemetry_frame_length(parser.frame) - header,
+											samples, RAWSTREAM_MAX_BLOCK);
+		if(count < 0)
+		{
+			bad_blocks++;
+			continue;
+		}
+
+		if(capture_path)
+		{
+			struct timespec now;
+			clock_gettime(CLOCK_REALTIME, &now);
+			capture_append(&capture, samples, (uint32_t)count, sample_index,
+							((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec);
+		}
+		else if(binary)
+		{
+			fwrite(samples, sizeof(int16_t), count, stdout);
+		}
+		else
+		{
+			for(int16_t i = 0; i < count; i++)
+			{
+				printf("%llu,%d\n", (unsigned long long)(sample_index + i), samples[i]);
+			}
+		}
+		sample_index += count;
+	}
+
+	fprintf(stderr, "%u blocks, last sample %llu, %u missing blocks, %llu missing samples, %u bad blocks, %u bad frames\n",
+			blocks, (unsigned long long)sample_index, missing_blocks, (unsigned long long)missing_samples,
+			bad_blocks, parser.bad_frames);
+	if(capture_path && (capture_finish(&capture) != CAPTURE_ERROR_SUCCESS))
+	{
+		fprintf(stderr, "%s: write failed\n", capture_path);
+		return 1;
+	}
+
+	return (bad_blocks | parser.bad_frames) ? 1 : 0;
+}
+
+// What the samples are, the ADC fields are adc_init_config enum values
+static void rawstream_info(const capture_info* info)
+{
+	fprintf(stderr, "info: %u Hz, block %u", info->sample_rate, info->block_size);
+	if(info->source == CAPTURE_SOURCE_FIRMWARE)
+	{
+		fprintf(stderr, ", channel %u bits %u avg %u clock %u/%u cycles+ %u", info->channel, info->bits, info->avg_samps,
+				info->clock, info->clock_div, info->sample_cycle_add);
+	}
+	fprintf(stderr, "\n");
+}
+
+// Every block size and pattern, then random ones, and every coding path has to have come up
+static int rawstream_test(void)
+{
+	int16_t samples[RAWSTREAM_MAX_BLOCK];
+	uint64_t index = 0;
+
+	for(uint16_t count = 1; count <= RAWSTREAM_MAX_BLOCK; count++)
+	{
+		for(uint8_t pattern = 0; pattern < TEST_PATTERNS; pattern++)
+		{
+			test_fill(samples, (uint8_t)count, pattern);
+			index += test_block(samples, (uint8_t)count, index);
+		}
+	}
+	for(uint32_t b = 0; b < TEST_RANDOM_BLOCKS; b++)
+	{
+		uint8_t count = 1 + (rand() % RAWSTREAM_MAX_BLOCK);
+		test_fill(samples, count, rand() % TEST_PATTERNS);
+		index += test_block(samples, count, index);
+	}
+
+	static const char* names[] = {"order 0", "order 1", "order 2", "verbatim"};
+	for(uint8_t m = 0; m <= COMPRESS_METHOD_VERBATIM; m++)
+	{
+		printf("%s %u blocks\n", names[m], test_methods[m]);
+		if(test_methods[m] == 0)
+		{
+			fprintf(stderr, "%s never came up\n", names[m]);
+			failures++;
+		}
+	}
+	printf("rice escapes in %u blocks\n", test_escapes);
+	if(test_escapes == 0)
+	{
+		fprintf(stderr, "the rice escape never came up\n");
+		failures++;
+	}
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+// One block as the firmware sends it - encode, frame, parse byte at a time, decode, compare
+static uint32_t test_block(const int16_t* samples, uint8_t count, uint64_t index)
+{
+	static uint8_t frame[TELEMETRY_FRAME_BYTES(TELEMETRY_INDEX_BYTES + COMPRESS_MAX_BYTES(RAWSTREAM_MAX_BLOCK))];
+	static telemetry_parser parser;
+	int16_t decoded[RAWSTREAM_MAX_BLOCK];
+	volatile int16_t block[RAWSTREAM_MAX_BLOCK];
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		block[i] = samples[i];
+	}
+	uint8_t* payload = telemetry_put_index(telemetry_payload(frame), index);
+	uint16_t encoded = compress_encode_block(block, count, payload);
+	uint16_t frame_length = telemetry_frame_close(frame, TELEMETRY_TYPE_RAW_BLOCK, (uint8_t)index,
+													TELEMETRY_INDEX_BYTES + encoded);
+
+	test_methods[COMPRESS_METHOD(payload[0])]++;
+	test_escapes += test_escaped(payload, samples, count);
+
+	bool parsed = false;
+	telemetry_parser_init(&parser);
+	for(uint16_t i = 0; i < frame_length; i++)
+	{
+		parsed = telemetry_parse_byte(&parser, frame[i]);
+	}
+
+	int16_t decoded_count = -1;
+	if(parsed)
+	{
+		uint8_t* got = telemetry_payload(parser.frame);
+		decoded_count = compress_decode_block(&got[TELEMETRY_INDEX_BYTES],
+								telemetry_frame_length(parser.frame) - TELEMETRY_INDEX_BYTES, decoded, RAWSTREAM_MAX_BLOCK);
+		parsed = (telemetry_get_index(got) == index);
+	}
+
+	if(	(encoded > COMPRESS_MAX_BYTES(count))						||
+		!parsed														||
+		(decoded_count != count)									||
+		memcmp(decoded, samples, count * sizeof(int16_t))			)
+	{
+		if(failures++ < 20)
+		{
+			fprintf(stderr, "block of %u at %llu (method %u, %u bytes): %s\n", count, (unsigned long long)index,
+					COMPRESS_METHOD(payload[0]), encoded, parsed ? "decoded wrong" : "frame rejected");
+		}
+	}
+
+	return count;
+}
+
+// 0 silence, 1 ramp, 2 parabola, 3 quiet noise, 4 full scale noise, 5 all INT16_MIN, 6 all INT16_MAX,
+// 7 INT16_MIN/MAX square of a random period, 8 lone full scale spike in silence, 9 quiet noise with spikes
+static void test_fill(int16_t* samples, uint8_t count, uint8_t pattern)
+{
+	uint8_t period = 1 + (rand() % 8);
+	uint8_t spike = rand() % count;
+	int16_t step = (int16_t)((rand() % 512) - 256);
+	int32_t curve = 1 + (rand() % 3);
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		int16_t x = 0;
+		switch(pattern)
+		{
+			case 1:
+				x = (int16_t)(step * i);
+				break;
+			case 2:
+				x = (int16_t)(curve * (i - (count / 2)) * (i - (count / 2)) - 16000);
+				break;
+			case 3:
+				x = (int16_t)((rand() % 33) - 16);
+				break;
+			case 4:
+				x = (int16_t)(rand() & 0xFFFF);
+				break;
+			case 5:
+				x = INT16_MIN;
+				break;
+			case 6:
+				x = INT16_MAX;
+				break;
+			case 7:
+				x = ((i / period) & 1) ? INT16_MIN : INT16_MAX;
+				break;
+			case 8:
+				x = (i == spike) ? ((rand() & 1) ? INT16_MIN : INT16_MAX) : 0;
+				break;
+			case 9:
+				x = (rand() % 40) ? (int16_t)((rand() % 9) - 4) : (int16_t)(rand() & 0xFFFF);
+				break;
+			default:
+				break;
+		}
+		samples[i] = x;
+	}
+}
+
+// Any residual the block's method and k send as an escape
+static bool test_escaped(const uint8_t* block, const int16_t* samples, uint8_t count)
+{
+	compress_method method = COMPRESS_METHOD(block[0]);
+	uint8_t k = COMPRESS_RICE_K(block[0]);
+	bool escaped = false;
+
+	for(uint8_t i = (uint8_t)method; (method != COMPRESS_METHOD_VERBATIM) && (i < count); i++)
+	{
+		int32_t e = samples[i];
+		if(method == COMPRESS_METHOD_ORDER_1)
+		{
+			e = samples[i] - samples[i - 1];
+		}
+		else if(method == COMPRESS_METHOD_ORDER_2)
+		{
+			e = samples[i] - (2 * samples[i - 1]) + samples[i - 2];
+		}
+		uint32_t u = ((uint32_t)e << 1) ^ (uint32_t)(e >> 31);
+		escaped |= ((u >> k) >= COMPRESS_ESCAPE_QUOTIENT);
+	}
+
+	return escaped;
+}
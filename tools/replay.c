@@ -0,0 +1,319 @@
+/*
+ * replay.c
+ *
+ *  Created on: Dec 16, 2018
+ *      Author: Dominic Doty
+ *
+ * Runs a WAV or CSV recording through the same double buffer swap and pipeline_process_block()
+ * chain as main.c, one BUFF_HALF_SIZE block at a time, as fast as the host can go.
+ *
+ * Build:
+ *   gcc -O2 -DCPU_MKL25Z128VFM4 -I../include -I../CMSIS -I../drivers -o replay replay.c \
+ *       ../source/pipeline.c ../source/peak_detect.c ../source/trigger.c ../source/telemetry.c \
+ *       ../source/goertzel.c ../source/format.c ../source/histogram.c -lm
+ *
+ * Use:
+ *   replay [-t] [-c channel] recording.wav > blocks.csv
+ *   replay [-t] samples.csv > blocks.csv		(first integer column, non numeric lines skipped)
+ *   -t writes TELEMETRY_TYPE_METER frames instead of CSV
+ *   -k chunk runs each block through pipeline_process_chunk a chunk at a time (ENABLE_LOW_LATENCY), the output
+ *      should be byte for byte the same as without it
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pipeline.h"
+#include "telemetry.h"
+
+/* DEFINES AND STATIC DATA */
+#define REPLAY_LINE_MAX		256
+#define REPLAY_SAMPLE_RATE	27000
+
+// Recording Source
+typedef struct
+{
+	FILE* file;
+	bool wav;
+	uint16_t channels;
+	uint16_t channel;
+	uint16_t bits;
+	uint32_t sample_rate;
+	uint32_t data_remaining;
+} replay_source;
+
+// Same buffer layout as main.c, filled by replay_dma_fill() instead of the DMA
+static volatile int16_t buffer[BUFF_DOUBLE_SIZE];
+static volatile bool active_DMA_buffer = 0;
+static volatile void* const buffer_ptr_lut[] = {&buffer[0], &buffer[BUFF_HALF_SIZE]};
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static bool replay_open(replay_source* source, const char* path, uint16_t channel);
+static bool replay_next_sample(replay_source* source, int16_t* sample);
+static bool replay_dma_fill(replay_source* source, volatile int16_t* dest, uint8_t count);
+static uint32_t replay_read_le(uint8_t* bytes, uint8_t count);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	bool telemetry = false;
+	uint16_t channel = 0;
+	uint8_t chunk = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "tc:k:")) != -1)
+	{
+		switch(opt)
+		{
+			case 't':
+				telemetry = true;
+				break;
+			case 'c':
+				channel = (uint16_t)atoi(optarg);
+				break;
+			case 'k':
+				chunk = (uint8_t)atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-t] [-c channel] [-k chunk] recording.(wav|csv)\n", argv[0]);
+				return 2;
+		}
+	}
+
+	replay_source source;
+	if((optind >= argc) || !replay_open(&source, argv[optind], channel))
+	{
+		fprintf(stderr, "cannot open recording\n");
+		return 1;
+	}
+
+	// CSV has no rate, assume the default ADC setup (ENABLE_GOERTZEL needs a rate)
+	if(pipeline_init(source.sample_rate ? source.sample_rate : REPLAY_SAMPLE_RATE) != PIPELINE_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "pipeline init failed\n");
+		return 1;
+	}
+
+	static uint8_t frame[TELEMETRY_FRAME_BYTES(PIPELINE_OUTPUT_BYTES)];
+	bool last_active_DMA_buffer = active_DMA_buffer;
+	pipeline_output output;
+	uint32_t blocks = 0;
+	clock_t start = clock();
+
+	if(!telemetry)
+	{
+		printf("block,first_sample,block_max,peak_counts,dbfs,trigger_count");
+		for(uint8_t i = 0; pipeline_tones() && (i < pipeline_tones()->config.tone_count); i++)
+		{
+			printf(",tone_%u", pipeline_tones()->config.frequencies[i]);
+		}
+		printf("\n");
+	}
+
+	// "DMA" fills the active half, "ISR" swaps, main loop processes the half that just completed
+	while(replay_dma_fill(&source, buffer_ptr_lut[active_DMA_buffer], BUFF_HALF_SIZE))
+	{
+		active_DMA_buffer = !active_DMA_buffer;
+
+		if(active_DMA_buffer != last_active_DMA_buffer)
+		{
+			output.first_sample = (uint64_t)blocks * BUFF_HALF_SIZE;
+			if(chunk)
+			{
+				volatile int16_t* half = buffer_ptr_lut[last_active_DMA_buffer];
+				for(uint8_t done = 0; done < BUFF_HALF_SIZE; done += chunk)
+				{
+					pipeline_process_chunk(&half[done], MIN(chunk, BUFF_HALF_SIZE - done));
+				}
+				pipeline_finish_block(half, BUFF_HALF_SIZE, &output);
+			}
+			else
+			{
+				pipeline_process_block(buffer_ptr_lut[last_active_DMA_buffer], BUFF_HALF_SIZE, &output);
+			}
+
+			if(telemetry)
+			{
+				uint16_t length = pipeline_output_pack(&output, telemetry_payload(frame));
+				fwrite(frame, 1, telemetry_frame_close(frame, TELEMETRY_TYPE_METER, (uint8_t)blocks, length), stdout);
+			}
+			else
+			{
+				printf("%u,%llu,%u,%u,%u,%u", blocks, (unsigned long long)output.first_sample,
+						output.block_max, output.peak_counts, output.dbfs, output.trigger_count);
+				for(uint8_t i = 0; i < output.tone_count; i++)
+				{
+					printf(",%u", output.tone_dbfs[i]);
+				}
+				printf("\n");
+			}
+
+			blocks++;
+			last_active_DMA_buffer = !last_active_DMA_buffer;
+		}
+
+		// Idle time - main.c streams trigger snapshots here, drain them so the trigger re-arms the same way
+		int16_t* snap_samples;
+		while(pipeline_trigger() && trigger_stream_next(pipeline_trigger(), &snap_samples, BUFF_HALF_SIZE));
+	}
+
+	double wall = (double)(clock() - start) / CLOCKS_PER_SEC;
+	fprintf(stderr, "%u blocks (%llu samples) in %.3f s", blocks, (unsigned long long)blocks * BUFF_HALF_SIZE, wall);
+	if(source.sample_rate && (wall > 0))
+	{
+		double recorded = (double)blocks * BUFF_HALF_SIZE / source.sample_rate;
+		fprintf(stderr, ", %.1f s of signal, %.0fx real time", recorded, recorded / wall);
+	}
+	fprintf(stderr, "\n");
+
+	// Whole recording levels from the pipeline histogram, same numbers as the hist command
+	if(pipeline_histogram() && pipeline_histogram()->total)
+	{
+		fprintf(stderr, "L10 -%.2f dBFS, L50 -%.2f dBFS, L90 -%.2f dBFS\n",
+				dbfs_output(histogram_level(pipeline_histogram(), 10)) / 100.0,
+				dbfs_output(histogram_level(pipeline_histogram(), 50)) / 100.0,
+				dbfs_output(histogram_level(pipeline_histogram(), 90)) / 100.0);
+	}
+
+	fclose(source.file);
+	return 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Open a WAV (PCM 8/16/24/32 bit, any channel count) or fall back to CSV
+static bool replay_open(replay_source* source, const char* path, uint16_t channel)
+{
+	memset(source, 0, sizeof(*source));
+	source->file = fopen(path, "rb");
+	if(source->file == NULL)
+	{
+		return false;
+	}
+
+	uint8_t riff[12];
+	if((fread(riff, 1, sizeof(riff), source->file) != sizeof(riff)) ||
+		memcmp(riff, "RIFF", 4) || memcmp(&riff[8], "WAVE", 4))
+	{
+		rewind(source->file);
+		return true;	// CSV
+	}
+
+	// Walk the chunks for fmt and data
+	uint8_t chunk[8];
+	while(fread(chunk, 1, sizeof(chunk), source->file) == sizeof(chunk))
+	{
+		uint32_t size = replay_read_le(&chunk[4], 4);
+
+		if(!memcmp(chunk, "fmt ", 4))
+		{
+			uint8_t fmt[16];
+			if((size < sizeof(fmt)) || (fread(fmt, 1, sizeof(fmt), source->file) != sizeof(fmt)))
+			{
+				return false;
+			}
+			uint16_t format = replay_read_le(&fmt[0], 2);
+			source->channels = replay_read_le(&fmt[2], 2);
+			source->sample_rate = replay_read_le(&fmt[4], 4);
+			source->bits = replay_read_le(&fmt[14], 2);
+			if(((format != 1) && (format != 0xFFFE)) || (source->bits % 8) || (source->bits > 32) ||
+				(channel >= source->channels))
+			{
+				fprintf(stderr, "unsupported WAV format\n");
+				return false;
+			}
+			fseek(source->file, (size - sizeof(fmt)) + (size & 1U), SEEK_CUR);
+		}
+		else if(!memcmp(chunk, "data", 4))
+		{
+			source->wav = (source->bits != 0);
+			source->channel = channel;
+			source->data_remaining = size;
+			return source->wav;
+		}
+		else
+		{
+			fseek(source->file, size + (size & 1U), SEEK_CUR);
+		}
+	}
+
+	return false;
+}
+
+// Next sample of the selected channel as the ADC would give it (signed 16 bit)
+static bool replay_next_sample(replay_source* source, int16_t* sample)
+{
+	if(source->wav)
+	{
+		uint8_t bytes_per_sample = source->bits / 8;
+		uint8_t frame[4 * 16];
+		uint32_t frame_bytes = (uint32_t)bytes_per_sample * source->channels;
+
+		if((frame_bytes > source->data_remaining) || (frame_bytes > sizeof(frame)) ||
+			(fread(frame, 1, frame_bytes, source->file) != frame_bytes))
+		{
+			return false;
+		}
+		source->data_remaining -= frame_bytes;
+
+		// Keep the top 16 bits, 8 bit WAV is offset binary
+		uint32_t raw = replay_read_le(&frame[source->channel * bytes_per_sample], bytes_per_sample);
+		if(bytes_per_sample == 1)
+		{
+			*sample = (int16_t)((raw ^ 0x80U) << 8);
+		}
+		else
+		{
+			*sample = (int16_t)(raw >> (source->bits - 16));
+		}
+		return true;
+	}
+
+	char line[REPLAY_LINE_MAX];
+	while(fgets(line, sizeof(line), source->file))
+	{
+		char* end;
+		long value = strtol(line, &end, 10);
+		if(end != line)
+		{
+			*sample = (int16_t)MAX(MIN(value, INT16_MAX), INT16_MIN);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Stand in for one DMA half buffer transfer, false when the recording cannot fill a whole block
+static bool replay_dma_fill(replay_source* source, volatile int16_t* dest, uint8_t count)
+{
+	for(uint8_t i = 0; i < count; i++)
+	{
+		int16_t sample;
+		if(!replay_next_sample(source, &sample))
+		{
+			return false;
+		}
+		dest[i] = sample;
+	}
+
+	return true;
+}
+
+// Little endian field from a byte array
+static uint32_t replay_read_le(uint8_t* bytes, uint8_t count)
+{
+	uint32_t value = 0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		value |= (uint32_t)bytes[i] << (8 * i);
+	}
+
+	return value;
+}
@@ -0,0 +1,472 @@
+/*
+ * rtt_read.c
+ *
+ *  Created on: Dec 23, 2018
+ *      Author: Dominic Doty
+ *
+ * Host side of the RTT console (ENABLE_RTT in rtt.h). Finds the control block the way a probe does,
+ * by scanning for the id, and reads the up rings through a load callback, so the same reader works on
+ * a RAM dump (e.g. "dump_image ram.bin 0x1ffff000 0x4000" in OpenOCD) and on a simulated target.
+ *
+ * The simulation links the firmware's rtt.c and telemetry.c. A producer writes frames and text lines
+ * of random sizes while a probe that polls at random intervals (and stalls now and then) drains the
+ * rings and feeds the shell's down ring. Checks that every frame arrives intact and in order, that
+ * the sequence gaps match the drop counter, that text lines are never cut in SKIP mode, that TRIM
+ * fills the ring exactly, that BLOCK gives up with no probe reading and blocks again once it reads,
+ * and that down ring bytes arrive in order across the wrap.
+ *
+ * Build:
+ *   gcc -O2 -no-pie -I../include -o rtt_read rtt_read.c ../source/rtt.c ../source/telemetry.c
+ *   (-no-pie keeps the simulated rings below 4 GB so the 32 bit descriptor addresses are usable)
+ *
+ * Use:
+ *   rtt_read -f ram.bin -a 0x1ffff000 -l				list the channels in a dump
+ *   rtt_read -f ram.bin -a 0x1ffff000 [-c channel] > out	pending bytes of an up channel
+ *   rtt_read -f ram.bin -a 0x1ffff000 -c 1 | rawstream	telemetry ring straight into the decoder
+ *   rtt_read -s [-n records] [-r seed] [-w ram.bin]		simulation, exit code 0 is a pass (-w saves a dump)
+ */
+
+/* INCLUDES */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rtt.h"
+#include "telemetry.h"
+
+/* DEFINES AND STATIC DATA */
+#define READ_MAX_DUMP		(1024 * 1024)
+#define READ_SIM_PAYLOAD	200
+#define READ_SIM_STALL		160		// Records the probe can sleep through, enough to overflow both rings
+
+// Where the reader gets target memory from
+typedef struct
+{
+	const uint8_t* image;		// NULL reads host memory at the target address (simulation)
+	uint32_t base;
+	uint32_t size;
+	bool write_back;			// Probe side index updates go back to the target
+} read_target;
+
+// Probe side of the simulation
+typedef struct
+{
+	telemetry_parser parser;
+	uint32_t frames;
+	uint32_t missing_frames;
+	uint8_t next_sequence;
+	char text[64];
+	uint16_t text_length;
+	uint32_t lines;
+	uint32_t missing_lines;
+	uint32_t next_line;
+	uint32_t failures;
+} read_sim;
+
+static uint8_t read_dump[READ_MAX_DUMP];
+
+
+/* STATIC FUNCTION DECLARATIONS */
+static bool read_load(read_target* target, uint32_t address, void* data, uint32_t length);
+static bool read_find(read_target* target, uint32_t start, uint32_t length, uint32_t* control);
+static bool read_ring(read_target* target, uint32_t control, bool up, uint8_t channel, rtt_ring* ring, uint32_t* address);
+static uint32_t read_drain(read_target* target, uint32_t control, uint8_t channel, uint8_t* data, uint32_t max);
+static uint32_t read_put(read_target* target, uint32_t control, uint8_t channel, const uint8_t* data, uint32_t length);
+static int read_list(read_target* target, uint32_t control);
+static int read_simulate(uint32_t records, const char* dump_file);
+static void read_sim_poll(read_sim* sim, read_target* target, uint32_t control);
+
+
+/* FUNCTION DEFINITIONS */
+int main(int argc, char** argv)
+{
+	const char* file = NULL;
+	const char* dump_file = NULL;
+	uint32_t base = 0x1FFFF000UL;
+	uint32_t records = 20000;
+	int channel = RTT_UP_TERMINAL;
+	bool list = false;
+	bool simulate = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "f:a:c:lsn:r:w:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'f':
+				file = optarg;
+				break;
+			case 'a':
+				base = strtoul(optarg, NULL, 0);
+				break;
+			case 'c':
+				channel = atoi(optarg);
+				break;
+			case 'l':
+				list = true;
+				break;
+			case 's':
+				simulate = true;
+				break;
+			case 'n':
+				records = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				srand(strtoul(optarg, NULL, 10));
+				break;
+			case 'w':
+				dump_file = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s -f dump -a base [-l | -c channel] | -s [-n records] [-r seed] [-w dump]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	if(simulate)
+	{
+		return read_simulate(records, dump_file);
+	}
+
+	FILE* in = file ? fopen(file, "rb") : NULL;
+	if(in == NULL)
+	{
+		fprintf(stderr, "need a dump file (-f)\n");
+		return 2;
+	}
+	read_target target = {read_dump, base, (uint32_t)fread(read_dump, 1, sizeof(read_dump), in), false};
+	fclose(in);
+
+	uint32_t control;
+	if(!read_find(&target, base, target.size, &control))
+	{
+		fprintf(stderr, "no control block in %u bytes from 0x%08x\n", (unsigned)target.size, (unsigned)base);
+		return 1;
+	}
+
+	if(list)
+	{
+		return read_list(&target, control);
+	}
+
+	static uint8_t data[READ_MAX_DUMP];
+	uint32_t count = read_drain(&target, control, (uint8_t)channel, data, sizeof(data));
+	fwrite(data, 1, count, stdout);
+
+	return 0;
+}
+
+
+/* STATIC FUNCTION DEFINITIONS */
+
+// Copy target memory, false if any of it is outside the dump
+static bool read_load(read_target* target, uint32_t address, void* data, uint32_t length)
+{
+	bool ret = true;
+
+	if(target->image == NULL)
+	{
+		memcpy(data, (void*)(uintptr_t)address, length);
+	}
+	else if((address < target->base) | ((uint64_t)address + length > (uint64_t)target->base + target->size))
+	{
+		ret = false;
+	}
+	else
+	{
+		memcpy(data, &target->image[address - target->base], length);
+	}
+
+	return ret;
+}
+
+// Scan for the id on 4 byte boundaries like the probes do
+static bool read_find(read_target* target, uint32_t start, uint32_t length, uint32_t* control)
+{
+	char id[RTT_ID_BYTES] = RTT_ID;
+	char candidate[RTT_ID_BYTES];
+
+	for(uint32_t offset = 0; (offset + RTT_ID_BYTES) <= length; offset += 4)
+	{
+		if(read_load(target, start + offset, candidate, RTT_ID_BYTES) && (memcmp(candidate, id, RTT_ID_BYTES) == 0))
+		{
+			*control = start + offset;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Fetch a descriptor and its target address, false for a channel the block does not have
+static bool read_ring(read_target* target, uint32_t control, bool up, uint8_t channel, rtt_ring* ring, uint32_t* address)
+{
+	int32_t counts[2];
+
+	if(!read_load(target, control + offsetof(rtt_control, up_count), counts, sizeof(counts)) ||
+		(channel >= (up ? counts[0] : counts[1])))
+	{
+		return false;
+	}
+
+	// The down rings follow however many up rings this build has
+	*address = control + offsetof(rtt_control, up) + ((up ? channel : (counts[0] + channel)) * sizeof(rtt_ring));
+
+	return read_load(target, *address, ring, sizeof(rtt_ring)) && (ring->size > 0) &&
+			(ring->read < ring->size) && (ring->write < ring->size);
+}
+
+// Take what is waiting on an up ring, and hand the space back when the target is live
+static uint32_t read_drain(read_target* target, uint32_t control, uint8_t channel, uint8_t* data, uint32_t max)
+{
+	rtt_ring ring;
+	uint32_t address;
+	uint32_t count = 0;
+
+	if(read_ring(target, control, true, channel, &ring, &address))
+	{
+		uint32_t read = ring.read;
+		count = RTT_RING_USED(ring.write, read, ring.size);
+		count = (count < max) ? count : max;
+
+		uint32_t first = ((ring.size - read) < count) ? (ring.size - read) : count;
+		if(	!read_load(target, ring.buffer + read, data, first)				||
+			!read_load(target, ring.buffer, &data[first], count - first)	)
+		{
+			count = 0;
+		}
+		else if(target->write_back)
+		{
+			read = (read + count) % ring.size;
+			((rtt_ring*)(uintptr_t)address)->read = read;
+		}
+	}
+
+	return count;
+}
+
+// Write to a down ring of a live target (simulation), returns what fit
+static uint32_t read_put(read_target* target, uint32_t control, uint8_t channel, const uint8_t* data, uint32_t length)
+{
+	rtt_ring ring;
+	uint32_t address;
+	uint32_t count = 0;
+
+	if(target->write_back && read_ring(target, control, false, channel, &ring, &address))
+	{
+		uint8_t* buffer = (uint8_t*)(uintptr_t)ring.buffer;
+		uint32_t write = ring.write;
+		count = RTT_RING_FREE(write, ring.read, ring.size);
+		count = (count < length) ? count : length;
+
+		for(uint32_t i = 0; i < count; i++)
+		{
+			buffer[write] = data[i];
+			write = (write + 1) % ring.size;
+		}
+		((rtt_ring*)(uintptr_t)address)->write = write;
+	}
+
+	return count;
+}
+
+// Channel table of a dump
+static int read_list(read_target* target, uint32_t control)
+{
+	printf("control block at 0x%08x\n", (unsigned)control);
+
+	for(uint8_t up = 0; up < 2; up++)
+	{
+		rtt_ring ring;
+		uint32_t address;
+
+		for(uint8_t channel = 0; read_ring(target, control, !up, channel, &ring, &address); channel++)
+		{
+			// Names are usually string literals in flash, a RAM dump will not have them
+			char name[24] = "?";
+			for(uint8_t i = 0; (i < sizeof(name) - 1) && read_load(target, ring.name + i, &name[i], 1) && name[i]; i++)
+			{
+				name[i + 1] = '\0';
+			}
+
+			printf("%s %u %-10s buffer 0x%08x size %5u write %5u read %5u pending %5u mode %u\n", up ? "down" : "up  ",
+					channel, name, (unsigned)ring.buffer, (unsigned)ring.size, (unsigned)ring.write, (unsigned)ring.read,
+					(unsigned)RTT_RING_USED(ring.write, ring.read, ring.size), (unsigned)(ring.flags & RTT_MODE_MASK));
+		}
+	}
+
+	return 0;
+}
+
+// Producer and polling probe against the firmware rtt.c, checked end to end
+static int read_simulate(uint32_t records, const char* dump_file)
+{
+	static read_sim sim;
+	static uint8_t frame[TELEMETRY_FRAME_BYTES(READ_SIM_PAYLOAD)];
+	char line[32];
+	uint32_t stall = 0;
+
+	rtt_init();
+	telemetry_parser_init(&sim.parser);
+
+	read_target target = {NULL, 0, 0, true};
+	uint32_t block = (uint32_t)(uintptr_t)rtt_control_block();
+	uint32_t control;
+	if(!read_find(&target, block & ~0xFFFUL, (block & 0xFFFUL) + sizeof(rtt_control), &control) || (control != block))
+	{
+		fprintf(stderr, "control block not found\n");
+		return 1;
+	}
+
+	for(uint32_t r = 0; r < records; r++)
+	{
+		// Target - one frame and one line per record, both SKIP so neither is ever cut
+		uint16_t length = 1 + (rand() % READ_SIM_PAYLOAD);
+		uint8_t* payload = telemetry_payload(frame);
+		for(uint16_t i = 0; i < length; i++)
+		{
+			payload[i] = (uint8_t)(r + i);
+		}
+		rtt_write(RTT_UP_TELEMETRY, frame, telemetry_frame_close(frame, TELEMETRY_TYPE_RAW_BLOCK, (uint8_t)r, length));
+		rtt_write(RTT_UP_TERMINAL, line, snprintf(line, sizeof(line), "line %u\n", (unsigned)r));
+
+		// Probe - polls about every fourth record, now and then sleeps long enough to overflow a ring
+		if(stall)
+		{
+			stall--;
+		}
+		else if((rand() % 4) == 0)
+		{
+			stall = ((rand() % 200) == 0) ? (rand() % READ_SIM_STALL) : 0;
+			read_sim_poll(&sim, &target, control);
+		}
+	}
+
+	// Whatever is still in the rings counts as delivered
+	read_sim_poll(&sim, &target, control);
+
+	// Sequence numbers are 8 bit, drops shorter than 256 frames are counted exactly
+	uint32_t failures = sim.failures;
+	failures += (sim.parser.bad_frames != 0) | ((sim.frames + rtt_dropped(RTT_UP_TELEMETRY)) != records);
+	failures += (sim.missing_frames != rtt_dropped(RTT_UP_TELEMETRY));
+	failures += ((sim.lines + rtt_dropped(RTT_UP_TERMINAL)) != records) | (sim.missing_lines != rtt_dropped(RTT_UP_TERMINAL));
+
+	// TRIM fills the ring exactly and reports the cut
+	rtt_control_block()->up[RTT_UP_TERMINAL].flags = RTT_MODE_TRIM;
+	uint32_t space = rtt_space(RTT_UP_TERMINAL);
+	uint32_t drops = rtt_dropped(RTT_UP_TERMINAL);
+	static uint8_t fill[RTT_UP_TERMINAL_SIZE * 2];
+	failures += (rtt_write(RTT_UP_TERMINAL, fill, sizeof(fill)) != space) | (rtt_space(RTT_UP_TERMINAL) != 0) |
+				(rtt_dropped(RTT_UP_TERMINAL) != (drops + 1));
+
+	// BLOCK with nobody reading - the full ring times out once, then writes skip at once until the probe reads
+	rtt_control_block()->up[RTT_UP_TERMINAL].flags = RTT_MODE_BLOCK;
+	failures += (rtt_write(RTT_UP_TERMINAL, fill, 8) != 0) | (rtt_write(RTT_UP_TERMINAL, fill, 8) != 0) |
+				(rtt_dropped(RTT_UP_TERMINAL) != (drops + 3));
+	uint8_t drained[RTT_UP_TERMINAL_SIZE];
+	failures += (read_drain(&target, control, RTT_UP_TERMINAL, drained, sizeof(drained)) != space);
+	failures += (rtt_write(RTT_UP_TERMINAL, fill, 8) != 8) | (rtt_dropped(RTT_UP_TERMINAL) != (drops + 3));
+
+	// Down ring - bytes go in and come out in order across several wraps
+	const char* command = "stats\r\nplacr\r\nhist reset\r\n";
+	uint32_t command_length = strlen(command);
+	uint32_t sent = 0;
+	uint32_t received = 0;
+	char echo[256];
+	while(sent < sizeof(echo))
+	{
+		uint8_t chunk = 1 + (rand() % 7);
+		for(uint8_t i = 0; (i < chunk) && (sent < sizeof(echo)); i++)
+		{
+			uint8_t c = (uint8_t)command[sent % command_length];
+			sent += read_put(&target, control, RTT_DOWN_TERMINAL, &c, 1);
+		}
+		received += rtt_read(RTT_DOWN_TERMINAL, &echo[received], rand() % 9);
+	}
+	received += rtt_read(RTT_DOWN_TERMINAL, &echo[received], sizeof(echo) - received);
+	for(uint32_t i = 0; i < received; i++)
+	{
+		failures += (echo[i] != command[i % command_length]);
+	}
+	failures += (received != sent);
+
+	printf("%u records: %u frames, %u lines, %u/%u dropped, down %u bytes\n", (unsigned)records, (unsigned)sim.frames,
+			(unsigned)sim.lines, (unsigned)rtt_dropped(RTT_UP_TELEMETRY), (unsigned)drops, (unsigned)received);
+
+	// A dump of the control block and rings for trying the -f path
+	if(dump_file != NULL)
+	{
+		rtt_control* rtt = rtt_control_block();
+		uint32_t low = control;
+		uint32_t high = control + sizeof(rtt_control);
+		for(uint8_t i = 0; i < (RTT_UP_COUNT + RTT_DOWN_COUNT); i++)
+		{
+			rtt_ring* ring = (i < RTT_UP_COUNT) ? &rtt->up[i] : &rtt->down[i - RTT_UP_COUNT];
+			low = (ring->buffer < low) ? ring->buffer : low;
+			high = ((ring->buffer + ring->size) > high) ? (ring->buffer + ring->size) : high;
+		}
+
+		FILE* out = fopen(dump_file, "wb");
+		if((out == NULL) || ((high - low) > READ_MAX_DUMP))
+		{
+			fprintf(stderr, "cannot write %s\n", dump_file);
+			failures++;
+		}
+		else
+		{
+			fwrite((void*)(uintptr_t)low, 1, high - low, out);
+			fclose(out);
+			printf("dump %s base 0x%08x\n", dump_file, (unsigned)low);
+		}
+	}
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+
+	return failures ? 1 : 0;
+}
+
+// Drain both up rings, parse the frames and check the lines
+static void read_sim_poll(read_sim* sim, read_target* target, uint32_t control)
+{
+	static uint8_t data[RTT_UP_TELEMETRY_SIZE];
+
+	uint32_t count = read_drain(target, control, RTT_UP_TELEMETRY, data, sizeof(data));
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(telemetry_parse_byte(&sim->parser, data[i]))
+		{
+			uint8_t sequence = telemetry_frame_sequence(sim->parser.frame);
+			sim->missing_frames += (uint8_t)(sequence - sim->next_sequence);
+			sim->next_sequence = sequence + 1;
+			sim->frames++;
+		}
+	}
+
+	count = read_drain(target, control, RTT_UP_TERMINAL, data, sizeof(data));
+	for(uint32_t i = 0; i < count; i++)
+	{
+		sim->text[sim->text_length++] = (char)data[i];
+		if(data[i] == '\n')
+		{
+			unsigned number;
+			sim->text[sim->text_length] = '\0';
+			if(sscanf(sim->text, "line %u\n", &number) != 1)
+			{
+				sim->failures++;
+				fprintf(stderr, "cut line \"%s\"\n", sim->text);
+			}
+			else
+			{
+				sim->missing_lines += number - sim->next_line;
+				sim->next_line = number + 1;
+				sim->lines++;
+			}
+			sim->text_length = 0;
+		}
+		else if(sim->text_length >= (sizeof(sim->text) - 1))
+		{
+			sim->failures++;
+			sim->text_length = 0;
+		}
+	}
+}